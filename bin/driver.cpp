@@ -10,6 +10,7 @@
 #include <qumir/parser/core/parser.h>
 #include <qumir/ir/lowering/lower_ast.h>
 #include <qumir/ir/builder.h>
+#include <qumir/ir/pgo_profile.h>
 #include <qumir/ir/passes/transforms/pipeline.h>
 #include <qumir/semantics/name_resolution/name_resolver.h>
 #include <qumir/semantics/transform/transform.h>
@@ -24,9 +25,11 @@
 #include <qumir/modules/painter/painter.h>
 #include <qumir/modules/colors/colors.h>
 #include <qumir/modules/keyboard/keyboard.h>
+#include <qumir/time_report.h>
 #include <sstream>
 #include <string>
 #include <filesystem>
+#include <optional>
 
 #include <sys/wait.h>
 #include <thread>
@@ -199,7 +202,7 @@ int GenerateAst(const std::string& inputFile, const std::string& outputFile, boo
     return 0;
 }
 
-int GenerateIr(const std::string& inputFile, const std::string& outputFile, int optLevel, bool coreInput, bool verbose, const TModuleConfig& moduleConfig) {
+int GenerateIr(const std::string& inputFile, const std::string& outputFile, int optLevel, int threads, const NIR::TLowerOptions& lowerOptions, bool coreInput, bool verbose, const TModuleConfig& moduleConfig) {
     if (verbose) {
         std::cerr << "Generating IR from " << inputFile << " to " << outputFile << "\n";
     }
@@ -229,14 +232,16 @@ int GenerateIr(const std::string& inputFile, const std::string& outputFile, int
     NIR::TModule module;
     NIR::TBuilder builder(module);
 
-    NIR::TAstLowerer lowerer(module, builder, r);
+    NIR::TAstLowerer lowerer(module, builder, r, lowerOptions);
     auto lowerResult = lowerer.LowerTop(ast);
     if (!lowerResult.has_value()) {
         std::cerr << lowerResult.error().ToString() << "\n";
         return 1;
     }
     if (optLevel > 0) {
-        NIR::NPasses::Pipeline(module);
+        NIR::NPasses::Pipeline(module, optLevel, threads);
+    } else {
+        NIR::NPasses::Cleanup(module, threads);
     }
 
     auto out = OpenOutputFile(outputFile);
@@ -249,7 +254,7 @@ int GenerateIr(const std::string& inputFile, const std::string& outputFile, int
     return 0;
 }
 
-int GenerateLlvm(const std::string& inputFile, const std::string& outputFile, int optLevel, bool coreInput, bool verbose, const TModuleConfig& moduleConfig) {
+int GenerateLlvm(const std::string& inputFile, const std::string& outputFile, int optLevel, const NIR::TLowerOptions& lowerOptions, bool coreInput, bool verbose, const TModuleConfig& moduleConfig) {
     if (verbose) {
         std::cerr << "Generating LLVM IR from " << inputFile << " to " << outputFile << "\n";
     }
@@ -279,7 +284,7 @@ int GenerateLlvm(const std::string& inputFile, const std::string& outputFile, in
     NIR::TModule module;
     NIR::TBuilder builder(module);
 
-    NIR::TAstLowerer lowerer(module, builder, r);
+    NIR::TAstLowerer lowerer(module, builder, r, lowerOptions);
     auto lowerResult = lowerer.LowerTop(ast);
     if (!lowerResult.has_value()) {
         std::cerr << lowerResult.error().ToString() << "\n";
@@ -414,7 +419,7 @@ void GenerateObjFromAsm(const std::string& asmCode, std::ostream& objOut) {
 }
 #endif
 
-int Generate(const std::string& inputFile, const std::string& outputFile, bool compileOnly, bool generateAsm, int optLevel, int wasmBits, bool coreInput, bool verbose, const TModuleConfig& moduleConfig) {
+int Generate(const std::string& inputFile, const std::string& outputFile, bool compileOnly, bool generateAsm, int optLevel, int threads, const NIR::TLowerOptions& lowerOptions, int wasmBits, bool coreInput, bool verbose, const TModuleConfig& moduleConfig, const NIR::TPgoProfile* profile) {
     if (verbose) {
         std::cerr << "Compiling " << inputFile << " to " << outputFile << "\n";
     }
@@ -447,7 +452,7 @@ int Generate(const std::string& inputFile, const std::string& outputFile, bool c
     }
     NIR::TBuilder builder(module);
 
-    NIR::TAstLowerer lowerer(module, builder, r);
+    NIR::TAstLowerer lowerer(module, builder, r, lowerOptions);
     auto lowerResult = lowerer.LowerTop(ast);
     if (!lowerResult.has_value()) {
         std::cerr << lowerResult.error().ToString() << "\n";
@@ -459,7 +464,9 @@ int Generate(const std::string& inputFile, const std::string& outputFile, bool c
     const int effectiveOptLevel = (hasCoroutines && optLevel == 0) ? 1 : optLevel;
 
     if (effectiveOptLevel > 0) {
-        NIR::NPasses::Pipeline(module);
+        NIR::NPasses::Pipeline(module, effectiveOptLevel, threads);
+    } else {
+        NIR::NPasses::Cleanup(module, threads);
     }
 
     NCodeGen::TLLVMCodeGenOptions cgOpts;
@@ -468,6 +475,15 @@ int Generate(const std::string& inputFile, const std::string& outputFile, bool c
     } else if (wasmBits == 64) {
         cgOpts.TargetTriple = "wasm64-unknown-unknown";
     }
+    // Labels and SymIds in the profile are those of the IR pipeline it was
+    // collected after; another pipeline would attach counts to wrong branches.
+    if (profile && !profile->Matches(effectiveOptLevel, lowerOptions.BoundsChecks)) {
+        std::cerr << "warning: profile was collected with -O" << profile->OptLevel
+                  << (profile->BoundsChecks ? " --bounds-check" : "")
+                  << ", ignoring it\n";
+    } else {
+        cgOpts.Profile = profile;
+    }
     NCodeGen::TLLVMCodeGen cg(cgOpts);
     auto artifacts = cg.Emit(module, effectiveOptLevel);
     if (!artifacts) {
@@ -531,10 +547,15 @@ int main(int argc, char** argv) {
     bool generateLlvm = false;
     bool generateAsm = false;
     int optLevel = 0;
+    int threads = 1;
     int wasmBits = 0; // 0 = native, 32, 64
     bool coreInput = false;
     bool verbose = false;
+    bool timeReport = false;
+    bool timeReportJson = false;
+    NIR::TLowerOptions lowerOptions;
     TModuleConfig moduleConfig;
+    std::string profileInput;
     for (int i = 1; i < argc; ++i) {
         if (!std::strcmp(argv[i], "-c")) {
             compileOnly = true;
@@ -564,7 +585,11 @@ int main(int argc, char** argv) {
                          "  -O1           Optimization level 1\n"
                          "  -O2           Optimization level 2\n"
                          "  -O3           Optimization level 3\n"
+                         "  --bounds-check Fail on out-of-range array indices at run time\n"
+                         "  --profile-use=<file> Use counts from qumiri --profile-out for branch weights and inlining\n"
+                         "  -j <n>        Optimize functions on n threads, 0 = all cores\n"
                          "  --verbose     Enable verbose output\n"
+                         "  --time-report[=json] Print time and memory per compiler phase to stderr\n"
                          "  --version, -v Show version information\n"
                          "  --help, -h    Show this help message\n";
             return 0;
@@ -605,6 +630,25 @@ int main(int argc, char** argv) {
             optLevel = 2;
         } else if (!std::strcmp(argv[i], "-O3")) {
             optLevel = 3;
+        } else if (!std::strcmp(argv[i], "--bounds-check")) {
+            lowerOptions.BoundsChecks = true;
+        } else if (!std::strncmp(argv[i], "--profile-use=", 14)) {
+            profileInput = argv[i] + 14;
+            if (profileInput.empty()) {
+                std::cerr << "--profile-use requires a file name\n";
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "-j")) {
+            if (i + 1 < argc) {
+                threads = std::atoi(argv[++i]);
+                if (threads < 0) {
+                    std::cerr << "-j must not be negative\n";
+                    return 1;
+                }
+            } else {
+                std::cerr << "-j requires an argument\n";
+                return 1;
+            }
         } else if (!std::strcmp(argv[i], "--core")) {
             coreInput = true;
         } else if (!std::strcmp(argv[i], "--module-path")) {
@@ -623,6 +667,11 @@ int main(int argc, char** argv) {
             }
         } else if (!std::strcmp(argv[i], "--verbose")) {
             verbose = true;
+        } else if (!std::strcmp(argv[i], "--time-report")) {
+            timeReport = true;
+        } else if (!std::strcmp(argv[i], "--time-report=json")) {
+            timeReport = true;
+            timeReportJson = true;
         } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
             std::cerr << "Unknown option: " << argv[i] << "\n";
             return 1;
@@ -641,39 +690,72 @@ int main(int argc, char** argv) {
         moduleConfig.Paths.insert(moduleConfig.Paths.begin(), dir.empty() ? "." : dir.string());
     }
 
-    if (generateAst || generateTransformedAst) {
-        if (outputFile.empty()) {
-            outputFile = OutputFilename(inputFile, ".ast");
+    std::optional<NIR::TPgoProfile> profile;
+    if (!profileInput.empty()) {
+        std::ifstream in(profileInput);
+        if (!in) {
+            std::cerr << "Failed to open profile: " << profileInput << "\n";
+            return 1;
+        }
+        auto read = NIR::TPgoProfile::Read(in);
+        if (!read) {
+            std::cerr << read.error().ToString() << "\n";
+            return 1;
         }
-        return GenerateAst(inputFile, outputFile, generateTransformedAst, coreInput, verbose, moduleConfig);
+        profile = std::move(*read);
     }
 
-    if (generateIr) {
-        if (outputFile.empty()) {
-            outputFile = OutputFilename(inputFile, ".ir");
+    auto compile = [&]() -> int {
+        if (generateAst || generateTransformedAst) {
+            if (outputFile.empty()) {
+                outputFile = OutputFilename(inputFile, ".ast");
+            }
+            return GenerateAst(inputFile, outputFile, generateTransformedAst, coreInput, verbose, moduleConfig);
         }
-        return GenerateIr(inputFile, outputFile, optLevel, coreInput, verbose, moduleConfig);
-    }
 
-    if (generateLlvm) {
-        if (outputFile.empty()) {
-            outputFile = OutputFilename(inputFile, ".ll");
+        if (generateIr) {
+            if (outputFile.empty()) {
+                outputFile = OutputFilename(inputFile, ".ir");
+            }
+            return GenerateIr(inputFile, outputFile, optLevel, threads, lowerOptions, coreInput, verbose, moduleConfig);
         }
-        return GenerateLlvm(inputFile, outputFile, optLevel, coreInput, verbose, moduleConfig);
-    }
 
-    if (!compileOnly && outputFile.empty()) {
-        outputFile = wasmBits != 0 ? OutputFilename(inputFile, ".wasm") : A_OUT;
-    }
+        if (generateLlvm) {
+            if (outputFile.empty()) {
+                outputFile = OutputFilename(inputFile, ".ll");
+            }
+            return GenerateLlvm(inputFile, outputFile, optLevel, lowerOptions, coreInput, verbose, moduleConfig);
+        }
+
+        if (!compileOnly && outputFile.empty()) {
+            outputFile = wasmBits != 0 ? OutputFilename(inputFile, ".wasm") : A_OUT;
+        }
 
-    std::string finalOutput = outputFile;
-    if (finalOutput.empty()) {
-        finalOutput = compileOnly
-            ? (generateAsm
-                ? OutputFilename(inputFile, ".s")
-                : OutputFilename(inputFile, ".o"))
-            : outputFile;
+        std::string finalOutput = outputFile;
+        if (finalOutput.empty()) {
+            finalOutput = compileOnly
+                ? (generateAsm
+                    ? OutputFilename(inputFile, ".s")
+                    : OutputFilename(inputFile, ".o"))
+                : outputFile;
+        }
+
+        return Generate(inputFile, finalOutput, compileOnly, generateAsm, optLevel, threads, lowerOptions, wasmBits, coreInput, verbose, moduleConfig, profile ? &*profile : nullptr);
+    };
+    if (!timeReport) {
+        return compile();
     }
 
-    return Generate(inputFile, finalOutput, compileOnly, generateAsm, optLevel, wasmBits, coreInput, verbose, moduleConfig);
+    TTimeReport report;
+    int result = 0;
+    {
+        TTimeReportScope reportScope(&report);
+        result = compile();
+    }
+    if (timeReportJson) {
+        report.PrintJson(std::cerr);
+    } else {
+        report.Print(std::cerr);
+    }
+    return result;
 }
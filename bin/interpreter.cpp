@@ -2,6 +2,7 @@
 #include <qumir/runner/runner_ir.h>
 #include <qumir/runner/runner_llvm.h>
 #include <qumir/codegen/llvm/llvm_initializer.h>
+#include <qumir/time_report.h>
 
 #include <iostream>
 #include <sstream>
@@ -23,6 +24,27 @@ void PrintResultIR(const std::optional<std::string>& v) {
     }
 }
 
+// Part of the --cache-dir key. Cached modules hold what this build's frontend
+// and passes produced, but a working copy's version string ("dev,<date>")
+// stays the same across rebuilds, so the size and modification time of the
+// binary go in too.
+std::string CompilerVersion(const char* argv0) {
+    std::string version = QUMIR_VERSION_STRING;
+    std::error_code ec;
+    auto exe = std::filesystem::canonical("/proc/self/exe", ec);
+    if (ec) {
+        exe = std::filesystem::canonical(argv0, ec);
+    }
+    if (!ec) {
+        const auto size = std::filesystem::file_size(exe, ec);
+        const auto mtime = std::filesystem::last_write_time(exe, ec);
+        if (!ec) {
+            version += "," + std::to_string(size) + "," + std::to_string(mtime.time_since_epoch().count());
+        }
+    }
+    return version;
+}
+
 } // namespace
 
 int main(int argc, char ** argv) {
@@ -31,6 +53,8 @@ int main(int argc, char ** argv) {
     enum class RunnerType { IR, LLVM };
     RunnerType runnerType = RunnerType::IR; // default
     bool printEvalTimeUs = false;
+    bool timeReport = false;
+    bool timeReportJson = false;
     bool printAst = false;
     bool printTransformedAst = false;
     bool printIr = false;
@@ -38,6 +62,15 @@ int main(int argc, char ** argv) {
     bool printAsm = false;
     bool printByteCode = false;
     bool coreInput = false;
+    bool tiered = false;
+    bool lazyJit = false;
+    bool boundsChecks = false;
+    int threads = 1;
+    uint32_t tierUpThreshold = 1000;
+    bool tierThresholdSet = false;
+    std::string profileOutput;
+    std::string pgoProfileOutput;
+    std::string cacheDir;
     int optLevel = 0;
     std::string inputFile; // stdin by default if empty
     std::vector<std::string> modulePaths;
@@ -46,8 +79,64 @@ int main(int argc, char ** argv) {
     for (int i = 1; i < argc; ++i) {
         if (!std::strcmp(argv[i], "--jit")) {
             runnerType = RunnerType::LLVM;
+        } else if (!std::strcmp(argv[i], "--jit-lazy")) {
+            runnerType = RunnerType::LLVM;
+            lazyJit = true;
+        } else if (!std::strcmp(argv[i], "--tiered")) {
+            tiered = true;
+        } else if (!std::strcmp(argv[i], "--tier-threshold")) {
+            if (i + 1 < argc) {
+                int threshold = std::atoi(argv[++i]);
+                if (threshold <= 0) {
+                    std::cerr << "--tier-threshold must be positive\n";
+                    return 1;
+                }
+                tierUpThreshold = static_cast<uint32_t>(threshold);
+                tierThresholdSet = true;
+            } else {
+                std::cerr << "--tier-threshold requires an argument\n";
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "--profile")) {
+            if (i + 1 < argc) {
+                profileOutput = argv[++i];
+            } else {
+                std::cerr << "--profile requires an output prefix\n";
+                return 1;
+            }
+        } else if (!std::strncmp(argv[i], "--profile-out=", 14)) {
+            pgoProfileOutput = argv[i] + 14;
+            if (pgoProfileOutput.empty()) {
+                std::cerr << "--profile-out requires a file name\n";
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "--cache-dir")) {
+            if (i + 1 < argc) {
+                cacheDir = argv[++i];
+            } else {
+                std::cerr << "--cache-dir requires a directory argument\n";
+                return 1;
+            }
+        } else if (!std::strcmp(argv[i], "--bounds-check")) {
+            boundsChecks = true;
+        } else if (!std::strcmp(argv[i], "--jobs") || !std::strcmp(argv[i], "-j")) {
+            if (i + 1 < argc) {
+                threads = std::atoi(argv[++i]);
+                if (threads < 0) {
+                    std::cerr << "--jobs must not be negative\n";
+                    return 1;
+                }
+            } else {
+                std::cerr << "--jobs requires an argument\n";
+                return 1;
+            }
         } else if (!std::strcmp(argv[i], "--time-us")) {
             printEvalTimeUs = true;
+        } else if (!std::strcmp(argv[i], "--time-report")) {
+            timeReport = true;
+        } else if (!std::strcmp(argv[i], "--time-report=json")) {
+            timeReport = true;
+            timeReportJson = true;
         } else if (!std::strcmp(argv[i], "--print-ast")) {
             printAst = true;
         } else if (!std::strcmp(argv[i], "--print-transformed-ast")) {
@@ -106,7 +195,16 @@ int main(int argc, char ** argv) {
             std::cout << "qumiri [options]\n"
                          "Options:\n"
                          "  --jit                Enable llvm jit\n"
+                         "  --jit-lazy           Llvm jit that compiles (and optimizes) a function on its first call\n"
+                         "  --tiered             Interpret, then move hot functions to the llvm jit\n"
+                         "  --tier-threshold <n> Calls plus loop iterations before a function is jitted (default 1000)\n"
+                         "  --profile <prefix>   Profile the interpreter, write <prefix>.folded and <prefix>.json\n"
+                         "  --profile-out=<file> Write entry and branch counts for qumirc --profile-use (same -O)\n"
+                         "  --cache-dir <dir>    Reuse programs lowered by earlier runs, cached in <dir> (interpreter only)\n"
+                         "  --bounds-check       Fail on out-of-range array indices\n"
+                         "  --jobs|-j <n>        Optimize (and compile to bytecode) functions on n threads, 0 = all cores\n"
                          "  --time-us            Print evaluation time in microseconds\n"
+                         "  --time-report[=json] Print time and memory per compiler phase to stderr\n"
                          "  --print-ast          Print AST after parsing\n"
                          "  --print-transformed-ast Print AST after semantic transforms\n"
                          "  --print-ir           Print IR after lowering\n"
@@ -162,6 +260,14 @@ int main(int argc, char ** argv) {
             .PrintByteCode = printByteCode,
             .CoreInput = coreInput,
             .OptLevel = optLevel,
+            .BoundsChecks = boundsChecks,
+            .Threads = threads,
+            .Tiered = tiered,
+            .TierUpThreshold = tierUpThreshold,
+            .ProfileOutput = profileOutput,
+            .PgoProfileOutput = pgoProfileOutput,
+            .BytecodeCacheDir = cacheDir,
+            .CompilerVersion = CompilerVersion(argv[0]),
             .Prelude = corePrelude,
             .ModuleSearchPaths = modulePaths,
             .ModuleFiles = moduleFiles,
@@ -176,23 +282,58 @@ int main(int argc, char ** argv) {
         .PrintAsm = printAsm,
         .CoreInput = coreInput,
         .OptLevel = optLevel,
+        .BoundsChecks = boundsChecks,
+        .Threads = threads,
+        .LazyJit = lazyJit,
         .Prelude = corePrelude,
         .ModuleSearchPaths = modulePaths,
         .ModuleFiles = moduleFiles,
     });
 
+    if (runnerType == RunnerType::LLVM && !profileOutput.empty()) {
+        std::cerr << "--profile is not supported with --jit\n";
+        return 1;
+    }
+    if (runnerType == RunnerType::LLVM && !pgoProfileOutput.empty()) {
+        std::cerr << "--profile-out is not supported with --jit\n";
+        return 1;
+    }
+    if (runnerType == RunnerType::LLVM && !cacheDir.empty()) {
+        std::cerr << "--cache-dir is not supported with --jit\n";
+        return 1;
+    }
+    if (runnerType == RunnerType::LLVM && tiered) {
+        std::cerr << "--tiered is not supported with --jit\n";
+        return 1;
+    }
+    if (runnerType == RunnerType::LLVM && tierThresholdSet) {
+        std::cerr << "--tier-threshold is not supported with --jit\n";
+        return 1;
+    }
+
     long long lastEvalUs = 0;
     std::expected<std::optional<std::string>, TError> result;
-    if (runnerType == RunnerType::LLVM) {
-        auto t0 = std::chrono::steady_clock::now();
-        result = llvmRunner.Run(*in);
-        auto t1 = std::chrono::steady_clock::now();
-        lastEvalUs = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
-    } else {
-        auto t0 = std::chrono::steady_clock::now();
-        result = irRunner.Run(*in);
-        auto t1 = std::chrono::steady_clock::now();
-        lastEvalUs = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+    TTimeReport report;
+    {
+        TTimeReportScope reportScope(timeReport ? &report : nullptr);
+        if (runnerType == RunnerType::LLVM) {
+            auto t0 = std::chrono::steady_clock::now();
+            result = llvmRunner.Run(*in);
+            auto t1 = std::chrono::steady_clock::now();
+            lastEvalUs = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+        } else {
+            auto t0 = std::chrono::steady_clock::now();
+            result = irRunner.Run(*in);
+            auto t1 = std::chrono::steady_clock::now();
+            lastEvalUs = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+        }
+    }
+    if (timeReport) {
+        if (timeReportJson) {
+            report.PrintJson(std::cerr);
+        } else {
+            report.Print(std::cerr);
+        }
     }
 
     std::optional<std::string> value;
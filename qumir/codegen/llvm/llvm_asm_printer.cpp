@@ -1,4 +1,5 @@
 #include "llvm_codegen_impl.h"
+#include <qumir/time_report.h>
 
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Config/llvm-config.h>
@@ -74,6 +75,7 @@ std::string FindRuntimeLibrary() {
 } // namespace
 
 void TLLVMModuleArtifacts::Generate(std::ostream& os, bool generateAsm, bool generateObj) const {
+    TPhaseTimer timer("llvm.emit");
     auto triple = Module->getTargetTriple();
     std::string errStr;
     const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple, errStr);
@@ -3,6 +3,7 @@
 
 #include <qumir/ir/builder.h>
 #include <qumir/align.h>
+#include <qumir/time_report.h>
 
 #include <memory>
 #include <string>
@@ -10,6 +11,9 @@
 #include <sstream>
 #include <unordered_set>
 #include <cassert>
+#include <limits>
+#include <algorithm>
+#include <functional>
 
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/IRBuilder.h>
@@ -21,6 +25,8 @@
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/ProfileSummary.h>
 #include <llvm/Bitcode/BitcodeReader.h>
 #include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/Linker/Linker.h>
@@ -539,6 +545,93 @@ std::unordered_map<uint64_t, llvm::Instruction::BinaryOps> fbinOpMap = {
     { "/"_op, llvm::Instruction::FDiv },
 };
 
+// Type-based alias info for what loads and stores reach through pointers.
+// Array elements and reference arguments are only ever read and written by
+// `lde`/`ste` with their own type (no unions; `copy` is an untagged memcpy),
+// so a вещ element store cannot change a цел element or an array pointer.
+// All integer widths share one type.
+llvm::MDNode* TbaaTag(llvm::LLVMContext& ctx, llvm::StringRef typeName) {
+    llvm::MDBuilder md(ctx);
+    auto* type = md.createTBAAScalarTypeNode(typeName, md.createTBAARoot("qumir tbaa"));
+    return md.createTBAAStructTagNode(type, type, 0);
+}
+
+// nullptr (may alias anything) for aggregates.
+llvm::MDNode* ElementTbaaTag(llvm::LLVMContext& ctx, llvm::Type* type) {
+    if (type->isDoubleTy()) {
+        return TbaaTag(ctx, "f64");
+    } else if (type->isFloatTy()) {
+        return TbaaTag(ctx, "f32");
+    } else if (type->isIntegerTy()) {
+        return TbaaTag(ctx, "int");
+    } else if (type->isPointerTy()) {
+        return TbaaTag(ctx, "ptr");
+    }
+    return nullptr;
+}
+
+// A slot whose address is never taken is only accessed by load/store on its
+// own global, so it can have a type nothing else uses. This covers the
+// hidden layout storage (bounds, sizes, strides) and base pointers of global
+// arrays, which are i64 like цел elements and would otherwise be reloaded
+// after every element store.
+llvm::MDNode* SlotTbaaTag(llvm::LLVMContext& ctx) {
+    return TbaaTag(ctx, "slot");
+}
+
+// Branch weights are 32-bit: long runs are scaled down keeping the ratio,
+// and a side the run never took stays possible.
+llvm::MDNode* BranchWeights(llvm::LLVMContext& ctx, const TPgoProfile::TBranch& branch) {
+    uint64_t taken = branch.Taken;
+    uint64_t notTaken = branch.NotTaken;
+    const uint64_t scale = std::max(taken, notTaken) / std::numeric_limits<uint32_t>::max() + 1;
+    taken = std::max<uint64_t>(taken / scale, 1);
+    notTaken = std::max<uint64_t>(notTaken / scale, 1);
+    return llvm::MDBuilder(ctx).createBranchWeights(static_cast<uint32_t>(taken), static_cast<uint32_t>(notTaken));
+}
+
+// The inliner and block placement take hot and cold thresholds from the
+// module's profile summary. This builds one the way llvm-profdata does for
+// instrumented runs (same cutoffs), from entry and branch counts.
+llvm::Metadata* BuildProfileSummary(const TPgoProfile& profile, llvm::LLVMContext& ctx) {
+    static constexpr uint32_t cutoffs[] = {
+        10000, 100000, 200000, 300000, 400000, 500000, 600000, 700000,
+        800000, 900000, 950000, 990000, 999000, 999900, 999990, 999999,
+    };
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t maxInternal = 0;
+    uint64_t maxFunction = 0;
+    for (const auto& [symId, function] : profile.Functions) {
+        counts.push_back(function.EntryCount);
+        maxFunction = std::max(maxFunction, function.EntryCount);
+        for (const auto& [label, branch] : function.Branches) {
+            counts.push_back(branch.Taken);
+            counts.push_back(branch.NotTaken);
+            maxInternal = std::max({maxInternal, branch.Taken, branch.NotTaken});
+        }
+    }
+    for (auto count : counts) {
+        total += count;
+    }
+    std::sort(counts.begin(), counts.end(), std::greater<>());
+
+    llvm::SummaryEntryVector detailed;
+    size_t used = 0;
+    uint64_t covered = 0;
+    for (uint32_t cutoff : cutoffs) {
+        const auto wanted = static_cast<uint64_t>(static_cast<double>(total) * cutoff / llvm::ProfileSummary::Scale);
+        while (used < counts.size() && (covered < wanted || used == 0)) {
+            covered += counts[used++];
+        }
+        detailed.emplace_back(cutoff, used ? counts[used - 1] : 0, used);
+    }
+    llvm::ProfileSummary summary(llvm::ProfileSummary::PSK_Instr, detailed, total,
+        std::max(maxInternal, maxFunction), maxInternal, maxFunction,
+        static_cast<uint32_t>(counts.size()), static_cast<uint32_t>(profile.Functions.size()));
+    return summary.getMD(ctx);
+}
+
 } // namespace
 
 std::vector<std::string> CollectCacheableSymbols(const NIR::TModule& module) {
@@ -616,6 +709,7 @@ TLLVMCodeGen::TLLVMCodeGen(const TLLVMCodeGenOptions& opts): Opts(opts) {}
 TLLVMCodeGen::~TLLVMCodeGen() = default;
 
 std::unique_ptr<ILLVMModuleArtifacts> TLLVMCodeGen::Emit(TModule& module, int optLevel) {
+    TPhaseTimer timer("llvm.codegen");
     Ctx = std::make_unique<llvm::LLVMContext>();
     LModule = std::make_unique<llvm::Module>(Opts.ModuleName, *Ctx);
 
@@ -703,6 +797,17 @@ std::unique_ptr<ILLVMModuleArtifacts> TLLVMCodeGen::Emit(TModule& module, int op
         }
     }
 
+    AddressTakenSlots.clear();
+    for (const auto& f : module.Functions) {
+        for (const auto& block : f.Blocks) {
+            for (const auto& instr : block.Instrs) {
+                if (instr.Op == "lea"_op && instr.Operands[0].Type == TOperand::EType::Slot) {
+                    AddressTakenSlots.insert(instr.Operands[0].Slot.Idx);
+                }
+            }
+        }
+    }
+
     // Pass 2: lower function bodies
     int funcIdx = 0;
     std::vector<llvm::Function*> ctorFunctions;
@@ -809,13 +914,31 @@ std::unique_ptr<ILLVMModuleArtifacts> TLLVMCodeGen::Emit(TModule& module, int op
         }
     }
 
+    // array_create returns fresh memory, like malloc, so arrays it creates
+    // alias neither each other nor anything the program already has.
+    if (auto* arrayCreate = LModule->getFunction("array_create")) {
+        arrayCreate->addRetAttr(llvm::Attribute::NoAlias);
+    }
+
+    if (Opts.Profile) {
+        LModule->setProfileSummary(BuildProfileSummary(*Opts.Profile, ctx), llvm::ProfileSummary::PSK_Instr);
+    }
+
     // Coroutine passes must run before verification: pre-split coroutine IR
     // intentionally violates SSA dominance (values live across suspend points
     // are not yet spilled). coro-split inserts the frame spills that make the
     // IR valid. Verifying before the passes would reject well-formed coroutines.
-    if (optLevel > 0) {
+    if (optLevel > 0 && Opts.DeferOptimization) {
+        if (hasCoroutines) {
+            TPhaseTimer optimizeTimer("llvm.codegen.optimize");
+            RunCoroutinePasses();
+        }
+        LModule->addModuleFlag(llvm::Module::Warning, DeferredOptLevelFlag, optLevel);
+    } else if (optLevel > 0) {
+        TPhaseTimer optimizeTimer("llvm.codegen.optimize");
         Optimize(optLevel);
     } else if (hasCoroutines) {
+        TPhaseTimer optimizeTimer("llvm.codegen.optimize");
         RunCoroutinePasses();
     }
 
@@ -877,6 +1000,12 @@ llvm::Function* TLLVMCodeGen::LowerFunction(const TFunction& fun, NIR::TModule&
     CurFun->Fun = &fun;
     CurFun->LFun = lfun;
     CurFun->TmpValues.resize(fun.NextTmpIdx, nullptr);
+    if (Opts.Profile) {
+        CurFun->Profile = Opts.Profile->Find(fun);
+        if (CurFun->Profile) {
+            lfun->setEntryCount(CurFun->Profile->EntryCount);
+        }
+    }
 
     std::vector<llvm::BasicBlock*> bbs; bbs.reserve(fun.Blocks.size());
     for (const auto& b : fun.Blocks) {
@@ -1206,6 +1335,7 @@ llvm::Function* TLLVMCodeGen::LowerCoroutineFunction(const TFunction& fun, NIR::
 
 void TLLVMCodeGen::LowerBlock(const TBlock& blk, NIR::TModule& module, llvm::Function*, std::vector<llvm::BasicBlock*>& orderedBBs) {
     auto* irb = static_cast<llvm::IRBuilder<>*>(BuilderBase.get());
+    CurFun->BlockLabel = blk.Label.Idx;
     for (const auto& instr : blk.Phis) {
         if (irb->GetInsertBlock()->getTerminator()) {
             throw std::runtime_error("attempt to emit instruction after terminator");
@@ -1658,6 +1788,9 @@ llvm::Value* TLLVMCodeGen::LowerInstr(const NIR::TInstr& instr, NIR::TModule& mo
             // tmp = *ptr
             auto ptr = GetOp(instr.Operands[0], module);
             auto val = irb->CreateLoad(outputType, ptr, "ldtmp");
+            if (auto* tag = ElementTbaaTag(ctx, outputType)) {
+                val->setMetadata(llvm::LLVMContext::MD_tbaa, tag);
+            }
             return storeTmp(val);
             break;
         }
@@ -1687,6 +1820,32 @@ llvm::Value* TLLVMCodeGen::LowerInstr(const NIR::TInstr& instr, NIR::TModule& mo
                 llvm::MaybeAlign(1));
             return storeTmp(alloca);
         }
+        case "bounds"_op: {
+            // 0 <= index < size as one unsigned compare; the failing side calls
+            // into the runtime, which does not return.
+            if (operandCount != 2) throw std::runtime_error("bounds needs index and size operands");
+            auto index = cast(GetOp(instr.Operands[0], module), i64);
+            auto size = cast(GetOp(instr.Operands[1], module), i64);
+            auto* function = irb->GetInsertBlock()->getParent();
+            auto* failBB = llvm::BasicBlock::Create(ctx, "bounds.fail", function);
+            auto* okBB = llvm::BasicBlock::Create(ctx, "bounds.ok", function);
+            auto inRange = irb->CreateICmpULT(index, size, "inbounds");
+            llvm::MDBuilder md(ctx);
+            irb->CreateCondBr(inRange, okBB, failBB, md.createBranchWeights(1u << 20, 1));
+            irb->SetInsertPoint(failBB);
+            auto* ptrTy = llvm::PointerType::get(ctx, 0);
+            auto raise = LModule->getOrInsertFunction("__raise_runtime_error",
+                llvm::FunctionType::get(llvm::Type::getVoidTy(ctx), {ptrTy}, false));
+            if (auto* f = llvm::dyn_cast<llvm::Function>(raise.getCallee())) {
+                f->setDoesNotReturn();
+                f->setCold();
+            }
+            auto message = irb->CreateGlobalString("array index out of bounds", "bounds.msg");
+            irb->CreateCall(raise, {message});
+            irb->CreateUnreachable();
+            irb->SetInsertPoint(okBB);
+            return nullptr;
+        }
         case "ste"_op: {
             // *ptr = tmp
             auto ptr = GetOp(instr.Operands[0], module);
@@ -1698,7 +1857,10 @@ llvm::Value* TLLVMCodeGen::LowerInstr(const NIR::TInstr& instr, NIR::TModule& mo
             }
             const int sourceTypeId = operandTypeId(instr.Operands[1]);
             const bool sourceSigned = sourceTypeId < 0 || IsSignedIntegerType(module.Types, sourceTypeId);
-            irb->CreateStore(cast(value, storeType, sourceSigned), ptr);
+            auto* store = irb->CreateStore(cast(value, storeType, sourceSigned), ptr);
+            if (auto* tag = ElementTbaaTag(ctx, storeType)) {
+                store->setMetadata(llvm::LLVMContext::MD_tbaa, tag);
+            }
             return nullptr;
             break;
         }
@@ -1727,6 +1889,9 @@ llvm::Value* TLLVMCodeGen::LowerInstr(const NIR::TInstr& instr, NIR::TModule& mo
                 auto idx = instr.Operands[0].Slot.Idx;
                 auto g = EnsureSlotGlobal(idx, module);
                 auto val = irb->CreateLoad(outputType, g, "loadtmp");
+                if (!AddressTakenSlots.contains(idx)) {
+                    val->setMetadata(llvm::LLVMContext::MD_tbaa, SlotTbaaTag(ctx));
+                }
                 return storeTmp(val);
             } else if (instr.Operands[0].Type == TOperand::EType::Local) {
                 auto lidx = instr.Operands[0].Local.Idx;
@@ -1765,7 +1930,10 @@ llvm::Value* TLLVMCodeGen::LowerInstr(const NIR::TInstr& instr, NIR::TModule& mo
                 auto g = EnsureSlotGlobal(idx, module);
                 auto value = GetOp(instr.Operands[1], module);
                 auto* valTy = g->getValueType();
-                irb->CreateStore(cast(value, valTy), g);
+                auto* store = irb->CreateStore(cast(value, valTy), g);
+                if (!AddressTakenSlots.contains(idx)) {
+                    store->setMetadata(llvm::LLVMContext::MD_tbaa, SlotTbaaTag(ctx));
+                }
             } else if (instr.Operands[0].Type == TOperand::EType::Local) {
                 auto lidx = instr.Operands[0].Local.Idx;
                 if (lidx < 0 || lidx >= CurFun->Allocas.size()) throw std::runtime_error("invalid local index");
@@ -1985,7 +2153,14 @@ llvm::Value* TLLVMCodeGen::LowerInstr(const NIR::TInstr& instr, NIR::TModule& mo
             if (itT->second == itF->second) {
                 irb->CreateBr(itT->second);
             } else {
-                irb->CreateCondBr(cmpNZ, itT->second, itF->second);
+                llvm::MDNode* weights = nullptr;
+                if (CurFun->Profile) {
+                    auto it = CurFun->Profile->Branches.find(CurFun->BlockLabel);
+                    if (it != CurFun->Profile->Branches.end()) {
+                        weights = BranchWeights(ctx, it->second);
+                    }
+                }
+                irb->CreateCondBr(cmpNZ, itT->second, itF->second, weights);
             }
             return nullptr;
         }
@@ -2041,29 +2216,19 @@ void TLLVMCodeGen::RunCoroutinePasses() {
     CoroMPM.run(*LModule, MAM);
 }
 
-void TLLVMCodeGen::Optimize(int optLevel) {
+void RunOptimizationPipeline(llvm::Module& module, llvm::TargetMachine* tm, int optLevel) {
     llvm::LoopAnalysisManager LAM;
     llvm::FunctionAnalysisManager FAM;
     llvm::CGSCCAnalysisManager CGAM;
     llvm::ModuleAnalysisManager MAM;
 
-    llvm::PassBuilder PB(TM.get());
+    llvm::PassBuilder PB(tm);
     PB.registerModuleAnalyses(MAM);
     PB.registerCGSCCAnalyses(CGAM);
     PB.registerFunctionAnalyses(FAM);
     PB.registerLoopAnalyses(LAM);
     PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
 
-    llvm::ModulePassManager CoroMPM;
-    if (auto err = PB.parsePassPipeline(CoroMPM, "coro-early,coro-split,coro-elide,coro-cleanup")) {
-        std::string msg;
-        llvm::raw_string_ostream os(msg);
-        os << err;
-        os.flush();
-        throw std::runtime_error("failed to build LLVM coroutine pass pipeline: " + msg);
-    }
-    CoroMPM.run(*LModule, MAM);
-
     auto OL = llvm::OptimizationLevel::O0;
     switch (optLevel) {
         case 0: OL = llvm::OptimizationLevel::O0; break;
@@ -2074,7 +2239,12 @@ void TLLVMCodeGen::Optimize(int optLevel) {
         default: OL = llvm::OptimizationLevel::O2; break;
     }
     llvm::ModulePassManager MPM = PB.buildPerModuleDefaultPipeline(OL);
-    MPM.run(*LModule, MAM);
+    MPM.run(module, MAM);
+}
+
+void TLLVMCodeGen::Optimize(int optLevel) {
+    RunCoroutinePasses();
+    RunOptimizationPipeline(*LModule, TM.get(), optLevel);
 }
 
 void TLLVMCodeGen::PrintFunction(int symId, std::ostream& os) const {
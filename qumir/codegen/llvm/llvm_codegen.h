@@ -10,6 +10,7 @@
 #include <unordered_set>
 
 #include <qumir/ir/builder.h>
+#include <qumir/ir/pgo_profile.h>
 
 namespace llvm {
 class AllocaInst;
@@ -61,6 +62,14 @@ struct TLLVMCodeGenOptions {
     // Binary LLVM bitcode modules linked into the generated module before the
     // LLVM optimization pipeline. The pointed-to vector must outlive Emit().
     const std::vector<std::string>* LlvmBitcode {nullptr};
+    // Leave the LLVM optimization pipeline to the JIT (see TLlvmRunnerOptions::
+    // LazyCompile), which runs it on each function before its first call.
+    // Emit only splits coroutines and records the level in the module.
+    bool DeferOptimization {false};
+    // Counts from an interpreter run of the same IR (qumiri --profile-out):
+    // functions get entry counts, `cmp` branches get !prof weights and the
+    // module a profile summary. Must outlive Emit().
+    const NIR::TPgoProfile* Profile {nullptr};
 };
 
 struct ILLVMModuleArtifacts {
@@ -111,6 +120,8 @@ private:
         std::unordered_map<int64_t, llvm::BasicBlock*> LabelExitBB; // actual predecessor block for PHI incoming edges
         std::vector<llvm::Value*> PendingArgs; // collected via 'arg' ops before 'call'
         std::vector<llvm::AllocaInst*> Allocas;
+        const NIR::TPgoProfile::TFunctionCounts* Profile {nullptr};
+        int64_t BlockLabel {-1}; // of the block being lowered
     };
     std::unique_ptr<TFunState> CurFun;
     // Module-global slot storage (i64 globals), indexed by module-wide slot index
@@ -119,6 +130,9 @@ private:
     // Map from SymId to lowered LLVM function for call lowering
     std::unordered_map<int, llvm::Function*> SymIdToLFun;
     std::unordered_map<int, int> SymIdToUniqueFunId; // for updating code of updated functions
+    // Slots some function takes the address of (`lea`); loads and stores of
+    // the others get their own TBAA type (see SlotTbaaTag).
+    std::unordered_set<int64_t> AddressTakenSlots;
 };
 
 } // namespace NQumir::NCodeGen
@@ -17,4 +17,12 @@ struct TLLVMModuleArtifacts : ILLVMModuleArtifacts {
     void Generate(std::ostream& os, bool generateAsm, bool generateObj) const override;
 };
 
+// Module flag with the optimization level of a module whose pipeline was
+// deferred to the JIT (TLLVMCodeGenOptions::DeferOptimization).
+inline constexpr const char* DeferredOptLevelFlag = "qumir.opt_level";
+
+// The default LLVM pipeline of optLevel (1-3, 4 for Oz) over a module whose
+// coroutines are already split.
+void RunOptimizationPipeline(llvm::Module& module, llvm::TargetMachine* tm, int optLevel);
+
 } // namespace NQumir::NCodeGen
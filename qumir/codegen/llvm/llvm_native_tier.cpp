@@ -0,0 +1,164 @@
+#include "llvm_native_tier.h"
+#include "llvm_codegen.h"
+#include "llvm_runner.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace NQumir::NCodeGen {
+
+using namespace NIR;
+using namespace NIR::NLiterals;
+
+namespace {
+
+class TLLVMNativeTier : public INativeTier {
+public:
+    TLLVMNativeTier(const TModule& module, int optLevel)
+        : Module(module)
+        , OptLevel(optLevel)
+        , Worker([this] { Loop(); })
+    { }
+
+    ~TLLVMNativeTier() override {
+        {
+            std::lock_guard lock(Mutex);
+            Stopping = true;
+        }
+        HasJobs.notify_all();
+        Worker.join();
+    }
+
+    void Request(const TFunction& function) override {
+        std::lock_guard lock(Mutex);
+        Results[function.SymId] = TResult{};
+        Jobs.push_back(TJob{function.SymId, function.UniqueId});
+        HasJobs.notify_one();
+    }
+
+    EStatus Poll(const TFunction& function, void** entry) override {
+        std::lock_guard lock(Mutex);
+        auto it = Results.find(function.SymId);
+        if (it == Results.end()) {
+            return EStatus::Failed;
+        }
+        *entry = it->second.Entry;
+        return it->second.Status;
+    }
+
+private:
+    struct TJob {
+        int SymId;
+        int UniqueId;
+    };
+
+    struct TResult {
+        EStatus Status = EStatus::Pending;
+        void* Entry = nullptr;
+    };
+
+    void Loop() {
+        while (true) {
+            TJob job;
+            {
+                std::unique_lock lock(Mutex);
+                HasJobs.wait(lock, [&] { return Stopping || !Jobs.empty(); });
+                if (Stopping) {
+                    return;
+                }
+                job = Jobs.front();
+                Jobs.pop_front();
+            }
+            void* entry = Compile(job);
+            std::lock_guard lock(Mutex);
+            Results[job.SymId] = TResult{
+                .Status = entry ? EStatus::Ready : EStatus::Failed,
+                .Entry = entry,
+            };
+        }
+    }
+
+    void* Compile(const TJob& job) {
+        auto it = Module.SymIdToFuncIdx.find(job.SymId);
+        if (it == Module.SymIdToFuncIdx.end() || Module.Functions[it->second].UniqueId != job.UniqueId) {
+            return nullptr;
+        }
+        std::unordered_set<std::string> definitions;
+        if (!CollectDefinitions(it->second, definitions)) {
+            return nullptr;
+        }
+        try {
+            TLLVMCodeGen cg(TLLVMCodeGenOptions{
+                .ModuleName = "tier_" + Module.Functions[it->second].Name,
+                .RestrictToDefinitions = &definitions,
+            });
+            auto artifacts = cg.Emit(Module, OptLevel);
+            std::string error;
+            return Runner.Lookup(std::move(artifacts), Module.Functions[it->second].Name, &error);
+        } catch (const std::exception&) {
+            return nullptr;
+        }
+    }
+
+    // The function and everything it calls, as the JIT resolves nothing else
+    // from the module.
+    bool CollectDefinitions(int funcIdx, std::unordered_set<std::string>& out) const {
+        const auto& function = Module.Functions[funcIdx];
+        if (!out.insert(function.Name).second) {
+            return true;
+        }
+        // Exec is set when the VM had already rewritten the IR for itself
+        // before the copy was taken.
+        if (function.IsCoroutine
+            || function.Exec
+            || funcIdx == Module.ModuleConstructorFunctionId
+            || funcIdx == Module.ModuleDestructorFunctionId)
+        {
+            return false;
+        }
+        for (const auto& block : function.Blocks) {
+            for (const auto& instr : block.Instrs) {
+                for (int i = 0; i < instr.OperandCount; ++i) {
+                    if (instr.Operands[i].Type == TOperand::EType::Slot) {
+                        return false;
+                    }
+                }
+                if (instr.Op != "call"_op) {
+                    continue;
+                }
+                auto callee = Module.SymIdToFuncIdx.find(instr.Operands[0].Imm.Value);
+                if (callee != Module.SymIdToFuncIdx.end() && !CollectDefinitions(callee->second, out)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Only the worker thread touches these two.
+    TModule Module;
+    TLlvmRunner Runner;
+    const int OptLevel;
+
+    std::mutex Mutex;
+    std::condition_variable HasJobs;
+    std::deque<TJob> Jobs;
+    std::unordered_map<int, TResult> Results;
+    bool Stopping = false;
+
+    std::thread Worker; // last, so it starts after everything above exists
+};
+
+} // namespace
+
+std::unique_ptr<INativeTier> MakeLLVMNativeTier(const TModule& module, int optLevel) {
+    return std::make_unique<TLLVMNativeTier>(module, optLevel);
+}
+
+} // namespace NQumir::NCodeGen
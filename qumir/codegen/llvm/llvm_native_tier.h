@@ -0,0 +1,17 @@
+#pragma once
+
+#include <qumir/ir/eval.h>
+
+#include <memory>
+
+namespace NQumir::NCodeGen {
+
+// Native tier for TInterpreter backed by TLLVMCodeGen and the ORC JIT.
+// Compiles run on a background thread against a private copy of the module,
+// taken before the VM rewrites any function, so the interpreter never waits.
+// A function qualifies when it and every function it calls are neither
+// coroutines nor touch module globals: the JIT would see its own copies of
+// the globals, not the VM's.
+std::unique_ptr<NIR::INativeTier> MakeLLVMNativeTier(const NIR::TModule& module, int optLevel);
+
+} // namespace NQumir::NCodeGen
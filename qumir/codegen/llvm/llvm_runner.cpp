@@ -1,8 +1,18 @@
 #include "llvm_runner.h"
 #include "llvm_codegen_impl.h"
+#include <qumir/parallel.h>
+#include <qumir/time_report.h>
 
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringExtras.h>
 #include <llvm/Config/llvm-config.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Metadata.h>
 #include <llvm/IR/Module.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/Core.h>
+#include <llvm/ExecutionEngine/Orc/IRPartitionLayer.h>
+#include <llvm/ExecutionEngine/Orc/IRTransformLayer.h>
 #include <llvm/ExecutionEngine/Orc/LLJIT.h>
 #include <llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h>
 #include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
@@ -11,6 +21,7 @@
 #include <llvm/Support/Error.h>
 #include <llvm/Support/Casting.h>
 #include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SHA256.h>
 #if defined(__linux__)
 #include <llvm/ExecutionEngine/Orc/Debugging/PerfSupportPlugin.h>
 #include <llvm/ExecutionEngine/Orc/TargetProcess/JITLoaderPerf.h>
@@ -18,6 +29,7 @@
 #include <llvm/TargetParser/Host.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <iomanip>
 #include <optional>
@@ -26,7 +38,9 @@
 #include <setjmp.h>
 #include <stdexcept>
 #include <functional>
+#include <future>
 #include <type_traits>
+#include <unordered_set>
 #include <utility>
 
 #include <qumir/runtime/string.h> // for str_release
@@ -61,8 +75,65 @@ namespace NQumir::NCodeGen {
 
 using namespace NIR;
 
+// One LLJIT shared by the modules of a runner. Every module gets a JITDylib
+// of its own; objects of cached dependencies go into Deps once, keyed by
+// their content, and every later module links against them there.
+struct TJitSession {
+    std::unique_ptr<llvm::orc::LLJIT> Jit;
+    // Set when the session compiles functions on their first call.
+    llvm::orc::LLLazyJIT* Lazy = nullptr;
+    llvm::orc::JITDylib* Deps = nullptr;
+
+    std::mutex DepsMutex;
+    std::unordered_set<std::string> DepsLoaded; // SHA-256 of the objects in Deps
+    std::atomic<uint64_t> NextModuleId = 0;
+};
+
 namespace {
 
+// A module in its own JITDylib. Everything is added through Tracker, so
+// dropping the module frees its code and data and leaves the session (and
+// the other modules) as they were.
+struct TJitModule {
+    std::shared_ptr<TJitSession> Session;
+    llvm::orc::JITDylib* Dylib = nullptr;
+    llvm::orc::ResourceTrackerSP Tracker;
+
+    TJitModule() = default;
+    TJitModule(const TJitModule&) = delete;
+    TJitModule& operator=(const TJitModule&) = delete;
+
+    ~TJitModule() {
+        if (Tracker) {
+            llvm::consumeError(Tracker->remove());
+        }
+        if (Dylib) {
+            llvm::consumeError(Session->Jit->getExecutionSession().removeJITDylib(*Dylib));
+        }
+    }
+
+    llvm::orc::LLJIT& Jit() {
+        return *Session->Jit;
+    }
+
+    // Searches the whole link order: an entry may come from a shared
+    // dependency object rather than from the module itself.
+    llvm::orc::JITDylibSearchOrder SearchOrder() {
+        return Dylib->withLinkOrderDo([](const llvm::orc::JITDylibSearchOrder& order) {
+            return order;
+        });
+    }
+
+    llvm::Expected<llvm::orc::ExecutorAddr> Lookup(const std::string& name) {
+        auto& jit = *Session->Jit;
+        auto symbol = jit.getExecutionSession().lookup(SearchOrder(), jit.mangleAndIntern(name));
+        if (!symbol) {
+            return symbol.takeError();
+        }
+        return symbol->getAddress();
+    }
+};
+
 void InitializeNativeJitTarget() {
     static const bool initialized = [] {
         llvm::InitializeNativeTarget();
@@ -122,7 +193,8 @@ bool EnablePerfSupport(llvm::orc::LLJIT& jit, std::string* error) {
 #endif
 }
 
-void SetObjectLinkingLayerCreator(llvm::orc::LLJITBuilder& builder) {
+template <typename TBuilder>
+void SetObjectLinkingLayerCreator(TBuilder& builder) {
 #if LLVM_VERSION_MAJOR <= 20
     builder.setObjectLinkingLayerCreator(
         [](llvm::orc::ExecutionSession& es, const llvm::Triple&)
@@ -140,9 +212,59 @@ void SetObjectLinkingLayerCreator(llvm::orc::LLJITBuilder& builder) {
 #endif
 }
 
+template <typename TBuilder>
+void ConfigureJitBuilder(TBuilder& builder, llvm::orc::JITTargetMachineBuilder jtmb, int compileThreads) {
+    builder.setJITTargetMachineBuilder(std::move(jtmb));
+    SetObjectLinkingLayerCreator(builder);
+    if (compileThreads > 1) {
+        // Materializations are dispatched to a pool of compileThreads, and
+        // ConcurrentIRCompiler builds a target machine per compile, so
+        // modules (each in its own LLVMContext) compile in parallel.
+        builder.setNumCompileThreads(compileThreads);
+        builder.setCompileFunctionCreator(
+            [](llvm::orc::JITTargetMachineBuilder jtmb)
+                -> llvm::Expected<std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>>
+            {
+                return std::make_unique<llvm::orc::ConcurrentIRCompiler>(std::move(jtmb));
+            });
+    }
+}
+
+// Runs the LLVM pipeline TLLVMCodeGen deferred (DeferredOptLevelFlag) right
+// before a module, or with a lazy session a single function, is compiled.
+// Modules without the flag were optimized by the codegen and pass unchanged.
+void OptimizeDeferredModules(llvm::orc::LLJIT& jit, llvm::orc::JITTargetMachineBuilder jtmb) {
+    jit.getIRTransformLayer().setTransform(
+        [jtmb = std::move(jtmb)](llvm::orc::ThreadSafeModule tsm, llvm::orc::MaterializationResponsibility&)
+            -> llvm::Expected<llvm::orc::ThreadSafeModule>
+        {
+            auto err = tsm.withModuleDo([&](llvm::Module& module) -> llvm::Error {
+                auto* optLevel = llvm::mdconst::extract_or_null<llvm::ConstantInt>(
+                    module.getModuleFlag(DeferredOptLevelFlag));
+                if (!optLevel) {
+                    return llvm::Error::success();
+                }
+                auto builder = jtmb; // compile threads may run this at once
+                auto tm = builder.createTargetMachine();
+                if (!tm) {
+                    return tm.takeError();
+                }
+                TPhaseTimer timer("llvm.jit.optimize");
+                RunOptimizationPipeline(module, tm->get(), static_cast<int>(optLevel->getZExtValue()));
+                return llvm::Error::success();
+            });
+            if (err) {
+                return std::move(err);
+            }
+            return std::move(tsm);
+        });
+}
+
 std::unique_ptr<llvm::orc::LLJIT> CreateOrcJit(
     bool nativeCode,
     bool enablePerf,
+    int compileThreads,
+    bool lazy,
     std::string* error)
 {
     llvm::orc::JITTargetMachineBuilder jtmb{
@@ -156,25 +278,100 @@ std::unique_ptr<llvm::orc::LLJIT> CreateOrcJit(
     }
     jtmb.setRelocationModel(llvm::Reloc::PIC_);
 
-    llvm::orc::LLJITBuilder builder;
-    builder.setJITTargetMachineBuilder(std::move(jtmb));
-    SetObjectLinkingLayerCreator(builder);
-    auto jit = TakeExpected(builder.create(), error);
-    if (!jit) {
+    std::unique_ptr<llvm::orc::LLJIT> jit;
+    if (lazy) {
+        llvm::orc::LLLazyJITBuilder builder;
+        ConfigureJitBuilder(builder, jtmb, compileThreads);
+        auto lazyJit = TakeExpected(builder.create(), error);
+        if (!lazyJit) {
+            return nullptr;
+        }
+        // One partition per function: only the function being called is
+        // compiled, its callees stay behind lazy reexport stubs.
+        (*lazyJit)->setPartitionFunction(llvm::orc::IRPartitionLayer::compileRequested);
+        jit = std::move(*lazyJit);
+    } else {
+        llvm::orc::LLJITBuilder builder;
+        ConfigureJitBuilder(builder, jtmb, compileThreads);
+        auto eagerJit = TakeExpected(builder.create(), error);
+        if (!eagerJit) {
+            return nullptr;
+        }
+        jit = std::move(*eagerJit);
+    }
+    OptimizeDeferredModules(*jit, std::move(jtmb));
+    if (enablePerf && !EnablePerfSupport(*jit, error)) {
         return nullptr;
     }
-    if (enablePerf && !EnablePerfSupport(**jit, error)) {
+    return jit;
+}
+
+// The dylib sees the process symbols, that is the runtime, like the main one.
+llvm::orc::JITDylib* CreateDylib(llvm::orc::LLJIT& jit, std::string name, std::string* error) {
+    auto dylib = jit.createJITDylib(std::move(name));
+    if (!dylib) {
+        *error = ToString(dylib.takeError());
         return nullptr;
     }
-    return std::move(*jit);
+    return &dylib.get();
 }
 
-bool AddArtifactsToJit(TLLVMModuleArtifacts& artifacts, llvm::orc::LLJIT& jit, std::string* error) {
-    artifacts.Module->setDataLayout(jit.getDataLayout());
+std::shared_ptr<TJitModule> CreateJitModule(std::shared_ptr<TJitSession> session, std::string* error) {
+    const auto id = session->NextModuleId++;
+    auto dylib = CreateDylib(*session->Jit, "qumir-module-" + std::to_string(id), error);
+    if (!dylib) {
+        return nullptr;
+    }
+    auto module = std::make_shared<TJitModule>();
+    module->Session = std::move(session);
+    module->Dylib = dylib;
+    module->Tracker = module->Dylib->createResourceTracker();
+    module->Dylib->addToLinkOrder(*module->Session->Deps);
+    return module;
+}
+
+// Adds a dependency object to the shared dylib unless an object with the same
+// content is there already. If its symbols clash with another dependency the
+// object stays private to `module`, whose own definitions win over Deps.
+bool AddDependencyObject(TJitModule& module, std::unique_ptr<llvm::MemoryBuffer> buf, std::string* error) {
+    auto& session = *module.Session;
+    auto digest = llvm::SHA256::hash(llvm::arrayRefFromStringRef(buf->getBuffer()));
+    std::string key = llvm::toHex(llvm::ArrayRef<uint8_t>(digest.data(), digest.size()), true);
+
+    std::lock_guard lock(session.DepsMutex);
+    if (session.DepsLoaded.contains(key)) {
+        return true;
+    }
+    auto copy = llvm::MemoryBuffer::getMemBufferCopy(
+        buf->getBuffer(), buf->getBufferIdentifier());
+    auto err = session.Jit->addObjectFile(*session.Deps, std::move(buf));
+    if (!err) {
+        session.DepsLoaded.insert(std::move(key));
+        return true;
+    }
+    if (!err.isA<llvm::orc::DuplicateDefinition>()) {
+        *error = ToString(std::move(err));
+        return false;
+    }
+    llvm::consumeError(std::move(err));
+    if (auto e = module.Jit().addObjectFile(module.Tracker, std::move(copy))) {
+        *error = ToString(std::move(e));
+        return false;
+    }
+    return true;
+}
+
+bool AddArtifactsToJit(TLLVMModuleArtifacts& artifacts, TJitModule& jit, std::string* error) {
+    artifacts.Module->setDataLayout(jit.Jit().getDataLayout());
     auto module = llvm::orc::ThreadSafeModule(
         std::move(artifacts.Module),
         std::move(artifacts.Ctx));
-    if (auto err = jit.addIRModule(std::move(module))) {
+    // Lazy modules are tracked by the dylib's default tracker, which
+    // removeJITDylib releases with the module.
+    auto err = jit.Session->Lazy
+        ? jit.Session->Lazy->addLazyIRModule(*jit.Dylib, std::move(module))
+        : jit.Jit().addIRModule(jit.Tracker, std::move(module));
+    if (err) {
         if (error) {
             *error = ToString(std::move(err));
         } else {
@@ -185,9 +382,55 @@ bool AddArtifactsToJit(TLLVMModuleArtifacts& artifacts, llvm::orc::LLJIT& jit, s
     return true;
 }
 
+// The linking half of LinkAndLookup: a new module with the dependency objects
+// and the kernel added but nothing compiled yet.
+std::shared_ptr<TJitModule> LinkModule(
+    std::shared_ptr<TJitSession> session,
+    const std::vector<std::string>& objectPaths,
+    const std::vector<std::string>& objectBlobs,
+    std::unique_ptr<ILLVMModuleArtifacts> kernelModule,
+    std::string* err)
+{
+    auto jit = CreateJitModule(std::move(session), err);
+    if (!jit) {
+        return nullptr;
+    }
+
+    // Objects first so the kernel module resolves their symbols by name.
+    for (const auto& path : objectPaths) {
+        auto buf = llvm::MemoryBuffer::getFile(path);
+        if (!buf) {
+            *err = "cannot read object file " + path + ": " + buf.getError().message();
+            return nullptr;
+        }
+        if (!AddDependencyObject(*jit, std::move(*buf), err)) {
+            return nullptr;
+        }
+    }
+    for (size_t i = 0; i < objectBlobs.size(); ++i) {
+        auto buf = llvm::MemoryBuffer::getMemBufferCopy(
+            objectBlobs[i], "cached-object-" + std::to_string(i));
+        if (!AddDependencyObject(*jit, std::move(buf), err)) {
+            return nullptr;
+        }
+    }
+
+    if (kernelModule) {
+        auto* artifacts = dynamic_cast<TLLVMModuleArtifacts*>(kernelModule.get());
+        if (!artifacts || !artifacts->Module) {
+            *err = "unexpected kernel artifacts implementation";
+            return nullptr;
+        }
+        if (!AddArtifactsToJit(*artifacts, *jit, err)) {
+            return nullptr;
+        }
+    }
+    return jit;
+}
+
 template <typename TFunction>
-std::optional<TFunction> LookupFunction(llvm::orc::LLJIT& jit, const std::string& name, std::string* error) {
-    auto addr = jit.lookup(name);
+std::optional<TFunction> LookupFunction(TJitModule& jit, const std::string& name, std::string* error) {
+    auto addr = jit.Lookup(name);
     if (!addr) {
         if (error) {
             *error = ToString(addr.takeError());
@@ -324,7 +567,7 @@ template <typename TResult, typename TFunction, typename... TArgs>
 }
 
 template <typename TInteger>
-std::optional<int64_t> RunIntegerFunction(llvm::orc::LLJIT& jit, const std::string& name, std::string* error) {
+std::optional<int64_t> RunIntegerFunction(TJitModule& jit, const std::string& name, std::string* error) {
     using TFn = TInteger (*)();
     auto function = LookupFunction<TFn>(jit, name, error);
     if (!function) {
@@ -334,7 +577,7 @@ std::optional<int64_t> RunIntegerFunction(llvm::orc::LLJIT& jit, const std::stri
 }
 
 static std::optional<std::string> RunEntryFunction(
-    llvm::orc::LLJIT& jit,
+    TJitModule& jit,
     const TEntryInfo& entry,
     bool returnTypeIsString,
     std::string* error)
@@ -426,7 +669,7 @@ static std::optional<std::string> RunEntryFunction(
 }
 
 static bool RunVoidFunctionIfPresent(
-    llvm::orc::LLJIT& jit,
+    TJitModule& jit,
     const std::string& name,
     std::string* error)
 {
@@ -442,7 +685,7 @@ static bool RunVoidFunctionIfPresent(
     return true;
 }
 
-static void* RunCoroutineEntry(llvm::orc::LLJIT& jit, const std::string& name, std::string* error) {
+static void* RunCoroutineEntry(TJitModule& jit, const std::string& name, std::string* error) {
     using TFn = void* (*)();
     auto function = LookupFunction<TFn>(jit, name, error);
     if (!function) {
@@ -452,7 +695,7 @@ static void* RunCoroutineEntry(llvm::orc::LLJIT& jit, const std::string& name, s
 }
 
 static std::optional<void*> RunPromisePtrFunction(
-    llvm::orc::LLJIT& jit,
+    TJitModule& jit,
     const std::string& name,
     void* handle,
     std::string* error)
@@ -472,6 +715,38 @@ TLlvmRunner::TLlvmRunner(TLlvmRunnerOptions options)
     InitializeNativeJitTarget();
 }
 
+std::shared_ptr<TJitSession> TLlvmRunner::Session(bool nativeCode, std::string* error) {
+    std::lock_guard lock(Mutex_);
+    auto& session = Sessions_[nativeCode ? 1 : 0];
+    if (session) {
+        return session;
+    }
+
+    // Make symbols from the current process available to the JIT. On Linux,
+    // this requires the executable to be linked with -rdynamic as well.
+    llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+
+    auto created = std::make_shared<TJitSession>();
+    created->Jit = CreateOrcJit(
+        nativeCode,
+        Options_.EnablePerfJitEventListener,
+        ThreadCount(Options_.CompileThreads),
+        Options_.LazyCompile,
+        error);
+    if (!created->Jit) {
+        return nullptr;
+    }
+    if (Options_.LazyCompile) {
+        created->Lazy = static_cast<llvm::orc::LLLazyJIT*>(created->Jit.get());
+    }
+    created->Deps = CreateDylib(*created->Jit, "qumir-deps", error);
+    if (!created->Deps) {
+        return nullptr;
+    }
+    session = std::move(created);
+    return session;
+}
+
 std::optional<std::string> TLlvmRunner::Run(
     std::unique_ptr<ILLVMModuleArtifacts> iartifacts,
     const std::string& entryPoint,
@@ -494,22 +769,27 @@ std::optional<std::string> TLlvmRunner::Run(
         return std::nullopt;
     }
 
-    InitializeNativeJitTarget();
-
-    // Make symbols from the current process available to the JIT. On Linux,
-    // this requires the executable to be linked with -rdynamic as well.
-    llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
-
-    auto jit = CreateOrcJit(
-        artifacts->NativeCode,
-        Options_.EnablePerfJitEventListener,
-        runError);
+    std::optional<TPhaseTimer> jitTimer(std::in_place, "llvm.jit");
+    auto session = Session(artifacts->NativeCode, runError);
+    if (!session) {
+        return std::nullopt;
+    }
+    // Removed from the session when the run is over.
+    auto jit = CreateJitModule(std::move(session), runError);
     if (!jit) {
         return std::nullopt;
     }
     if (!AddArtifactsToJit(*artifacts, *jit, runError)) {
         return std::nullopt;
     }
+    if (CurrentTimeReport()) {
+        // Compile the module now rather than on the first call, so that the
+        // report tells compiling apart from running.
+        if (auto addr = jit->Lookup(entry->Name); !addr) {
+            llvm::consumeError(addr.takeError());
+        }
+    }
+    jitTimer.reset();
 
     if (!RunVoidFunctionIfPresent(*jit, entry->ConstructorName, runError)) {
         return std::nullopt;
@@ -604,14 +884,12 @@ std::unordered_map<std::string, void*> TLlvmRunner::LookupMany(
         return {};
     }
 
-    InitializeNativeJitTarget();
-
-    llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
-
-    auto jit = CreateOrcJit(
-        artifacts->NativeCode,
-        Options_.EnablePerfJitEventListener,
-        lookupError);
+    TPhaseTimer timer("llvm.jit");
+    auto session = Session(artifacts->NativeCode, lookupError);
+    if (!session) {
+        return {};
+    }
+    auto jit = CreateJitModule(std::move(session), lookupError);
     if (!jit) {
         return {};
     }
@@ -622,7 +900,7 @@ std::unordered_map<std::string, void*> TLlvmRunner::LookupMany(
     std::unordered_map<std::string, void*> entries;
     entries.reserve(names.size());
     for (const auto& name : names) {
-        auto addr = jit->lookup(name);
+        auto addr = jit->Lookup(name);
         if (!addr) {
             *lookupError = ToString(addr.takeError());
             return {};
@@ -630,13 +908,8 @@ std::unordered_map<std::string, void*> TLlvmRunner::LookupMany(
         entries.emplace(name, addr->toPtr<void*>());
     }
 
-    struct TLiveJit {
-        std::unique_ptr<llvm::orc::LLJIT> Jit;
-    };
-
-    auto live = std::make_shared<TLiveJit>();
-    live->Jit = std::move(jit);
-    LiveEngines_.push_back(std::move(live));
+    std::lock_guard lock(Mutex_);
+    LiveModules_.push_back(std::move(jit));
     return entries;
 }
 
@@ -648,74 +921,73 @@ TLlvmRunner::TLinkedModule TLlvmRunner::LinkAndLookup(
     const std::vector<std::string>& names,
     std::string* error)
 {
-    std::string localError;
-    auto* err = error ? error : &localError;
-    err->clear();
-
-    InitializeNativeJitTarget();
-    llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
-
-    auto jit = CreateOrcJit(nativeCode, Options_.EnablePerfJitEventListener, err);
-    if (!jit) {
-        return {};
-    }
-
-    auto addObject = [&](std::unique_ptr<llvm::MemoryBuffer> buf) -> bool {
-        if (auto e = jit->addObjectFile(std::move(buf))) {
-            *err = ToString(std::move(e));
-            return false;
-        }
-        return true;
-    };
-
-    // Objects first so the kernel module resolves their symbols by name.
-    for (const auto& path : objectPaths) {
-        auto buf = llvm::MemoryBuffer::getFile(path);
-        if (!buf) {
-            *err = "cannot read object file " + path + ": " + buf.getError().message();
-            return {};
-        }
-        if (!addObject(std::move(*buf))) {
-            return {};
-        }
+    TPhaseTimer timer("llvm.jit");
+    auto linked = SubmitLinkAndLookup(
+        objectPaths, objectBlobs, std::move(kernelModule), nativeCode, names).get();
+    if (error) {
+        *error = linked.Error;
     }
-    for (size_t i = 0; i < objectBlobs.size(); ++i) {
-        auto buf = llvm::MemoryBuffer::getMemBufferCopy(
-            objectBlobs[i], "cached-object-" + std::to_string(i));
-        if (!addObject(std::move(buf))) {
-            return {};
-        }
+    if (!linked.Error.empty()) {
+        linked.Entries.clear();
+        linked.Lifetime.reset();
     }
+    return linked;
+}
 
-    if (kernelModule) {
-        auto* artifacts = dynamic_cast<TLLVMModuleArtifacts*>(kernelModule.get());
-        if (!artifacts || !artifacts->Module) {
-            *err = "unexpected kernel artifacts implementation";
-            return {};
-        }
-        if (!AddArtifactsToJit(*artifacts, *jit, err)) {
-            return {};
-        }
+std::future<TLlvmRunner::TLinkedModule> TLlvmRunner::SubmitLinkAndLookup(
+    const std::vector<std::string>& objectPaths,
+    const std::vector<std::string>& objectBlobs,
+    std::unique_ptr<ILLVMModuleArtifacts> kernelModule,
+    bool nativeCode,
+    const std::vector<std::string>& names)
+{
+    auto promise = std::make_shared<std::promise<TLinkedModule>>();
+    auto future = promise->get_future();
+
+    TLinkedModule failed;
+    auto session = Session(nativeCode, &failed.Error);
+    auto jit = session
+        ? LinkModule(std::move(session), objectPaths, objectBlobs, std::move(kernelModule), &failed.Error)
+        : nullptr;
+    if (!jit) {
+        promise->set_value(std::move(failed));
+        return future;
     }
 
-    TLinkedModule linked;
-    linked.Entries.reserve(names.size());
+    auto& orc = jit->Jit();
+    llvm::orc::SymbolLookupSet symbols;
+    std::vector<std::pair<std::string, llvm::orc::SymbolStringPtr>> entries;
+    entries.reserve(names.size());
     for (const auto& name : names) {
-        auto addr = jit->lookup(name);
-        if (!addr) {
-            *err = ToString(addr.takeError());
-            return {};
-        }
-        linked.Entries.emplace(name, addr->toPtr<void*>());
+        auto mangled = orc.mangleAndIntern(name);
+        symbols.add(mangled);
+        entries.emplace_back(name, std::move(mangled));
     }
-
-    struct TLiveJit {
-        std::unique_ptr<llvm::orc::LLJIT> Jit;
-    };
-    auto live = std::make_shared<TLiveJit>();
-    live->Jit = std::move(jit);
-    linked.Lifetime = std::move(live);
-    return linked;
+    symbols.removeDuplicates();
+
+    // Runs on an ORC compile thread once the entries are ready (or inline,
+    // without a pool). The module goes to the caller even on failure, so that
+    // it is never removed from within an ORC callback.
+    orc.getExecutionSession().lookup(
+        llvm::orc::LookupKind::Static,
+        jit->SearchOrder(),
+        std::move(symbols),
+        llvm::orc::SymbolState::Ready,
+        [promise, jit, entries = std::move(entries)](llvm::Expected<llvm::orc::SymbolMap> result) mutable {
+            TLinkedModule linked;
+            if (result) {
+                linked.Entries.reserve(entries.size());
+                for (const auto& [name, mangled] : entries) {
+                    linked.Entries.emplace(name, (*result)[mangled].getAddress().toPtr<void*>());
+                }
+            } else {
+                linked.Error = ToString(result.takeError());
+            }
+            linked.Lifetime = std::move(jit);
+            promise->set_value(std::move(linked));
+        },
+        llvm::orc::NoDependenciesToRegister);
+    return future;
 }
 
 TBuildFingerprint MakeBuildFingerprint(
@@ -7,14 +7,26 @@
 #include <string>
 #include <optional>
 #include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
 namespace NQumir::NCodeGen {
 
+struct TJitSession;
+
 struct TLlvmRunnerOptions {
     bool EnablePerfJitEventListener = false;
+    // Threads ORC compiles IR modules on (0: one per hardware thread). With
+    // more than one, modules are compiled by ConcurrentIRCompiler on a pool
+    // of that many threads; with one, on the thread that looks them up.
+    int CompileThreads = 1;
+    // Compile each function of a module on its first call (ORC lazy
+    // reexports) instead of the whole module up front. A module emitted with
+    // TLLVMCodeGenOptions::DeferOptimization is also optimized per function.
+    bool LazyCompile = false;
 };
 
 // Runner: lowers code to NIR, translates to LLVM IR, returns full module IR text.
@@ -32,6 +44,12 @@ public:
         bool returnTypeIsString = false /* TODO: remove me, clutch: support string returnType */,
         std::function<std::optional<std::string>(const void*)> coroutineResultFormatter = {});
 
+    // Modules of one runner share a long-lived ORC session (one per code model:
+    // generic or host CPU); each module is put in a JITDylib of its own, which
+    // sees the process symbols (the runtime) and the shared dependency dylib.
+    // Lookup, LookupMany, LinkAndLookup and SubmitLinkAndLookup may be called
+    // from several threads at once; Run executes on the calling thread.
+
     // Compiles the module via JIT and returns a function pointer by name.
     // The pointer is valid for the lifetime of this TLlvmRunner.
     void* Lookup(
@@ -44,18 +62,24 @@ public:
         const std::vector<std::string>& names,
         std::string* error = nullptr);
 
-    // Entry pointers plus an opaque handle that keeps their JIT alive. The
+    // Entry pointers plus an opaque handle that keeps their JITDylib alive. The
     // pointers are valid exactly as long as Lifetime is held, so the caller can
-    // scope a query's compiled code to the query (not to the whole runner).
+    // scope a query's compiled code to the query (not to the whole runner):
+    // dropping the handle removes the module's code and data from the session.
     struct TLinkedModule {
         std::unordered_map<std::string, void*> Entries;
         std::shared_ptr<void> Lifetime;
+        // Why Entries is empty, if it is.
+        std::string Error;
     };
 
     // Links prebuilt objects (from files and/or in-memory blobs) and an optional
-    // IR module into one JIT, then looks up `names`. Objects are added first so
-    // the module can reference their symbols; each symbol must be defined once.
-    // On failure returns an empty Entries map (and sets *error).
+    // IR module into a new JITDylib, then looks up `names`. The objects are
+    // cached dependencies: each one goes into the session's dependency dylib the
+    // first time it is seen (by content) and is reused by later modules; an
+    // object whose symbols clash with one already there is linked into the
+    // module's own dylib instead. On failure returns an empty Entries map (and
+    // sets *error).
     TLinkedModule LinkAndLookup(
         const std::vector<std::string>& objectPaths,
         const std::vector<std::string>& objectBlobs,
@@ -64,13 +88,30 @@ public:
         const std::vector<std::string>& names,
         std::string* error = nullptr);
 
+    // Asynchronous LinkAndLookup: adds the objects and the module on the
+    // calling thread and returns at once; the future becomes ready when ORC
+    // has compiled and linked everything `names` needs, on its compile threads
+    // when CompileThreads > 1. Failures are reported in TLinkedModule::Error.
+    std::future<TLinkedModule> SubmitLinkAndLookup(
+        const std::vector<std::string>& objectPaths,
+        const std::vector<std::string>& objectBlobs,
+        std::unique_ptr<ILLVMModuleArtifacts> kernelModule,
+        bool nativeCode,
+        const std::vector<std::string>& names);
+
 private:
     TLlvmRunnerOptions Options_;
     std::string LastError; // currently unused (kept for future diagnostics)
 
-    // Keeps JIT engines alive so function pointers returned by Lookup remain valid.
+    // Created on first use; [1] generates code for the host CPU.
+    std::shared_ptr<TJitSession> Session(bool nativeCode, std::string* error);
+
+    std::mutex Mutex_; // guards Sessions_ and LiveModules_
+    std::shared_ptr<TJitSession> Sessions_[2];
+
+    // Keeps the modules of Lookup alive so the pointers it returns remain valid.
     // Type-erased to avoid including heavy LLVM headers here.
-    std::vector<std::shared_ptr<void>> LiveEngines_;
+    std::vector<std::shared_ptr<void>> LiveModules_;
 };
 
 // Builds a fingerprint from the current LLVM/target settings plus the caller's
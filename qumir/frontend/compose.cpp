@@ -1,6 +1,7 @@
 #include "compose.h"
 
 #include <qumir/frontend/source_module_loader.h>
+#include <qumir/time_report.h>
 
 #include <algorithm>
 #include <unordered_map>
@@ -215,6 +216,7 @@ std::expected<TComposeResult, TError> LoadAndCompose(
     const std::vector<TPragma>& corePragmas,
     bool cloneSourceModules)
 {
+    TPhaseTimer timer("compose");
     if (auto block = TMaybeNode<TBlockExpr>(mainAst)) {
         for (const auto& stmt : block.Cast()->Stmts) {
             auto use = TMaybeNode<TUseExpr>(stmt);
@@ -1,6 +1,7 @@
 #include "builder.h"
 
 #include <iostream>
+#include <utility>
 
 namespace NQumir {
 namespace NIR {
@@ -247,12 +248,27 @@ TFunction* TModule::GetFunctionByName(const std::string& name)
     return nullptr;
 }
 
+size_t TModule::InstructionCount() const {
+    size_t count = 0;
+    for (const auto& function : Functions) {
+        for (const auto& block : function.Blocks) {
+            count += block.Phis.size() + block.Instrs.size();
+        }
+    }
+    return count;
+}
+
 TFunction* TModule::GetEntryPoint() {
-    auto* f = GetFunctionByName("<main>");
-    if (f) {
-        return f;
+    return const_cast<TFunction*>(std::as_const(*this).GetEntryPoint());
+}
+
+const TFunction* TModule::GetEntryPoint() const {
+    for (const auto& f : Functions) {
+        if (f.Name == "<main>") {
+            return &f;
+        }
     }
-    for (auto& f : Functions) {
+    for (const auto& f : Functions) {
         if (f.Name.substr(0, 2) == "__" || f.Name.substr(0, 2) == "$$") {
             // skip generated functions
             continue;
@@ -280,7 +296,8 @@ int TBuilder::NewFunction(std::string name, std::vector<TLocal> args, int symId)
             .Blocks = {},
             .SymId = symId,
             .UniqueId = NextUniqueFunctionId++,
-            .NextTmpIdx = 0
+            .NextTmpIdx = 0,
+            .Line = CurrentLine,
         };
         CurrentFunction = &Module.Functions[maybeIdx->second];
         NewBlock();
@@ -292,7 +309,8 @@ int TBuilder::NewFunction(std::string name, std::vector<TLocal> args, int symId)
             .ArgLocals = args,
             .Blocks = {},
             .SymId = symId,
-            .UniqueId = NextUniqueFunctionId++
+            .UniqueId = NextUniqueFunctionId++,
+            .Line = CurrentLine,
         });
         Module.SymIdToFuncIdx[symId] = Module.Functions.size() - 1;
         CurrentFunction = &Module.Functions.back();
@@ -308,13 +326,18 @@ std::pair<TLabel, int> TBuilder::NewBlock(TLabel label) {
     }
     CurrentFunction->Blocks.push_back({
         .Label = label.Idx >= 0 ? label : NewLabel(),
-        .Instrs = {}
+        .Instrs = {},
+        .Line = CurrentLine,
     });
     CurrentBlock = &CurrentFunction->Blocks.back();
     CurrentFunction->LabelToBlockIdx[CurrentBlock->Label] = CurrentFunction->Blocks.size() - 1;
     return {CurrentBlock->Label, CurrentFunction->Blocks.size() - 1};
 }
 
+void TBuilder::SetLine(int line) {
+    CurrentLine = line;
+}
+
 int TBuilder::CurrentBlockIdx() const
 {
     if (!CurrentFunction || !CurrentBlock) {
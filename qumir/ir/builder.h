@@ -197,6 +197,7 @@ struct TBlock {
     std::vector<TInstr> Instrs;
     std::list<TLabel> Succ;
     std::list<TLabel> Pred;
+    int Line = 0; // source line being lowered when the block was opened, 0 if unknown
 };
 
 struct TExecFunc;
@@ -233,6 +234,7 @@ struct TFunction {
     int32_t NextLabelIdx;
     TExecFunc* Exec{nullptr};
     std::map<TLabel, int> LabelToBlockIdx;
+    int Line = 0; // source line of the declaration, 0 if unknown
 
     int GetTmpType(int tmpId) const;
     int GetType(TTmp tmp) const;
@@ -263,6 +265,9 @@ struct TModule {
 
     TFunction* GetFunctionByName(const std::string& name);
     TFunction* GetEntryPoint();
+    const TFunction* GetEntryPoint() const;
+    // Instructions and phis in all the function bodies.
+    size_t InstructionCount() const;
     void Print(std::ostream& out) const;
 };
 
@@ -296,6 +301,8 @@ public:
     // instructions should be appended to this block.
     bool IsCurrentBlockTerminated() const;
     TLabel NewLabel();
+    // Source line stamped on functions and blocks created from now on.
+    void SetLine(int line);
 
 private:
     TTmp NewTmp();
@@ -303,6 +310,7 @@ private:
     TModule& Module;
     TFunction* CurrentFunction = nullptr;
     TBlock* CurrentBlock = nullptr;
+    int CurrentLine = 0;
 
     int NextUniqueFunctionId = 0;
 };
@@ -0,0 +1,514 @@
+#include "bytecode_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+
+#include <unistd.h>
+
+namespace NQumir {
+namespace NIR {
+
+namespace {
+
+// Bump on any change to the layout below or to the IR structures it mirrors.
+constexpr uint32_t FormatVersion = 1;
+constexpr char Magic[8] = {'Q', 'U', 'M', 'I', 'R', 'B', 'C', '\0'};
+// Guards allocations against corrupt entries.
+constexpr uint64_t MaxCount = 1ull << 28;
+
+class TWriter {
+public:
+    explicit TWriter(std::ostream& out)
+        : Out(out)
+    {}
+
+    template<typename T>
+    void Pod(T value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        Out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void Count(size_t n) {
+        Pod<uint64_t>(n);
+    }
+
+    void Str(const std::string& s) {
+        Count(s.size());
+        Out.write(s.data(), s.size());
+    }
+
+    void Ints(const std::vector<int>& v) {
+        Count(v.size());
+        for (int x : v) {
+            Pod<int32_t>(x);
+        }
+    }
+
+    void Operand(const TOperand& op) {
+        Pod(op.Type);
+        if (op.Type == TOperand::EType::Imm) {
+            Pod<int64_t>(op.Imm.Value);
+            Pod<int32_t>(op.Imm.TypeId);
+        } else {
+            // Tmp, Slot, Local and Label all are a single int32 index.
+            Pod<int32_t>(op.Tmp.Idx);
+        }
+    }
+
+    void Labels(const std::list<TLabel>& labels) {
+        Count(labels.size());
+        for (auto label : labels) {
+            Pod<int32_t>(label.Idx);
+        }
+    }
+
+    void Types(const TTypeTable& types) {
+        Pod<int32_t>(types.GetPointerSize());
+        Count(types.Size());
+        for (int id = 0; id < types.Size(); ++id) {
+            EKind kind = types.GetKind(id);
+            Pod(kind);
+            switch (kind) {
+            case EKind::Ptr:
+                Pod<int32_t>(types.UnderlyingType(id));
+                break;
+            case EKind::Func: {
+                auto& sig = types.GetFuncSig(id);
+                Ints(sig.Params);
+                Pod<int32_t>(sig.Result);
+                break;
+            }
+            case EKind::Struct:
+                Ints(types.GetStructFields(id));
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    void Function(const TFunction& f) {
+        Str(f.Name);
+        Count(f.ArgLocals.size());
+        for (auto local : f.ArgLocals) {
+            Pod<int32_t>(local.Idx);
+        }
+        Count(f.Blocks.size());
+        for (const auto& block : f.Blocks) {
+            Pod<int32_t>(block.Label.Idx);
+            Count(block.Phis.size());
+            for (const auto& phi : block.Phis) {
+                Pod<uint64_t>(phi.Op.Code);
+                Pod<int32_t>(phi.Dest.Idx);
+                Count(phi.Operands.size());
+                for (const auto& op : phi.Operands) {
+                    Operand(op);
+                }
+            }
+            Count(block.Instrs.size());
+            for (const auto& instr : block.Instrs) {
+                Pod<uint64_t>(instr.Op.Code);
+                Pod<int32_t>(instr.Dest.Idx);
+                Pod<uint8_t>(instr.OperandCount);
+                for (int i = 0; i < instr.OperandCount; ++i) {
+                    Operand(instr.Operands[i]);
+                }
+            }
+            Labels(block.Succ);
+            Labels(block.Pred);
+            Pod<int32_t>(block.Line);
+        }
+        Ints(f.LocalTypes);
+        Ints(f.TmpTypes);
+        Ints(f.Label2Idx);
+        Pod<int32_t>(f.ReturnTypeId);
+        Pod<uint8_t>(f.ReturnTypeIsString);
+        Pod<uint8_t>(f.IsCoroutine);
+        Pod<int32_t>(f.CoroutineResultTypeId);
+        Pod<uint8_t>(f.CfgBuilt);
+        Pod<uint8_t>(f.Cacheable);
+        Pod<int32_t>(f.SymId);
+        Pod<int32_t>(f.UniqueId);
+        Pod<int32_t>(f.NextTmpIdx);
+        Pod<int32_t>(f.NextLabelIdx);
+        Count(f.LabelToBlockIdx.size());
+        for (const auto& [label, idx] : f.LabelToBlockIdx) {
+            Pod<int32_t>(label.Idx);
+            Pod<int32_t>(idx);
+        }
+        Pod<int32_t>(f.Line);
+    }
+
+    void Module(const TModule& module) {
+        Count(module.Functions.size());
+        for (const auto& f : module.Functions) {
+            Function(f);
+        }
+        Count(module.ExternalFunctions.size());
+        for (const auto& ext : module.ExternalFunctions) {
+            Str(ext.Name);
+            Str(ext.MangledName);
+            Ints(ext.ArgTypes);
+            Pod<int32_t>(ext.ReturnTypeId);
+            Pod<uint8_t>(ext.Packed != nullptr);
+            Pod<int32_t>(ext.SymId);
+        }
+        SymMap(module.SymIdToFuncIdx);
+        SymMap(module.SymIdToExtFuncIdx);
+        Count(module.GlobalValues.size());
+        for (const auto& value : module.GlobalValues) {
+            Pod<int64_t>(value.Value);
+            Pod<int32_t>(value.TypeId);
+        }
+        Ints(module.GlobalTypes);
+        // StringLiteralsSet is rebuilt from the ids.
+        Count(module.StringLiterals.size());
+        for (const auto& s : module.StringLiterals) {
+            Str(s);
+        }
+        Pod<int32_t>(module.ModuleConstructorFunctionId);
+        Pod<int32_t>(module.ModuleDestructorFunctionId);
+        Types(module.Types);
+    }
+
+private:
+    void SymMap(const std::unordered_map<int, int>& map) {
+        Count(map.size());
+        for (const auto& [sym, idx] : map) {
+            Pod<int32_t>(sym);
+            Pod<int32_t>(idx);
+        }
+    }
+
+    std::ostream& Out;
+};
+
+class TReader {
+public:
+    explicit TReader(std::istream& in)
+        : In(in)
+    {}
+
+    template<typename T>
+    T Pod() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        if (!In.read(reinterpret_cast<char*>(&value), sizeof(value))) {
+            throw std::runtime_error("truncated entry");
+        }
+        return value;
+    }
+
+    size_t Count() {
+        auto n = Pod<uint64_t>();
+        if (n > MaxCount) {
+            throw std::runtime_error("corrupt entry");
+        }
+        return n;
+    }
+
+    std::string Str() {
+        std::string s(Count(), '\0');
+        if (!In.read(s.data(), s.size())) {
+            throw std::runtime_error("truncated entry");
+        }
+        return s;
+    }
+
+    std::vector<int> Ints() {
+        std::vector<int> v(Count());
+        for (auto& x : v) {
+            x = Pod<int32_t>();
+        }
+        return v;
+    }
+
+    TOperand Operand() {
+        auto type = Pod<TOperand::EType>();
+        switch (type) {
+        case TOperand::EType::Imm: {
+            TImm imm;
+            imm.Value = Pod<int64_t>();
+            imm.TypeId = Pod<int32_t>();
+            return imm;
+        }
+        case TOperand::EType::Tmp: return TTmp{Pod<int32_t>()};
+        case TOperand::EType::Slot: return TSlot{Pod<int32_t>()};
+        case TOperand::EType::Local: return TLocal{Pod<int32_t>()};
+        case TOperand::EType::Label: return TLabel{Pod<int32_t>()};
+        }
+        throw std::runtime_error("corrupt operand");
+    }
+
+    std::list<TLabel> Labels() {
+        std::list<TLabel> labels;
+        for (size_t n = Count(); n > 0; --n) {
+            labels.push_back(TLabel{Pod<int32_t>()});
+        }
+        return labels;
+    }
+
+    // Replays the table through its constructors; ids come out the same
+    // because every type in a table is distinct.
+    void Types(TTypeTable& types) {
+        types.SetPointerSize(Pod<int32_t>());
+        const size_t n = Count();
+        for (size_t id = 0; id < n; ++id) {
+            auto kind = Pod<EKind>();
+            int got;
+            switch (kind) {
+            case EKind::Ptr:
+                got = types.Ptr(Pod<int32_t>());
+                break;
+            case EKind::Func: {
+                auto params = Ints();
+                got = types.Func(std::move(params), Pod<int32_t>());
+                break;
+            }
+            case EKind::Struct:
+                got = types.Struct(Ints());
+                break;
+            default:
+                got = types.I(kind);
+                break;
+            }
+            if (got != (int)id) {
+                throw std::runtime_error("type table mismatch");
+            }
+        }
+    }
+
+    TFunction Function() {
+        TFunction f;
+        f.Name = Str();
+        f.ArgLocals.resize(Count());
+        for (auto& local : f.ArgLocals) {
+            local.Idx = Pod<int32_t>();
+        }
+        f.Blocks.resize(Count());
+        for (auto& block : f.Blocks) {
+            block.Label.Idx = Pod<int32_t>();
+            // TPhi and TInstr have no default constructor (TOp has none).
+            for (size_t n = Count(); n > 0; --n) {
+                auto& phi = block.Phis.emplace_back(TPhi{.Op = TOp(Pod<uint64_t>())});
+                phi.Dest.Idx = Pod<int32_t>();
+                phi.Operands.resize(Count());
+                for (auto& op : phi.Operands) {
+                    op = Operand();
+                }
+            }
+            for (size_t n = Count(); n > 0; --n) {
+                auto& instr = block.Instrs.emplace_back(TInstr{.Op = TOp(Pod<uint64_t>())});
+                instr.Dest.Idx = Pod<int32_t>();
+                instr.OperandCount = Pod<uint8_t>();
+                if (instr.OperandCount > instr.Operands.size()) {
+                    throw std::runtime_error("corrupt instruction");
+                }
+                for (int i = 0; i < instr.OperandCount; ++i) {
+                    instr.Operands[i] = Operand();
+                }
+            }
+            block.Succ = Labels();
+            block.Pred = Labels();
+            block.Line = Pod<int32_t>();
+        }
+        f.LocalTypes = Ints();
+        f.TmpTypes = Ints();
+        f.Label2Idx = Ints();
+        f.ReturnTypeId = Pod<int32_t>();
+        f.ReturnTypeIsString = Pod<uint8_t>();
+        f.IsCoroutine = Pod<uint8_t>();
+        f.CoroutineResultTypeId = Pod<int32_t>();
+        f.CfgBuilt = Pod<uint8_t>();
+        f.Cacheable = Pod<uint8_t>();
+        f.SymId = Pod<int32_t>();
+        f.UniqueId = Pod<int32_t>();
+        f.NextTmpIdx = Pod<int32_t>();
+        f.NextLabelIdx = Pod<int32_t>();
+        for (size_t n = Count(); n > 0; --n) {
+            TLabel label{Pod<int32_t>()};
+            f.LabelToBlockIdx[label] = Pod<int32_t>();
+        }
+        f.Line = Pod<int32_t>();
+        return f;
+    }
+
+    TModule Module(const TPackedResolver& resolvePacked) {
+        TModule module;
+        module.Functions.resize(Count());
+        for (auto& f : module.Functions) {
+            f = Function();
+        }
+        module.ExternalFunctions.resize(Count());
+        for (auto& ext : module.ExternalFunctions) {
+            ext.Name = Str();
+            ext.MangledName = Str();
+            ext.ArgTypes = Ints();
+            ext.ReturnTypeId = Pod<int32_t>();
+            if (Pod<uint8_t>()) {
+                ext.Packed = resolvePacked ? resolvePacked(ext.MangledName) : nullptr;
+                if (!ext.Packed) {
+                    throw std::runtime_error("unknown builtin `" + ext.MangledName + "'");
+                }
+            }
+            ext.SymId = Pod<int32_t>();
+        }
+        module.SymIdToFuncIdx = SymMap();
+        module.SymIdToExtFuncIdx = SymMap();
+        module.GlobalValues.resize(Count());
+        for (auto& value : module.GlobalValues) {
+            value.Value = Pod<int64_t>();
+            value.TypeId = Pod<int32_t>();
+        }
+        module.GlobalTypes = Ints();
+        module.StringLiterals.resize(Count());
+        module.StringLiteralsSet.clear();
+        for (size_t i = 0; i < module.StringLiterals.size(); ++i) {
+            module.StringLiterals[i] = Str();
+            module.StringLiteralsSet.emplace(module.StringLiterals[i], (int)i);
+        }
+        module.ModuleConstructorFunctionId = Pod<int32_t>();
+        module.ModuleDestructorFunctionId = Pod<int32_t>();
+        Types(module.Types);
+        return module;
+    }
+
+private:
+    std::unordered_map<int, int> SymMap() {
+        std::unordered_map<int, int> map;
+        for (size_t n = Count(); n > 0; --n) {
+            int sym = Pod<int32_t>();
+            map[sym] = Pod<int32_t>();
+        }
+        return map;
+    }
+
+    std::istream& In;
+};
+
+// FNV-1a; only names the entry file, the key itself is compared on load.
+uint64_t Fnv1a(const std::string& s) {
+    uint64_t hash = 1469598103934665603ull;
+    for (unsigned char c : s) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::optional<std::string> ReadFile(const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return std::nullopt;
+    }
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+} // namespace
+
+void SaveModule(std::ostream& out, const TModule& module) {
+    TWriter(out).Module(module);
+}
+
+std::expected<TModule, TError> LoadModule(std::istream& in, const TPackedResolver& resolvePacked) {
+    try {
+        return TReader(in).Module(resolvePacked);
+    } catch (const std::exception& e) {
+        return std::unexpected(TError(std::string("bytecode cache: ") + e.what()));
+    }
+}
+
+TBytecodeCache::TBytecodeCache(std::filesystem::path dir)
+    : Dir(std::move(dir))
+{}
+
+std::filesystem::path TBytecodeCache::EntryPath(const std::string& key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.qbc", (unsigned long long)Fnv1a(key));
+    return Dir / name;
+}
+
+std::optional<TModule> TBytecodeCache::Load(const std::string& key, const TPackedResolver& resolvePacked) const {
+    std::ifstream in(EntryPath(key), std::ios::binary);
+    if (!in) {
+        return std::nullopt;
+    }
+    try {
+        TReader reader(in);
+        char magic[sizeof(Magic)];
+        if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, Magic, sizeof(Magic)) != 0) {
+            return std::nullopt;
+        }
+        if (reader.Pod<uint32_t>() != FormatVersion || reader.Str() != key) {
+            return std::nullopt;
+        }
+        for (size_t n = reader.Count(); n > 0; --n) {
+            auto path = reader.Str();
+            auto content = reader.Str();
+            if (ReadFile(path) != content) {
+                return std::nullopt;
+            }
+        }
+        auto module = reader.Module(resolvePacked);
+        return module;
+    } catch (const std::exception&) {
+        // Truncated or foreign entry: recompile and overwrite it.
+        return std::nullopt;
+    }
+}
+
+std::optional<TError> TBytecodeCache::Store(
+    const std::string& key,
+    const std::vector<std::filesystem::path>& dependencies,
+    const TModule& module) const
+{
+    std::error_code ec;
+    std::filesystem::create_directories(Dir, ec);
+    if (ec) {
+        return TError("bytecode cache: cannot create " + Dir.string() + ": " + ec.message());
+    }
+
+    std::ostringstream image;
+    TWriter writer(image);
+    image.write(Magic, sizeof(Magic));
+    writer.Pod<uint32_t>(FormatVersion);
+    writer.Str(key);
+    writer.Count(dependencies.size());
+    for (const auto& path : dependencies) {
+        auto content = ReadFile(path);
+        if (!content) {
+            return TError("bytecode cache: cannot read " + path.string());
+        }
+        writer.Str(path.string());
+        writer.Str(*content);
+    }
+    writer.Module(module);
+
+    const auto path = EntryPath(key);
+    auto tmp = path;
+    tmp += "." + std::to_string(::getpid()) + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        const auto bytes = image.str();
+        out.write(bytes.data(), bytes.size());
+        if (!out) {
+            std::filesystem::remove(tmp, ec);
+            return TError("bytecode cache: cannot write " + tmp.string());
+        }
+    }
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp, ec);
+        return TError("bytecode cache: cannot write " + path.string());
+    }
+    return std::nullopt;
+}
+
+} // namespace NIR
+} // namespace NQumir
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "builder.h"
+
+#include <qumir/error.h>
+
+#include <expected>
+#include <filesystem>
+#include <functional>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace NQumir {
+namespace NIR {
+
+// Re-binds TExternalFunction::Packed by mangled name; nullptr if unknown.
+using TPackedResolver = std::function<TExternalFunction::TPacked(const std::string& mangledName)>;
+
+// Binary image of a lowered module. Host pointers are not stored:
+// TFunction::Exec starts empty and TExternalFunction::Packed is looked up
+// again through resolvePacked.
+void SaveModule(std::ostream& out, const TModule& module);
+std::expected<TModule, TError> LoadModule(std::istream& in, const TPackedResolver& resolvePacked);
+
+// On-disk cache of lowered modules, so repeated runs of the same program
+// skip parsing, semantic passes, lowering and IR passes. An entry is found
+// by a hash of its key but only used when the stored key matches verbatim
+// and every recorded source dependency still has the same content, so hash
+// collisions and edited `.oz` modules are plain misses.
+// VM bytecode is not stored: it embeds process addresses (string literals,
+// FFI thunks) and is rebuilt per function on first call.
+class TBytecodeCache {
+public:
+    explicit TBytecodeCache(std::filesystem::path dir);
+
+    // key must cover everything lowering depends on: compiler version,
+    // frontend options and the program source.
+    std::optional<TModule> Load(const std::string& key, const TPackedResolver& resolvePacked) const;
+    // Written to a temp file and renamed, so concurrent runs never see a
+    // partial entry.
+    std::optional<TError> Store(
+        const std::string& key,
+        const std::vector<std::filesystem::path>& dependencies,
+        const TModule& module) const;
+
+private:
+    std::filesystem::path EntryPath(const std::string& key) const;
+
+    std::filesystem::path Dir;
+};
+
+} // namespace NIR
+} // namespace NQumir
@@ -1,5 +1,6 @@
 #include "eval.h"
 
+#include <algorithm>
 #include <bit>
 #include <cstdint>
 #include <iostream>
@@ -8,6 +9,7 @@
 #include <cstring>
 
 #include <qumir/runtime/string.h> // for str_release
+#include <qumir/runtime/runtime.h> // for the longjmp escape out of native code
 #include <qumir/runtime/drawer.h>
 #include <qumir/runtime/painter.h>
 #include <qumir/runtime/robot.h>
@@ -16,6 +18,24 @@
 #include <qumir/runtime/future.h>
 #include <qumir/future.h>
 
+#if defined(QUMIR_VM_THREADED_DISPATCH) && defined(__GNUC__)
+#define QUMIR_VM_THREADED
+#endif
+
+// Every non-binary opcode with a handler in TInterpreter::Execute; binary ones
+// come from QUMIR_VM_BINARY_OPS.
+#define QUMIR_VM_HANDLED_OPS(X) \
+    X(StructStore) X(Copy) X(SAlloc) X(BoundsCheck) X(Ste) X(Lde) X(Lea) X(LeaG) X(Load64) X(Load64G) X(Store64) X(Store64G) \
+    X(INeg) X(FNeg) X(INot) X(IBitNot) X(Cmov) X(Mov) X(Bitcast) X(I2F) X(F2I) \
+    X(INeg128) X(IBitNot128) X(INot128) X(I2B128) X(IAdd128) X(ISub128) X(IMul128) X(IDivS128) X(IDivU128) \
+    X(IRemS128) X(IRemU128) X(IAnd128) X(IOr128) X(IXor128) X(IShl128) X(IShrS128) X(IShrU128) \
+    X(ICmpLTS128) X(ICmpLTU128) X(ICmpGTS128) X(ICmpGTU128) X(ICmpLES128) X(ICmpLEU128) \
+    X(ICmpGES128) X(ICmpGEU128) X(ICmpEQ128) X(ICmpNE128) \
+    X(CmovS128) X(SExt128) X(CmovU128) X(ZExt128) X(Mov128) X(Trunc128) X(I2F128S) X(I2F128U) X(F2I128) \
+    X(Load128) X(Load128G) X(Store128) X(Store128G) X(Lde128) X(Ste128) X(ArgTmp128) \
+    X(Jmp) X(Cmp) X(ArgTmp) X(ArgConst) X(ECall) X(Call) X(Await) X(AwaitVoid) X(Ret128) X(Ret) X(RetVoid) \
+    X(ProfBlock)
+
 namespace NQumir {
 namespace NIR {
 
@@ -23,46 +43,12 @@ using namespace NLiterals;
 
 namespace {
 
-template<typename Dest=int64_t>
-inline Dest ReadOperand(const std::vector<int64_t>& regs, const TVMOperand& op) {
-    switch (op.Type) {
-        case TVMOperand::EType::Tmp: {
-            const auto& t = op.Tmp;
-            assert(t.Idx >= 0 && t.Idx < regs.size());
-            return std::bit_cast<Dest>(regs[t.Idx]);
-        }
-        case TVMOperand::EType::Imm: {
-            const auto& i = op.Imm;
-            return std::bit_cast<Dest>(i.Value);
-        }
-        default: {
-            assert(false && "Slot operand not supported in ALU operations");
-            return 0;
-        }
-    }
-}
-
-inline __int128_t ReadOperand128(const std::vector<__int128_t>& regs, const TVMOperand& op) {
-    switch (op.Type) {
-        case TVMOperand::EType::Tmp: {
-            const auto& t = op.Tmp;
-            assert(t.Idx >= 0 && t.Idx < regs.size());
-            return regs[t.Idx];
-        }
-        case TVMOperand::EType::Imm:
-            return static_cast<__int128_t>(op.Imm.Value);
-        default: {
-            assert(false && "Slot operand not supported in ALU operations");
-            return 0;
-        }
-    }
-}
+constexpr size_t MaxRegs = 4 * 1024 * 1024; // register window stack, in registers
 
+// Operands arrive as raw register/constant bits; Dest picks their interpretation.
 template<typename Dest, typename T>
-inline int64_t EvalAlu(const std::vector<int64_t>& regs, const TVMInstr& instr, T lambda) {
-    Dest lhs = ReadOperand<Dest>(regs, instr.Operands[1]);
-    Dest rhs = ReadOperand<Dest>(regs, instr.Operands[2]);
-    auto res = lambda(lhs, rhs);
+inline int64_t EvalAlu(int64_t lhsBits, int64_t rhsBits, T lambda) {
+    auto res = lambda(std::bit_cast<Dest>(lhsBits), std::bit_cast<Dest>(rhsBits));
     if constexpr (std::is_same_v<decltype(res), int64_t>) {
         return res;
     } else {
@@ -73,15 +59,14 @@ inline int64_t EvalAlu(const std::vector<int64_t>& regs, const TVMInstr& instr,
 }
 
 template<typename T>
-inline auto Alu128(const std::vector<__int128_t>& regs, const TVMInstr& instr, T lambda) {
-    return lambda(ReadOperand128(regs, instr.Operands[1]),
-                  ReadOperand128(regs, instr.Operands[2]));
+inline auto Alu128(const __int128_t* regs, const TVMInstr& instr, T lambda) {
+    return lambda(regs[instr.B], regs[instr.C]);
 }
 
 template<typename T>
-inline auto AluU128(const std::vector<__int128_t>& regs, const TVMInstr& instr, T lambda) {
-    return lambda(std::bit_cast<__uint128_t>(ReadOperand128(regs, instr.Operands[1])),
-                  std::bit_cast<__uint128_t>(ReadOperand128(regs, instr.Operands[2])));
+inline auto AluU128(const __int128_t* regs, const TVMInstr& instr, T lambda) {
+    return lambda(std::bit_cast<__uint128_t>(regs[instr.B]),
+                  std::bit_cast<__uint128_t>(regs[instr.C]));
 }
 
 ITypeErasedFuture* MakeCompletedVoidFuture() {
@@ -96,6 +81,29 @@ ITypeErasedFuture* MakeCompletedValueFuture(uint64_t value) {
     return new TWrappedFuture<uint64_t>(MakeExternalFuture<uint64_t>(promise));
 }
 
+// Native code has no unwind info for C++ exceptions, so a runtime error inside
+// it longjmps back here and is rethrown, like SafeJitCall in the LLVM runner.
+// Must stay noinline so no C++ object lives between setjmp and longjmp.
+struct TGuardedNativeFunction : public NFFI::IFunction {
+    explicit TGuardedNativeFunction(NFFI::IFunction* inner)
+        : Inner(inner)
+    { }
+
+    [[gnu::noinline]] uint64_t operator() (const uint64_t* args, size_t argCount) override {
+        jmp_buf jb;
+        __set_jmp_target(&jb);
+        if (setjmp(jb) != 0) {
+            __clear_jmp_target();
+            throw std::runtime_error(__get_runtime_error());
+        }
+        auto ret = (*Inner)(args, argCount);
+        __clear_jmp_target();
+        return ret;
+    }
+
+    NFFI::IFunction* Inner;
+};
+
 } // namespace
 
 TInterpreter::TInterpreter(TModule& module, std::ostream& out, std::istream& in)
@@ -103,7 +111,10 @@ TInterpreter::TInterpreter(TModule& module, std::ostream& out, std::istream& in)
     , Compiler(module)
     , Out(out)
     , In(in)
-{ }
+{
+    // Publishes the handler addresses to the compiler before any code is built.
+    Execute(nullptr);
+}
 
 std::optional<std::string> TInterpreter::Eval(TFunction& function, std::vector<int64_t> args, TInterpreter::TOptions options)
 {
@@ -162,6 +173,15 @@ size_t TInterpreter::ProcessAsyncRuntimeEvents() {
 }
 
 std::optional<int64_t> TInterpreter::DoEvalRaw(TFunction& function, std::vector<int64_t> args, TOptions options) {
+    // Await only appears inside coroutine functions, so a module without them
+    // never suspends and can skip the coroutine frame and the event loop.
+    const bool hasCoroutines = std::any_of(Module.Functions.begin(), Module.Functions.end(),
+        [](const TFunction& f) { return f.IsCoroutine; });
+    if (!hasCoroutines) {
+        auto ans = DoEvalRawSync(function, std::move(args), options);
+        ProcessAsyncRuntimeEvents(); // flush batched calls
+        return ans;
+    }
     auto future = DoEvalRawAsync(function, std::move(args), options);
     while (!future.done()) {
         bool hasEvents = ProcessAsyncRuntimeEvents() > 0;
@@ -171,756 +191,758 @@ std::optional<int64_t> TInterpreter::DoEvalRaw(TFunction& function, std::vector<
     return future.await_resume();
 }
 
+std::optional<int64_t> TInterpreter::DoEvalRawSync(TFunction& function, std::vector<int64_t> args, TInterpreter::TOptions options) {
+    TExecState state;
+    if (!PrepareEntryFrame(state, function, args, options)) {
+        return std::nullopt;
+    }
+    if (!Execute(&state)) {
+        throw std::runtime_error("Await reached in a module without coroutines");
+    }
+    return state.RetVal;
+}
+
 TFuture<std::optional<int64_t>> TInterpreter::DoEvalRawAsync(TFunction& function, std::vector<int64_t> args, TInterpreter::TOptions options) {
+    TExecState state;
+    if (!PrepareEntryFrame(state, function, args, options)) {
+        co_return std::nullopt;
+    }
+
+    while (!Execute(&state)) {
+        auto& frame = state.CallStack.back();
+        const auto& instr = *frame.PC;
+        int64_t* regs = Runtime.Regs.get() + frame.RegBase;
+        if (instr.Op == EVMOp::Await) {
+            ITypeErasedFuture* future = reinterpret_cast<ITypeErasedFuture*>(regs[instr.B]);
+            auto value = co_await AwaitTypeErasedFuture<uint64_t>(future);
+            regs[instr.A] = static_cast<int64_t>(value);
+        } else {
+            ITypeErasedFuture* future = reinterpret_cast<ITypeErasedFuture*>(regs[instr.A]);
+            co_await AwaitTypeErasedFuture<void>(future);
+        }
+        ++frame.PC;
+    }
+
+    co_return state.RetVal;
+}
+
+bool TInterpreter::PrepareEntryFrame(TExecState& state, TFunction& function, const std::vector<int64_t>& args, TInterpreter::TOptions options) {
     if (!function.Exec) {
         function.Exec = &Compiler.Compile(function, options.PrintByteCode);
     }
-    std::vector<TFrame> callStack; callStack.reserve(16);
+    state.CallStack.reserve(16);
     auto* execFunc = function.Exec;
-    callStack.push_back(TFrame {
+    state.CallStack.push_back(TFrame {
         .Exec = execFunc,
         .UsedRegs = execFunc->MaxTmpIdx + 1,
         .Used128Regs = execFunc->MaxTmp128Idx + 1,
         .StackBase = 0,
+        .RegBase = 0,
         .PC = &execFunc->VMCode[0],
         .Name = function.Name,
     });
 
-    static constexpr size_t MaxStackSize = 128 * 1024 * 1024; // 128M
-
-    Runtime.Regs.resize(execFunc->MaxTmpIdx + 1, 0);
-    Runtime.Regs128.resize(execFunc->MaxTmp128Idx + 1, 0);
-    Runtime.Stack.reserve(MaxStackSize);
+    if (!Runtime.Regs) {
+        // Left uninitialized so untouched pages are never committed.
+        Runtime.Regs.reset(new int64_t[MaxRegs]);
+        Runtime.Regs128.reset(new __int128_t[MaxRegs]);
+    }
+    if (execFunc->MaxTmpIdx + 1 > (int)MaxRegs) {
+        throw std::runtime_error("Stack overflow in interpreter");
+    }
+    // Frames hand out pointers into the stack, so it must never reallocate.
+    Runtime.Stack.reserve(MaxStackBytes);
+    if (execFunc->NumLocals > MaxStackBytes) {
+        throw std::runtime_error("Stack overflow in interpreter");
+    }
+    std::fill_n(Runtime.Regs.get(), execFunc->MaxTmpIdx + 1, 0);
+    std::fill_n(Runtime.Regs128.get(), execFunc->MaxTmp128Idx + 1, 0);
     Runtime.Stack.resize(execFunc->NumLocals, 0); // NumLocals is frame size in bytes
     if (args.size() != function.ArgLocals.size()) {
         std::cerr << "Function " << function.Name << " expects " << function.ArgLocals.size() << " arguments, got " << args.size() << "\n";
-        co_return std::nullopt;
+        return false;
     }
 
-    auto copyArgsToFrame = [&](char* frameBase, const TExecFunc* exec,
-                                const int64_t* srcArgs, int srcCount) {
-        for (int i = 0; i < srcCount; ++i) {
-            const int byteOff = (i < (int)exec->ArgByteOffsets.size())
-                ? exec->ArgByteOffsets[i] : i * 8;
-            const int typeId = (i < (int)exec->ArgTypeIds.size()) ? exec->ArgTypeIds[i] : -1;
-            const int argSize = Module.Types.SizeInBytes(typeId);
-            if (typeId >= 0 && Module.Types.GetKind(typeId) == EKind::Struct) {
-                // struct arg: value is a pointer — copy the struct into the frame
-                std::memcpy(frameBase + byteOff, reinterpret_cast<const void*>(srcArgs[i]), argSize);
-            } else if (typeId >= 0 && argSize == 16 && i < (int)Runtime.Args128.size()) {
-                std::memcpy(frameBase + byteOff, &Runtime.Args128[i], 16);
-            } else {
-                std::memcpy(frameBase + byteOff, &srcArgs[i], 8);
-            }
-        }
-    };
-
-    copyArgsToFrame(Runtime.Stack.data(), execFunc, args.data(), (int)args.size());
+    CopyArgsToFrame(Runtime.Stack.data(), execFunc, args.data(), nullptr, (int)args.size());
+    if (Profiler) {
+        Profiler->Enter(static_cast<int>(&function - Module.Functions.data()));
+    }
+    return true;
+}
 
-    std::optional<int64_t> retVal;
-    bool retIs128 = false;
-    auto materializeStructTmp =[&](const TFrame& targetFrame, int32_t tmpIdx, const void* src) -> std::optional<int64_t> {
-        const TExecFunc* exec = targetFrame.Exec;
-        if (!exec || tmpIdx < 0 || tmpIdx >= (int32_t)exec->TmpTypeIds.size()) {
-            return std::nullopt;
-        }
-        const int typeId = exec->TmpTypeIds[tmpIdx];
-        if (typeId < 0 || Module.Types.GetKind(typeId) != EKind::Struct) {
-            return std::nullopt;
-        }
-        if (tmpIdx >= (int32_t)exec->TmpFrameOffsets.size()
-            || exec->TmpFrameOffsets[tmpIdx] < 0)
-        {
-            throw std::runtime_error("struct temporary has no frame storage");
-        }
-        const size_t size = static_cast<size_t>(Module.Types.SizeInBytes(typeId));
-        const size_t byteOffset = targetFrame.StackBase + exec->TmpFrameOffsets[tmpIdx];
-        assert(byteOffset + size <= Runtime.Stack.size());
-        char* temp = Runtime.Stack.data() + byteOffset;
-        if (src) {
-            std::memcpy(temp, src, size);
+void TInterpreter::CopyArgsToFrame(char* frameBase, const TExecFunc* exec, const int64_t* srcArgs, const __int128_t* srcArgs128, int srcCount) {
+    for (int i = 0; i < srcCount; ++i) {
+        const int byteOff = (i < (int)exec->ArgByteOffsets.size())
+            ? exec->ArgByteOffsets[i] : i * 8;
+        const int typeId = (i < (int)exec->ArgTypeIds.size()) ? exec->ArgTypeIds[i] : -1;
+        const int argSize = Module.Types.SizeInBytes(typeId);
+        if (typeId >= 0 && Module.Types.GetKind(typeId) == EKind::Struct) {
+            // struct arg: value is a pointer — copy the struct into the frame
+            std::memcpy(frameBase + byteOff, reinterpret_cast<const void*>(srcArgs[i]), argSize);
+        } else if (typeId >= 0 && argSize == 16 && srcArgs128) {
+            std::memcpy(frameBase + byteOff, &srcArgs128[i], 16);
         } else {
-            std::memset(temp, 0, size);
-        }
-        return reinterpret_cast<int64_t>(temp);
-    };
-
-    while (!callStack.empty()) {
-        auto& frame = callStack.back();
-        assert(frame.PC <= &frame.Exec->VMCode[frame.Exec->VMCode.size()-1]);
-        assert(frame.PC >= &frame.Exec->VMCode[0]);
-        const auto& instr = *frame.PC++;
-
-        switch (instr.Op) {
-        case EVMOp::StructStore: { // dst=Local (byte offset in frame), src=Tmp (pointer), size=Imm
-            const size_t byteOffset = frame.StackBase + instr.Operands[0].Local.Idx;
-            void* dst = Runtime.Stack.data() + byteOffset;
-            void* src = reinterpret_cast<void*>(ReadOperand<int64_t>(Runtime.Regs, instr.Operands[1]));
-            int64_t size = instr.Operands[2].Imm.Value;
-            std::memcpy(dst, src, static_cast<size_t>(size));
-            break;
+            std::memcpy(frameBase + byteOff, &srcArgs[i], 8);
         }
-        case EVMOp::Copy: { // dst/src are Tmp (pointers), size is Imm
-            void* dst = reinterpret_cast<void*>(ReadOperand<int64_t>(Runtime.Regs, instr.Operands[0]));
-            void* src = reinterpret_cast<void*>(ReadOperand<int64_t>(Runtime.Regs, instr.Operands[1]));
-            int64_t size = instr.Operands[2].Imm.Value;
-            std::memcpy(dst, src, static_cast<size_t>(size));
-            break;
+    }
+}
+
+void TInterpreter::CallPacked(NFFI::IFunction* func, const TFrame& frame, int64_t* regs, const TVMInstr& instr) {
+    const int32_t dstTmp = instr.A;
+    // Args were written to slots 1..C of the arg area; slot 0 takes the
+    // struct-return pointer when there is one.
+    int64_t* args = regs + frame.Exec->ArgSlotBase;
+    size_t argCount = instr.C;
+    auto structDst = MaterializeStructTmp(frame, dstTmp, nullptr);
+    if (structDst) {
+        args[0] = *structDst;
+        ++argCount;
+    } else {
+        ++args;
+    }
+
+    if (dstTmp >= 0) {
+        auto ret = (*func)(reinterpret_cast<const uint64_t*>(args), argCount);
+        regs[dstTmp] = structDst.value_or(static_cast<int64_t>(ret));
+    } else {
+        (*func)(reinterpret_cast<const uint64_t*>(args), argCount);
+    }
+}
+
+void TInterpreter::SetProfiler(TProfiler* profiler) {
+    Profiler = profiler;
+    Compiler.SetProfiling(profiler != nullptr);
+}
+
+void TInterpreter::CompileAll(int threads) {
+    Compiler.CompileAll(threads);
+}
+
+void TInterpreter::SetLimits(TLimits limits) {
+    Fuel = limits.Fuel ? limits.Fuel : std::numeric_limits<uint64_t>::max();
+    MaxStackBytes = limits.MaxStackBytes;
+}
+
+void TInterpreter::SetNativeTier(INativeTier* tier, uint32_t threshold) {
+    NativeTier = tier;
+    TierUpThreshold = threshold;
+}
+
+NFFI::IFunction* TInterpreter::TierUp(TFunction& function, TExecFunc& exec) {
+    switch (exec.Tier) {
+        case ETierState::Native:
+            return exec.Native;
+        case ETierState::Interpreted:
+            // Coroutines suspend through the VM and have no native entry.
+            if (++exec.Hotness >= TierUpThreshold) {
+                if (function.IsCoroutine) {
+                    exec.Tier = ETierState::VMOnly;
+                } else {
+                    NativeTier->Request(function);
+                    exec.Tier = ETierState::Compiling;
+                }
+            }
+            return nullptr;
+        case ETierState::Compiling: {
+            void* entry = nullptr;
+            switch (NativeTier->Poll(function, &entry)) {
+                case INativeTier::EStatus::Pending:
+                    return nullptr;
+                case INativeTier::EStatus::Ready:
+                    if (auto* thunk = Compiler.CreateNativeThunk(function, entry)) {
+                        NativeThunks.push_back(std::make_unique<TGuardedNativeFunction>(thunk));
+                        exec.Native = NativeThunks.back().get();
+                    }
+                    break;
+                case INativeTier::EStatus::Failed:
+                    break;
+            }
+            exec.Tier = exec.Native ? ETierState::Native : ETierState::VMOnly;
+            return exec.Native;
         }
-        case EVMOp::SAlloc: {
-            const size_t offset = static_cast<size_t>(instr.Operands[1].Imm.Value);
-            const size_t size = static_cast<size_t>(instr.Operands[2].Imm.Value);
-            const size_t byteOffset = frame.StackBase + offset;
+        case ETierState::VMOnly:
+            return nullptr;
+    }
+    return nullptr;
+}
+
+std::optional<int64_t> TInterpreter::MaterializeStructTmp(const TFrame& targetFrame, int32_t tmpIdx, const void* src) {
+    const TExecFunc* exec = targetFrame.Exec;
+    if (!exec || tmpIdx < 0 || tmpIdx >= (int32_t)exec->TmpTypeIds.size()) {
+        return std::nullopt;
+    }
+    const int typeId = exec->TmpTypeIds[tmpIdx];
+    if (typeId < 0 || Module.Types.GetKind(typeId) != EKind::Struct) {
+        return std::nullopt;
+    }
+    if (tmpIdx >= (int32_t)exec->TmpFrameOffsets.size()
+        || exec->TmpFrameOffsets[tmpIdx] < 0)
+    {
+        throw std::runtime_error("struct temporary has no frame storage");
+    }
+    const size_t size = static_cast<size_t>(Module.Types.SizeInBytes(typeId));
+    const size_t byteOffset = targetFrame.StackBase + exec->TmpFrameOffsets[tmpIdx];
+    assert(byteOffset + size <= Runtime.Stack.size());
+    char* temp = Runtime.Stack.data() + byteOffset;
+    if (src) {
+        std::memcpy(temp, src, size);
+    } else {
+        std::memset(temp, 0, size);
+    }
+    return reinterpret_cast<int64_t>(temp);
+}
+
+// With threaded dispatch every handler ends by jumping straight to the handler
+// of the next instruction. Otherwise VM_NEXT() goes back to the switch.
+#ifdef QUMIR_VM_THREADED
+#define VM_CASE(op) case EVMOp::op: L_##op
+#define VM_DEFAULT default: L_Unknown
+#define VM_NEXT() do { instr = pc++; goto *DispatchTable[static_cast<uint8_t>(instr->Op)]; } while (false)
+#else
+#define VM_CASE(op) case EVMOp::op
+#define VM_DEFAULT default
+#define VM_NEXT() continue
+#endif
+
+// Stays exhausted once it hits zero, so later Evals fail too.
+#define BURN_FUEL() \
+        do { \
+            if (Fuel == 0) [[unlikely]] { \
+                throw std::runtime_error("instruction budget exhausted"); \
+            } \
+            --Fuel; \
+        } while (false)
+
+#define VM_BINARY(op, T, fn) \
+        VM_CASE(op): \
+            regs[instr->A] = EvalAlu<T>(regs[instr->B], regs[instr->C], fn); \
+            VM_NEXT(); \
+        VM_CASE(op##RI): \
+            regs[instr->A] = EvalAlu<T>(regs[instr->B], consts[instr->C], fn); \
+            VM_NEXT(); \
+        VM_CASE(op##IR): \
+            regs[instr->A] = EvalAlu<T>(consts[instr->B], regs[instr->C], fn); \
+            VM_NEXT();
+
+bool TInterpreter::Execute(TExecState* state) {
+#ifdef QUMIR_VM_THREADED
+    if (!state) {
+        DispatchTable.fill(&&L_Unknown);
+#define VM_REGISTER_HANDLER(op) DispatchTable[static_cast<size_t>(EVMOp::op)] = &&L_##op;
+#define VM_REGISTER_BINARY(op) VM_REGISTER_HANDLER(op) VM_REGISTER_HANDLER(op##RI) VM_REGISTER_HANDLER(op##IR)
+        QUMIR_VM_BINARY_OPS(VM_REGISTER_BINARY)
+        QUMIR_VM_HANDLED_OPS(VM_REGISTER_HANDLER)
+#undef VM_REGISTER_BINARY
+#undef VM_REGISTER_HANDLER
+        return true;
+    }
+#else
+    if (!state) {
+        return true;
+    }
+#endif
+
+    auto& callStack = state->CallStack;
+    TFrame* frame = &callStack.back();
+    TVMInstr* pc = frame->PC;
+    int64_t* regs = Runtime.Regs.get() + frame->RegBase;
+    __int128_t* regs128 = Runtime.Regs128.get() + frame->RegBase;
+    const int64_t* consts = frame->Exec->Consts.data();
+    TVMInstr* instr = nullptr;
+
+    for (;;) {
+        instr = pc++;
+#ifdef QUMIR_VM_THREADED
+        goto *DispatchTable[static_cast<uint8_t>(instr->Op)];
+#endif
+        switch (instr->Op) {
+        VM_BINARY(IAdd, int64_t, std::plus<int64_t>{})
+        VM_BINARY(ISub, int64_t, std::minus<int64_t>{})
+        VM_BINARY(IMulS, int64_t, std::multiplies<int64_t>{})
+        VM_BINARY(IMulU, uint64_t, std::multiplies<uint64_t>{})
+        VM_BINARY(IDivS, int64_t, std::divides<int64_t>{})
+        VM_BINARY(IDivU, uint64_t, std::divides<uint64_t>{})
+        VM_BINARY(IRemS, int64_t, std::modulus<int64_t>{})
+        VM_BINARY(IRemU, uint64_t, std::modulus<uint64_t>{})
+        VM_BINARY(IAnd, int64_t, std::bit_and<int64_t>{})
+        VM_BINARY(IOr, int64_t, std::bit_or<int64_t>{})
+        VM_BINARY(IXor, int64_t, std::bit_xor<int64_t>{})
+        VM_BINARY(IShl, uint64_t, [](uint64_t lhs, uint64_t rhs) { return lhs << (rhs & 63); })
+        VM_BINARY(IShrS, int64_t, [](int64_t lhs, int64_t rhs) { return lhs >> (rhs & 63); })
+        VM_BINARY(IShrU, uint64_t, [](uint64_t lhs, uint64_t rhs) { return lhs >> (rhs & 63); })
+        VM_BINARY(ICmpLTS, int64_t, std::less<int64_t>{})
+        VM_BINARY(ICmpLTU, uint64_t, std::less<uint64_t>{})
+        VM_BINARY(ICmpGTS, int64_t, std::greater<int64_t>{})
+        VM_BINARY(ICmpGTU, uint64_t, std::greater<uint64_t>{})
+        VM_BINARY(ICmpLES, int64_t, std::less_equal<int64_t>{})
+        VM_BINARY(ICmpLEU, uint64_t, std::less_equal<uint64_t>{})
+        VM_BINARY(ICmpGES, int64_t, std::greater_equal<int64_t>{})
+        VM_BINARY(ICmpGEU, uint64_t, std::greater_equal<uint64_t>{})
+        VM_BINARY(ICmpEQ, int64_t, std::equal_to<int64_t>{})
+        VM_BINARY(ICmpNE, int64_t, std::not_equal_to<int64_t>{})
+        VM_BINARY(FAdd, double, std::plus<double>{})
+        VM_BINARY(FSub, double, std::minus<double>{})
+        VM_BINARY(FMul, double, std::multiplies<double>{})
+        VM_BINARY(FDiv, double, std::divides<double>{})
+        VM_BINARY(FCmpLT, double, std::less<double>{})
+        VM_BINARY(FCmpGT, double, std::greater<double>{})
+        VM_BINARY(FCmpLE, double, std::less_equal<double>{})
+        VM_BINARY(FCmpGE, double, std::greater_equal<double>{})
+        VM_BINARY(FCmpEQ, double, std::equal_to<double>{})
+        VM_BINARY(FCmpNE, double, std::not_equal_to<double>{})
+
+        VM_CASE(StructStore): { // A = frame byte offset, B = src pointer, C = size
+            void* dst = Runtime.Stack.data() + frame->StackBase + instr->A;
+            void* src = reinterpret_cast<void*>(regs[instr->B]);
+            std::memcpy(dst, src, static_cast<size_t>(instr->C));
+            VM_NEXT();
+        }
+        VM_CASE(Copy): { // A/B are pointers, C is size
+            void* dst = reinterpret_cast<void*>(regs[instr->A]);
+            void* src = reinterpret_cast<void*>(regs[instr->B]);
+            std::memcpy(dst, src, static_cast<size_t>(instr->C));
+            VM_NEXT();
+        }
+        VM_CASE(SAlloc): {
+            const size_t byteOffset = frame->StackBase + instr->B;
+            const size_t size = static_cast<size_t>(instr->C);
             assert(byteOffset + size <= Runtime.Stack.size());
             char* addrPtr = Runtime.Stack.data() + byteOffset;
             std::memset(addrPtr, 0, size);
-            int64_t addr = reinterpret_cast<int64_t>(addrPtr);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = addr;
-            break;
+            regs[instr->A] = reinterpret_cast<int64_t>(addrPtr);
+            VM_NEXT();
         }
-        case EVMOp::Ste: {
-            int64_t intAddr = ReadOperand<int64_t>(Runtime.Regs, instr.Operands[0]);
-            void* addr = reinterpret_cast<void*>(intAddr);
-            int64_t value = ReadOperand<int64_t>(Runtime.Regs, instr.Operands[1]);
-            size_t size = static_cast<size_t>(instr.Operands[2].Imm.Value);
+        VM_CASE(BoundsCheck):
+            // A negative index wraps to a huge unsigned one, so one compare covers both ends.
+            if (static_cast<uint64_t>(regs[instr->A]) >= static_cast<uint64_t>(regs[instr->B])) [[unlikely]] {
+                throw std::runtime_error("array index out of bounds");
+            }
+            VM_NEXT();
+        VM_CASE(Ste): {
+            void* addr = reinterpret_cast<void*>(regs[instr->A]);
+            int64_t value = regs[instr->B];
+            size_t size = static_cast<size_t>(instr->C);
             if (size == 0 || size > sizeof(int64_t)) {
                 size = sizeof(int64_t);
             }
-            //std::cerr << "ste addr " << std::hex << addr << std::dec << " = " << value << "\n";
             std::memcpy(addr, &value, size);
-            break;
+            VM_NEXT();
         }
-        case EVMOp::Lde: {
-            int64_t intAddr = ReadOperand<int64_t>(Runtime.Regs, instr.Operands[1]);
-            void* addr = reinterpret_cast<void*>(intAddr);
+        VM_CASE(Lde): {
+            void* addr = reinterpret_cast<void*>(regs[instr->B]);
             int64_t value = 0;
-            size_t size = static_cast<size_t>(instr.Operands[2].Imm.Value);
+            size_t size = static_cast<size_t>(instr->C);
             if (size == 0 || size > sizeof(int64_t)) {
                 size = sizeof(int64_t);
             }
             std::memcpy(&value, addr, size);
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = value;
-            break;
-        }
-        case EVMOp::Lea: {
-            // load addr of local or slot operand
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            if (instr.Operands[1].Type == TVMOperand::EType::Slot) {
-                const auto& s = instr.Operands[1].Slot;
-                const size_t byteOffset = s.Idx * 8;
-                assert(s.Idx >= 0 && byteOffset < Runtime.Globals.size());
-                int64_t addr = reinterpret_cast<int64_t>(Runtime.Globals.data() + byteOffset);
-                Runtime.Regs[instr.Operands[0].Tmp.Idx] = addr;
-            } else if (instr.Operands[1].Type == TVMOperand::EType::Local) {
-                const auto& l = instr.Operands[1].Local;
-                const size_t byteOffset = frame.StackBase + l.Idx; // l.Idx is byte offset from vmcompiler
-                assert(l.Idx >= 0 && byteOffset < Runtime.Stack.size());
-                int64_t addr = reinterpret_cast<int64_t>(Runtime.Stack.data() + byteOffset);
-                Runtime.Regs[instr.Operands[0].Tmp.Idx] = addr;
-            } else {
-                assert(false && "Invalid operand for lea");
+            regs[instr->A] = value;
+            VM_NEXT();
+        }
+        VM_CASE(Lea): {
+            const size_t byteOffset = frame->StackBase + instr->B; // B is byte offset from vmcompiler
+            assert(instr->B >= 0 && byteOffset < Runtime.Stack.size());
+            regs[instr->A] = reinterpret_cast<int64_t>(Runtime.Stack.data() + byteOffset);
+            VM_NEXT();
+        }
+        VM_CASE(LeaG): {
+            const size_t byteOffset = instr->B * 8;
+            assert(instr->B >= 0 && byteOffset < Runtime.Globals.size());
+            regs[instr->A] = reinterpret_cast<int64_t>(Runtime.Globals.data() + byteOffset);
+            VM_NEXT();
+        }
+        VM_CASE(Load64): {
+            const size_t byteOffset = frame->StackBase + instr->B;
+            assert(instr->B >= 0 && byteOffset + 8 <= Runtime.Stack.size());
+            std::memcpy(&regs[instr->A], Runtime.Stack.data() + byteOffset, 8);
+            VM_NEXT();
+        }
+        VM_CASE(Load64G): {
+            const size_t byteOffset = instr->B * 8;
+            assert(instr->B >= 0 && byteOffset + 8 <= Runtime.Globals.size());
+            std::memcpy(&regs[instr->A], Runtime.Globals.data() + byteOffset, 8);
+            VM_NEXT();
+        }
+        VM_CASE(Store64): {
+            const size_t byteOffset = frame->StackBase + instr->A;
+            assert(instr->A >= 0 && byteOffset + 8 <= Runtime.Stack.size());
+            std::memcpy(Runtime.Stack.data() + byteOffset, &regs[instr->B], 8);
+            VM_NEXT();
+        }
+        VM_CASE(Store64G): {
+            // TODO:
+            const size_t byteOffset = instr->A * 8;
+            if (byteOffset + 8 > Runtime.Globals.size()) {
+                Runtime.Globals.resize(byteOffset + 8, 0);
             }
-            break;
-        }
-        case EVMOp::Load64: {
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            if (instr.Operands[1].Type == TVMOperand::EType::Slot) {
-                const auto& s = instr.Operands[1].Slot;
-                const size_t byteOffset = s.Idx * 8;
-                assert(s.Idx >= 0 && byteOffset + 8 <= Runtime.Globals.size());
-                int64_t value;
-                std::memcpy(&value, Runtime.Globals.data() + byteOffset, 8);
-                Runtime.Regs[instr.Operands[0].Tmp.Idx] = value;
-            } else if (instr.Operands[1].Type == TVMOperand::EType::Local) {
-                const auto& l = instr.Operands[1].Local;
-                const size_t byteOffset = frame.StackBase + l.Idx; // l.Idx is byte offset
-                assert(l.Idx >= 0 && byteOffset + 8 <= Runtime.Stack.size());
-                int64_t value;
-                std::memcpy(&value, Runtime.Stack.data() + byteOffset, 8);
-                Runtime.Regs[instr.Operands[0].Tmp.Idx] = value;
-            } else {
-                assert(false && "Invalid operand for load");
+            std::memcpy(Runtime.Globals.data() + byteOffset, &regs[instr->B], 8);
+            VM_NEXT();
+        }
+
+        VM_CASE(INeg):
+            regs[instr->A] = -regs[instr->B];
+            VM_NEXT();
+        VM_CASE(FNeg):
+            regs[instr->A] = std::bit_cast<int64_t>(-std::bit_cast<double>(regs[instr->B]));
+            VM_NEXT();
+        VM_CASE(INot):
+            regs[instr->A] = !regs[instr->B];
+            VM_NEXT();
+        VM_CASE(IBitNot):
+            regs[instr->A] = ~regs[instr->B];
+            VM_NEXT();
+
+        VM_CASE(Mov):
+        VM_CASE(Bitcast):
+            regs[instr->A] = regs[instr->B];
+            VM_NEXT();
+        VM_CASE(Cmov):
+            regs[instr->A] = consts[instr->B];
+            VM_NEXT();
+        VM_CASE(I2F):
+            regs[instr->A] = std::bit_cast<int64_t>(static_cast<double>(regs[instr->B]));
+            VM_NEXT();
+        VM_CASE(F2I):
+            regs[instr->A] = static_cast<int64_t>(std::bit_cast<double>(regs[instr->B]));
+            VM_NEXT();
+
+        VM_CASE(INeg128):
+            regs128[instr->A] = -regs128[instr->B];
+            VM_NEXT();
+        VM_CASE(IBitNot128):
+            regs128[instr->A] = ~regs128[instr->B];
+            VM_NEXT();
+        VM_CASE(INot128):
+            regs[instr->A] = !regs128[instr->B];
+            VM_NEXT();
+        VM_CASE(I2B128):
+            regs[instr->A] = regs128[instr->B] != 0;
+            VM_NEXT();
+        VM_CASE(IAdd128):
+            regs128[instr->A] = Alu128(regs128, *instr, std::plus<__int128_t>{});
+            VM_NEXT();
+        VM_CASE(ISub128):
+            regs128[instr->A] = Alu128(regs128, *instr, std::minus<__int128_t>{});
+            VM_NEXT();
+        VM_CASE(IMul128):
+            regs128[instr->A] = Alu128(regs128, *instr, std::multiplies<__int128_t>{});
+            VM_NEXT();
+        VM_CASE(IDivS128):
+            regs128[instr->A] = Alu128(regs128, *instr, std::divides<__int128_t>{});
+            VM_NEXT();
+        VM_CASE(IDivU128):
+            regs128[instr->A] = std::bit_cast<__int128_t>(
+                AluU128(regs128, *instr, std::divides<__uint128_t>{}));
+            VM_NEXT();
+        VM_CASE(IRemS128):
+            regs128[instr->A] = Alu128(regs128, *instr, std::modulus<__int128_t>{});
+            VM_NEXT();
+        VM_CASE(IRemU128):
+            regs128[instr->A] = std::bit_cast<__int128_t>(
+                AluU128(regs128, *instr, std::modulus<__uint128_t>{}));
+            VM_NEXT();
+        VM_CASE(IAnd128):
+            regs128[instr->A] = Alu128(regs128, *instr, std::bit_and<__int128_t>{});
+            VM_NEXT();
+        VM_CASE(IOr128):
+            regs128[instr->A] = Alu128(regs128, *instr, std::bit_or<__int128_t>{});
+            VM_NEXT();
+        VM_CASE(IXor128):
+            regs128[instr->A] = Alu128(regs128, *instr, std::bit_xor<__int128_t>{});
+            VM_NEXT();
+        VM_CASE(IShl128): {
+            auto lhs = std::bit_cast<__uint128_t>(regs128[instr->B]);
+            auto rhs = static_cast<unsigned>(regs128[instr->C]) & 127u;
+            regs128[instr->A] = std::bit_cast<__int128_t>(lhs << rhs);
+            VM_NEXT();
+        }
+        VM_CASE(IShrS128): {
+            auto lhs = regs128[instr->B];
+            auto rhs = static_cast<unsigned>(regs128[instr->C]) & 127u;
+            regs128[instr->A] = lhs >> rhs;
+            VM_NEXT();
+        }
+        VM_CASE(IShrU128): {
+            auto lhs = std::bit_cast<__uint128_t>(regs128[instr->B]);
+            auto rhs = static_cast<unsigned>(regs128[instr->C]) & 127u;
+            regs128[instr->A] = std::bit_cast<__int128_t>(lhs >> rhs);
+            VM_NEXT();
+        }
+        VM_CASE(ICmpLTS128):
+            regs[instr->A] = Alu128(regs128, *instr, std::less<__int128_t>{});
+            VM_NEXT();
+        VM_CASE(ICmpLTU128):
+            regs[instr->A] = AluU128(regs128, *instr, std::less<__uint128_t>{});
+            VM_NEXT();
+        VM_CASE(ICmpGTS128):
+            regs[instr->A] = Alu128(regs128, *instr, std::greater<__int128_t>{});
+            VM_NEXT();
+        VM_CASE(ICmpGTU128):
+            regs[instr->A] = AluU128(regs128, *instr, std::greater<__uint128_t>{});
+            VM_NEXT();
+        VM_CASE(ICmpLES128):
+            regs[instr->A] = Alu128(regs128, *instr, std::less_equal<__int128_t>{});
+            VM_NEXT();
+        VM_CASE(ICmpLEU128):
+            regs[instr->A] = AluU128(regs128, *instr, std::less_equal<__uint128_t>{});
+            VM_NEXT();
+        VM_CASE(ICmpGES128):
+            regs[instr->A] = Alu128(regs128, *instr, std::greater_equal<__int128_t>{});
+            VM_NEXT();
+        VM_CASE(ICmpGEU128):
+            regs[instr->A] = AluU128(regs128, *instr, std::greater_equal<__uint128_t>{});
+            VM_NEXT();
+        VM_CASE(ICmpEQ128):
+            regs[instr->A] = Alu128(regs128, *instr, std::equal_to<__int128_t>{});
+            VM_NEXT();
+        VM_CASE(ICmpNE128):
+            regs[instr->A] = Alu128(regs128, *instr, std::not_equal_to<__int128_t>{});
+            VM_NEXT();
+
+        VM_CASE(CmovS128):
+            regs128[instr->A] = static_cast<__int128_t>(consts[instr->B]);
+            VM_NEXT();
+        VM_CASE(CmovU128):
+            regs128[instr->A] = std::bit_cast<__int128_t>(
+                static_cast<__uint128_t>(std::bit_cast<uint64_t>(consts[instr->B])));
+            VM_NEXT();
+        VM_CASE(SExt128):
+            regs128[instr->A] = static_cast<__int128_t>(regs[instr->B]);
+            VM_NEXT();
+        VM_CASE(ZExt128):
+            regs128[instr->A] = std::bit_cast<__int128_t>(
+                static_cast<__uint128_t>(std::bit_cast<uint64_t>(regs[instr->B])));
+            VM_NEXT();
+        VM_CASE(Mov128):
+            regs128[instr->A] = regs128[instr->B];
+            VM_NEXT();
+        VM_CASE(Trunc128):
+            regs[instr->A] = static_cast<int64_t>(regs128[instr->B]);
+            VM_NEXT();
+        VM_CASE(I2F128S):
+            regs[instr->A] = std::bit_cast<int64_t>(static_cast<double>(regs128[instr->B]));
+            VM_NEXT();
+        VM_CASE(I2F128U):
+            regs[instr->A] = std::bit_cast<int64_t>(
+                static_cast<double>(std::bit_cast<__uint128_t>(regs128[instr->B])));
+            VM_NEXT();
+        VM_CASE(F2I128):
+            regs128[instr->A] = static_cast<__int128_t>(std::bit_cast<double>(regs[instr->B]));
+            VM_NEXT();
+        VM_CASE(Load128): {
+            const size_t byteOffset = frame->StackBase + instr->B;
+            std::memcpy(&regs128[instr->A], Runtime.Stack.data() + byteOffset, 16);
+            VM_NEXT();
+        }
+        VM_CASE(Load128G):
+            std::memcpy(&regs128[instr->A], Runtime.Globals.data() + instr->B * 8, 16);
+            VM_NEXT();
+        VM_CASE(Store128): {
+            const size_t byteOffset = frame->StackBase + instr->A;
+            assert(byteOffset + 16 <= Runtime.Stack.size());
+            std::memcpy(Runtime.Stack.data() + byteOffset, &regs128[instr->B], 16);
+            VM_NEXT();
+        }
+        VM_CASE(Store128G): {
+            const size_t byteOffset = static_cast<size_t>(instr->A) * 8;
+            if (byteOffset + 16 > Runtime.Globals.size()) {
+                Runtime.Globals.resize(byteOffset + 16, 0);
             }
-            break;
-        }
-        case EVMOp::Store64: {
-            int64_t val = ReadOperand(Runtime.Regs, instr.Operands[1]);
-            if (instr.Operands[0].Type == TVMOperand::EType::Slot) {
-                // TODO:
-                const auto& s = instr.Operands[0].Slot;
-                const size_t byteOffset = s.Idx * 8;
-                if (byteOffset + 8 > Runtime.Globals.size()) {
-                    Runtime.Globals.resize(byteOffset + 8, 0);
-                }
-                std::memcpy(Runtime.Globals.data() + byteOffset, &val, 8);
-            } else if (instr.Operands[0].Type == TVMOperand::EType::Local) {
-                const auto& l = instr.Operands[0].Local;
-                const size_t byteOffset = frame.StackBase + l.Idx; // l.Idx is byte offset
-                assert(l.Idx >= 0 && byteOffset + 8 <= Runtime.Stack.size());
-                std::memcpy(Runtime.Stack.data() + byteOffset, &val, 8);
-            } else {
-                assert(false && "Invalid operand for store");
-            }
-            break;
-        }
-
-        case EVMOp::INeg:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = -ReadOperand(Runtime.Regs, instr.Operands[1]);
-            break;
-        case EVMOp::FNeg: {
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            double tmp = ReadOperand<double>(Runtime.Regs, instr.Operands[1]);
-            tmp = -tmp;
-            std::memcpy(&Runtime.Regs[instr.Operands[0].Tmp.Idx], &tmp, sizeof(double));
-            break;
-        }
-        case EVMOp::INot:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = !ReadOperand(Runtime.Regs, instr.Operands[1]);
-            break;
-        case EVMOp::IBitNot: {
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            auto value = ReadOperand<uint64_t>(Runtime.Regs, instr.Operands[1]);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = std::bit_cast<int64_t>(~value);
-            break;
-        }
-
-        case EVMOp::IAdd:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<int64_t>(Runtime.Regs, instr, std::plus<int64_t>{});
-            break;
-        case EVMOp::FAdd:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<double>(Runtime.Regs, instr, std::plus<double>{});
-            break;
-
-        case EVMOp::ISub:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<int64_t>(Runtime.Regs, instr, std::minus<int64_t>{});
-            break;
-        case EVMOp::FSub:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<double>(Runtime.Regs, instr, std::minus<double>{});
-            break;
-
-        case EVMOp::IMulS:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<int64_t>(Runtime.Regs, instr, std::multiplies<int64_t>{});
-            break;
-        case EVMOp::IMulU:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<uint64_t>(Runtime.Regs, instr, std::multiplies<uint64_t>{});
-            break;
-        case EVMOp::FMul:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<double>(Runtime.Regs, instr, std::multiplies<double>{});
-            break;
-
-        case EVMOp::IDivS:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<int64_t>(Runtime.Regs, instr, std::divides<int64_t>{});
-            break;
-        case EVMOp::IDivU:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<uint64_t>(Runtime.Regs, instr, std::divides<uint64_t>{});
-            break;
-        case EVMOp::IRemS:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<int64_t>(Runtime.Regs, instr, std::modulus<int64_t>{});
-            break;
-        case EVMOp::IRemU:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<uint64_t>(Runtime.Regs, instr, std::modulus<uint64_t>{});
-            break;
-        case EVMOp::FDiv:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<double>(Runtime.Regs, instr, std::divides<double>{});
-            break;
-
-        case EVMOp::IAnd:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<int64_t>(Runtime.Regs, instr, std::bit_and<int64_t>{});
-            break;
-        case EVMOp::IOr:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<int64_t>(Runtime.Regs, instr, std::bit_or<int64_t>{});
-            break;
-        case EVMOp::IXor:
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<int64_t>(Runtime.Regs, instr, std::bit_xor<int64_t>{});
-            break;
-        case EVMOp::IShl: {
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            auto lhs = ReadOperand<uint64_t>(Runtime.Regs, instr.Operands[1]);
-            auto rhs = ReadOperand<uint64_t>(Runtime.Regs, instr.Operands[2]) & 63;
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = std::bit_cast<int64_t>(lhs << rhs);
-            break;
-        }
-        case EVMOp::IShrS: {
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            auto lhs = ReadOperand<int64_t>(Runtime.Regs, instr.Operands[1]);
-            auto rhs = ReadOperand<uint64_t>(Runtime.Regs, instr.Operands[2]) & 63;
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = lhs >> rhs;
-            break;
-        }
-        case EVMOp::IShrU: {
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            auto lhs = ReadOperand<uint64_t>(Runtime.Regs, instr.Operands[1]);
-            auto rhs = ReadOperand<uint64_t>(Runtime.Regs, instr.Operands[2]) & 63;
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = std::bit_cast<int64_t>(lhs >> rhs);
-            break;
-        }
-
-        case EVMOp::ICmpLTS: // <
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<int64_t>(Runtime.Regs, instr, std::less<int64_t>{});
-            break;
-        case EVMOp::ICmpLTU: // <
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<uint64_t>(Runtime.Regs, instr, std::less<uint64_t>{});
-            break;
-        case EVMOp::FCmpLT: // <
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<double>(Runtime.Regs, instr, std::less<double>{});
-            break;
-
-        case EVMOp::ICmpGTS: // >
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<int64_t>(Runtime.Regs, instr, std::greater<int64_t>{});
-            break;
-        case EVMOp::ICmpGTU: // >
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<uint64_t>(Runtime.Regs, instr, std::greater<uint64_t>{});
-            break;
-        case EVMOp::FCmpGT: // >
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<double>(Runtime.Regs, instr, std::greater<double>{});
-            break;
-
-        case EVMOp::ICmpLES: // <=
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<int64_t>(Runtime.Regs, instr, std::less_equal<int64_t>{});
-            break;
-        case EVMOp::ICmpLEU: // <=
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<uint64_t>(Runtime.Regs, instr, std::less_equal<uint64_t>{});
-            break;
-        case EVMOp::FCmpLE: // <=
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<double>(Runtime.Regs, instr, std::less_equal<double>{});
-            break;
-
-        case EVMOp::ICmpGES: // >=
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<int64_t>(Runtime.Regs, instr, std::greater_equal<int64_t>{});
-            break;
-        case EVMOp::ICmpGEU: // >=
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<uint64_t>(Runtime.Regs, instr, std::greater_equal<uint64_t>{});
-            break;
-        case EVMOp::FCmpGE: // >=
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<double>(Runtime.Regs, instr, std::greater_equal<double>{});
-            break;
-
-        case EVMOp::ICmpEQ: // ==
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<int64_t>(Runtime.Regs, instr, std::equal_to<int64_t>{});
-            break;
-        case EVMOp::FCmpEQ: // ==
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<double>(Runtime.Regs, instr, std::equal_to<double>{});
-            break;
-
-        case EVMOp::ICmpNE: // !=
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<int64_t>(Runtime.Regs, instr, std::not_equal_to<int64_t>{});
-            break;
-        case EVMOp::FCmpNE: // !=
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = EvalAlu<double>(Runtime.Regs, instr, std::not_equal_to<double>{});
-            break;
-
-        case EVMOp::Cmov:
-            // TODO: dont use ReadOperand
-        case EVMOp::Mov: {
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            int64_t val = ReadOperand(Runtime.Regs, instr.Operands[1]);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = val;
-            break;
-        }
-        case EVMOp::Bitcast: {
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = ReadOperand(
-                Runtime.Regs,
-                instr.Operands[1]);
-            break;
-        }
-        case EVMOp::I2F: {
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            int64_t ival = ReadOperand<int64_t>(Runtime.Regs, instr.Operands[1]);
-            double fval = static_cast<double>(ival);
-            int64_t ret = 0;
-            std::memcpy(&ret, &fval, sizeof(fval));
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = ret;
-            break;
-        }
-        case EVMOp::F2I: {
-            assert(instr.Operands[0].Tmp.Idx >= 0);
-            double fval = ReadOperand<double>(Runtime.Regs, instr.Operands[1]);
-            int64_t ival = static_cast<int64_t>(fval);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = ival;
-            break;
-        }
-
-        case EVMOp::INeg128:
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = -ReadOperand128(Runtime.Regs128, instr.Operands[1]);
-            break;
-        case EVMOp::IBitNot128:
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = ~ReadOperand128(Runtime.Regs128, instr.Operands[1]);
-            break;
-        case EVMOp::INot128:
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = !ReadOperand128(Runtime.Regs128, instr.Operands[1]);
-            break;
-        case EVMOp::I2B128:
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = ReadOperand128(Runtime.Regs128, instr.Operands[1]) != 0;
-            break;
-        case EVMOp::IAdd128:
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = Alu128(Runtime.Regs128, instr, std::plus<__int128_t>{});
-            break;
-        case EVMOp::ISub128:
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = Alu128(Runtime.Regs128, instr, std::minus<__int128_t>{});
-            break;
-        case EVMOp::IMul128:
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = Alu128(Runtime.Regs128, instr, std::multiplies<__int128_t>{});
-            break;
-        case EVMOp::IDivS128:
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = Alu128(Runtime.Regs128, instr, std::divides<__int128_t>{});
-            break;
-        case EVMOp::IDivU128:
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = std::bit_cast<__int128_t>(
-                AluU128(Runtime.Regs128, instr, std::divides<__uint128_t>{}));
-            break;
-        case EVMOp::IRemS128:
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = Alu128(Runtime.Regs128, instr, std::modulus<__int128_t>{});
-            break;
-        case EVMOp::IRemU128:
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = std::bit_cast<__int128_t>(
-                AluU128(Runtime.Regs128, instr, std::modulus<__uint128_t>{}));
-            break;
-        case EVMOp::IAnd128:
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = Alu128(Runtime.Regs128, instr, std::bit_and<__int128_t>{});
-            break;
-        case EVMOp::IOr128:
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = Alu128(Runtime.Regs128, instr, std::bit_or<__int128_t>{});
-            break;
-        case EVMOp::IXor128:
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = Alu128(Runtime.Regs128, instr, std::bit_xor<__int128_t>{});
-            break;
-        case EVMOp::IShl128: {
-            auto lhs = std::bit_cast<__uint128_t>(ReadOperand128(Runtime.Regs128, instr.Operands[1]));
-            auto rhs = static_cast<unsigned>(ReadOperand128(Runtime.Regs128, instr.Operands[2])) & 127u;
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = std::bit_cast<__int128_t>(lhs << rhs);
-            break;
-        }
-        case EVMOp::IShrS128: {
-            auto lhs = ReadOperand128(Runtime.Regs128, instr.Operands[1]);
-            auto rhs = static_cast<unsigned>(ReadOperand128(Runtime.Regs128, instr.Operands[2])) & 127u;
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = lhs >> rhs;
-            break;
-        }
-        case EVMOp::IShrU128: {
-            auto lhs = std::bit_cast<__uint128_t>(ReadOperand128(Runtime.Regs128, instr.Operands[1]));
-            auto rhs = static_cast<unsigned>(ReadOperand128(Runtime.Regs128, instr.Operands[2])) & 127u;
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = std::bit_cast<__int128_t>(lhs >> rhs);
-            break;
-        }
-        case EVMOp::ICmpLTS128:
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = Alu128(Runtime.Regs128, instr, std::less<__int128_t>{});
-            break;
-        case EVMOp::ICmpLTU128:
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = AluU128(Runtime.Regs128, instr, std::less<__uint128_t>{});
-            break;
-        case EVMOp::ICmpGTS128:
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = Alu128(Runtime.Regs128, instr, std::greater<__int128_t>{});
-            break;
-        case EVMOp::ICmpGTU128:
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = AluU128(Runtime.Regs128, instr, std::greater<__uint128_t>{});
-            break;
-        case EVMOp::ICmpLES128:
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = Alu128(Runtime.Regs128, instr, std::less_equal<__int128_t>{});
-            break;
-        case EVMOp::ICmpLEU128:
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = AluU128(Runtime.Regs128, instr, std::less_equal<__uint128_t>{});
-            break;
-        case EVMOp::ICmpGES128:
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = Alu128(Runtime.Regs128, instr, std::greater_equal<__int128_t>{});
-            break;
-        case EVMOp::ICmpGEU128:
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = AluU128(Runtime.Regs128, instr, std::greater_equal<__uint128_t>{});
-            break;
-        case EVMOp::ICmpEQ128:
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = Alu128(Runtime.Regs128, instr, std::equal_to<__int128_t>{});
-            break;
-        case EVMOp::ICmpNE128:
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = Alu128(Runtime.Regs128, instr, std::not_equal_to<__int128_t>{});
-            break;
-
-        case EVMOp::CmovS128:
-        case EVMOp::SExt128:
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] =
-                static_cast<__int128_t>(ReadOperand<int64_t>(Runtime.Regs, instr.Operands[1]));
-            break;
-        case EVMOp::CmovU128:
-        case EVMOp::ZExt128:
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = std::bit_cast<__int128_t>(
-                static_cast<__uint128_t>(ReadOperand<uint64_t>(Runtime.Regs, instr.Operands[1])));
-            break;
-        case EVMOp::Mov128:
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = ReadOperand128(Runtime.Regs128, instr.Operands[1]);
-            break;
-        case EVMOp::Trunc128:
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] =
-                static_cast<int64_t>(ReadOperand128(Runtime.Regs128, instr.Operands[1]));
-            break;
-        case EVMOp::I2F128S: {
-            double fval = static_cast<double>(ReadOperand128(Runtime.Regs128, instr.Operands[1]));
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = std::bit_cast<int64_t>(fval);
-            break;
-        }
-        case EVMOp::I2F128U: {
-            double fval = static_cast<double>(
-                std::bit_cast<__uint128_t>(ReadOperand128(Runtime.Regs128, instr.Operands[1])));
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = std::bit_cast<int64_t>(fval);
-            break;
-        }
-        case EVMOp::F2I128: {
-            double fval = ReadOperand<double>(Runtime.Regs, instr.Operands[1]);
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = static_cast<__int128_t>(fval);
-            break;
-        }
-        case EVMOp::Load128: {
-            const size_t byteOffset = instr.Operands[1].Type == TVMOperand::EType::Slot
-                ? static_cast<size_t>(instr.Operands[1].Slot.Idx) * 8
-                : frame.StackBase + instr.Operands[1].Local.Idx;
-            const char* base = instr.Operands[1].Type == TVMOperand::EType::Slot
-                ? Runtime.Globals.data()
-                : Runtime.Stack.data();
-            __int128_t value = 0;
-            std::memcpy(&value, base + byteOffset, 16);
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = value;
-            break;
-        }
-        case EVMOp::Store128: {
-            __int128_t value = ReadOperand128(Runtime.Regs128, instr.Operands[1]);
-            if (instr.Operands[0].Type == TVMOperand::EType::Slot) {
-                const size_t byteOffset = static_cast<size_t>(instr.Operands[0].Slot.Idx) * 8;
-                if (byteOffset + 16 > Runtime.Globals.size()) {
-                    Runtime.Globals.resize(byteOffset + 16, 0);
+            std::memcpy(Runtime.Globals.data() + byteOffset, &regs128[instr->B], 16);
+            VM_NEXT();
+        }
+        VM_CASE(Lde128):
+            std::memcpy(&regs128[instr->A], reinterpret_cast<void*>(regs[instr->B]), 16);
+            VM_NEXT();
+        VM_CASE(Ste128):
+            std::memcpy(reinterpret_cast<void*>(regs[instr->A]), &regs128[instr->B], 16);
+            VM_NEXT();
+        VM_CASE(ArgTmp128):
+            regs[instr->B] = 0;
+            regs128[instr->B] = regs128[instr->A];
+            VM_NEXT();
+
+        // Backward jumps close loops: they burn fuel and count towards the
+        // function's hotness.
+        VM_CASE(Jmp):
+            pc = instr + instr->A;
+            if (instr->A <= 0) {
+                BURN_FUEL();
+                if (NativeTier) {
+                    ++frame->Exec->Hotness;
                 }
-                std::memcpy(Runtime.Globals.data() + byteOffset, &value, 16);
-            } else {
-                const size_t byteOffset = frame.StackBase + instr.Operands[0].Local.Idx;
-                assert(byteOffset + 16 <= Runtime.Stack.size());
-                std::memcpy(Runtime.Stack.data() + byteOffset, &value, 16);
             }
-            break;
-        }
-        case EVMOp::Lde128: {
-            void* addr = reinterpret_cast<void*>(ReadOperand<int64_t>(Runtime.Regs, instr.Operands[1]));
-            __int128_t value = 0;
-            std::memcpy(&value, addr, 16);
-            Runtime.Regs128[instr.Operands[0].Tmp.Idx] = value;
-            break;
-        }
-        case EVMOp::Ste128: {
-            void* addr = reinterpret_cast<void*>(ReadOperand<int64_t>(Runtime.Regs, instr.Operands[0]));
-            __int128_t value = ReadOperand128(Runtime.Regs128, instr.Operands[1]);
-            std::memcpy(addr, &value, 16);
-            break;
-        }
-        case EVMOp::ArgTmp128: {
-            Runtime.Args.push_back(0);
-            Runtime.Args128.push_back(ReadOperand128(Runtime.Regs128, instr.Operands[0]));
-            break;
-        }
-
-        case EVMOp::Jmp: {
-            assert(instr.Operands[0].Type == TVMOperand::EType::Imm);
-            frame.PC = reinterpret_cast<TVMInstr*>(instr.Operands[0].Imm.Value);
-            break;
-        }
-        case EVMOp::Cmp: {
-            int64_t cmp = ReadOperand(Runtime.Regs, instr.Operands[0]);
-            assert(instr.Operands[1].Type == TVMOperand::EType::Imm);
-            assert(instr.Operands[2].Type == TVMOperand::EType::Imm);
-            int64_t trueLabel = instr.Operands[1].Imm.Value;
-            int64_t falseLabel = instr.Operands[2].Imm.Value;
-            if (cmp) {
-                frame.PC = reinterpret_cast<TVMInstr*>(trueLabel);
+            VM_NEXT();
+        VM_CASE(Cmp):
+            if (regs[instr->A]) {
+                pc = instr + instr->B;
             } else {
-                frame.PC = reinterpret_cast<TVMInstr*>(falseLabel);
+                pc = instr + instr->C;
             }
-            break;
-        }
-        case EVMOp::ArgTmp: // TODO: optimize
-        case EVMOp::ArgConst: {
-            auto value = ReadOperand(Runtime.Regs, instr.Operands[0]);
-            Runtime.Args.push_back(value);
-            Runtime.Args128.push_back(static_cast<__int128_t>(value));
-            break;
-        }
-        case EVMOp::ECall: {// external call
-            auto* func = reinterpret_cast<NFFI::IFunction*>(instr.Operands[1].Imm.Value);
-            const int32_t dstTmp = instr.Operands[0].Tmp.Idx;
-            auto structDst = materializeStructTmp(frame, dstTmp, nullptr);
-            if (structDst) {
-                Runtime.Args.insert(Runtime.Args.begin(), *structDst);
-            }
-
-            if (dstTmp >= 0) {
-                auto ret = (*func)(reinterpret_cast<const uint64_t*>(Runtime.Args.data()), Runtime.Args.size());
-                Runtime.Regs[dstTmp] = structDst.value_or(static_cast<int64_t>(ret));
-            } else {
-                (*func)(reinterpret_cast<const uint64_t*>(Runtime.Args.data()), Runtime.Args.size());
+            if (pc <= instr) {
+                BURN_FUEL();
+                if (NativeTier) {
+                    ++frame->Exec->Hotness;
+                }
             }
-            Runtime.Args.clear();
-            Runtime.Args128.clear();
-
-            break;
-        }
-        case EVMOp::Call: {
-            assert(instr.Operands[1].Type == TVMOperand::EType::Imm && "callee must be Imm(id)");
-            const int64_t calleeId = instr.Operands[1].Imm.Value;
+            VM_NEXT();
+        // The 128-bit copy keeps a 64-bit value widened for a 128-bit parameter.
+        VM_CASE(ArgTmp): {
+            auto value = regs[instr->A];
+            regs[instr->B] = value;
+            regs128[instr->B] = static_cast<__int128_t>(value);
+            VM_NEXT();
+        }
+        VM_CASE(ArgConst): {
+            auto value = consts[instr->A];
+            regs[instr->B] = value;
+            regs128[instr->B] = static_cast<__int128_t>(value);
+            VM_NEXT();
+        }
+        VM_CASE(ECall): // external call
+            CallPacked(reinterpret_cast<NFFI::IFunction*>(consts[instr->B]), *frame, regs, *instr);
+            VM_NEXT();
+        VM_CASE(Call): {
+            const int64_t calleeId = instr->B;
 
             assert(calleeId >=0 && calleeId < Module.Functions.size() && "Invalid callee id");
             TFunction* calleeFn = Module.Functions.data() + calleeId;
+            BURN_FUEL();
 
             if (!calleeFn->Exec) {
                 calleeFn->Exec = &Compiler.Compile(*calleeFn);
             }
             auto* calleeExec = calleeFn->Exec;
+            if (NativeTier) {
+                if (auto* native = TierUp(*calleeFn, *calleeExec)) {
+                    CallPacked(native, *frame, regs, *instr);
+                    VM_NEXT();
+                }
+            }
 
             const auto& localArgs = calleeFn->ArgLocals;
-            const int argCount = (int)Runtime.Args.size();
+            const int argCount = instr->C;
             assert(argCount <= (int)localArgs.size() && "too many arguments for callee");
 
-            const size_t saved128Bytes = Runtime.Regs128.size() * sizeof(__int128_t);
-            const size_t savedRegsBytes = frame.UsedRegs * 8;
-            const size_t oldSize = Runtime.Stack.size();
-            Runtime.Stack.resize(oldSize + savedRegsBytes + saved128Bytes);
-            std::memcpy(Runtime.Stack.data() + oldSize, Runtime.Regs.data(), savedRegsBytes);
-            std::memcpy(Runtime.Stack.data() + oldSize + savedRegsBytes,
-                        Runtime.Regs128.data(), saved128Bytes);
-            auto base = Runtime.Stack.size();
-
-            Runtime.Regs.resize(calleeExec->MaxTmpIdx + 1, 0);
-            Runtime.Regs128.assign(calleeExec->MaxTmp128Idx + 1, 0);
-            Runtime.Stack.resize(Runtime.Stack.size() + calleeExec->NumLocals, 0); // NumLocals is bytes
-            if (Runtime.Stack.size() > MaxStackSize) {
+            // The callee's register window starts right after the caller's one.
+            const uint64_t regBase = frame->RegBase + frame->UsedRegs;
+            const auto base = Runtime.Stack.size();
+            // Checked before the resize, which must stay within the reserved storage.
+            if (base + calleeExec->NumLocals > MaxStackBytes || regBase + calleeExec->MaxTmpIdx + 1 > MaxRegs) {
                 throw std::runtime_error("Stack overflow in interpreter");
             }
+            Runtime.Stack.resize(base + calleeExec->NumLocals, 0); // NumLocals is bytes
+            std::fill_n(Runtime.Regs128.get() + regBase, calleeExec->MaxTmp128Idx + 1, 0);
 
-            copyArgsToFrame(Runtime.Stack.data() + base, calleeExec,
-                            Runtime.Args.data(), argCount);
+            const int32_t argSlots = frame->Exec->ArgSlotBase + 1;
+            CopyArgsToFrame(Runtime.Stack.data() + base, calleeExec,
+                            regs + argSlots, regs128 + argSlots, argCount);
+
+            if (Profiler) {
+                Profiler->Enter(calleeId);
+            }
 
             ReturnLinks.emplace_back(TReturnLink {
                 .FrameIdx = (int64_t) callStack.size() - 1,
-                .CallerDst = instr.Operands[0].Tmp.Idx,
+                .CallerDst = instr->A,
                 .CalleeIsCoroutine = calleeFn->IsCoroutine,
                 .CalleeReturnsVoid = calleeFn->CoroutineResultTypeId >= 0
                     && Module.Types.IsVoid(calleeFn->CoroutineResultTypeId),
             });
 
-            Runtime.Args.clear();
-            Runtime.Args128.clear();
+            frame->PC = pc;
             callStack.push_back(TFrame {
                 .Exec = calleeExec,
                 .UsedRegs = calleeExec->MaxTmpIdx + 1,
                 .Used128Regs = calleeExec->MaxTmp128Idx + 1,
                 .StackBase = base,
+                .RegBase = regBase,
                 .PC = &calleeExec->VMCode[0],
                 .Name = calleeFn->Name,
             });
-            break;
-        }
-        case EVMOp::Await: {
-            ITypeErasedFuture* future = reinterpret_cast<ITypeErasedFuture*>(ReadOperand(Runtime.Regs, instr.Operands[1]));
-            auto value = co_await AwaitTypeErasedFuture<uint64_t>(future);
-            Runtime.Regs[instr.Operands[0].Tmp.Idx] = static_cast<int64_t>(value);
-            break;
-        }
-        case EVMOp::AwaitVoid: {
-            ITypeErasedFuture* future = reinterpret_cast<ITypeErasedFuture*>(ReadOperand(Runtime.Regs, instr.Operands[0]));
-            co_await AwaitTypeErasedFuture<void>(future);
-            break;
-        }
-        case EVMOp::Ret128:
-            Runtime.Ret128Value = ReadOperand128(Runtime.Regs128, instr.Operands[0]);
-            retVal = static_cast<int64_t>(Runtime.Ret128Value);
-            retIs128 = true;
+            frame = &callStack.back();
+            pc = frame->PC;
+            regs = Runtime.Regs.get() + regBase;
+            regs128 = Runtime.Regs128.get() + regBase;
+            consts = frame->Exec->Consts.data();
+            VM_NEXT();
+        }
+        VM_CASE(ProfBlock):
+            ++frame->Exec->BlockCounts[instr->A];
+            VM_NEXT();
+        VM_CASE(Await):
+        VM_CASE(AwaitVoid):
+            // Suspension is the caller's job: leave PC on the await so it can
+            // read the future operand and resume right after it.
+            frame->PC = instr;
+            return false;
+        VM_CASE(Ret128):
+            Runtime.Ret128Value = regs128[instr->A];
+            state->RetVal = static_cast<int64_t>(Runtime.Ret128Value);
+            state->RetIs128 = true;
             [[fallthrough]];
-        case EVMOp::Ret:
-            if (!retIs128) {
-                retVal = ReadOperand(Runtime.Regs, instr.Operands[0]);
+        VM_CASE(Ret):
+            if (!state->RetIs128) {
+                state->RetVal = regs[instr->A];
             }
-        case EVMOp::RetVoid: {
-            auto base = frame.StackBase;
+            [[fallthrough]];
+        VM_CASE(RetVoid): {
+            if (Profiler) {
+                Profiler->Leave();
+            }
+            auto base = frame->StackBase;
             callStack.pop_back();
             if (callStack.empty()) {
-                break;
-            } else {
-                auto& callerFrame = callStack.back();
-                assert(!ReturnLinks.empty());
-                auto link = std::move(ReturnLinks.back());
-                ReturnLinks.pop_back();
-
-                std::optional<int64_t> materializedRet;
-                if (retVal.has_value()) {
-                    materializedRet = materializeStructTmp(
-                        callerFrame, link.CallerDst, reinterpret_cast<const void*>(*retVal));
-                }
+                return true;
+            }
+            auto& callerFrame = callStack.back();
+            assert(!ReturnLinks.empty());
+            auto link = std::move(ReturnLinks.back());
+            ReturnLinks.pop_back();
+
+            std::optional<int64_t> materializedRet;
+            if (state->RetVal.has_value()) {
+                materializedRet = MaterializeStructTmp(
+                    callerFrame, link.CallerDst, reinterpret_cast<const void*>(*state->RetVal));
+            }
 
-                Runtime.Stack.resize(base);
-                // restore saved caller regs
-                Runtime.Regs.resize(callerFrame.UsedRegs);
-                Runtime.Regs128.resize(callerFrame.Used128Regs);
-                const size_t saved128Bytes = callerFrame.Used128Regs * sizeof(__int128_t);
-                const size_t savedRegsBytes = callerFrame.UsedRegs * 8;
-                const size_t savedRegsStart = base - savedRegsBytes - saved128Bytes;
-                std::memcpy(Runtime.Regs.data(), Runtime.Stack.data() + savedRegsStart, savedRegsBytes);
-                std::memcpy(Runtime.Regs128.data(),
-                            Runtime.Stack.data() + savedRegsStart + savedRegsBytes, saved128Bytes);
-                if (link.CallerDst >= 0 && link.CalleeIsCoroutine) {
-                    ITypeErasedFuture* completed = nullptr;
-                    if (link.CalleeReturnsVoid) {
-                        completed = MakeCompletedVoidFuture();
-                    } else {
-                        completed = MakeCompletedValueFuture(static_cast<uint64_t>(retVal.value_or(0)));
-                    }
-                    Runtime.Regs[link.CallerDst] = reinterpret_cast<int64_t>(completed);
-                } else if (retIs128 && link.CallerDst >= 0) {
-                    Runtime.Regs128[link.CallerDst] = Runtime.Ret128Value;
-                } else if (retVal.has_value()) {
-                    Runtime.Regs[link.CallerDst] = materializedRet.value_or(*retVal);
+            Runtime.Stack.resize(base);
+            // The caller's window was never moved, only the base goes back.
+            frame = &callerFrame;
+            pc = frame->PC;
+            regs = Runtime.Regs.get() + frame->RegBase;
+            regs128 = Runtime.Regs128.get() + frame->RegBase;
+            if (link.CallerDst >= 0 && link.CalleeIsCoroutine) {
+                ITypeErasedFuture* completed = nullptr;
+                if (link.CalleeReturnsVoid) {
+                    completed = MakeCompletedVoidFuture();
+                } else {
+                    completed = MakeCompletedValueFuture(static_cast<uint64_t>(state->RetVal.value_or(0)));
                 }
-                Runtime.Stack.resize(savedRegsStart);
-                retVal = std::nullopt;
-                retIs128 = false;
+                regs[link.CallerDst] = reinterpret_cast<int64_t>(completed);
+            } else if (state->RetIs128 && link.CallerDst >= 0) {
+                regs128[link.CallerDst] = Runtime.Ret128Value;
+            } else if (state->RetVal.has_value() && link.CallerDst >= 0) {
+                regs[link.CallerDst] = materializedRet.value_or(*state->RetVal);
             }
-            break;
+            state->RetVal = std::nullopt;
+            state->RetIs128 = false;
+            consts = frame->Exec->Consts.data();
+            VM_NEXT();
         }
-        default:
-            std::cerr << "Unknown instruction: '" << (int)instr.Op << "'\n";
+        VM_DEFAULT:
+            std::cerr << "Unknown instruction: '" << (int)instr->Op << "'\n";
             throw std::runtime_error("Unknown instruction");
-            break;
         }
     }
-
-    co_return retVal;
 }
 
+#undef VM_DEFAULT
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_BINARY
+#undef BURN_FUEL
+#undef QUMIR_VM_HANDLED_OPS
+
 } // namespace NIR
 } // namespace NQumir
@@ -1,10 +1,14 @@
 #pragma once
 
 #include "builder.h"
+#include "profiler.h"
 #include "vmcompiler.h"
 
+#include <array>
 #include <coroutine>
 #include <cstdint>
+#include <limits>
+#include <memory>
 #include <ostream>
 #include <vector>
 
@@ -16,21 +20,21 @@ namespace NIR {
 struct TRuntime {
     std::vector<char> Globals; // byte array; each variable slot is 8 bytes (64-bit aligned)
     std::vector<char> Stack;   // byte array; each variable slot is 8 bytes (64-bit aligned)
-    std::vector<int64_t> Args; // call arguments, will be copied on stack on call, TODO: remove
-    std::vector<__int128_t> Args128; // parallel to Args, filled for 128-bit arguments only
     __int128_t Ret128Value = 0;
-    std::vector<int64_t> Regs;
-    std::vector<__int128_t> Regs128; // addressed by the same register index as Regs
-    std::vector<int64_t> SavedRegs;
+    // Register window stack: a frame's registers start at TFrame::RegBase and
+    // the callee's window follows the caller's, so calls never copy registers.
+    std::unique_ptr<int64_t[]> Regs;
+    std::unique_ptr<__int128_t[]> Regs128; // addressed by the same register index as Regs
 };
 
 struct TExecFunc;
 
 struct TFrame {
-    const TExecFunc* Exec{nullptr};
+    TExecFunc* Exec{nullptr};
     const int UsedRegs = 0;
     const int Used128Regs = 0;
     const uint64_t StackBase = 0;
+    const uint64_t RegBase = 0;
     TVMInstr* PC{nullptr};
     std::string_view Name;
 };
@@ -43,6 +47,29 @@ struct TReturnLink {
     bool CalleeReturnsVoid = false;
 };
 
+// Interpreter state that outlives a single Execute() run.
+struct TExecState {
+    std::vector<TFrame> CallStack;
+    std::optional<int64_t> RetVal;
+    bool RetIs128 = false;
+};
+
+// Compiles hot functions to native code off the interpreter thread.
+class INativeTier {
+public:
+    enum class EStatus {
+        Pending,
+        Ready,
+        Failed,
+    };
+
+    virtual ~INativeTier() = default;
+    // Queues a compile of the function. Called once per function.
+    virtual void Request(const TFunction& function) = 0;
+    // On Ready, *entry is a C ABI function with the function's signature.
+    virtual EStatus Poll(const TFunction& function, void** entry) = 0;
+};
+
 class TInterpreter {
 public:
     TInterpreter(TModule& module, std::ostream& out, std::istream& in);
@@ -56,18 +83,70 @@ public:
     // results whose caller already knows the function's return type.
     std::optional<int64_t> EvalRaw(TFunction& function, std::vector<int64_t> args, TOptions options);
 
+    // Functions called or looping more than threshold times are handed to the
+    // tier; once it is ready, calls from the VM run the native code instead.
+    // The tier must outlive the interpreter's runs.
+    void SetNativeTier(INativeTier* tier, uint32_t threshold);
+    // Must be set before the first Eval: only functions compiled afterwards
+    // count their blocks.
+    void SetProfiler(TProfiler* profiler);
+    // Compiles the functions that have no bytecode yet up front, on up to
+    // `threads` threads (see TVMCompiler::CompileAll). After SetProfiler.
+    void CompileAll(int threads);
+
+    static constexpr size_t DefaultMaxStackBytes = 128 * 1024 * 1024;
+
+    // Resource limits for running untrusted programs in-process. Exceeding
+    // one throws std::runtime_error out of Eval, like any runtime error.
+    struct TLimits {
+        // Back-edges plus calls the program may take; 0 means unlimited.
+        uint64_t Fuel = 0;
+        // Bytes of frame storage (TRuntime::Stack) across the call stack.
+        size_t MaxStackBytes = DefaultMaxStackBytes;
+    };
+    // Native code from the tier is not metered, so a host that sets Fuel
+    // should not set a native tier.
+    void SetLimits(TLimits limits);
+
 private:
     std::optional<int64_t> DoEvalRaw(TFunction& function, std::vector<int64_t> args, TOptions options);
 
+    // Used when no function in the module is a coroutine: runs Execute once
+    // on the caller's stack, without a coroutine frame or event polling.
+    std::optional<int64_t> DoEvalRawSync(TFunction& function, std::vector<int64_t> args, TOptions options);
     TFuture<std::optional<int64_t>> DoEvalRawAsync(TFunction& function, std::vector<int64_t> args, TOptions options);
+    // Compiles the function if needed and pushes its frame with args copied in.
+    // Returns false on an argument count mismatch.
+    bool PrepareEntryFrame(TExecState& state, TFunction& function, const std::vector<int64_t>& args, TOptions options);
     size_t ProcessAsyncRuntimeEvents();
 
+    // Runs until the outermost frame returns (true) or an Await/AwaitVoid is
+    // reached (false, the top frame's PC stays on it). A null state only
+    // fills DispatchTable.
+    bool Execute(TExecState* state);
+    // srcArgs128 may be null; 128-bit arguments then take the 64-bit value.
+    void CopyArgsToFrame(char* frameBase, const TExecFunc* exec, const int64_t* srcArgs, const __int128_t* srcArgs128, int srcCount);
+    std::optional<int64_t> MaterializeStructTmp(const TFrame& targetFrame, int32_t tmpIdx, const void* src);
+    // Calls a packed thunk with the args in the frame's arg area (ECall operands).
+    void CallPacked(NFFI::IFunction* func, const TFrame& frame, int64_t* regs, const TVMInstr& instr);
+    // Native code to run for a call to the function, nullptr to interpret it.
+    NFFI::IFunction* TierUp(TFunction& function, TExecFunc& exec);
+
     std::ostream& Out;
     std::istream& In;
     TModule& Module;
     TRuntime Runtime;
     TVMCompiler Compiler;
     std::vector<TReturnLink> ReturnLinks;
+    INativeTier* NativeTier = nullptr;
+    uint32_t TierUpThreshold = 0;
+    std::vector<std::unique_ptr<NFFI::IFunction>> NativeThunks;
+    TProfiler* Profiler = nullptr;
+    // Remaining fuel; the default never runs out in practice.
+    uint64_t Fuel = std::numeric_limits<uint64_t>::max();
+    size_t MaxStackBytes = DefaultMaxStackBytes;
+    // Handler address per EVMOp, only filled with threaded dispatch.
+    std::array<const void*, 256> DispatchTable{};
 };
 
 } // namespace NIR
@@ -5,6 +5,7 @@
 #include "qumir/parser/type.h"
 #include "qumir/semantics/lifetime/validator.h"
 #include "qumir/error.h"
+#include "qumir/time_report.h"
 
 #include <iostream>
 #include <sstream>
@@ -99,6 +100,16 @@ TTmp TAstLowerer::LoadLayoutOperand(TOperand operand)
     return tmp;
 }
 
+void TAstLowerer::EmitBoundsCheck(TOperand zeroBasedIndex, TOperand dimSizeStorage)
+{
+    if (!Options.BoundsChecks) {
+        return;
+    }
+    // bounds idx size: fails unless 0 <= idx < size
+    auto dimSize = LoadLayoutOperand(dimSizeStorage);
+    Builder.Emit0("bounds"_op, {zeroBasedIndex, dimSize});
+}
+
 TExpectedTask<TAstLowerer::TArrayLayout, TError, TLocation> TAstLowerer::LowerArrayLayout(
     NSemantics::TSymbolInfo symbol,
     const std::vector<std::pair<NAst::TExprPtr, NAst::TExprPtr>>& bounds,
@@ -444,6 +455,7 @@ TExpectedTask<TAstLowerer::TValueWithBlock, TError, TLocation> TAstLowerer::Lowe
         auto tmp = LoadLayoutOperand(layout.LBounds[i]);
         tmp = Builder.Emit1("-"_op, {*indexRes.Value, tmp});
         Builder.SetType(tmp, i64);
+        EmitBoundsCheck(tmp, layout.DimSizes[i]);
         if (i != n) {
             auto stride = LoadLayoutOperand(layout.Strides[i + 1]);
             tmp = Builder.Emit1("*"_op, {tmp, stride});
@@ -514,6 +526,7 @@ TExpectedTask<TAstLowerer::TValueWithBlock, TError, TLocation> TAstLowerer::Lowe
             auto lbound0 = LoadLayoutOperand(layoutIt->second.LBounds[0]);
             auto zeroBasedIndex = Builder.Emit1("-"_op, {*indexValue.Value, lbound0});
             Builder.SetType(zeroBasedIndex, i64);
+            EmitBoundsCheck(zeroBasedIndex, layoutIt->second.DimSizes[0]);
             auto offset = Builder.Emit1("*"_op, {zeroBasedIndex, TImm{elemByteSize, i64}});
             Builder.SetType(offset, i64);
             byteOffset = offset;
@@ -639,6 +652,10 @@ TExpectedTask<std::monostate, TError, TLocation> TAstLowerer::EmitLifetimeDestro
 
 TExpectedTask<TAstLowerer::TValueWithBlock, TError, TLocation> TAstLowerer::Lower(const NAst::TExprPtr& inputExpr, TBlockScope scope) {
     NAst::TExprPtr expr = inputExpr;
+    // Lets profiles map blocks back to source; synthesized nodes keep the last line.
+    if (expr && expr->Location.Line > 0) {
+        Builder.SetLine(expr->Location.Line);
+    }
 
     if (auto maybeRetain = NAst::TMaybeNode<NAst::TRetainExpr>(expr)) {
         auto retain = maybeRetain.Cast();
@@ -1196,6 +1213,7 @@ TExpectedTask<TAstLowerer::TValueWithBlock, TError, TLocation> TAstLowerer::Lowe
         auto i64 = Module.Types.I(EKind::I64);
         auto zeroBasedIndex = Builder.Emit1("-"_op, {*indexValue.Value, lbound0});
         Builder.SetType(zeroBasedIndex, i64);
+        EmitBoundsCheck(zeroBasedIndex, layoutIt->second.DimSizes[0]);
 
         auto arrayType = Builder.GetType(arrayPtr.Tmp);
         int elemTypeId = FromAstType(expr->Type, Module.Types);
@@ -1755,7 +1773,35 @@ void TAstLowerer::ImportExternalFunctions() {
     }
 }
 
+// OptimizeOwnership rewrites string code into calls of these and can only
+// call what the module imports; a module that releases strings gets them.
+void TAstLowerer::ImportOwnershipHelpers() {
+    const bool usesStrings = std::any_of(
+        Module.ExternalFunctions.begin(),
+        Module.ExternalFunctions.end(),
+        [](const TExternalFunction& f) {
+            return f.MangledName == "str_release";
+        });
+    if (!usesStrings) {
+        return;
+    }
+    for (const char* name : {"str_append", "str_init_lit", "str_init_unicode"}) {
+        auto sidOpt = Context.Lookup(name, NSemantics::TScopeId{0});
+        if (!sidOpt) {
+            continue;
+        }
+        auto funDecl = NAst::TMaybeNode<NAst::TFunDecl>(
+            Context.GetSymbolNode(NSemantics::TSymbolId{sidOpt->Id}));
+        if (funDecl && funDecl.Cast()->IsExternal()) {
+            ImportExternalFunction(sidOpt->Id, *funDecl.Cast());
+        }
+    }
+}
+
 std::expected<std::monostate, TError> TAstLowerer::LowerTop(const NAst::TExprPtr& expr) {
+    TPhaseTimer timer("lower");
+    auto* report = CurrentTimeReport();
+    const size_t instructionsBefore = report ? Module.InstructionCount() : 0;
     NSemantics::TLifetimeValidator validator(Context);
     if (auto validation = validator.Validate(expr); !validation) {
         return std::unexpected(validation.error());
@@ -2003,7 +2049,11 @@ std::expected<std::monostate, TError> TAstLowerer::LowerTop(const NAst::TExprPtr
         Builder.Emit0("ret"_op, {});
         Module.ModuleConstructorFunctionId = constructorFunctionId;
     }
+    ImportOwnershipHelpers();
 
+    if (report) {
+        report->Count("ir.instructions.lowered", Module.InstructionCount() - instructionsBefore);
+    }
     return {};
 }
 
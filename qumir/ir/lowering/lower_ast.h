@@ -14,10 +14,16 @@ namespace NIR {
 
 using namespace NLiterals;
 
+struct TLowerOptions {
+    // Check every `таб` index against its dimension and fail with a runtime
+    // error when it is out of range (see NPasses::EliminateBoundsChecks).
+    bool BoundsChecks = false;
+};
+
 class TAstLowerer {
 public:
-    TAstLowerer(TModule& module, TBuilder& builder, NSemantics::TNameResolver& ctx)
-        : Module(module), Builder(builder), Context(ctx)
+    TAstLowerer(TModule& module, TBuilder& builder, NSemantics::TNameResolver& ctx, TLowerOptions options = {})
+        : Module(module), Builder(builder), Context(ctx), Options(options)
     {}
 
     std::expected<std::monostate, TError> LowerTop(const NAst::TExprPtr& expr);
@@ -63,15 +69,18 @@ private:
         const TLocation& loc);
     TExpectedTask<TTmp, TError, TLocation> LoadVar(const std::string& name, TBlockScope scope, const TLocation& loc, bool ref = false);
     TTmp LoadLayoutOperand(TOperand operand);
+    void EmitBoundsCheck(TOperand zeroBasedIndex, TOperand dimSizeStorage);
     TOperand AllocLayoutStorage(NSemantics::TSymbolInfo symbol, int typeId);
 
     void ImportExternalFunction(int symbolId, const NAst::TFunDecl& funcDecl);
     void ImportExternalFunctions();
+    void ImportOwnershipHelpers();
     TExpectedTask<int, TError, TLocation> GlobalSymbolId(const std::string& name);
 
     TModule& Module;
     TBuilder& Builder;
     NSemantics::TNameResolver& Context;
+    TLowerOptions Options;
 
     std::unordered_map<int32_t, TArrayLayout> ArrayLayouts;
     int32_t NextHiddenGlobalSlot = -1;
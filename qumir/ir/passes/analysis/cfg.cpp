@@ -18,7 +18,12 @@ void BuildCfg(TFunction& function)
         return;
     }
     function.CfgBuilt = true;
-    function.Label2Idx.resize(function.Blocks.size());
+    // Labels are not always dense: a label may end up without a block.
+    size_t labelCount = function.Blocks.size();
+    for (const auto& block : function.Blocks) {
+        labelCount = std::max<size_t>(labelCount, block.Label.Idx + 1);
+    }
+    function.Label2Idx.resize(labelCount);
 
     int idx = 0;
     for (auto& block : function.Blocks) {
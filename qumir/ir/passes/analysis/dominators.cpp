@@ -0,0 +1,103 @@
+#include "dominators.h"
+#include "cfg.h"
+
+#include <utility>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+bool TDominatorTree::IsReachable(int block) const {
+    return Enter[block] >= 0;
+}
+
+bool TDominatorTree::Dominates(int a, int b) const {
+    if (!IsReachable(a) || !IsReachable(b)) {
+        return false;
+    }
+    return Enter[a] <= Enter[b] && Leave[b] <= Leave[a];
+}
+
+TDominatorTree BuildDominatorTree(TFunction& function) {
+    BuildCfg(function);
+    const int n = static_cast<int>(function.Blocks.size());
+    TDominatorTree tree;
+    tree.IDom.assign(n, -1);
+    tree.Children.resize(n);
+    tree.Enter.assign(n, -1);
+    tree.Leave.assign(n, -1);
+    if (n == 0) {
+        return tree;
+    }
+
+    for (auto label : ComputeRPO(function)) {
+        tree.RPO.push_back(function.GetBlockIdx(label));
+    }
+    std::vector<int> order(n, -1); // block -> position in RPO
+    for (int i = 0; i < (int)tree.RPO.size(); ++i) {
+        order[tree.RPO[i]] = i;
+    }
+
+    auto& idom = tree.IDom;
+    const int entry = tree.RPO[0];
+    idom[entry] = entry;
+    auto intersect = [&](int a, int b) {
+        while (a != b) {
+            while (order[a] > order[b]) {
+                a = idom[a];
+            }
+            while (order[b] > order[a]) {
+                b = idom[b];
+            }
+        }
+        return a;
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 1; i < (int)tree.RPO.size(); ++i) {
+            const int block = tree.RPO[i];
+            int newIdom = -1;
+            for (const auto& predLabel : function.Blocks[block].Pred) {
+                const int pred = function.GetBlockIdx(predLabel);
+                if (order[pred] < 0 || idom[pred] < 0) {
+                    continue; // unreachable or not processed yet
+                }
+                newIdom = newIdom < 0 ? pred : intersect(pred, newIdom);
+            }
+            if (newIdom != idom[block]) {
+                idom[block] = newIdom;
+                changed = true;
+            }
+        }
+    }
+    idom[entry] = -1;
+
+    for (int i = 1; i < (int)tree.RPO.size(); ++i) {
+        const int block = tree.RPO[i];
+        tree.Children[idom[block]].push_back(block);
+    }
+
+    // Iterative DFS: dominator trees of long straight-line code are deep.
+    int counter = 0;
+    std::vector<std::pair<int, size_t>> stack; // block, next child
+    stack.push_back({entry, 0});
+    tree.Enter[entry] = counter++;
+    while (!stack.empty()) {
+        auto& [block, next] = stack.back();
+        if (next < tree.Children[block].size()) {
+            const int child = tree.Children[block][next++];
+            tree.Enter[child] = counter++;
+            stack.push_back({child, 0});
+        } else {
+            tree.Leave[block] = counter++;
+            stack.pop_back();
+        }
+    }
+    return tree;
+}
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
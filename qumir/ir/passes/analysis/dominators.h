@@ -0,0 +1,33 @@
+#pragma once
+
+#include <qumir/ir/builder.h>
+
+#include <vector>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+// All indices are block indices (TFunction::Blocks), not label indices.
+struct TDominatorTree {
+    // Blocks reachable from the entry, in reverse post order.
+    std::vector<int> RPO;
+    // Immediate dominator; -1 for the entry and for unreachable blocks.
+    std::vector<int> IDom;
+    std::vector<std::vector<int>> Children;
+
+    bool IsReachable(int block) const;
+    // Reflexive: every reachable block dominates itself.
+    bool Dominates(int a, int b) const;
+
+    // Pre/post order numbers of a DFS over the tree, for O(1) Dominates.
+    std::vector<int> Enter;
+    std::vector<int> Leave;
+};
+
+// Cooper, Harvey, Kennedy, "A Simple, Fast Dominance Algorithm".
+TDominatorTree BuildDominatorTree(TFunction& function);
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <qumir/ir/builder.h>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+// Result depends only on the operands and there are no side effects, so an
+// unused instruction can go and a repeated one can reuse the first result.
+// Division is included: a trap on a value nobody uses need not be kept.
+inline bool IsPure(TOp op) {
+    using namespace NLiterals;
+    switch (op) {
+        case '+'_op: case '-'_op: case '*'_op: case '/'_op: case '%'_op:
+        case '&'_op: case '|'_op: case '^'_op: case '~'_op: case '!'_op:
+        case "<<"_op: case ">>"_op:
+        case '<'_op: case '>'_op: case "<="_op: case ">="_op: case "=="_op: case "!="_op:
+        case "&&"_op: case "||"_op:
+        case "neg"_op: case "mov"_op: case "bitcast"_op:
+        case "i2f"_op: case "f2i"_op: case "i2b"_op: case "f2b"_op:
+        case "lea"_op:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Reads memory without writing it: removable when unused, but a repeated
+// read only matches while no write can happen in between.
+inline bool IsMemoryRead(TOp op) {
+    using namespace NLiterals;
+    return op == "load"_op || op == "lde"_op;
+}
+
+inline bool IsCommutative(TOp op) {
+    using namespace NLiterals;
+    switch (op) {
+        case '+'_op: case '*'_op: case '&'_op: case '|'_op: case '^'_op:
+        case "=="_op: case "!="_op: case "&&"_op: case "||"_op:
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
@@ -0,0 +1,91 @@
+#include "globals.h"
+
+#include <optional>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+using namespace NLiterals;
+
+namespace {
+
+bool CallsModuleFunction(const TFunction& function, const TModule& module) {
+    for (const auto& block : function.Blocks) {
+        for (const auto& instr : block.Instrs) {
+            if (instr.Op == "await"_op) {
+                return true;
+            }
+            if (instr.Op == "call"_op && module.SymIdToFuncIdx.contains(instr.Operands[0].Imm.Value)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+TGlobalFacts CollectGlobalFacts(const TModule& module) {
+    struct TStored {
+        std::optional<TImm> Imm; // nullopt: not a single constant
+        const TFunction* Writer = nullptr;
+    };
+    // The module constructor runs before anything else, the entry point
+    // next, unless the constructor calls into the module first. A store at
+    // the top of either, before any call, happens before every read in
+    // another function.
+    const TFunction* constructor = module.ModuleConstructorFunctionId >= 0
+        ? &module.Functions[module.ModuleConstructorFunctionId]
+        : nullptr;
+    const TFunction* entry = module.GetEntryPoint();
+    if (constructor && CallsModuleFunction(*constructor, module)) {
+        entry = nullptr;
+    }
+    std::unordered_map<int, TStored> stored;
+    TGlobalFacts facts;
+    facts.Constructor = constructor;
+    for (const auto& function : module.Functions) {
+        const bool first = &function == constructor || &function == entry;
+        for (const auto& block : function.Blocks) {
+            bool prologue = first && block.Label.Idx == 0;
+            for (const auto& instr : block.Instrs) {
+                if (instr.Op == "call"_op || instr.Op == "await"_op) {
+                    prologue = false;
+                }
+                for (int i = 0; i < instr.Size(); ++i) {
+                    const auto& op = instr.Operands[i];
+                    if (op.Type != TOperand::EType::Slot || instr.Op == "load"_op) {
+                        continue;
+                    }
+                    if (instr.Op == "lea"_op) {
+                        facts.AddressTakenSlots.insert(op.Slot.Idx);
+                    }
+                    const bool constantStore = prologue && instr.Op == "stre"_op && i == 0
+                        && instr.Operands[1].Type == TOperand::EType::Imm;
+                    auto [it, inserted] = stored.emplace(op.Slot.Idx, TStored{});
+                    auto& entry = it->second;
+                    if (constantStore && inserted) {
+                        entry = {instr.Operands[1].Imm, &function};
+                    } else if (!constantStore
+                        || !entry.Imm
+                        || entry.Writer != &function
+                        || entry.Imm->Value != instr.Operands[1].Imm.Value)
+                    {
+                        entry.Imm = std::nullopt;
+                    }
+                }
+            }
+        }
+    }
+    for (const auto& [slot, entry] : stored) {
+        if (entry.Imm) {
+            facts.Constants.emplace(slot, TGlobalFacts::TConstant{*entry.Imm, entry.Writer});
+        }
+    }
+    return facts;
+}
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
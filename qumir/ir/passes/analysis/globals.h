@@ -0,0 +1,37 @@
+#pragma once
+
+#include <qumir/ir/builder.h>
+
+#include <unordered_map>
+#include <unordered_set>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+// What the per-function passes need to know about globals, gathered from
+// every function of the module. Collected once before the functions are
+// optimized: passes that run on several threads then never read a
+// function another thread is rewriting, and the code does not depend on
+// the order the functions are visited in.
+struct TGlobalFacts {
+    struct TConstant {
+        TImm Value;
+        // The function that stores it, at the top of its entry block: the
+        // module constructor or the entry point.
+        const TFunction* Writer = nullptr;
+    };
+    // Globals only ever set to one constant (see PropagateConstants).
+    std::unordered_map<int, TConstant> Constants;
+    // Runs before the entry point, so it sees globals the entry point sets
+    // in their initial state.
+    const TFunction* Constructor = nullptr;
+    // Globals whose address some function takes with lea.
+    std::unordered_set<int> AddressTakenSlots;
+};
+
+TGlobalFacts CollectGlobalFacts(const TModule& module);
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
@@ -0,0 +1,80 @@
+#include "liveness.h"
+
+#include <algorithm>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+bool TTmpSet::Merge(const TTmpSet& other) {
+    bool changed = false;
+    for (size_t w = 0; w < Words.size(); ++w) {
+        const uint64_t merged = Words[w] | other.Words[w];
+        changed |= merged != Words[w];
+        Words[w] = merged;
+    }
+    return changed;
+}
+
+bool TTmpSet::MergeExcept(const TTmpSet& other, const TTmpSet& except) {
+    bool changed = false;
+    for (size_t w = 0; w < Words.size(); ++w) {
+        const uint64_t merged = Words[w] | (other.Words[w] & ~except.Words[w]);
+        changed |= merged != Words[w];
+        Words[w] = merged;
+    }
+    return changed;
+}
+
+TLiveness ComputeLiveness(const TFunction& function) {
+    TLiveness live;
+    int tmpCount = static_cast<int>(function.TmpTypes.size());
+    for (const auto& block : function.Blocks) {
+        for (const auto& instr : block.Instrs) {
+            tmpCount = std::max(tmpCount, instr.Dest.Idx + 1);
+            for (size_t i = 0; i < instr.OperandCount; ++i) {
+                if (instr.Operands[i].Type == TOperand::EType::Tmp) {
+                    tmpCount = std::max(tmpCount, instr.Operands[i].Tmp.Idx + 1);
+                }
+            }
+        }
+    }
+    live.TmpCount = tmpCount;
+
+    const int n = static_cast<int>(function.Blocks.size());
+    // LiveIn starts as the upward-exposed uses and only grows.
+    std::vector<TTmpSet> defs(n, TTmpSet(tmpCount));
+    live.LiveIn.assign(n, TTmpSet(tmpCount));
+    live.LiveOut.assign(n, TTmpSet(tmpCount));
+    for (int b = 0; b < n; ++b) {
+        const auto& instrs = function.Blocks[b].Instrs;
+        for (auto it = instrs.rbegin(); it != instrs.rend(); ++it) {
+            if (it->Dest.Idx >= 0) {
+                defs[b].Set(it->Dest.Idx);
+                live.LiveIn[b].Reset(it->Dest.Idx);
+            }
+            for (size_t i = 0; i < it->OperandCount; ++i) {
+                if (it->Operands[i].Type == TOperand::EType::Tmp && it->Operands[i].Tmp.Idx >= 0) {
+                    live.LiveIn[b].Set(it->Operands[i].Tmp.Idx);
+                }
+            }
+        }
+    }
+
+    // Blocks are mostly laid out in program order, so walking them
+    // backwards settles straight-line code and loop bodies in few rounds.
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (int b = n - 1; b >= 0; --b) {
+            for (const auto& succ : function.Blocks[b].Succ) {
+                live.LiveOut[b].Merge(live.LiveIn[function.GetBlockIdx(succ)]);
+            }
+            changed |= live.LiveIn[b].MergeExcept(live.LiveOut[b], defs[b]);
+        }
+    }
+    return live;
+}
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
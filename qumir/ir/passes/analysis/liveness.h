@@ -0,0 +1,59 @@
+#pragma once
+
+#include <qumir/ir/builder.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+// Set of temporaries, indexed by TTmp::Idx.
+class TTmpSet {
+public:
+    explicit TTmpSet(int size = 0)
+        : Words((size + 63) / 64, 0)
+    { }
+
+    bool Test(int tmp) const {
+        return (Words[tmp >> 6] >> (tmp & 63)) & 1;
+    }
+    void Set(int tmp) {
+        Words[tmp >> 6] |= uint64_t{1} << (tmp & 63);
+    }
+    void Reset(int tmp) {
+        Words[tmp >> 6] &= ~(uint64_t{1} << (tmp & 63));
+    }
+    // Both return true if the set grew.
+    bool Merge(const TTmpSet& other);
+    bool MergeExcept(const TTmpSet& other, const TTmpSet& except);
+
+    template<typename F>
+    void ForEach(F&& f) const {
+        for (size_t w = 0; w < Words.size(); ++w) {
+            for (uint64_t bits = Words[w]; bits; bits &= bits - 1) {
+                f(static_cast<int>(w * 64 + __builtin_ctzll(bits)));
+            }
+        }
+    }
+
+private:
+    std::vector<uint64_t> Words;
+};
+
+// Temporaries live on entry to and on exit from each block (block indices,
+// as in TDominatorTree). Expects a built CFG and no φ-nodes, i.e. runs on
+// the code the VM compiler sees, after DeSSA.
+struct TLiveness {
+    // One past the largest temporary index in the function.
+    int TmpCount = 0;
+    std::vector<TTmpSet> LiveIn;
+    std::vector<TTmpSet> LiveOut;
+};
+
+TLiveness ComputeLiveness(const TFunction& function);
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
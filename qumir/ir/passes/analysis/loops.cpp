@@ -0,0 +1,99 @@
+#include "loops.h"
+
+#include <algorithm>
+#include <map>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+bool TLoop::Contains(int block) const {
+    return std::binary_search(Blocks.begin(), Blocks.end(), block);
+}
+
+TLoopNest FindLoops(TFunction& function, const TDominatorTree& tree) {
+    const int n = static_cast<int>(function.Blocks.size());
+    TLoopNest nest;
+    nest.BlockLoop.assign(n, -1);
+
+    // Back edges grouped by header: loops sharing a header are one loop.
+    std::map<int, std::vector<int>> latches;
+    for (int block : tree.RPO) {
+        for (const auto& succLabel : function.Blocks[block].Succ) {
+            const int succ = function.GetBlockIdx(succLabel);
+            if (tree.Dominates(succ, block)) {
+                latches[succ].push_back(block);
+            }
+        }
+    }
+
+    std::vector<char> inLoop(n, 0);
+    for (auto& [header, sources] : latches) {
+        TLoop loop;
+        loop.Header = header;
+        loop.Latches = sources;
+        std::fill(inLoop.begin(), inLoop.end(), 0);
+        inLoop[header] = 1;
+        loop.Blocks.push_back(header);
+        std::vector<int> worklist;
+        for (int latch : sources) {
+            if (!inLoop[latch]) {
+                inLoop[latch] = 1;
+                loop.Blocks.push_back(latch);
+                worklist.push_back(latch);
+            }
+        }
+        while (!worklist.empty()) {
+            const int block = worklist.back();
+            worklist.pop_back();
+            for (const auto& predLabel : function.Blocks[block].Pred) {
+                const int pred = function.GetBlockIdx(predLabel);
+                if (!inLoop[pred] && tree.IsReachable(pred)) {
+                    inLoop[pred] = 1;
+                    loop.Blocks.push_back(pred);
+                    worklist.push_back(pred);
+                }
+            }
+        }
+        std::sort(loop.Blocks.begin(), loop.Blocks.end());
+
+        int outside = -1;
+        int outsideCount = 0;
+        for (const auto& predLabel : function.Blocks[header].Pred) {
+            const int pred = function.GetBlockIdx(predLabel);
+            if (!inLoop[pred]) {
+                outside = pred;
+                ++outsideCount;
+            }
+        }
+        if (outsideCount == 1 && function.Blocks[outside].Succ.size() == 1) {
+            loop.Preheader = outside;
+        }
+        nest.Loops.push_back(std::move(loop));
+    }
+
+    // An enclosing loop has strictly more blocks than the loops inside it.
+    std::stable_sort(nest.Loops.begin(), nest.Loops.end(), [](const TLoop& a, const TLoop& b) {
+        return a.Blocks.size() > b.Blocks.size();
+    });
+    for (int i = 0; i < (int)nest.Loops.size(); ++i) {
+        auto& loop = nest.Loops[i];
+        // Loops containing a block form a chain, so the nearest earlier loop
+        // that contains the header is the immediate parent.
+        for (int j = i - 1; j >= 0; --j) {
+            if (nest.Loops[j].Contains(loop.Header)) {
+                loop.Parent = j;
+                loop.Depth = nest.Loops[j].Depth + 1;
+                break;
+            }
+        }
+        for (int block : loop.Blocks) {
+            nest.BlockLoop[block] = i;
+        }
+    }
+    return nest;
+}
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
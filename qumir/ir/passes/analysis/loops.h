@@ -0,0 +1,42 @@
+#pragma once
+
+#include <qumir/ir/builder.h>
+#include <qumir/ir/passes/analysis/dominators.h>
+
+#include <vector>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+// A natural loop: the header and every block that reaches one of its back
+// edges without passing through the header. Block indices, as in
+// TDominatorTree.
+struct TLoop {
+    int Header = -1;
+    // Sorted, header included.
+    std::vector<int> Blocks;
+    // Sources of the back edges.
+    std::vector<int> Latches;
+    // The only predecessor of the header outside the loop, if it has no
+    // other successor; -1 otherwise. Code hoisted out of the loop goes there.
+    int Preheader = -1;
+    // Index of the enclosing loop in TLoopNest::Loops, -1 for outermost.
+    int Parent = -1;
+    int Depth = 1;
+
+    bool Contains(int block) const;
+};
+
+struct TLoopNest {
+    // Enclosing loops come before the loops they contain.
+    std::vector<TLoop> Loops;
+    // Block -> innermost loop containing it, -1 outside of loops.
+    std::vector<int> BlockLoop;
+};
+
+TLoopNest FindLoops(TFunction& function, const TDominatorTree& tree);
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
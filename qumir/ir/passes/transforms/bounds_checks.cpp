@@ -0,0 +1,509 @@
+#include "bounds_checks.h"
+
+#include <qumir/ir/passes/analysis/dominators.h>
+#include <qumir/ir/passes/analysis/loops.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+using namespace NLiterals;
+
+namespace {
+
+constexpr __int128_t MinI64 = std::numeric_limits<int64_t>::min();
+constexpr __int128_t MaxI64 = std::numeric_limits<int64_t>::max();
+
+// Constant + sum of Coef * tmp, in exact arithmetic: the constant is wide
+// enough to state i64 limits such as `MaxI64 - i >= 0`.
+struct TLinear {
+    __int128_t Constant = 0;
+    std::map<int, int64_t> Terms;
+
+    bool IsConstant() const {
+        return Terms.empty();
+    }
+};
+
+std::optional<TLinear> Combine(const TLinear& a, const TLinear& b, int64_t scaleB) {
+    TLinear result = a;
+    __int128_t scaledConstant;
+    if (__builtin_mul_overflow(b.Constant, scaleB, &scaledConstant)
+        || __builtin_add_overflow(result.Constant, scaledConstant, &result.Constant))
+    {
+        return std::nullopt;
+    }
+    for (const auto& [tmp, coef] : b.Terms) {
+        auto& sum = result.Terms[tmp];
+        int64_t scaled;
+        if (__builtin_mul_overflow(coef, scaleB, &scaled)
+            || __builtin_add_overflow(sum, scaled, &sum))
+        {
+            return std::nullopt;
+        }
+        if (sum == 0) {
+            result.Terms.erase(tmp);
+        }
+    }
+    return result;
+}
+
+std::optional<TLinear> Scale(const TLinear& a, int64_t k) {
+    return Combine(TLinear{}, a, k);
+}
+
+// F >= 0 and G >= 0 with F = g * G + c, g the gcd of the coefficients,
+// say the same; dividing makes facts from `(b - i) * step >= 0` match.
+TLinear Normalize(TLinear fact) {
+    int64_t g = 0;
+    for (const auto& [tmp, coef] : fact.Terms) {
+        g = std::gcd(g, coef);
+    }
+    if (g > 1) {
+        for (auto& [tmp, coef] : fact.Terms) {
+            coef /= g;
+        }
+        const __int128_t q = fact.Constant / g;
+        fact.Constant = (fact.Constant % g < 0) ? q - 1 : q;
+    }
+    return fact;
+}
+
+class TBoundsCheckElimination {
+public:
+    TBoundsCheckElimination(TFunction& function, TModule& module)
+        : Function(function)
+        , Module(module)
+    { }
+
+    void Run() {
+        bool any = false;
+        for (const auto& block : Function.Blocks) {
+            for (const auto& instr : block.Instrs) {
+                any |= instr.Op == "bounds"_op;
+            }
+        }
+        if (!any) {
+            return;
+        }
+
+        for (auto& block : Function.Blocks) {
+            for (auto& instr : block.Instrs) {
+                if (instr.Dest.Idx >= 0) {
+                    Defs[instr.Dest.Idx] = &instr;
+                }
+            }
+        }
+        auto tree = BuildDominatorTree(Function);
+        if (tree.RPO.empty()) {
+            return;
+        }
+        Nest = FindLoops(Function, tree);
+        // Induction facts are assumed on entry to a loop header and checked
+        // on its latches; a counter that fails there is dropped and the
+        // function looked at again.
+        do {
+            Broken = false;
+            Redundant.clear();
+            LatchChecks.clear();
+            VisitTree(tree, tree.RPO[0]);
+        } while (Broken);
+        for (auto* instr : Redundant) {
+            instr->Clear();
+        }
+    }
+
+private:
+    bool IsSignedInt(int typeId) const {
+        return typeId >= 0 && Module.Types.GetKind(typeId) == EKind::I64;
+    }
+
+    int OperandType(const TOperand& op) const {
+        if (op.Type == TOperand::EType::Imm) {
+            return op.Imm.TypeId;
+        }
+        if (op.Type == TOperand::EType::Tmp) {
+            return Function.GetType(op.Tmp);
+        }
+        return -1;
+    }
+
+    std::optional<TLinear> Expand(const TOperand& op, int depth = 0) {
+        if (op.Type == TOperand::EType::Imm) {
+            // Untyped immediates in index arithmetic are plain integers.
+            if (op.Imm.TypeId >= 0 && !IsSignedInt(op.Imm.TypeId)) {
+                return std::nullopt;
+            }
+            return TLinear{op.Imm.Value, {}};
+        }
+        if (op.Type != TOperand::EType::Tmp || !IsSignedInt(Function.GetType(op.Tmp))) {
+            return std::nullopt;
+        }
+        const int tmp = op.Tmp.Idx;
+        if (auto it = Expanded.find(tmp); it != Expanded.end()) {
+            return it->second;
+        }
+        std::optional<TLinear> result = TLinear{0, {{tmp, 1}}};
+        auto def = Defs.find(tmp);
+        if (def != Defs.end() && depth < 16) {
+            const auto& instr = *def->second;
+            auto operand = [&](int i) {
+                return Expand(instr.Operands[i], depth + 1);
+            };
+            if ((instr.Op == '+'_op || instr.Op == '-'_op) && instr.Size() == 2) {
+                auto a = operand(0);
+                auto b = operand(1);
+                if (a && b) {
+                    if (auto sum = Combine(*a, *b, instr.Op == '+'_op ? 1 : -1)) {
+                        result = sum;
+                    }
+                }
+            } else if (instr.Op == '*'_op && instr.Size() == 2) {
+                auto a = operand(0);
+                auto b = operand(1);
+                if (a && b && (a->IsConstant() || b->IsConstant())) {
+                    auto product = a->IsConstant() ? Scale(*b, a->Constant) : Scale(*a, b->Constant);
+                    if (product) {
+                        result = product;
+                    }
+                }
+            } else if (instr.Op == "neg"_op && instr.Size() == 1) {
+                if (auto a = operand(0)) {
+                    if (auto negated = Scale(*a, -1)) {
+                        result = negated;
+                    }
+                }
+            } else if (instr.Op == "mov"_op && instr.Size() == 1) {
+                if (auto a = operand(0)) {
+                    result = a;
+                }
+            }
+        }
+        Expanded.emplace(tmp, result);
+        return result;
+    }
+
+    void AddFact(std::optional<TLinear> fact) {
+        if (fact) {
+            Facts.push_back(Normalize(std::move(*fact)));
+        }
+    }
+
+    // What `cond` being `taken` (nonzero or zero) says about integers.
+    void AddConditionFacts(const TOperand& cond, bool taken, int depth = 0) {
+        if (cond.Type != TOperand::EType::Tmp || depth > 4) {
+            return;
+        }
+        auto def = Defs.find(cond.Tmp.Idx);
+        if (def == Defs.end()) {
+            return;
+        }
+        const auto& instr = *def->second;
+        if (instr.Op == "&&"_op && taken) {
+            AddConditionFacts(instr.Operands[0], true, depth + 1);
+            AddConditionFacts(instr.Operands[1], true, depth + 1);
+            return;
+        }
+        if (instr.Op == '!'_op) {
+            AddConditionFacts(instr.Operands[0], !taken, depth + 1);
+            return;
+        }
+        if (instr.Size() != 2
+            || !IsSignedInt(OperandType(instr.Operands[0]))
+            || !IsSignedInt(OperandType(instr.Operands[1])))
+        {
+            return;
+        }
+        // The compare sees i64 values, so it says nothing about a sum that
+        // might have wrapped on the way there.
+        auto a = Expand(instr.Operands[0]);
+        auto b = Expand(instr.Operands[1]);
+        if (!a || !b || !InRange(*a) || !InRange(*b)) {
+            return;
+        }
+        auto diff = [&](const TLinear& x, const TLinear& y, int64_t minus) -> std::optional<TLinear> {
+            auto d = Combine(x, y, -1); // x - y - minus >= 0
+            if (d && !__builtin_sub_overflow(d->Constant, minus, &d->Constant)) {
+                return d;
+            }
+            return std::nullopt;
+        };
+        TOp op = instr.Op;
+        if (!taken) {
+            switch (op) {
+                case '<'_op: op = ">="_op; break;
+                case "<="_op: op = '>'_op; break;
+                case '>'_op: op = "<="_op; break;
+                case ">="_op: op = '<'_op; break;
+                case "=="_op: op = "!="_op; break;
+                case "!="_op: op = "=="_op; break;
+                default: return;
+            }
+        }
+        switch (op) {
+            case ">="_op: AddFact(diff(*a, *b, 0)); break;
+            case '>'_op: AddFact(diff(*a, *b, 1)); break;
+            case "<="_op: AddFact(diff(*b, *a, 0)); break;
+            case '<'_op: AddFact(diff(*b, *a, 1)); break;
+            case "=="_op:
+                AddFact(diff(*a, *b, 0));
+                AddFact(diff(*b, *a, 0));
+                break;
+            default:
+                break;
+        }
+    }
+
+    // A header phi that enters with S and comes back from every latch as
+    // itself plus a positive (negative) constant never drops below (rises
+    // above) S, unless a step wraps it around. That is ruled out by assuming
+    // the phi stays a full step away from the i64 limit: this holds for S and
+    // is checked for the stepped value on every latch (CheckLatches).
+    void AddInductionFacts(int blockIdx) {
+        const int loopIdx = Nest.BlockLoop[blockIdx];
+        if (loopIdx < 0 || Nest.Loops[loopIdx].Header != blockIdx) {
+            return;
+        }
+        const auto& loop = Nest.Loops[loopIdx];
+        std::vector<TLinear> facts;
+        for (const auto& phi : Function.Blocks[blockIdx].Phis) {
+            if (phi.Op != "phi"_op || !IsSignedInt(Function.GetType(phi.Dest))
+                || Rejected.contains(phi.Dest.Idx))
+            {
+                continue;
+            }
+            std::optional<TOperand> start;
+            int direction = 0;
+            __int128_t step = 0;
+            std::vector<std::pair<int, TLinear>> latches;
+            bool ok = true;
+            for (int i = 0; i + 1 < phi.Size() && ok; i += 2) {
+                const auto& value = phi.Operands[i];
+                const int pred = Function.GetBlockIdx(phi.Operands[i + 1].Label);
+                if (!loop.Contains(pred)) {
+                    ok = !start || *start == value;
+                    start = value;
+                    continue;
+                }
+                auto next = Expand(value);
+                if (!next || next->Terms.size() != 1 || !next->Terms.contains(phi.Dest.Idx)
+                    || next->Terms.at(phi.Dest.Idx) != 1 || next->Constant == 0)
+                {
+                    ok = false;
+                    continue;
+                }
+                const int sign = next->Constant > 0 ? 1 : -1;
+                ok = direction == 0 || direction == sign;
+                direction = sign;
+                step = std::max(step, next->Constant * sign);
+                latches.emplace_back(pred, *next);
+            }
+            if (!ok || !start || direction == 0) {
+                continue;
+            }
+            auto startValue = Expand(*start);
+            if (!startValue || !InRange(*startValue)) {
+                continue;
+            }
+            // >= 0 while `value` is a step away from the limit.
+            auto room = [&](const TLinear& value) {
+                return direction > 0
+                    ? Combine(TLinear{MaxI64 - step, {}}, value, -1)
+                    : Combine(value, TLinear{MinI64 + step, {}}, -1);
+            };
+            auto entry = room(*startValue);
+            if (!entry || !Proves(*entry)) {
+                continue;
+            }
+            const TLinear self{0, {{phi.Dest.Idx, 1}}};
+            auto fromStart = direction > 0 ? Combine(self, *startValue, -1) : Combine(*startValue, self, -1);
+            auto selfRoom = room(self);
+            if (!fromStart || !selfRoom) {
+                continue;
+            }
+            facts.push_back(*fromStart);
+            facts.push_back(*selfRoom);
+            for (const auto& [latch, next] : latches) {
+                LatchChecks.emplace(latch, TLatchCheck{phi.Dest.Idx, room(next)});
+            }
+        }
+        // Added after all phis of the header: the entry checks above only
+        // use what holds on the way in.
+        for (auto& fact : facts) {
+            AddFact(std::move(fact));
+        }
+    }
+
+    void CheckLatches(int blockIdx) {
+        auto [begin, end] = LatchChecks.equal_range(blockIdx);
+        for (auto it = begin; it != end; ++it) {
+            const auto& check = it->second;
+            if (!check.Room || !Proves(*check.Room)) {
+                Broken |= Rejected.insert(check.Phi).second;
+            }
+        }
+    }
+
+    void AddEdgeFacts(int blockIdx) {
+        const auto& block = Function.Blocks[blockIdx];
+        if (block.Pred.size() != 1) {
+            return;
+        }
+        const int pred = Function.GetBlockIdx(block.Pred.front());
+        const auto& instrs = Function.Blocks[pred].Instrs;
+        if (instrs.empty() || instrs.back().Op != "cmp"_op) {
+            return;
+        }
+        const auto& cmp = instrs.back();
+        const bool onTrue = cmp.Operands[1].Label.Idx == block.Label.Idx;
+        const bool onFalse = cmp.Operands[2].Label.Idx == block.Label.Idx;
+        if (onTrue != onFalse) {
+            AddConditionFacts(cmp.Operands[0], onTrue);
+        }
+    }
+
+    // value >= 0, from at most two facts; whatever is left over must be
+    // non-negative for every i64 value of its terms.
+    bool Proves(const TLinear& value) const {
+        auto nonNegative = [](const std::optional<TLinear>& rest) {
+            if (!rest) {
+                return false;
+            }
+            __int128_t low = rest->Constant;
+            for (const auto& [tmp, coef] : rest->Terms) {
+                __int128_t term;
+                if (__builtin_mul_overflow(coef, coef > 0 ? MinI64 : MaxI64, &term)
+                    || __builtin_add_overflow(low, term, &low))
+                {
+                    return false;
+                }
+            }
+            return low >= 0;
+        };
+        if (nonNegative(value)) {
+            return true;
+        }
+        for (size_t i = 0; i < Facts.size(); ++i) {
+            auto rest = Combine(value, Facts[i], -1);
+            if (nonNegative(rest)) {
+                return true;
+            }
+            if (!rest) {
+                continue;
+            }
+            for (size_t j = i + 1; j < Facts.size(); ++j) {
+                if (nonNegative(Combine(*rest, Facts[j], -1))) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // The i64 the IR computes for `value` is `value` itself: the sum lies
+    // within the i64 range, so no wrap on the way changed it.
+    bool InRange(const TLinear& value) const {
+        auto belowMax = Combine(TLinear{MaxI64, {}}, value, -1);
+        auto aboveMin = Combine(value, TLinear{MinI64, {}}, -1);
+        return belowMax && aboveMin && Proves(*belowMax) && Proves(*aboveMin);
+    }
+
+    void VisitBlock(int blockIdx) {
+        AddEdgeFacts(blockIdx);
+        AddInductionFacts(blockIdx);
+        for (auto& instr : Function.Blocks[blockIdx].Instrs) {
+            if (instr.Op != "bounds"_op) {
+                continue;
+            }
+            auto index = Expand(instr.Operands[0]);
+            auto size = Expand(instr.Operands[1]);
+            std::optional<TLinear> room; // size - index - 1
+            if (index && size) {
+                room = Combine(*size, *index, -1);
+                if (room && __builtin_sub_overflow(room->Constant, 1, &room->Constant)) {
+                    room.reset();
+                }
+            }
+            // The check compares i64 values; with an exact size, a proven
+            // 0 <= index < size also makes the index exact.
+            const bool exact = index && size && InRange(*index) && InRange(*size);
+            if (exact && room && Proves(*index) && Proves(*room)) {
+                Redundant.push_back(&instr);
+                continue;
+            }
+            // Past this point the check has passed.
+            if (exact) {
+                AddFact(index);
+                AddFact(room);
+            }
+        }
+        CheckLatches(blockIdx);
+    }
+
+    void VisitTree(const TDominatorTree& tree, int entry) {
+        struct TFrame {
+            int Block;
+            size_t NextChild;
+            size_t FactsMark;
+        };
+        std::vector<TFrame> stack;
+        stack.push_back({entry, 0, Facts.size()});
+        VisitBlock(entry);
+        while (!stack.empty()) {
+            auto& frame = stack.back();
+            const auto& children = tree.Children[frame.Block];
+            if (frame.NextChild < children.size()) {
+                const int child = children[frame.NextChild++];
+                stack.push_back({child, 0, Facts.size()});
+                VisitBlock(child);
+                continue;
+            }
+            Facts.resize(frame.FactsMark);
+            stack.pop_back();
+        }
+    }
+
+    TFunction& Function;
+    TModule& Module;
+    TLoopNest Nest;
+    std::unordered_map<int, const TInstr*> Defs;
+    std::unordered_map<int, std::optional<TLinear>> Expanded;
+    // Each one is >= 0 in the block being visited.
+    std::vector<TLinear> Facts;
+
+    struct TLatchCheck {
+        int Phi;
+        // Must be >= 0 at the end of the latch.
+        std::optional<TLinear> Room;
+    };
+    std::unordered_multimap<int, TLatchCheck> LatchChecks;
+    // Header phis whose induction facts did not hold up on a latch.
+    std::unordered_set<int> Rejected;
+    bool Broken = false;
+    std::vector<TInstr*> Redundant;
+};
+
+} // namespace
+
+void EliminateBoundsChecks(TFunction& function, TModule& module) {
+    TBoundsCheckElimination(function, module).Run();
+}
+
+void EliminateBoundsChecks(TModule& module) {
+    for (auto& function : module.Functions) {
+        EliminateBoundsChecks(function, module);
+    }
+}
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
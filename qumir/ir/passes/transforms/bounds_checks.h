@@ -0,0 +1,27 @@
+#pragma once
+
+#include <qumir/ir/builder.h>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+// Removes `bounds index size` checks (see TLowerOptions::BoundsChecks) that
+// can never fail. Index and size are expanded into sums of SSA values with
+// constant coefficients, and a check goes when `index >= 0` and
+// `size - index - 1 >= 0` follow from facts that hold where it runs:
+//  - a loop counter that only steps up from its start (`нц для i от a до b`
+//    gives i - a >= 0), or only steps down;
+//  - the comparison of a branch that must be taken to get there (the loop
+//    test gives b - i >= 0);
+//  - an earlier check that dominates it.
+// The IR wraps on i64 overflow, so a comparison or check only gives a fact
+// if its operands are proven to stay within i64, and a loop counter only if
+// its step is proven not to wrap it; `i + 3 < n` says nothing about i + 3
+// for i close to the i64 maximum. Needs SSA form.
+void EliminateBoundsChecks(TFunction& function, TModule& module);
+void EliminateBoundsChecks(TModule& module);
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
@@ -0,0 +1,96 @@
+#include "dce.h"
+
+#include <qumir/ir/passes/analysis/effects.h>
+
+#include <unordered_map>
+#include <vector>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+using namespace NLiterals;
+
+void EliminateDeadCode(TFunction& function, TModule& module) {
+    std::unordered_map<int, TInstr*> instrDefs; // tmp idx -> defining instr
+    std::unordered_map<int, TPhi*> phiDefs;
+    std::vector<char> live(function.TmpTypes.size(), 0);
+    std::vector<int> worklist;
+
+    auto markUsed = [&](const TOperand& op) {
+        if (op.Type != TOperand::EType::Tmp || op.Tmp.Idx < 0) {
+            return;
+        }
+        if (op.Tmp.Idx >= (int)live.size()) {
+            live.resize(op.Tmp.Idx + 1, 0);
+        }
+        if (!live[op.Tmp.Idx]) {
+            live[op.Tmp.Idx] = 1;
+            worklist.push_back(op.Tmp.Idx);
+        }
+    };
+    auto isRemovable = [](const TInstr& instr) {
+        return instr.Dest.Idx >= 0 && (IsPure(instr.Op) || IsMemoryRead(instr.Op));
+    };
+
+    for (auto& block : function.Blocks) {
+        for (auto& phi : block.Phis) {
+            if (phi.Op == "phi"_op) {
+                phiDefs[phi.Dest.Idx] = &phi;
+            }
+        }
+        for (auto& instr : block.Instrs) {
+            if (instr.Op == "nop"_op) {
+                continue;
+            }
+            if (instr.Dest.Idx >= 0) {
+                instrDefs[instr.Dest.Idx] = &instr;
+            }
+            if (!isRemovable(instr)) {
+                for (int i = 0; i < instr.Size(); ++i) {
+                    markUsed(instr.Operands[i]);
+                }
+            }
+        }
+    }
+
+    while (!worklist.empty()) {
+        const int tmp = worklist.back();
+        worklist.pop_back();
+        if (auto it = instrDefs.find(tmp); it != instrDefs.end()) {
+            for (int i = 0; i < it->second->Size(); ++i) {
+                markUsed(it->second->Operands[i]);
+            }
+        } else if (auto it = phiDefs.find(tmp); it != phiDefs.end()) {
+            for (const auto& op : it->second->Operands) {
+                markUsed(op);
+            }
+        }
+    }
+
+    auto isLive = [&](TTmp tmp) {
+        return tmp.Idx < (int)live.size() && live[tmp.Idx];
+    };
+    for (auto& block : function.Blocks) {
+        for (auto& phi : block.Phis) {
+            if (phi.Op == "phi"_op && !isLive(phi.Dest)) {
+                phi.Clear();
+            }
+        }
+        for (auto& instr : block.Instrs) {
+            if (instr.Op != "nop"_op && isRemovable(instr) && !isLive(instr.Dest)) {
+                instr.Clear();
+            }
+        }
+    }
+}
+
+void EliminateDeadCode(TModule& module) {
+    for (auto& function : module.Functions) {
+        EliminateDeadCode(function, module);
+    }
+}
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
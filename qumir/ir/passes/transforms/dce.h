@@ -0,0 +1,17 @@
+#pragma once
+
+#include <qumir/ir/builder.h>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+// Mark-and-sweep over tmp uses: everything with a side effect is live, and
+// so is whatever computes its operands. Unused pure instructions, loads and
+// phis (dead phi cycles included) become nops.
+void EliminateDeadCode(TFunction& function, TModule& module);
+void EliminateDeadCode(TModule& module);
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
@@ -1,6 +1,7 @@
 #include "de_ssa.h"
 
 #include <iostream>
+#include <vector>
 
 namespace NQumir {
 namespace NIR {
@@ -71,43 +72,60 @@ void DeSSA(TFunction& function, TModule& module) {
             }
         }
 
-        // For each predecessor, insert two-phase copies: capture sources into fresh tmps, then assign to dests
-        for (const auto& entry : perPred) {
-            const TLabel predLabel = entry.first;
-            const auto& pairs = entry.second;
+        // For each predecessor, sequentialize the parallel copy: a copy goes
+        // once no other pending copy still reads its dest, and a cycle
+        // (a swap of two loop variables) is broken through a fresh tmp.
+        for (auto& [predLabel, pending] : perPred) {
             auto& predBlock = function.Blocks[function.GetBlockIdx(predLabel)];
             if (predBlock.Instrs.empty()) {
                 throw std::runtime_error("DeSSA: cannot insert phi assignment into empty predecessor block: " + std::to_string(predLabel.Idx));
             }
-            // Build sequences
-            std::vector<TInstr> preCopies; preCopies.reserve(pairs.size());
-            std::vector<TInstr> postCopies; postCopies.reserve(pairs.size());
-            std::vector<TTmp> temps; temps.reserve(pairs.size());
-            for (const auto& [dest, src] : pairs) {
-                // fresh tmp of the same type as dest
-                TTmp t{ function.NextTmpIdx++ };
-                function.SetType(t, function.GetTmpType(dest.Idx));
-                temps.push_back(t);
-                // t = src
-                preCopies.push_back(TInstr{
-                    .Op = "mov"_op,
-                    .Dest = t,
-                    .Operands = { src },
-                    .OperandCount = 1,
-                });
-                // dest = t
-                postCopies.push_back(TInstr{
+            std::erase_if(pending, [](const auto& copy) {
+                return copy.second == TOperand(copy.first);
+            });
+            auto isRead = [&](TTmp tmp, size_t except) {
+                for (size_t i = 0; i < pending.size(); ++i) {
+                    if (i != except && pending[i].second == TOperand(tmp)) {
+                        return true;
+                    }
+                }
+                return false;
+            };
+            std::vector<TInstr> copies;
+            while (!pending.empty()) {
+                size_t ready = 0;
+                while (ready < pending.size() && isRead(pending[ready].first, ready)) {
+                    ++ready;
+                }
+                if (ready == pending.size()) {
+                    // Every dest is still read: save one and redirect its readers.
+                    const TTmp saved = pending.front().first;
+                    TTmp t{ function.NextTmpIdx++ };
+                    function.SetType(t, function.GetTmpType(saved.Idx));
+                    copies.push_back(TInstr{
+                        .Op = "mov"_op,
+                        .Dest = t,
+                        .Operands = { TOperand(saved) },
+                        .OperandCount = 1,
+                    });
+                    for (auto& copy : pending) {
+                        if (copy.second == TOperand(saved)) {
+                            copy.second = TOperand(t);
+                        }
+                    }
+                    continue;
+                }
+                const auto [dest, src] = pending[ready];
+                copies.push_back(TInstr{
                     .Op = "mov"_op,
                     .Dest = dest,
-                    .Operands = { TOperand(t) },
+                    .Operands = { src },
                     .OperandCount = 1,
                 });
+                pending.erase(pending.begin() + ready);
             }
-            // Insert before the terminator, first all pre-copies then all post-copies
-            auto termIt = predBlock.Instrs.end() - 1;
-            predBlock.Instrs.insert(termIt, preCopies.begin(), preCopies.end());
-            termIt = predBlock.Instrs.end() - 1; // iterator invalidated; recompute
-            predBlock.Instrs.insert(termIt, postCopies.begin(), postCopies.end());
+            // Insert before the terminator
+            predBlock.Instrs.insert(predBlock.Instrs.end() - 1, copies.begin(), copies.end());
         }
         // Remove phis from the block after lowering
         block.Phis.clear();
@@ -0,0 +1,210 @@
+#include "gvn.h"
+
+#include <qumir/ir/passes/analysis/dominators.h>
+#include <qumir/ir/passes/analysis/effects.h>
+
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+using namespace NLiterals;
+
+namespace {
+
+using TKey = std::vector<int64_t>;
+
+void AppendOperand(TKey& key, const TOperand& op) {
+    key.push_back(static_cast<int64_t>(op.Type));
+    switch (op.Type) {
+        case TOperand::EType::Tmp:
+            key.push_back(op.Tmp.Idx);
+            break;
+        case TOperand::EType::Slot:
+            key.push_back(op.Slot.Idx);
+            break;
+        case TOperand::EType::Local:
+            key.push_back(op.Local.Idx);
+            break;
+        case TOperand::EType::Imm:
+            key.push_back(op.Imm.Value);
+            key.push_back(op.Imm.TypeId);
+            break;
+        case TOperand::EType::Label:
+            key.push_back(op.Label.Idx);
+            break;
+    }
+}
+
+struct TValueNumbering {
+    TValueNumbering(TFunction& function)
+        : Function(function)
+    { }
+
+    void Run() {
+        // A local that is never stored to and whose address is never taken
+        // (arguments, typically) holds the same value everywhere, so its
+        // loads number like pure instructions.
+        WrittenLocals.assign(Function.LocalTypes.size(), 0);
+        for (const auto& block : Function.Blocks) {
+            for (const auto& instr : block.Instrs) {
+                if (instr.Op == "load"_op) {
+                    continue;
+                }
+                for (int i = 0; i < instr.Size(); ++i) {
+                    const auto& op = instr.Operands[i];
+                    if (op.Type == TOperand::EType::Local && op.Local.Idx >= 0) {
+                        if (op.Local.Idx >= (int)WrittenLocals.size()) {
+                            WrittenLocals.resize(op.Local.Idx + 1, 0);
+                        }
+                        WrittenLocals[op.Local.Idx] = 1;
+                    }
+                }
+            }
+        }
+
+        auto tree = BuildDominatorTree(Function);
+        if (tree.RPO.empty()) {
+            return;
+        }
+        VisitTree(tree, tree.RPO[0]);
+
+        // Phi operands flow in from predecessors that may not have been
+        // visited when the phi was, and unreachable blocks are not visited
+        // at all.
+        for (auto& block : Function.Blocks) {
+            for (auto& phi : block.Phis) {
+                for (auto& op : phi.Operands) {
+                    Resolve(op);
+                }
+            }
+            for (auto& instr : block.Instrs) {
+                for (int i = 0; i < instr.Size(); ++i) {
+                    Resolve(instr.Operands[i]);
+                }
+            }
+        }
+    }
+
+    // Preorder over the dominator tree: the table holds exactly the values
+    // computed in positions that dominate the current block.
+
+    void VisitTree(const TDominatorTree& tree, int entry) {
+        struct TFrame {
+            int Block;
+            size_t NextChild;
+            size_t UndoMark;
+        };
+        std::vector<TFrame> stack;
+        stack.push_back({entry, 0, Undo.size()});
+        VisitBlock(entry);
+        while (!stack.empty()) {
+            auto& frame = stack.back();
+            const auto& children = tree.Children[frame.Block];
+            if (frame.NextChild < children.size()) {
+                const int child = children[frame.NextChild++];
+                stack.push_back({child, 0, Undo.size()});
+                VisitBlock(child);
+                continue;
+            }
+            while (Undo.size() > frame.UndoMark) {
+                Table.erase(Undo.back());
+                Undo.pop_back();
+            }
+            stack.pop_back();
+        }
+    }
+
+    void VisitBlock(int blockIdx) {
+        // Loads are keyed by block and by the number of possible writes
+        // seen so far in it.
+        int64_t memoryEpoch = 0;
+        for (auto& instr : Function.Blocks[blockIdx].Instrs) {
+            if (instr.Op == "nop"_op) {
+                continue;
+            }
+            for (int i = 0; i < instr.Size(); ++i) {
+                Resolve(instr.Operands[i]);
+            }
+            const bool pure = IsPure(instr.Op) || IsInvariantLoad(instr);
+            const bool load = !pure && IsMemoryRead(instr.Op);
+            if (!pure && !load) {
+                ++memoryEpoch;
+                continue;
+            }
+            if (instr.Dest.Idx < 0) {
+                continue;
+            }
+
+            TKey key;
+            key.push_back(static_cast<int64_t>(instr.Op.Code));
+            key.push_back(Function.GetType(instr.Dest));
+            if (load) {
+                key.push_back(blockIdx);
+                key.push_back(memoryEpoch);
+            }
+            const bool swap = IsCommutative(instr.Op) && instr.Size() == 2;
+            TKey lhs, rhs;
+            for (int i = 0; i < instr.Size(); ++i) {
+                AppendOperand(i == 0 || !swap ? lhs : rhs, instr.Operands[i]);
+            }
+            if (swap && rhs < lhs) {
+                std::swap(lhs, rhs);
+            }
+            key.insert(key.end(), lhs.begin(), lhs.end());
+            key.insert(key.end(), rhs.begin(), rhs.end());
+
+            auto [it, inserted] = Table.emplace(std::move(key), instr.Dest);
+            if (inserted) {
+                Undo.push_back(it);
+            } else {
+                Replacements[instr.Dest.Idx] = it->second;
+                instr.Clear();
+            }
+        }
+    }
+
+    bool IsInvariantLoad(const TInstr& instr) const {
+        if (instr.Op != "load"_op || instr.Size() != 1 || instr.Operands[0].Type != TOperand::EType::Local) {
+            return false;
+        }
+        const int local = instr.Operands[0].Local.Idx;
+        return local >= 0 && (local >= (int)WrittenLocals.size() || !WrittenLocals[local]);
+    }
+
+    void Resolve(TOperand& op) {
+        while (op.Type == TOperand::EType::Tmp) {
+            auto it = Replacements.find(op.Tmp.Idx);
+            if (it == Replacements.end()) {
+                break;
+            }
+            op = it->second;
+        }
+    }
+
+    TFunction& Function;
+    std::map<TKey, TTmp> Table;
+    std::vector<std::map<TKey, TTmp>::iterator> Undo;
+    std::unordered_map<int, TTmp> Replacements;
+    std::vector<char> WrittenLocals;
+};
+
+} // namespace
+
+void GlobalValueNumbering(TFunction& function, TModule& module) {
+    TValueNumbering(function).Run();
+}
+
+void GlobalValueNumbering(TModule& module) {
+    for (auto& function : module.Functions) {
+        GlobalValueNumbering(function, module);
+    }
+}
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
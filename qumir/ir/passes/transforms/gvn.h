@@ -0,0 +1,19 @@
+#pragma once
+
+#include <qumir/ir/builder.h>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+// Dominator-scoped value numbering: a pure instruction that repeats one in
+// a dominating position (same op, result type and operands) is removed and
+// its uses take the earlier result. Loads only match within a block and
+// while no instruction that may write memory lies in between.
+// Works on SSA and on freshly lowered IR alike, since tmps are defined once.
+void GlobalValueNumbering(TFunction& function, TModule& module);
+void GlobalValueNumbering(TModule& module);
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
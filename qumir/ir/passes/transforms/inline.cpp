@@ -0,0 +1,315 @@
+#include "inline.h"
+
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+using namespace NLiterals;
+
+namespace {
+
+int FunctionSize(const TFunction& function) {
+    int size = 0;
+    for (const auto& block : function.Blocks) {
+        for (const auto& phi : block.Phis) {
+            size += phi.Op != "nop"_op;
+        }
+        for (const auto& instr : block.Instrs) {
+            size += instr.Op != "nop"_op;
+        }
+    }
+    return size;
+}
+
+class TInliner {
+public:
+    TInliner(TModule& module, const TInlineOptions& options)
+        : Module(module)
+        , Options(options)
+    { }
+
+    void Run() {
+        // Bottom-up: a function is done once everything it calls is done,
+        // except for callees still on the stack (recursion).
+        State.assign(Module.Functions.size(), EState::New);
+        for (int i = 0; i < (int)Module.Functions.size(); ++i) {
+            Visit(i);
+        }
+    }
+
+private:
+    enum class EState {
+        New,
+        Active,
+        Done,
+    };
+
+    int CalleeIdx(const TInstr& instr) const {
+        if (instr.Op != "call"_op) {
+            return -1;
+        }
+        auto it = Module.SymIdToFuncIdx.find(instr.Operands[0].Imm.Value);
+        return it == Module.SymIdToFuncIdx.end() ? -1 : it->second;
+    }
+
+    void Visit(int root) {
+        if (State[root] != EState::New) {
+            return;
+        }
+        // Iterative DFS: call chains can be deep.
+        std::vector<std::pair<int, std::vector<int>>> stack;
+        auto enter = [&](int f) {
+            State[f] = EState::Active;
+            std::vector<int> callees;
+            for (const auto& block : Module.Functions[f].Blocks) {
+                for (const auto& instr : block.Instrs) {
+                    if (int callee = CalleeIdx(instr); callee >= 0) {
+                        callees.push_back(callee);
+                    }
+                }
+            }
+            stack.push_back({f, std::move(callees)});
+        };
+        enter(root);
+        while (!stack.empty()) {
+            auto& [f, callees] = stack.back();
+            if (!callees.empty()) {
+                const int callee = callees.back();
+                callees.pop_back();
+                if (State[callee] == EState::New) {
+                    enter(callee);
+                }
+                continue;
+            }
+            const int done = f;
+            stack.pop_back();
+            InlineInto(Module.Functions[done]);
+            State[done] = EState::Done;
+        }
+    }
+
+    bool CanInline(const TFunction& caller, const TFunction& callee, int calleeIdx) const {
+        if (State[calleeIdx] != EState::Done || &caller == &callee) {
+            return false;
+        }
+        if (callee.IsCoroutine || callee.Blocks.empty()) {
+            return false;
+        }
+        for (const auto& block : callee.Blocks) {
+            for (const auto& instr : block.Instrs) {
+                // A dynamic stack allocation lives until the frame goes
+                // away, which the caller's frame would postpone.
+                if (instr.Op == "salloc"_op) {
+                    return false;
+                }
+            }
+        }
+        return FunctionSize(callee) <= Options.MaxCalleeSize;
+    }
+
+    void InlineInto(TFunction& caller) {
+        if (caller.IsCoroutine) {
+            return;
+        }
+        int callerSize = FunctionSize(caller);
+        bool changed = false;
+        // Blocks are appended as calls get inlined; the copied bodies are
+        // scanned as well, their calls were left in place for a reason and
+        // stay.
+        for (int blockIdx = 0; blockIdx < (int)caller.Blocks.size(); ++blockIdx) {
+            for (int i = 0; i < (int)caller.Blocks[blockIdx].Instrs.size(); ++i) {
+                const auto& instr = caller.Blocks[blockIdx].Instrs[i];
+                const int calleeIdx = CalleeIdx(instr);
+                if (calleeIdx < 0 || callerSize > Options.MaxCallerSize) {
+                    continue;
+                }
+                const auto& callee = Module.Functions[calleeIdx];
+                if (!CanInline(caller, callee, calleeIdx)) {
+                    continue;
+                }
+                if (InlineCall(caller, blockIdx, i, callee)) {
+                    callerSize += FunctionSize(callee);
+                    changed = true;
+                    break; // the rest of the block moved to a new one
+                }
+            }
+        }
+        if (changed) {
+            caller.CfgBuilt = false;
+            caller.LabelToBlockIdx.clear();
+            caller.Label2Idx.assign(caller.NextLabelIdx, -1);
+            for (int i = 0; i < (int)caller.Blocks.size(); ++i) {
+                caller.LabelToBlockIdx[caller.Blocks[i].Label] = i;
+                caller.Label2Idx[caller.Blocks[i].Label.Idx] = i;
+            }
+        }
+    }
+
+    // Splits the caller block at the call: the head stores the arguments and
+    // jumps into the copied body, whose rets jump to the tail.
+    bool InlineCall(TFunction& caller, int blockIdx, int callPos, const TFunction& callee) {
+        auto& instrs = caller.Blocks[blockIdx].Instrs;
+        const int argCount = static_cast<int>(callee.ArgLocals.size());
+        int firstArg = callPos;
+        while (firstArg > 0 && callPos - firstArg < argCount && instrs[firstArg - 1].Op == "arg"_op) {
+            --firstArg;
+        }
+        if (callPos - firstArg != argCount) {
+            return false;
+        }
+
+        const TInstr call = instrs[callPos];
+        const int localBase = static_cast<int>(caller.LocalTypes.size());
+        const int tmpBase = caller.NextTmpIdx;
+        caller.LocalTypes.insert(caller.LocalTypes.end(), callee.LocalTypes.begin(), callee.LocalTypes.end());
+        caller.NextTmpIdx += callee.NextTmpIdx;
+        for (int t = 0; t < (int)callee.TmpTypes.size(); ++t) {
+            if (callee.TmpTypes[t] >= 0) {
+                caller.SetType(TTmp{tmpBase + t}, callee.TmpTypes[t]);
+            }
+        }
+        std::vector<int> labelMap(callee.NextLabelIdx, -1);
+        for (const auto& block : callee.Blocks) {
+            labelMap[block.Label.Idx] = caller.NextLabelIdx++;
+        }
+        const TLabel tailLabel{caller.NextLabelIdx++};
+
+        std::optional<TLocal> result;
+        if (call.Dest.Idx >= 0 && callee.ReturnTypeId >= 0) {
+            result = TLocal{static_cast<int>(caller.LocalTypes.size())};
+            caller.LocalTypes.push_back(callee.ReturnTypeId);
+        }
+
+        auto remap = [&](TOperand op) {
+            switch (op.Type) {
+                case TOperand::EType::Tmp:
+                    if (op.Tmp.Idx >= 0) {
+                        op.Tmp.Idx += tmpBase;
+                    }
+                    break;
+                case TOperand::EType::Local:
+                    op.Local.Idx += localBase;
+                    break;
+                case TOperand::EType::Label:
+                    op.Label.Idx = labelMap[op.Label.Idx];
+                    break;
+                default:
+                    break;
+            }
+            return op;
+        };
+
+        TBlock tail{
+            .Label = tailLabel,
+            .Instrs = {instrs.begin() + callPos + 1, instrs.end()},
+            .Line = caller.Blocks[blockIdx].Line,
+        };
+        if (result) {
+            TInstr load{.Op = "load"_op, .Dest = call.Dest, .Operands = {TOperand{*result}}, .OperandCount = 1};
+            tail.Instrs.insert(tail.Instrs.begin(), load);
+        }
+
+        std::vector<TOperand> args;
+        for (int i = firstArg; i < callPos; ++i) {
+            args.push_back(instrs[i].Operands[0]);
+        }
+        instrs.erase(instrs.begin() + firstArg, instrs.end());
+        for (int i = 0; i < argCount; ++i) {
+            const TLocal local{callee.ArgLocals[i].Idx + localBase};
+            instrs.push_back(TInstr{.Op = "stre"_op, .Operands = {TOperand{local}, args[i]}, .OperandCount = 2});
+        }
+        // label(0) is the entry, as in ComputeRPO.
+        const TLabel entryLabel{labelMap[0]};
+        instrs.push_back(TInstr{.Op = "jmp"_op, .Operands = {TOperand{entryLabel}}, .OperandCount = 1});
+
+        // Phis that named the split block now come from the tail.
+        const TLabel headLabel = caller.Blocks[blockIdx].Label;
+        for (auto& block : caller.Blocks) {
+            for (auto& phi : block.Phis) {
+                for (auto& op : phi.Operands) {
+                    if (op.Type == TOperand::EType::Label && op.Label == headLabel) {
+                        op.Label = tailLabel;
+                    }
+                }
+            }
+        }
+
+        for (const auto& calleeBlock : callee.Blocks) {
+            TBlock block{
+                .Label = TLabel{labelMap[calleeBlock.Label.Idx]},
+                .Line = calleeBlock.Line,
+            };
+            for (const auto& phi : calleeBlock.Phis) {
+                if (phi.Op == "nop"_op) {
+                    continue;
+                }
+                TPhi copy{.Op = phi.Op, .Dest = TTmp{phi.Dest.Idx + tmpBase}};
+                for (const auto& op : phi.Operands) {
+                    copy.Operands.push_back(remap(op));
+                }
+                block.Phis.push_back(std::move(copy));
+            }
+            for (const auto& calleeInstr : calleeBlock.Instrs) {
+                if (calleeInstr.Op == "nop"_op) {
+                    continue;
+                }
+                if (calleeInstr.Op == "ret"_op) {
+                    if (result && calleeInstr.Size() == 1) {
+                        block.Instrs.push_back(TInstr{
+                            .Op = "stre"_op,
+                            .Operands = {TOperand{*result}, remap(calleeInstr.Operands[0])},
+                            .OperandCount = 2,
+                        });
+                    }
+                    block.Instrs.push_back(TInstr{.Op = "jmp"_op, .Operands = {TOperand{tailLabel}}, .OperandCount = 1});
+                    continue;
+                }
+                TInstr copy = calleeInstr;
+                if (copy.Dest.Idx >= 0) {
+                    copy.Dest.Idx += tmpBase;
+                }
+                for (int i = 0; i < copy.Size(); ++i) {
+                    copy.Operands[i] = remap(copy.Operands[i]);
+                }
+                block.Instrs.push_back(copy);
+            }
+            caller.Blocks.push_back(std::move(block));
+        }
+        caller.Blocks.push_back(std::move(tail));
+        return true;
+    }
+
+    TModule& Module;
+    const TInlineOptions& Options;
+    std::vector<EState> State;
+};
+
+} // namespace
+
+TInlineOptions InlineOptionsForLevel(int optLevel) {
+    if (optLevel <= 0) {
+        return {};
+    }
+    if (optLevel == 1) {
+        return {.MaxCalleeSize = 24, .MaxCallerSize = 1000};
+    }
+    if (optLevel == 2) {
+        return {.MaxCalleeSize = 64, .MaxCallerSize = 4000};
+    }
+    return {.MaxCalleeSize = 128, .MaxCallerSize = 8000};
+}
+
+void InlineFunctions(TModule& module, const TInlineOptions& options) {
+    if (options.MaxCalleeSize <= 0) {
+        return;
+    }
+    TInliner(module, options).Run();
+}
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <qumir/ir/builder.h>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+struct TInlineOptions {
+    // Callees of at most this many instructions are inlined; 0 disables.
+    int MaxCalleeSize = 0;
+    // A caller stops taking callees once it grows past this size.
+    int MaxCallerSize = 0;
+};
+
+TInlineOptions InlineOptionsForLevel(int optLevel);
+
+// Replaces calls of small module functions by a copy of their body. Works
+// bottom-up over the call graph, so helpers are inlined into their callers
+// before those are measured; calls within a recursive cycle and
+// coroutines on either side stay calls. Arguments become stores to copies
+// of the callee's locals and every ret a store to a result local followed
+// by a jump to the rest of the caller, so the caller needs
+// PromoteLocalsToSSA afterwards to get rid of them.
+void InlineFunctions(TModule& module, const TInlineOptions& options);
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
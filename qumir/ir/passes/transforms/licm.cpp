@@ -0,0 +1,224 @@
+#include "licm.h"
+
+#include <qumir/ir/passes/analysis/dominators.h>
+#include <qumir/ir/passes/analysis/effects.h>
+#include <qumir/ir/passes/analysis/loops.h>
+
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+using namespace NLiterals;
+
+namespace {
+
+// What the instructions of one loop may write.
+struct TLoopWrites {
+    std::unordered_set<int> Locals;
+    std::unordered_set<int> Slots;
+    // ste through a pointer or a call into the runtime: reaches any memory
+    // whose address was taken.
+    bool Escaped = false;
+    // call of a module function or await: may write any global as well.
+    bool Globals = false;
+};
+
+class TLoopInvariantMotion {
+public:
+    TLoopInvariantMotion(TFunction& function, TModule& module, const TGlobalFacts* facts)
+        : Function(function)
+        , Module(module)
+        , Facts(facts)
+    { }
+
+    void Run() {
+        auto tree = BuildDominatorTree(Function);
+        auto nest = FindLoops(Function, tree);
+        if (nest.Loops.empty()) {
+            return;
+        }
+
+        for (int i = 0; i < (int)Function.Blocks.size(); ++i) {
+            const auto& block = Function.Blocks[i];
+            for (const auto& phi : block.Phis) {
+                if (phi.Op == "phi"_op) {
+                    DefBlock[phi.Dest.Idx] = i;
+                }
+            }
+            for (const auto& instr : block.Instrs) {
+                if (instr.Dest.Idx >= 0) {
+                    DefBlock[instr.Dest.Idx] = i;
+                }
+                if (instr.Op == "lea"_op && instr.Size() == 1
+                    && instr.Operands[0].Type == TOperand::EType::Local)
+                {
+                    AddressTakenLocals.insert(instr.Operands[0].Local.Idx);
+                }
+            }
+        }
+
+        // Blocks of a loop in RPO: a def is visited before its uses.
+        std::vector<int> order(Function.Blocks.size(), -1);
+        for (int i = 0; i < (int)tree.RPO.size(); ++i) {
+            order[tree.RPO[i]] = i;
+        }
+        for (int i = (int)nest.Loops.size() - 1; i >= 0; --i) {
+            auto& loop = nest.Loops[i];
+            if (loop.Preheader < 0) {
+                continue;
+            }
+            std::vector<int> blocks = loop.Blocks;
+            std::sort(blocks.begin(), blocks.end(), [&](int a, int b) {
+                return order[a] < order[b];
+            });
+            Hoist(loop, blocks);
+        }
+    }
+
+private:
+    void Hoist(const TLoop& loop, const std::vector<int>& blocks) {
+        const auto writes = CollectWrites(blocks);
+        auto& preheader = Function.Blocks[loop.Preheader];
+        std::vector<TInstr> hoisted;
+        for (int blockIdx : blocks) {
+            for (auto& instr : Function.Blocks[blockIdx].Instrs) {
+                if (instr.Op == "nop"_op || instr.Dest.Idx < 0 || !CanHoist(instr, writes)) {
+                    continue;
+                }
+                bool invariant = true;
+                for (int i = 0; i < instr.Size() && invariant; ++i) {
+                    const auto& op = instr.Operands[i];
+                    if (op.Type == TOperand::EType::Tmp) {
+                        auto it = DefBlock.find(op.Tmp.Idx);
+                        invariant = it == DefBlock.end() || !loop.Contains(it->second);
+                    }
+                }
+                if (!invariant) {
+                    continue;
+                }
+                DefBlock[instr.Dest.Idx] = loop.Preheader;
+                hoisted.push_back(instr);
+                instr.Clear();
+            }
+        }
+        if (hoisted.empty()) {
+            return;
+        }
+        // The preheader ends with its jump into the loop.
+        auto& instrs = preheader.Instrs;
+        instrs.insert(instrs.end() - 1, hoisted.begin(), hoisted.end());
+    }
+
+    bool CanHoist(const TInstr& instr, const TLoopWrites& writes) {
+        if (instr.Op == '/'_op || instr.Op == '%'_op) {
+            return Module.Types.IsFloat(Function.GetType(instr.Dest));
+        }
+        if (IsPure(instr.Op)) {
+            return true;
+        }
+        if (instr.Op != "load"_op || instr.Size() != 1) {
+            return false;
+        }
+        const int destType = Function.GetType(instr.Dest);
+        if (destType >= 0 && Module.Types.GetKind(destType) == EKind::Struct) {
+            // A struct load is an address in the VM; its fields may still change.
+            return false;
+        }
+        const auto& op = instr.Operands[0];
+        if (op.Type == TOperand::EType::Local) {
+            const int local = op.Local.Idx;
+            return !writes.Locals.contains(local)
+                && !((writes.Escaped || writes.Globals) && AddressTakenLocals.contains(local));
+        }
+        if (op.Type == TOperand::EType::Slot) {
+            const int slot = op.Slot.Idx;
+            return !writes.Globals
+                && !writes.Slots.contains(slot)
+                && !(writes.Escaped && IsSlotAddressTaken(slot));
+        }
+        return false;
+    }
+
+    TLoopWrites CollectWrites(const std::vector<int>& blocks) {
+        TLoopWrites writes;
+        for (int blockIdx : blocks) {
+            for (const auto& instr : Function.Blocks[blockIdx].Instrs) {
+                if (instr.Op == "nop"_op || IsPure(instr.Op) || IsMemoryRead(instr.Op)) {
+                    continue;
+                }
+                switch (instr.Op) {
+                    case "stre"_op: {
+                        const auto& target = instr.Operands[0];
+                        if (target.Type == TOperand::EType::Local) {
+                            writes.Locals.insert(target.Local.Idx);
+                        } else if (target.Type == TOperand::EType::Slot) {
+                            writes.Slots.insert(target.Slot.Idx);
+                        } else {
+                            writes.Escaped = true;
+                        }
+                        break;
+                    }
+                    case "call"_op: {
+                        const int64_t callee = instr.Operands[0].Imm.Value;
+                        if (Module.SymIdToExtFuncIdx.contains(callee)) {
+                            writes.Escaped = true;
+                        } else {
+                            writes.Globals = writes.Escaped = true;
+                        }
+                        break;
+                    }
+                    case "arg"_op:
+                    case "jmp"_op:
+                    case "cmp"_op:
+                    case "ret"_op:
+                        break;
+                    case "ste"_op:
+                        writes.Escaped = true;
+                        break;
+                    default:
+                        // await and anything unfamiliar
+                        writes.Globals = writes.Escaped = true;
+                        break;
+                }
+            }
+        }
+        return writes;
+    }
+
+    bool IsSlotAddressTaken(int slot) {
+        if (!Facts) {
+            // Any function may pass the address of a global along.
+            Facts = &CollectedFacts.emplace(CollectGlobalFacts(Module));
+        }
+        return Facts->AddressTakenSlots.contains(slot);
+    }
+
+    TFunction& Function;
+    TModule& Module;
+    std::unordered_map<int, int> DefBlock; // tmp idx -> block idx
+    std::unordered_set<int> AddressTakenLocals;
+    const TGlobalFacts* Facts;
+    std::optional<TGlobalFacts> CollectedFacts;
+};
+
+} // namespace
+
+void HoistLoopInvariants(TFunction& function, TModule& module, const TGlobalFacts* facts) {
+    TLoopInvariantMotion(function, module, facts).Run();
+}
+
+void HoistLoopInvariants(TModule& module) {
+    for (auto& function : module.Functions) {
+        HoistLoopInvariants(function, module);
+    }
+}
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <qumir/ir/builder.h>
+#include <qumir/ir/passes/analysis/globals.h>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+// Loop-invariant code motion: pure instructions whose operands are defined
+// outside a loop, and loads of locals/globals the loop cannot write, move
+// to the loop preheader. Inner loops go first, so invariants climb as far
+// out as they can. Integer division stays put: hoisting it could trap in a
+// loop that never runs. Which globals have their address taken comes from
+// facts, or from the module as it is now.
+void HoistLoopInvariants(TFunction& function, TModule& module, const TGlobalFacts* facts = nullptr);
+void HoistLoopInvariants(TModule& module);
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
@@ -0,0 +1,544 @@
+#include "ownership.h"
+
+#include <qumir/ir/passes/analysis/effects.h>
+#include <qumir/runtime/string.h>
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+using namespace NLiterals;
+
+namespace {
+
+// Read their string arguments and nothing else: the strings are neither
+// kept nor is their count or symbol index touched, so a string built in the
+// frame can be passed to them.
+const std::unordered_set<std::string_view> ReadOnly = {
+    "output_string", "str_concat", "str_compare", "str_str", "str_str_from",
+    "str_to_int", "str_to_double",
+};
+
+// Leave every reference count alone and write no memory the caller can
+// see: a retain/release pair may be dropped around them.
+const std::unordered_set<std::string_view> Neutral = {
+    "output_string", "output_int64", "output_double", "output_bool", "output_symbol",
+    "str_retain", "str_concat", "str_compare", "str_str", "str_str_from",
+    "str_len", "str_slice", "str_symbol_at",
+    "str_from_lit", "str_from_unicode", "str_from_int", "str_from_double",
+    "str_init_lit", "str_init_unicode",
+};
+
+// Return a string nobody else holds yet.
+const std::unordered_set<std::string_view> Fresh = {
+    "str_from_lit", "str_from_unicode", "str_from_int", "str_from_double",
+    "str_concat", "str_slice", "str_input",
+};
+
+// Values are tmps, after following loads of a known value; -1 never
+// matches anything.
+constexpr int64_t Unknown = -1;
+constexpr int64_t Null = -2;
+
+// Where a string pointer is kept: a local ({0, local}), or the memory behind
+// a pointer value ({1, value}).
+using TPlace = std::pair<int, int64_t>;
+
+// What the instructions seen so far in a block say about memory.
+struct TBlockState {
+    std::map<TPlace, int64_t> Content;
+    std::unordered_map<int, TPlace> Loaded; // tmp -> the place it was read from
+};
+
+class TOwnership {
+public:
+    TOwnership(TFunction& function, TModule& module)
+        : Function(function)
+        , Module(module)
+    {
+        for (const auto& ext : module.ExternalFunctions) {
+            Names.emplace(ext.SymId, ext.MangledName);
+            Syms.emplace(ext.MangledName, ext.SymId);
+        }
+    }
+
+    void Run() {
+        if (!Syms.contains("str_release")) {
+            return;
+        }
+        Index();
+        for (auto& block : Function.Blocks) {
+            AppendInPlace(block);
+            PairRetainRelease(block);
+            // A coroutine frame does not stay put across a suspension.
+            if (!Function.IsCoroutine) {
+                KeepInFrame(block);
+            }
+        }
+    }
+
+private:
+    void Index() {
+        Uses.assign(Function.NextTmpIdx, 0);
+        auto use = [&](const TOperand& op) {
+            if (op.Type == TOperand::EType::Tmp && op.Tmp.Idx >= 0) {
+                if (op.Tmp.Idx >= (int)Uses.size()) {
+                    Uses.resize(op.Tmp.Idx + 1, 0);
+                }
+                ++Uses[op.Tmp.Idx];
+            }
+        };
+        for (const auto& block : Function.Blocks) {
+            for (const auto& phi : block.Phis) {
+                for (const auto& op : phi.Operands) {
+                    use(op);
+                }
+            }
+            for (const auto& instr : block.Instrs) {
+                for (int i = 0; i < instr.Size(); ++i) {
+                    use(instr.Operands[i]);
+                }
+                if (instr.Dest.Idx < 0) {
+                    continue;
+                }
+                if (instr.Op == "lea"_op && instr.Operands[0].Type == TOperand::EType::Local) {
+                    LeaOf[instr.Dest.Idx] = instr.Operands[0].Local.Idx;
+                } else if (instr.Op == "bitcast"_op
+                    && instr.Operands[0].Type == TOperand::EType::Imm
+                    && instr.Operands[0].Imm.Value == 0)
+                {
+                    Alias[instr.Dest.Idx] = Null;
+                } else if (instr.Op == "call"_op) {
+                    DefCallee[instr.Dest.Idx] = Callee(instr);
+                }
+            }
+        }
+    }
+
+    std::string_view Callee(const TInstr& call) const {
+        auto it = Names.find(call.Operands[0].Imm.Value);
+        return it != Names.end() ? std::string_view(it->second) : std::string_view();
+    }
+
+    // The arg instructions right before the call.
+    std::vector<int> Args(const TBlock& block, int call) const {
+        std::vector<int> args;
+        for (int i = call - 1; i >= 0; --i) {
+            const auto& instr = block.Instrs[i];
+            if (instr.Op == "arg"_op) {
+                args.push_back(i);
+            } else if (instr.Op != "nop"_op) {
+                break;
+            }
+        }
+        std::reverse(args.begin(), args.end());
+        return args;
+    }
+
+    // The call an arg instruction belongs to, -1 if none.
+    int CallOf(const TBlock& block, int arg) const {
+        for (int i = arg + 1; i < (int)block.Instrs.size(); ++i) {
+            const auto& instr = block.Instrs[i];
+            if (instr.Op == "call"_op) {
+                return i;
+            }
+            if (instr.Op != "arg"_op && instr.Op != "nop"_op) {
+                break;
+            }
+        }
+        return -1;
+    }
+
+    int64_t Value(const TOperand& op) const {
+        if (op.Type == TOperand::EType::Imm) {
+            return op.Imm.Value == 0 ? Null : Unknown;
+        }
+        if (op.Type != TOperand::EType::Tmp || op.Tmp.Idx < 0) {
+            return Unknown;
+        }
+        auto it = Alias.find(op.Tmp.Idx);
+        return it != Alias.end() ? it->second : op.Tmp.Idx;
+    }
+
+    std::optional<TPlace> Place(const TOperand& address) const {
+        if (address.Type == TOperand::EType::Local) {
+            return TPlace{0, address.Local.Idx};
+        }
+        if (address.Type != TOperand::EType::Tmp) {
+            return std::nullopt;
+        }
+        if (auto it = LeaOf.find(address.Tmp.Idx); it != LeaOf.end()) {
+            return TPlace{0, it->second};
+        }
+        const int64_t value = Value(address);
+        if (value < 0) {
+            return std::nullopt;
+        }
+        return TPlace{1, value};
+    }
+
+    void Step(TBlockState& state, const TInstr& instr) {
+        if (IsMemoryRead(instr.Op)) {
+            auto place = instr.Dest.Idx >= 0 && instr.Size() == 1
+                ? Place(instr.Operands[0])
+                : std::nullopt;
+            if (!place) {
+                return;
+            }
+            state.Loaded[instr.Dest.Idx] = *place;
+            auto [it, inserted] = state.Content.emplace(*place, instr.Dest.Idx);
+            if (!inserted) {
+                Alias[instr.Dest.Idx] = it->second;
+            }
+        } else if (instr.Op == "stre"_op || instr.Op == "ste"_op) {
+            auto place = Place(instr.Operands[0]);
+            // A store through a pointer may hit any place, one to a local
+            // any pointer to it.
+            if (!place || place->first == 1) {
+                state.Content.clear();
+            } else {
+                std::erase_if(state.Content, [](const auto& item) {
+                    return item.first.first == 1;
+                });
+            }
+            const int64_t value = Value(instr.Operands[1]);
+            if (place && value != Unknown) {
+                state.Content[*place] = value;
+            } else if (place) {
+                state.Content.erase(*place);
+            }
+        } else if (instr.Op == "call"_op) {
+            if (!Neutral.contains(Callee(instr))) {
+                state.Content.clear();
+            }
+        } else if (!IsPure(instr.Op)) {
+            switch (instr.Op) {
+                case "arg"_op: case "salloc"_op: case "bounds"_op: case "nop"_op:
+                case "jmp"_op: case "cmp"_op: case "ret"_op:
+                    break;
+                default:
+                    state.Content.clear();
+            }
+        }
+    }
+
+    void Drop(TInstr& instr) {
+        for (int i = 0; i < instr.Size(); ++i) {
+            const auto& op = instr.Operands[i];
+            if (op.Type == TOperand::EType::Tmp && op.Tmp.Idx >= 0 && op.Tmp.Idx < (int)Uses.size()) {
+                --Uses[op.Tmp.Idx];
+            }
+        }
+        instr.Clear();
+    }
+
+    int DefinedAt(const TBlock& block, int tmp) const {
+        for (int i = 0; i < (int)block.Instrs.size(); ++i) {
+            if (block.Instrs[i].Dest.Idx == tmp) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    void AppendInPlace(TBlock& block) {
+        auto append = Syms.find("str_append");
+        if (append == Syms.end()) {
+            return;
+        }
+        TBlockState state;
+        for (int i = 0; i < (int)block.Instrs.size(); ++i) {
+            if (block.Instrs[i].Op == "call"_op && Callee(block.Instrs[i]) == "str_concat") {
+                i += TryAppend(block, state, i, append->second);
+            }
+            Step(state, block.Instrs[i]);
+        }
+    }
+
+    // `c = str_concat(a, b)` with a what some place holds, followed by the
+    // replace protocol for that place: the old value read again and
+    // released, c stored. Returns by how much the call moved.
+    int TryAppend(TBlock& block, TBlockState& state, int call, int appendSym) {
+        auto& instrs = block.Instrs;
+        const auto args = Args(block, call);
+        const int result = instrs[call].Dest.Idx;
+        if (args.size() != 2 || result < 0 || Uses[result] != 1) {
+            return 0;
+        }
+        const auto& first = instrs[args[0]].Operands[0];
+        if (first.Type != TOperand::EType::Tmp) {
+            return 0;
+        }
+        auto loaded = state.Loaded.find(first.Tmp.Idx);
+        if (loaded == state.Loaded.end()) {
+            return 0;
+        }
+        const TPlace place = loaded->second;
+        const int64_t value = Value(first);
+        auto content = state.Content.find(place);
+        if (content == state.Content.end() || content->second != value) {
+            return 0;
+        }
+
+        int oldLoad = -1, releaseArg = -1, releaseCall = -1, store = -1;
+        for (int j = call + 1; j < (int)instrs.size() && store < 0; ++j) {
+            const auto& instr = instrs[j];
+            if (instr.Op == "nop"_op || instr.Op == "lea"_op) {
+                continue;
+            }
+            if (IsMemoryRead(instr.Op)) {
+                if (oldLoad >= 0 || instr.Size() != 1 || Place(instr.Operands[0]) != place) {
+                    return 0;
+                }
+                oldLoad = j;
+            } else if (instr.Op == "arg"_op) {
+                // Only releases: of the old value, or of a temporary that
+                // cannot be it.
+                const int k = CallOf(block, j);
+                if (k != j + 1 || Callee(instrs[k]) != "str_release") {
+                    return 0;
+                }
+                const auto& released = instr.Operands[0];
+                const bool isOld = oldLoad >= 0
+                    && released.Type == TOperand::EType::Tmp
+                    && released.Tmp.Idx == instrs[oldLoad].Dest.Idx;
+                if (isOld && releaseCall < 0) {
+                    releaseArg = j;
+                    releaseCall = k;
+                } else if (!IsOtherFresh(released, value)) {
+                    return 0;
+                }
+                j = k;
+            } else if ((instr.Op == "ste"_op || instr.Op == "stre"_op)
+                && Place(instr.Operands[0]) == place
+                && instr.Operands[1].Type == TOperand::EType::Tmp
+                && instr.Operands[1].Tmp.Idx == result)
+            {
+                store = j;
+            } else {
+                return 0;
+            }
+        }
+        if (store < 0 || releaseCall < 0 || Uses[instrs[oldLoad].Dest.Idx] != 1) {
+            return 0;
+        }
+        const TOperand address = instrs[store].Operands[0];
+        if (address.Type != TOperand::EType::Tmp) {
+            return 0;
+        }
+        // The address is needed where the arguments are passed; a lea
+        // computed after the concat moves up.
+        const int def = DefinedAt(block, address.Tmp.Idx);
+        const bool hoist = def > args[0];
+        if (hoist) {
+            if (instrs[def].Op != "lea"_op) {
+                return 0;
+            }
+            std::rotate(instrs.begin() + args[0], instrs.begin() + def, instrs.begin() + def + 1);
+        }
+        auto at = [&](int idx) {
+            return hoist && idx >= args[0] && idx < def ? idx + 1 : idx;
+        };
+
+        auto& arg = instrs[at(args[0])];
+        --Uses[arg.Operands[0].Tmp.Idx];
+        arg.Operands[0] = address;
+        ++Uses[address.Tmp.Idx];
+        auto& appendCall = instrs[at(call)];
+        appendCall.Dest = TTmp{-1};
+        appendCall.Operands[0].Imm.Value = appendSym;
+        for (int idx : {oldLoad, releaseArg, releaseCall, store}) {
+            Drop(instrs[at(idx)]);
+        }
+        return hoist ? 1 : 0;
+    }
+
+    bool IsOtherFresh(const TOperand& op, int64_t value) const {
+        if (op.Type != TOperand::EType::Tmp || Value(op) == value) {
+            return false;
+        }
+        auto it = DefCallee.find(op.Tmp.Idx);
+        return it != DefCallee.end() && Fresh.contains(it->second);
+    }
+
+    void PairRetainRelease(TBlock& block) {
+        struct TRetain {
+            int64_t Value;
+            int Arg;
+            int Call;
+        };
+        std::vector<TRetain> retains;
+        TBlockState state;
+        auto& instrs = block.Instrs;
+        for (int i = 0; i < (int)instrs.size(); ++i) {
+            if (instrs[i].Op == "call"_op) {
+                const auto callee = Callee(instrs[i]);
+                const auto args = Args(block, i);
+                if ((callee == "str_retain" || callee == "str_release") && args.size() == 1) {
+                    const int64_t value = Value(instrs[args[0]].Operands[0]);
+                    auto pending = std::find_if(retains.rbegin(), retains.rend(), [&](const TRetain& r) {
+                        return r.Value == value;
+                    });
+                    if (value == Null) {
+                        Drop(instrs[args[0]]);
+                        Drop(instrs[i]);
+                    } else if (callee == "str_retain") {
+                        if (value != Unknown) {
+                            retains.push_back({value, args[0], i});
+                        }
+                    } else if (value != Unknown && pending != retains.rend()) {
+                        Drop(instrs[pending->Arg]);
+                        Drop(instrs[pending->Call]);
+                        Drop(instrs[args[0]]);
+                        Drop(instrs[i]);
+                        retains.erase(std::next(pending).base());
+                    } else {
+                        // may free what a pending retain keeps alive
+                        retains.clear();
+                    }
+                } else if (!Neutral.contains(callee)) {
+                    retains.clear();
+                }
+            }
+            Step(state, instrs[i]);
+        }
+    }
+
+    // The release that ends the life of a string made at def, -1 unless
+    // every use before it is in the block and only reads the string.
+    int ReleaseOf(const TBlock& block, int def, int tmp) const {
+        const auto& instrs = block.Instrs;
+        int seen = 0;
+        for (int j = def + 1; j < (int)instrs.size(); ++j) {
+            const auto& instr = instrs[j];
+            int uses = 0;
+            for (int i = 0; i < instr.Size(); ++i) {
+                uses += instr.Operands[i].Type == TOperand::EType::Tmp && instr.Operands[i].Tmp.Idx == tmp;
+            }
+            if (!uses) {
+                continue;
+            }
+            const int call = instr.Op == "arg"_op ? CallOf(block, j) : -1;
+            if (call < 0) {
+                return -1;
+            }
+            const auto callee = Callee(instrs[call]);
+            seen += uses;
+            if (callee == "str_release") {
+                return seen == Uses[tmp] && Args(block, call).size() == 1 ? call : -1;
+            }
+            if (callee == "str_append") {
+                const auto args = Args(block, call);
+                if (args.size() != 2 || args[1] != j) {
+                    return -1;
+                }
+            } else if (!ReadOnly.contains(callee)) {
+                return -1;
+            }
+        }
+        return -1;
+    }
+
+    void KeepInFrame(TBlock& block) {
+        auto initLit = Syms.find("str_init_lit");
+        auto initUnicode = Syms.find("str_init_unicode");
+        if (initLit == Syms.end() || initUnicode == Syms.end()) {
+            return;
+        }
+        std::vector<std::pair<int, TInstr>> inserts; // before index
+        auto& instrs = block.Instrs;
+        for (int i = 0; i < (int)instrs.size(); ++i) {
+            auto& instr = instrs[i];
+            if (instr.Op != "call"_op || instr.Dest.Idx < 0) {
+                continue;
+            }
+            const auto callee = Callee(instr);
+            const auto args = Args(block, i);
+            if (args.size() != 1) {
+                continue;
+            }
+            const auto& arg = instrs[args[0]].Operands[0];
+            int64_t length;
+            int init;
+            if (callee == "str_from_lit") {
+                if (arg.Type != TOperand::EType::Imm
+                    || arg.Imm.Value < 0 || arg.Imm.Value >= (int64_t)Module.StringLiterals.size())
+                {
+                    continue;
+                }
+                length = Module.StringLiterals[arg.Imm.Value].size();
+                init = initLit->second;
+            } else if (callee == "str_from_unicode") {
+                length = 4;
+                init = initUnicode->second;
+            } else {
+                continue;
+            }
+            const int release = ReleaseOf(block, i, instr.Dest.Idx);
+            if (release < 0) {
+                continue;
+            }
+
+            const TTmp buffer{Function.NextTmpIdx++};
+            Function.SetType(buffer, Function.GetType(instr.Dest));
+            const int64_t size = (sizeof(NRuntime::TString) + length + 1 + 7) / 8 * 8;
+            inserts.push_back({args[0], TInstr{
+                .Op = "salloc"_op,
+                .Dest = buffer,
+                .Operands = {TImm{size, Module.Types.I(EKind::I64)}},
+                .OperandCount = 1
+            }});
+            inserts.push_back({args[0], TInstr{.Op = "arg"_op, .Operands = {buffer}, .OperandCount = 1}});
+            instr.Operands[0].Imm.Value = init;
+            Drop(instrs[Args(block, release)[0]]);
+            Drop(instrs[release]);
+        }
+        if (inserts.empty()) {
+            return;
+        }
+        std::vector<TInstr> result;
+        result.reserve(instrs.size() + inserts.size());
+        size_t next = 0;
+        for (int i = 0; i < (int)instrs.size(); ++i) {
+            for (; next < inserts.size() && inserts[next].first == i; ++next) {
+                result.push_back(inserts[next].second);
+            }
+            result.push_back(instrs[i]);
+        }
+        instrs = std::move(result);
+    }
+
+    TFunction& Function;
+    TModule& Module;
+    std::unordered_map<int64_t, std::string> Names; // external SymId -> mangled name
+    std::unordered_map<std::string_view, int> Syms;
+    std::vector<int> Uses;
+    std::unordered_map<int, int> LeaOf; // tmp -> local it is the address of
+    std::unordered_map<int, int64_t> Alias; // tmp -> the value it is known to hold
+    std::unordered_map<int, std::string_view> DefCallee;
+};
+
+} // namespace
+
+void OptimizeOwnership(TFunction& function, TModule& module) {
+    TOwnership(function, module).Run();
+}
+
+void OptimizeOwnership(TModule& module) {
+    for (auto& function : module.Functions) {
+        OptimizeOwnership(function, module);
+    }
+}
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <qumir/ir/builder.h>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+// Removes reference counting work the lifetime pass had to put in to be safe.
+// Works on one block at a time and only with the runtime calls it knows:
+//  - str_retain(x) ... str_release(x) with no call in between that may drop
+//    a reference or look at the count go away together, as does
+//    str_release of a null string;
+//  - `s := s + x`, a concat into s followed by releasing the old s, becomes
+//    str_append, which grows a string nobody else holds in place;
+//  - a str_from_lit / str_from_unicode temporary that is only read and then
+//    released in the same block is built in the frame (salloc) and never
+//    reaches the heap.
+// The last two use runtime entry points the lowering imports next to
+// str_release; without them those rewrites are skipped.
+void OptimizeOwnership(TFunction& function, TModule& module);
+void OptimizeOwnership(TModule& module);
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
@@ -4,7 +4,17 @@
 #include <qumir/ir/passes/transforms/locals2ssa.h>
 #include <qumir/ir/passes/transforms/de_ssa.h>
 #include <qumir/ir/passes/transforms/renumber_regs.h>
-#include <qumir/ir/passes/transforms/const_fold.h>
+#include <qumir/ir/passes/transforms/bounds_checks.h>
+#include <qumir/ir/passes/transforms/dce.h>
+#include <qumir/ir/passes/transforms/gvn.h>
+#include <qumir/ir/passes/transforms/inline.h>
+#include <qumir/ir/passes/transforms/licm.h>
+#include <qumir/ir/passes/transforms/ownership.h>
+#include <qumir/ir/passes/transforms/sccp.h>
+#include <qumir/ir/passes/transforms/strength_reduce.h>
+
+#include <qumir/parallel.h>
+#include <qumir/time_report.h>
 
 #include <algorithm>
 
@@ -14,38 +24,9 @@ namespace NPasses {
 
 using namespace NLiterals;
 
-void Pipeline(TFunction& function, TModule& module) {
-    PromoteLocalsToSSA(function, module);
-    ConstFold(function, module);
-    RenumberRegisters(function, module);
-    // remove str_release(nullptr)
-    // TODO: dont'generate them in the first place
-    auto strDtor = std::find_if(
-        module.ExternalFunctions.begin(),
-        module.ExternalFunctions.end(),
-        [](const TExternalFunction& f) {
-            return f.Name == "str_release";
-        }
-    );
-    if (strDtor != module.ExternalFunctions.end()) {
-        int strDtorSymId = strDtor->SymId;
-        for (auto& block : function.Blocks) {
-            for (int i = 1; i < (int)block.Instrs.size(); ++i) {
-                auto& instr = block.Instrs[i];
-                auto& prevInstr = block.Instrs[i-1];
-                if (instr.Op == "call"_op && instr.Operands[0].Imm.Value == strDtor->SymId
-                    && prevInstr.Op == "arg"_op
-                    && prevInstr.Operands[0].Type == TOperand::EType::Imm
-                    && prevInstr.Operands[0].Imm.Value == 0)
-                {
-                    prevInstr.Clear();
-                    instr.Clear();
-                }
-            }
-        }
-    }
+namespace {
 
-    // remove nops
+void RemoveNops(TFunction& function) {
     for (auto& block : function.Blocks) {
         block.Instrs.erase(
             std::remove_if(
@@ -60,10 +41,83 @@ void Pipeline(TFunction& function, TModule& module) {
     }
 }
 
-void Pipeline(TModule& module) {
-    for (auto& function : module.Functions) {
-        Pipeline(function, module);
+// The passes only write the function they run on. The types they may ask
+// for are interned up front, so that with several threads the table can
+// stay frozen, and the type ids do not depend on the number of threads.
+template<typename F>
+void ForEachFunction(TModule& module, int threads, F&& pass) {
+    module.Types.I(EKind::Undef);
+    module.Types.I(EKind::I64);
+    if (ThreadCount(threads) <= 1 || module.Functions.size() <= 1) {
+        for (auto& function : module.Functions) {
+            pass(function);
+        }
+        return;
     }
+    TTypeTableFreeze freeze(module.Types);
+    auto* report = CurrentTimeReport();
+    ParallelFor(module.Functions.size(), threads, [&](size_t i) {
+        TTimeReportScope scope(report);
+        pass(module.Functions[i]);
+    });
+}
+
+template<typename F>
+void Timed(std::string_view phase, F&& pass) {
+    TPhaseTimer timer(phase);
+    pass();
+}
+
+void CountInstructions(const TModule& module) {
+    if (auto* report = CurrentTimeReport()) {
+        report->Count("ir.instructions.optimized", module.InstructionCount());
+    }
+}
+
+} // namespace
+
+void Pipeline(TFunction& function, TModule& module, const TGlobalFacts* facts) {
+    Timed("ir_passes.ssa", [&] { PromoteLocalsToSSA(function, module); });
+    Timed("ir_passes.sccp", [&] { PropagateConstants(function, module, facts); });
+    Timed("ir_passes.gvn", [&] { GlobalValueNumbering(function, module); });
+    Timed("ir_passes.bounds_checks", [&] { EliminateBoundsChecks(function, module); });
+    Timed("ir_passes.licm", [&] { HoistLoopInvariants(function, module, facts); });
+    Timed("ir_passes.strength_reduce", [&] { ReduceStrength(function, module); });
+    Timed("ir_passes.ownership", [&] { OptimizeOwnership(function, module); });
+    Timed("ir_passes.dce", [&] { EliminateDeadCode(function, module); });
+    Timed("ir_passes.renumber", [&] {
+        RenumberRegisters(function, module);
+        RemoveNops(function);
+    });
+}
+
+void Pipeline(TModule& module, int optLevel, int threads) {
+    TPhaseTimer timer("ir_passes");
+    Timed("ir_passes.inline", [&] { InlineFunctions(module, InlineOptionsForLevel(optLevel)); });
+    const auto facts = CollectGlobalFacts(module);
+    ForEachFunction(module, threads, [&](TFunction& function) {
+        Pipeline(function, module, &facts);
+    });
+    CountInstructions(module);
+}
+
+void Cleanup(TFunction& function, TModule& module, const TGlobalFacts* facts) {
+    Timed("ir_passes.gvn", [&] { GlobalValueNumbering(function, module); });
+    Timed("ir_passes.licm", [&] { HoistLoopInvariants(function, module, facts); });
+    Timed("ir_passes.dce", [&] { EliminateDeadCode(function, module); });
+    Timed("ir_passes.renumber", [&] {
+        RenumberRegisters(function, module);
+        RemoveNops(function);
+    });
+}
+
+void Cleanup(TModule& module, int threads) {
+    TPhaseTimer timer("ir_passes");
+    const auto facts = CollectGlobalFacts(module);
+    ForEachFunction(module, threads, [&](TFunction& function) {
+        Cleanup(function, module, &facts);
+    });
+    CountInstructions(module);
 }
 
 void BeforeCompile(TFunction& function, TModule& module) {
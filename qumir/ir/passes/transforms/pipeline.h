@@ -1,13 +1,25 @@
 #pragma once
 
 #include <qumir/ir/builder.h>
+#include <qumir/ir/passes/analysis/globals.h>
 
 namespace NQumir {
 namespace NIR {
 namespace NPasses {
 
-void Pipeline(TFunction& function, TModule& module);
-void Pipeline(TModule& module);
+void Pipeline(TFunction& function, TModule& module, const TGlobalFacts* facts = nullptr);
+// Inlines small functions (more of them at higher optLevel), then runs
+// the per-function Pipeline on up to `threads` threads (0: one per hardware
+// thread, see ParallelFor). Facts about globals are collected in between,
+// so the result does not depend on the number of threads.
+void Pipeline(TModule& module, int optLevel = 1, int threads = 1);
+
+// The part of Pipeline that needs no SSA (value numbering, loop-invariant
+// code motion and dead code elimination), for -O0: the VM and the LLVM
+// backend at -O0 would otherwise run the redundant code lowering leaves
+// behind, array layout loads in loops included.
+void Cleanup(TFunction& function, TModule& module, const TGlobalFacts* facts = nullptr);
+void Cleanup(TModule& module, int threads = 1);
 
 void BeforeCompile(TFunction& function, TModule& module);
 void BeforeCompile(TModule& module);
@@ -0,0 +1,643 @@
+#include "sccp.h"
+
+#include <qumir/ir/passes/analysis/cfg.h>
+#include <qumir/ir/passes/analysis/effects.h>
+
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+using namespace NLiterals;
+
+namespace {
+
+struct TValue {
+    enum class EState : uint8_t {
+        Unknown,
+        Constant,
+        Varying,
+    };
+    EState State = EState::Unknown;
+    TImm Imm{0};
+
+    static TValue Constant(TImm imm) {
+        return {EState::Constant, imm};
+    }
+    static TValue Varying() {
+        return {EState::Varying, {}};
+    }
+    bool IsUnknown() const {
+        return State == EState::Unknown;
+    }
+    bool IsConstant() const {
+        return State == EState::Constant;
+    }
+    bool IsVarying() const {
+        return State == EState::Varying;
+    }
+};
+
+class TConstantPropagation {
+public:
+    TConstantPropagation(TFunction& function, TModule& module, const TGlobalFacts* facts)
+        : Function(function)
+        , Module(module)
+        , Facts(facts)
+    { }
+
+    void Run() {
+        if (Function.Blocks.empty()) {
+            return;
+        }
+        BuildCfg(Function);
+        const int n = static_cast<int>(Function.Blocks.size());
+        Values.assign(std::max<int>(Function.NextTmpIdx, Function.TmpTypes.size()), TValue{});
+        Uses.assign(Values.size(), {});
+        Executable.assign(n, 0);
+        for (int b = 0; b < n; ++b) {
+            auto& block = Function.Blocks[b];
+            for (int i = 0; i < (int)block.Phis.size(); ++i) {
+                for (const auto& op : block.Phis[i].Operands) {
+                    AddUse(op, {b, i, true});
+                }
+            }
+            for (int i = 0; i < (int)block.Instrs.size(); ++i) {
+                const auto& instr = block.Instrs[i];
+                for (int j = 0; j < instr.Size(); ++j) {
+                    AddUse(instr.Operands[j], {b, i, false});
+                }
+            }
+        }
+
+        EdgeWork.push_back({-1, Function.GetBlockIdx(TLabel{0})});
+        while (!EdgeWork.empty() || !TmpWork.empty()) {
+            while (!EdgeWork.empty()) {
+                auto [from, to] = EdgeWork.back();
+                EdgeWork.pop_back();
+                if (!ExecutableEdges.insert({from, to}).second) {
+                    continue;
+                }
+                auto& block = Function.Blocks[to];
+                for (auto& phi : block.Phis) {
+                    VisitPhi(to, phi);
+                }
+                if (!Executable[to]) {
+                    Executable[to] = 1;
+                    for (auto& instr : block.Instrs) {
+                        VisitInstr(to, instr);
+                    }
+                }
+            }
+            while (!TmpWork.empty()) {
+                const int tmp = TmpWork.back();
+                TmpWork.pop_back();
+                for (const auto& use : Uses[tmp]) {
+                    if (!Executable[use.Block]) {
+                        continue;
+                    }
+                    auto& block = Function.Blocks[use.Block];
+                    if (use.Phi) {
+                        VisitPhi(use.Block, block.Phis[use.Index]);
+                    } else {
+                        VisitInstr(use.Block, block.Instrs[use.Index]);
+                    }
+                }
+            }
+        }
+
+        Rewrite();
+    }
+
+private:
+    struct TUse {
+        int Block;
+        int Index;
+        bool Phi;
+    };
+
+    void AddUse(const TOperand& op, TUse use) {
+        if (op.Type == TOperand::EType::Tmp && op.Tmp.Idx >= 0 && op.Tmp.Idx < (int)Uses.size()) {
+            Uses[op.Tmp.Idx].push_back(use);
+        }
+    }
+
+    TValue ValueOf(const TOperand& op) const {
+        switch (op.Type) {
+            case TOperand::EType::Imm:
+                return TValue::Constant(op.Imm);
+            case TOperand::EType::Tmp:
+                if (op.Tmp.Idx >= 0 && op.Tmp.Idx < (int)Values.size()) {
+                    return Values[op.Tmp.Idx];
+                }
+                return TValue::Varying();
+            default:
+                return TValue::Varying();
+        }
+    }
+
+    // Values only go down: unknown -> constant -> varying.
+    void Update(TTmp tmp, TValue value) {
+        if (tmp.Idx < 0 || tmp.Idx >= (int)Values.size()) {
+            return;
+        }
+        auto& current = Values[tmp.Idx];
+        if (current.IsVarying() || value.IsUnknown()) {
+            return;
+        }
+        if (current.IsConstant() && value.IsConstant()) {
+            if (current.Imm.Value == value.Imm.Value) {
+                return;
+            }
+            value = TValue::Varying();
+        }
+        current = value;
+        TmpWork.push_back(tmp.Idx);
+    }
+
+    bool IsEdgeExecutable(int from, int to) const {
+        return ExecutableEdges.contains({from, to});
+    }
+
+    void VisitPhi(int blockIdx, const TPhi& phi) {
+        if (phi.Op != "phi"_op) {
+            return;
+        }
+        TValue result;
+        for (int i = 0; i + 1 < phi.Size(); i += 2) {
+            const int pred = Function.GetBlockIdx(phi.Operands[i + 1].Label);
+            if (!IsEdgeExecutable(pred, blockIdx)) {
+                continue;
+            }
+            auto value = ValueOf(phi.Operands[i]);
+            if (value.IsUnknown()) {
+                continue;
+            }
+            if (value.IsVarying()
+                || (result.IsConstant() && result.Imm.Value != value.Imm.Value))
+            {
+                result = TValue::Varying();
+                break;
+            }
+            result = TValue::Constant(TImm{value.Imm.Value, Function.GetType(phi.Dest)});
+        }
+        Update(phi.Dest, result);
+    }
+
+    void VisitInstr(int blockIdx, const TInstr& instr) {
+        if (instr.Op == "nop"_op) {
+            return;
+        }
+        if (instr.Op == "jmp"_op) {
+            EdgeWork.push_back({blockIdx, Function.GetBlockIdx(instr.Operands[0].Label)});
+            return;
+        }
+        if (instr.Op == "cmp"_op) {
+            auto cond = ValueOf(instr.Operands[0]);
+            if (cond.IsUnknown()) {
+                return;
+            }
+            const int onTrue = Function.GetBlockIdx(instr.Operands[1].Label);
+            const int onFalse = Function.GetBlockIdx(instr.Operands[2].Label);
+            if (cond.IsVarying() || cond.Imm.Value != 0) {
+                EdgeWork.push_back({blockIdx, onTrue});
+            }
+            if (cond.IsVarying() || cond.Imm.Value == 0) {
+                EdgeWork.push_back({blockIdx, onFalse});
+            }
+            return;
+        }
+        if (instr.Dest.Idx < 0) {
+            return;
+        }
+        Update(instr.Dest, Evaluate(instr));
+    }
+
+    bool IsFoldableType(int typeId) const {
+        if (typeId < 0) {
+            return false;
+        }
+        switch (Module.Types.GetKind(typeId)) {
+            case EKind::I1:
+            case EKind::I64:
+            case EKind::U64:
+            case EKind::F64:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    TValue Evaluate(const TInstr& instr) {
+        const int destType = Function.GetType(instr.Dest);
+        if (instr.Op == "load"_op) {
+            if (instr.Size() == 1 && instr.Operands[0].Type == TOperand::EType::Slot) {
+                if (auto imm = GlobalConstant(instr.Operands[0].Slot.Idx)) {
+                    if (IsFoldableType(destType)) {
+                        return TValue::Constant(TImm{imm->Value, destType});
+                    }
+                }
+            }
+            return TValue::Varying();
+        }
+        if (!IsPure(instr.Op) || instr.Op == "lea"_op || !IsFoldableType(destType)) {
+            return TValue::Varying();
+        }
+
+        std::vector<TValue> args;
+        bool unknown = false;
+        for (int i = 0; i < instr.Size(); ++i) {
+            const auto& op = instr.Operands[i];
+            if (op.Type != TOperand::EType::Tmp && op.Type != TOperand::EType::Imm) {
+                return TValue::Varying();
+            }
+            const int typeId = OperandType(op);
+            if (!IsFoldableType(typeId)) {
+                return TValue::Varying();
+            }
+            args.push_back(ValueOf(op));
+            unknown |= args.back().IsUnknown();
+        }
+
+        // A zero decides these whatever the other operand is.
+        if (args.size() == 2 && !Module.Types.IsFloat(destType)) {
+            for (const auto& arg : args) {
+                if (arg.IsConstant() && arg.Imm.Value == 0
+                    && (instr.Op == '*'_op || instr.Op == '&'_op || instr.Op == "&&"_op))
+                {
+                    return TValue::Constant(TImm{0, destType});
+                }
+            }
+        }
+        for (const auto& arg : args) {
+            if (arg.IsVarying()) {
+                return TValue::Varying();
+            }
+        }
+        if (unknown) {
+            return TValue{};
+        }
+
+        auto result = Fold(instr, args);
+        return result ? TValue::Constant(TImm{*result, destType}) : TValue::Varying();
+    }
+
+    int OperandType(const TOperand& op) const {
+        if (op.Type == TOperand::EType::Imm) {
+            return op.Imm.TypeId;
+        }
+        if (op.Type == TOperand::EType::Tmp) {
+            return Function.GetType(op.Tmp);
+        }
+        return -1;
+    }
+
+    // Mirrors the VM: 64-bit wrapping integers, shift counts mod 64, doubles.
+    std::optional<int64_t> Fold(const TInstr& instr, const std::vector<TValue>& args) const {
+        const auto op = instr.Op;
+        const int destType = Function.GetType(instr.Dest);
+        const int argType = OperandType(instr.Operands[0]);
+        const bool isFloat = Module.Types.IsFloat(argType);
+        const bool isUnsigned = Module.Types.IsUnsigned(argType);
+        auto boolean = [](bool v) -> std::optional<int64_t> {
+            return v ? 1 : 0;
+        };
+
+        if (args.size() == 1) {
+            const int64_t a = args[0].Imm.Value;
+            const double fa = std::bit_cast<double>(a);
+            switch (op) {
+                case "mov"_op:
+                case "bitcast"_op:
+                    return a;
+                case "neg"_op:
+                    if (isFloat) {
+                        return std::bit_cast<int64_t>(-fa);
+                    }
+                    return static_cast<int64_t>(0 - static_cast<uint64_t>(a));
+                case '~'_op:
+                    return isFloat ? std::nullopt : std::optional<int64_t>(~a);
+                case '!'_op:
+                    return isFloat ? std::nullopt : boolean(!a);
+                case "i2f"_op:
+                    return std::bit_cast<int64_t>(static_cast<double>(a));
+                case "f2i"_op:
+                    // Out of range is undefined in C++ and differs between
+                    // the VM and LLVM: leave it to run time.
+                    if (!std::isfinite(fa) || std::fabs(fa) >= 9.2e18) {
+                        return std::nullopt;
+                    }
+                    return static_cast<int64_t>(fa);
+                case "i2b"_op:
+                    // The VM moves the value as is, so only 0 and 1 agree.
+                    if (a == 0 || a == 1) {
+                        return a;
+                    }
+                    return std::nullopt;
+                default:
+                    return std::nullopt;
+            }
+        }
+        if (args.size() != 2) {
+            return std::nullopt;
+        }
+
+        const int64_t a = args[0].Imm.Value;
+        const int64_t b = args[1].Imm.Value;
+        if (isFloat || Module.Types.IsFloat(OperandType(instr.Operands[1]))) {
+            if (!Module.Types.IsFloat(argType) || !Module.Types.IsFloat(OperandType(instr.Operands[1]))) {
+                return std::nullopt;
+            }
+            const double x = std::bit_cast<double>(a);
+            const double y = std::bit_cast<double>(b);
+            switch (op) {
+                case '+'_op: return std::bit_cast<int64_t>(x + y);
+                case '-'_op: return std::bit_cast<int64_t>(x - y);
+                case '*'_op: return std::bit_cast<int64_t>(x * y);
+                case '/'_op:
+                    if (y == 0) {
+                        return std::nullopt;
+                    }
+                    return std::bit_cast<int64_t>(x / y);
+                case '<'_op: return boolean(x < y);
+                case '>'_op: return boolean(x > y);
+                case "<="_op: return boolean(x <= y);
+                case ">="_op: return boolean(x >= y);
+                case "=="_op: return boolean(x == y);
+                case "!="_op: return boolean(x != y);
+                default:
+                    return std::nullopt;
+            }
+        }
+
+        const uint64_t ua = static_cast<uint64_t>(a);
+        const uint64_t ub = static_cast<uint64_t>(b);
+        const bool unsignedResult = Module.Types.IsUnsigned(destType);
+        switch (op) {
+            case '+'_op: return static_cast<int64_t>(ua + ub);
+            case '-'_op: return static_cast<int64_t>(ua - ub);
+            case '*'_op: return static_cast<int64_t>(ua * ub);
+            case '/'_op:
+            case '%'_op:
+                if (b == 0 || (!unsignedResult && a == std::numeric_limits<int64_t>::min() && b == -1)) {
+                    return std::nullopt;
+                }
+                if (unsignedResult) {
+                    return static_cast<int64_t>(op == '/'_op ? ua / ub : ua % ub);
+                }
+                return op == '/'_op ? a / b : a % b;
+            case '&'_op: return a & b;
+            case '|'_op: return a | b;
+            case '^'_op: return a ^ b;
+            case "&&"_op: return boolean(a && b);
+            case "||"_op: return boolean(a || b);
+            case "<<"_op: return static_cast<int64_t>(ua << (ub & 63));
+            case ">>"_op:
+                if (unsignedResult) {
+                    return static_cast<int64_t>(ua >> (ub & 63));
+                }
+                return a >> (ub & 63);
+            case '<'_op: return boolean(isUnsigned ? ua < ub : a < b);
+            case '>'_op: return boolean(isUnsigned ? ua > ub : a > b);
+            case "<="_op: return boolean(isUnsigned ? ua <= ub : a <= b);
+            case ">="_op: return boolean(isUnsigned ? ua >= ub : a >= b);
+            case "=="_op: return boolean(a == b);
+            case "!="_op: return boolean(a != b);
+            default:
+                return std::nullopt;
+        }
+    }
+
+    // A global whose only writes store one constant at the top of the
+    // module constructor or the entry point, before any call, and whose
+    // address is never taken (see CollectGlobalFacts), holds that constant
+    // in every other function: those only run once the store is done. The
+    // writer itself is left alone, it may read the slot before the store,
+    // and so is the constructor, which runs before the entry point.
+    std::optional<TImm> GlobalConstant(int slot) {
+        if (!GlobalConstants) {
+            GlobalConstants.emplace();
+            std::optional<TGlobalFacts> collected;
+            const auto& facts = Facts ? *Facts : collected.emplace(CollectGlobalFacts(Module));
+            for (const auto& [idx, constant] : facts.Constants) {
+                if (constant.Writer != &Function && &Function != facts.Constructor
+                    && idx >= 0 && idx < (int)Module.GlobalTypes.size()
+                    && IsFoldableType(Module.GlobalTypes[idx]))
+                {
+                    (*GlobalConstants)[idx] = constant.Value;
+                }
+            }
+        }
+        auto it = GlobalConstants->find(slot);
+        if (it == GlobalConstants->end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    void Rewrite() {
+        std::unordered_map<int, TOperand> replacements;
+        auto resolve = [&](TOperand& op) {
+            while (op.Type == TOperand::EType::Tmp) {
+                auto it = replacements.find(op.Tmp.Idx);
+                if (it == replacements.end()) {
+                    break;
+                }
+                op = it->second;
+            }
+        };
+        auto constantOf = [&](TTmp tmp) -> std::optional<TImm> {
+            if (tmp.Idx < 0 || tmp.Idx >= (int)Values.size() || !Values[tmp.Idx].IsConstant()) {
+                return std::nullopt;
+            }
+            return TImm{Values[tmp.Idx].Imm.Value, Function.GetType(tmp)};
+        };
+
+        const int n = static_cast<int>(Function.Blocks.size());
+        for (int b = 0; b < n; ++b) {
+            if (!Executable[b]) {
+                continue;
+            }
+            auto& block = Function.Blocks[b];
+            for (auto& phi : block.Phis) {
+                if (phi.Op != "phi"_op) {
+                    continue;
+                }
+                if (auto imm = constantOf(phi.Dest)) {
+                    replacements[phi.Dest.Idx] = *imm;
+                    phi.Clear();
+                    continue;
+                }
+                std::vector<TOperand> live;
+                for (int i = 0; i + 1 < phi.Size(); i += 2) {
+                    const int pred = Function.GetBlockIdx(phi.Operands[i + 1].Label);
+                    if (IsEdgeExecutable(pred, b)) {
+                        live.push_back(phi.Operands[i]);
+                        live.push_back(phi.Operands[i + 1]);
+                    }
+                }
+                phi.Operands = std::move(live);
+            }
+            for (auto& instr : block.Instrs) {
+                if (instr.Op == "cmp"_op) {
+                    auto cond = ValueOf(instr.Operands[0]);
+                    if (cond.IsConstant()) {
+                        const TLabel target = cond.Imm.Value ? instr.Operands[1].Label : instr.Operands[2].Label;
+                        instr = TInstr{.Op = "jmp"_op, .Operands = {TOperand{target}}, .OperandCount = 1};
+                    }
+                    continue;
+                }
+                if (instr.Dest.Idx < 0 || instr.Op == "nop"_op) {
+                    continue;
+                }
+                if (auto imm = constantOf(instr.Dest)) {
+                    if (IsPure(instr.Op) || IsMemoryRead(instr.Op)) {
+                        replacements[instr.Dest.Idx] = *imm;
+                        instr.Clear();
+                    }
+                    continue;
+                }
+                if (auto same = Identity(instr)) {
+                    replacements[instr.Dest.Idx] = *same;
+                    instr.Clear();
+                }
+            }
+        }
+
+        // A phi left with one input, or the same input on every edge, is a copy.
+        for (int b = 0; b < n; ++b) {
+            if (!Executable[b]) {
+                continue;
+            }
+            for (auto& phi : Function.Blocks[b].Phis) {
+                if (phi.Op != "phi"_op) {
+                    continue;
+                }
+                std::optional<TOperand> single;
+                bool copy = true;
+                for (int i = 0; i + 1 < phi.Size() && copy; i += 2) {
+                    auto op = phi.Operands[i];
+                    resolve(op);
+                    if (op == TOperand{phi.Dest}) {
+                        continue;
+                    }
+                    if (!single) {
+                        single = op;
+                    } else {
+                        copy = *single == op;
+                    }
+                }
+                if (copy && single) {
+                    replacements[phi.Dest.Idx] = *single;
+                    phi.Clear();
+                }
+            }
+        }
+
+        std::vector<TBlock> blocks;
+        blocks.reserve(n);
+        for (int b = 0; b < n; ++b) {
+            if (!Executable[b]) {
+                continue;
+            }
+            auto& block = Function.Blocks[b];
+            for (auto& phi : block.Phis) {
+                for (auto& op : phi.Operands) {
+                    resolve(op);
+                }
+            }
+            for (auto& instr : block.Instrs) {
+                for (int i = 0; i < instr.Size(); ++i) {
+                    resolve(instr.Operands[i]);
+                }
+            }
+            blocks.push_back(std::move(block));
+        }
+        if ((int)blocks.size() != n) {
+            Function.Blocks = std::move(blocks);
+            Function.LabelToBlockIdx.clear();
+            for (int i = 0; i < (int)Function.Blocks.size(); ++i) {
+                Function.LabelToBlockIdx[Function.Blocks[i].Label] = i;
+            }
+        } else {
+            Function.Blocks = std::move(blocks);
+        }
+        // Terminators may have changed even when no block went away.
+        Function.CfgBuilt = false;
+    }
+
+    // x + 0, x - 0, 0 + x, x * 1, 1 * x, x / 1 are x.
+    std::optional<TOperand> Identity(const TInstr& instr) const {
+        if (instr.Size() != 2) {
+            return std::nullopt;
+        }
+        const int destType = Function.GetType(instr.Dest);
+        if (!IsFoldableType(destType) || Module.Types.IsFloat(destType)) {
+            return std::nullopt;
+        }
+        auto isImm = [&](int i, int64_t value) {
+            auto v = ValueOf(instr.Operands[i]);
+            return v.IsConstant() && v.Imm.Value == value;
+        };
+        auto other = [&](int i) -> std::optional<TOperand> {
+            if (OperandType(instr.Operands[i]) != destType) {
+                return std::nullopt;
+            }
+            return instr.Operands[i];
+        };
+        switch (instr.Op) {
+            case '+'_op:
+                if (isImm(1, 0)) return other(0);
+                if (isImm(0, 0)) return other(1);
+                break;
+            case '-'_op:
+                if (isImm(1, 0)) return other(0);
+                break;
+            case '*'_op:
+                if (isImm(1, 1)) return other(0);
+                if (isImm(0, 1)) return other(1);
+                break;
+            case '/'_op:
+                if (isImm(1, 1)) return other(0);
+                break;
+            default:
+                break;
+        }
+        return std::nullopt;
+    }
+
+    TFunction& Function;
+    TModule& Module;
+    const TGlobalFacts* Facts;
+    std::vector<TValue> Values;
+    std::vector<std::vector<TUse>> Uses;
+    std::vector<char> Executable;
+    std::set<std::pair<int, int>> ExecutableEdges;
+    std::vector<std::pair<int, int>> EdgeWork;
+    std::vector<int> TmpWork;
+    std::optional<std::unordered_map<int, TImm>> GlobalConstants;
+};
+
+} // namespace
+
+void PropagateConstants(TFunction& function, TModule& module, const TGlobalFacts* facts) {
+    TConstantPropagation(function, module, facts).Run();
+}
+
+void PropagateConstants(TModule& module) {
+    for (auto& function : module.Functions) {
+        PropagateConstants(function, module);
+    }
+}
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
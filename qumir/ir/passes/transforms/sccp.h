@@ -0,0 +1,24 @@
+#pragma once
+
+#include <qumir/ir/builder.h>
+#include <qumir/ir/passes/analysis/globals.h>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+// Sparse conditional constant propagation (Wegman, Zadeck) over SSA form.
+// Values start unknown and only become constant or varying; a block is
+// visited once an edge into it is known to execute, and a phi only meets
+// the inputs of such edges. Afterwards constants replace their tmps, cmp
+// on a constant becomes jmp, phis lose inputs from dead edges and blocks
+// that never execute are removed. A scalar global that is only ever set to
+// one constant, at the start of one function, reads as that constant
+// everywhere else. Without facts they are collected from the module as it
+// is now.
+void PropagateConstants(TFunction& function, TModule& module, const TGlobalFacts* facts = nullptr);
+void PropagateConstants(TModule& module);
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
@@ -0,0 +1,508 @@
+#include "strength_reduce.h"
+
+#include <qumir/ir/passes/analysis/dominators.h>
+#include <qumir/ir/passes/analysis/loops.h>
+
+#include <map>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+using namespace NLiterals;
+
+namespace {
+
+// Constant + IvCoef * IvScale * Iv + sum of Coef * tmp, the tmps invariant
+// in the loop. IvScale is an invariant tmp as well, the row length of an
+// array whose bounds are not known, -1 for none.
+struct TAffine {
+    int64_t Constant = 0;
+    int Iv = -1;
+    int64_t IvCoef = 0;
+    int IvScale = -1;
+    std::map<int, int64_t> Terms;
+    // A multiplication went into the value: reducing it saves work.
+    bool Scaled = false;
+};
+
+bool Add(int64_t& sum, int64_t value, int64_t scale) {
+    int64_t scaled;
+    return !__builtin_mul_overflow(value, scale, &scaled)
+        && !__builtin_add_overflow(sum, scaled, &sum);
+}
+
+std::optional<TAffine> Combine(const TAffine& a, const TAffine& b, int64_t scaleB) {
+    TAffine result = a;
+    result.Scaled |= b.Scaled;
+    if (!Add(result.Constant, b.Constant, scaleB)) {
+        return std::nullopt;
+    }
+    if (b.Iv >= 0) {
+        if (result.Iv >= 0 && (result.Iv != b.Iv || result.IvScale != b.IvScale)) {
+            return std::nullopt;
+        }
+        result.Iv = b.Iv;
+        result.IvScale = b.IvScale;
+        if (!Add(result.IvCoef, b.IvCoef, scaleB)) {
+            return std::nullopt;
+        }
+    }
+    if (result.IvCoef == 0) {
+        result.Iv = result.IvScale = -1;
+    }
+    for (const auto& [tmp, coef] : b.Terms) {
+        auto& sum = result.Terms[tmp];
+        if (!Add(sum, coef, scaleB)) {
+            return std::nullopt;
+        }
+        if (sum == 0) {
+            result.Terms.erase(tmp);
+        }
+    }
+    return result;
+}
+
+bool IsConstant(const TAffine& a) {
+    return a.Iv < 0 && a.Terms.empty();
+}
+
+// A header φ that steps by a constant on the back edge.
+struct TInduction {
+    TOperand Init;
+    int64_t Step = 0;
+};
+
+// Addresses that differ only by their constant part.
+struct TGroupKey {
+    int Iv;
+    int64_t IvCoef;
+    int IvScale;
+    std::map<int, int64_t> Terms;
+    int TypeId;
+
+    bool operator<(const TGroupKey& other) const {
+        return std::tie(Iv, IvCoef, IvScale, Terms, TypeId)
+            < std::tie(other.Iv, other.IvCoef, other.IvScale, other.Terms, other.TypeId);
+    }
+};
+
+struct TCandidate {
+    TInstr* Instr;
+    int64_t Constant;
+};
+
+class TStrengthReduction {
+public:
+    TStrengthReduction(TFunction& function, TModule& module)
+        : Function(function)
+        , Module(module)
+    { }
+
+    void Run() {
+        auto tree = BuildDominatorTree(Function);
+        if (tree.RPO.empty()) {
+            return;
+        }
+        // New code goes into existing blocks only, so the nest stays valid.
+        auto nest = FindLoops(Function, tree);
+        for (int i = (int)nest.Loops.size() - 1; i >= 0; --i) {
+            const auto& loop = nest.Loops[i];
+            if (loop.Preheader >= 0 && loop.Latches.size() == 1) {
+                Reduce(nest, i);
+            }
+        }
+    }
+
+private:
+    bool IsInt(int typeId) const {
+        return typeId >= 0 && Module.Types.GetKind(typeId) == EKind::I64;
+    }
+
+    bool IsPointer(int typeId) const {
+        return typeId >= 0 && Module.Types.IsPointer(typeId);
+    }
+
+    void IndexDefs() {
+        Defs.clear();
+        for (int b = 0; b < (int)Function.Blocks.size(); ++b) {
+            auto& block = Function.Blocks[b];
+            for (auto& phi : block.Phis) {
+                if (phi.Op == "phi"_op) {
+                    Defs[phi.Dest.Idx] = {b, nullptr};
+                }
+            }
+            for (auto& instr : block.Instrs) {
+                if (instr.Dest.Idx >= 0) {
+                    Defs[instr.Dest.Idx] = {b, &instr};
+                }
+            }
+        }
+    }
+
+    void FindInductions(const TLoop& loop) {
+        Inductions.clear();
+        const TLabel preheader = Function.Blocks[loop.Preheader].Label;
+        const TLabel latch = Function.Blocks[loop.Latches[0]].Label;
+        for (const auto& phi : Function.Blocks[loop.Header].Phis) {
+            if (phi.Op != "phi"_op || phi.Size() != 4 || !IsInt(Function.GetType(phi.Dest))) {
+                continue;
+            }
+            std::optional<TOperand> init, next;
+            for (int i = 0; i < phi.Size(); i += 2) {
+                const TLabel from = phi.Operands[i + 1].Label;
+                if (from == preheader) {
+                    init = phi.Operands[i];
+                } else if (from == latch) {
+                    next = phi.Operands[i];
+                }
+            }
+            if (!init || !next || next->Type != TOperand::EType::Tmp
+                || (init->Type == TOperand::EType::Tmp && DefinedIn(loop, init->Tmp.Idx)))
+            {
+                continue;
+            }
+            auto def = Defs.find(next->Tmp.Idx);
+            if (def == Defs.end() || !def->second.Instr || !loop.Contains(def->second.Block)) {
+                continue;
+            }
+            const auto& instr = *def->second.Instr;
+            if ((instr.Op != '+'_op && instr.Op != '-'_op) || instr.Size() != 2) {
+                continue;
+            }
+            auto isSelf = [&](const TOperand& op) {
+                return op.Type == TOperand::EType::Tmp && op.Tmp.Idx == phi.Dest.Idx;
+            };
+            auto isStep = [&](const TOperand& op) {
+                return op.Type == TOperand::EType::Imm && (op.Imm.TypeId < 0 || IsInt(op.Imm.TypeId));
+            };
+            int64_t step;
+            if (isSelf(instr.Operands[0]) && isStep(instr.Operands[1])) {
+                step = instr.Operands[1].Imm.Value;
+                if (instr.Op == '-'_op && __builtin_sub_overflow(int64_t{0}, step, &step)) {
+                    continue;
+                }
+            } else if (instr.Op == '+'_op && isStep(instr.Operands[0]) && isSelf(instr.Operands[1])) {
+                step = instr.Operands[0].Imm.Value;
+            } else {
+                continue;
+            }
+            Inductions[phi.Dest.Idx] = TInduction{*init, step};
+        }
+    }
+
+    bool DefinedIn(const TLoop& loop, int tmp) const {
+        auto it = Defs.find(tmp);
+        return it != Defs.end() && loop.Contains(it->second.Block);
+    }
+
+    std::optional<TAffine> Expand(const TLoop& loop, const TOperand& op, int depth = 0) {
+        if (op.Type == TOperand::EType::Imm) {
+            if (op.Imm.TypeId >= 0 && !IsInt(op.Imm.TypeId)) {
+                return std::nullopt;
+            }
+            return TAffine{.Constant = op.Imm.Value};
+        }
+        if (op.Type != TOperand::EType::Tmp) {
+            return std::nullopt;
+        }
+        const int tmp = op.Tmp.Idx;
+        const int typeId = Function.GetType(op.Tmp);
+        if (!IsInt(typeId) && !IsPointer(typeId)) {
+            return std::nullopt;
+        }
+        if (auto it = Expanded.find(tmp); it != Expanded.end()) {
+            return it->second;
+        }
+        std::optional<TAffine> result;
+        auto def = Defs.find(tmp);
+        if (Inductions.contains(tmp)) {
+            result = TAffine{.Iv = tmp, .IvCoef = 1};
+        } else if (def == Defs.end() || !loop.Contains(def->second.Block)) {
+            result = TAffine{.Terms = {{tmp, 1}}};
+        } else if (def->second.Instr && depth < 16) {
+            const auto& instr = *def->second.Instr;
+            auto operand = [&](int i) {
+                return Expand(loop, instr.Operands[i], depth + 1);
+            };
+            if ((instr.Op == '+'_op || instr.Op == '-'_op) && instr.Size() == 2) {
+                auto a = operand(0);
+                auto b = operand(1);
+                if (a && b) {
+                    result = Combine(*a, *b, instr.Op == '+'_op ? 1 : -1);
+                }
+            } else if (instr.Op == '*'_op && instr.Size() == 2) {
+                auto a = operand(0);
+                auto b = operand(1);
+                if (a && b && (IsConstant(*a) || IsConstant(*b))) {
+                    result = IsConstant(*a)
+                        ? Combine(TAffine{}, *b, a->Constant)
+                        : Combine(TAffine{}, *a, b->Constant);
+                } else if (a && b) {
+                    result = IsScale(*a) ? ScaleByTmp(*b, a->Terms.begin()->first)
+                        : IsScale(*b) ? ScaleByTmp(*a, b->Terms.begin()->first)
+                        : std::nullopt;
+                }
+                if (result) {
+                    result->Scaled = true;
+                }
+            } else if (instr.Op == "mov"_op && instr.Size() == 1) {
+                result = operand(0);
+            }
+        }
+        Expanded.emplace(tmp, result);
+        return result;
+    }
+
+    // A lone invariant integer.
+    bool IsScale(const TAffine& form) const {
+        return form.Iv < 0 && form.Constant == 0 && form.Terms.size() == 1
+            && form.Terms.begin()->second == 1 && IsInt(Function.GetTmpType(form.Terms.begin()->first));
+    }
+
+    // (c * i + d) * s = c * s * i + d * s: what indexing by the counter of an
+    // array with a row length not known in advance gives.
+    std::optional<TAffine> ScaleByTmp(const TAffine& form, int scale) const {
+        if (form.Iv < 0 || form.IvScale >= 0 || !form.Terms.empty()) {
+            return std::nullopt;
+        }
+        TAffine result{.Iv = form.Iv, .IvCoef = form.IvCoef, .IvScale = scale};
+        if (form.Constant != 0) {
+            result.Terms[scale] = form.Constant;
+        }
+        return result;
+    }
+
+    // Base pointer + integers: the only shape a φ can be built for.
+    bool IsAddress(const TAffine& form) const {
+        int pointers = 0;
+        for (const auto& [tmp, coef] : form.Terms) {
+            const int typeId = Function.GetTmpType(tmp);
+            if (IsPointer(typeId)) {
+                if (coef != 1) {
+                    return false;
+                }
+                ++pointers;
+            } else if (!IsInt(typeId)) {
+                return false;
+            }
+        }
+        return pointers == 1;
+    }
+
+    TTmp NewTmp(int typeId) {
+        TTmp tmp{Function.NextTmpIdx++};
+        Function.SetType(tmp, typeId);
+        return tmp;
+    }
+
+    void Reduce(const TLoopNest& nest, int loopIdx) {
+        const auto& loop = nest.Loops[loopIdx];
+        IndexDefs();
+        FindInductions(loop);
+        if (Inductions.empty()) {
+            return;
+        }
+        Expanded.clear();
+
+        std::map<TGroupKey, std::vector<TCandidate>> groups;
+        for (int blockIdx : loop.Blocks) {
+            if (nest.BlockLoop[blockIdx] != loopIdx) {
+                continue;
+            }
+            for (auto& instr : Function.Blocks[blockIdx].Instrs) {
+                if ((instr.Op != '+'_op && instr.Op != '-'_op) || instr.Dest.Idx < 0) {
+                    continue;
+                }
+                const int typeId = Function.GetType(instr.Dest);
+                if (!IsPointer(typeId)) {
+                    continue;
+                }
+                auto form = Expand(loop, TOperand(instr.Dest));
+                if (!form || form->Iv < 0 || !form->Scaled || !IsAddress(*form)) {
+                    continue;
+                }
+                groups[TGroupKey{form->Iv, form->IvCoef, form->IvScale, form->Terms, typeId}]
+                    .push_back(TCandidate{&instr, form->Constant});
+            }
+        }
+
+        // Candidates point into the blocks: rewrite them all before new
+        // code goes into the preheader and the latch.
+        std::vector<TInstr> latchCode;
+        std::unordered_map<int, TTmp> renamed;
+        PreheaderCode.clear();
+        for (const auto& [key, candidates] : groups) {
+            const auto& iv = Inductions.at(key.Iv);
+            const int64_t base = candidates.front().Constant;
+            int64_t increment = 0;
+            if (!Add(increment, key.IvCoef, iv.Step)) {
+                continue;
+            }
+            auto start = Start(key, iv.Init, base);
+            if (!start) {
+                continue;
+            }
+            TOperand stride = TImm{increment, Module.Types.I(EKind::I64)};
+            if (key.IvScale >= 0) {
+                const TTmp scaled = NewTmp(Module.Types.I(EKind::I64));
+                PreheaderCode.push_back(TInstr{
+                    .Op = "*"_op,
+                    .Dest = scaled,
+                    .Operands = {TTmp{key.IvScale}, stride},
+                    .OperandCount = 2,
+                });
+                stride = scaled;
+            }
+
+            // phi p = start (preheader), p + increment (latch)
+            const TTmp phi = NewTmp(key.TypeId);
+            const TTmp next = NewTmp(key.TypeId);
+            Function.Blocks[loop.Header].Phis.push_back(TPhi{
+                .Op = "phi"_op,
+                .Dest = phi,
+                .Operands = {
+                    *start, Function.Blocks[loop.Preheader].Label,
+                    TOperand(next), Function.Blocks[loop.Latches[0]].Label,
+                },
+            });
+            latchCode.push_back(TInstr{
+                .Op = "+"_op,
+                .Dest = next,
+                .Operands = {phi, stride},
+                .OperandCount = 2,
+            });
+
+            for (const auto& candidate : candidates) {
+                const int64_t delta = candidate.Constant - base;
+                if (delta == 0) {
+                    renamed[candidate.Instr->Dest.Idx] = phi;
+                    candidate.Instr->Clear();
+                } else {
+                    *candidate.Instr = TInstr{
+                        .Op = "+"_op,
+                        .Dest = candidate.Instr->Dest,
+                        .Operands = {phi, TImm{delta, Module.Types.I(EKind::I64)}},
+                        .OperandCount = 2,
+                    };
+                }
+            }
+        }
+        auto& preheader = Function.Blocks[loop.Preheader].Instrs;
+        preheader.insert(preheader.end() - 1, PreheaderCode.begin(), PreheaderCode.end());
+        auto& latch = Function.Blocks[loop.Latches[0]].Instrs;
+        latch.insert(latch.end() - 1, latchCode.begin(), latchCode.end());
+        Rename(renamed);
+    }
+
+    // The address on entry to the loop; the code computing it goes to
+    // PreheaderCode.
+    std::optional<TOperand> Start(const TGroupKey& key, const TOperand& init, int64_t constant) {
+        const int i64 = Module.Types.I(EKind::I64);
+        std::vector<TInstr> code;
+        std::optional<TOperand> sum;
+        auto emit = [&](TOp op, TOperand a, TOperand b, int typeId) {
+            const TTmp dest = NewTmp(typeId);
+            code.push_back(TInstr{.Op = op, .Dest = dest, .Operands = {a, b}, .OperandCount = 2});
+            return TOperand(dest);
+        };
+        auto addTerm = [&](const TOperand& value, int64_t coef) {
+            TOperand scaled = coef == 1 ? value : emit('*'_op, value, TImm{coef, i64}, i64);
+            sum = sum ? emit('+'_op, *sum, scaled, i64) : scaled;
+        };
+
+        std::optional<TOperand> pointer;
+        for (const auto& [tmp, coef] : key.Terms) {
+            if (IsPointer(Function.GetTmpType(tmp))) {
+                pointer = TOperand(TTmp{tmp});
+            } else {
+                addTerm(TOperand(TTmp{tmp}), coef);
+            }
+        }
+        if (key.IvScale >= 0) {
+            const TOperand scale = TTmp{key.IvScale};
+            if (init.Type == TOperand::EType::Imm) {
+                int64_t coef = 0;
+                if (!Add(coef, init.Imm.Value, key.IvCoef)) {
+                    return std::nullopt;
+                }
+                if (coef != 0) {
+                    addTerm(scale, coef);
+                }
+            } else {
+                addTerm(emit('*'_op, init, scale, i64), key.IvCoef);
+            }
+        } else if (init.Type == TOperand::EType::Imm) {
+            if (!Add(constant, init.Imm.Value, key.IvCoef)) {
+                return std::nullopt;
+            }
+        } else {
+            addTerm(init, key.IvCoef);
+        }
+        if (constant != 0) {
+            sum = sum ? emit('+'_op, *sum, TImm{constant, i64}, i64) : TOperand(TImm{constant, i64});
+        }
+        if (sum) {
+            pointer = emit('+'_op, *pointer, *sum, key.TypeId);
+        }
+        PreheaderCode.insert(PreheaderCode.end(), code.begin(), code.end());
+        return pointer;
+    }
+
+    void Rename(const std::unordered_map<int, TTmp>& renamed) {
+        if (renamed.empty()) {
+            return;
+        }
+        auto rename = [&](TOperand& op) {
+            if (op.Type == TOperand::EType::Tmp) {
+                if (auto it = renamed.find(op.Tmp.Idx); it != renamed.end()) {
+                    op.Tmp = it->second;
+                }
+            }
+        };
+        for (auto& block : Function.Blocks) {
+            for (auto& phi : block.Phis) {
+                for (auto& op : phi.Operands) {
+                    rename(op);
+                }
+            }
+            for (auto& instr : block.Instrs) {
+                for (int i = 0; i < instr.Size(); ++i) {
+                    rename(instr.Operands[i]);
+                }
+            }
+        }
+    }
+
+    struct TDef {
+        int Block;
+        TInstr* Instr; // nullptr for φ-nodes
+    };
+
+    TFunction& Function;
+    TModule& Module;
+    std::unordered_map<int, TDef> Defs;
+    std::unordered_map<int, TInduction> Inductions;
+    std::unordered_map<int, std::optional<TAffine>> Expanded;
+    std::vector<TInstr> PreheaderCode;
+};
+
+} // namespace
+
+void ReduceStrength(TFunction& function, TModule& module) {
+    TStrengthReduction(function, module).Run();
+}
+
+void ReduceStrength(TModule& module) {
+    for (auto& function : module.Functions) {
+        ReduceStrength(function, module);
+    }
+}
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
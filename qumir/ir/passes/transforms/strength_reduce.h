@@ -0,0 +1,23 @@
+#pragma once
+
+#include <qumir/ir/builder.h>
+
+namespace NQumir {
+namespace NIR {
+namespace NPasses {
+
+// Strength reduction of array addresses in loops. A pointer computed in a
+// loop as `base + c * i + invariants`, with i a counter that steps by a
+// constant (`нц для i от a до b шаг s`), becomes a φ of its own that starts
+// at the address for `i = a` and moves by `c * s` every iteration. Addresses
+// that differ only by a constant (`A[i-1]`, `A[i+1]`) share one φ. The
+// multiplications of the row-major index go away with DCE; for a loop nest
+// the start addresses computed in the preheader of an inner loop are in turn
+// reduced in the outer one. Needs SSA form and a preheader; loops with
+// several latches are left alone.
+void ReduceStrength(TFunction& function, TModule& module);
+void ReduceStrength(TModule& module);
+
+} // namespace NPasses
+} // namespace NIR
+} // namespace NQumir
@@ -0,0 +1,95 @@
+#include "pgo_profile.h"
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+namespace NQumir {
+namespace NIR {
+
+namespace {
+
+constexpr const char* Header = "qumir-profile 1";
+
+} // namespace
+
+const TPgoProfile::TFunctionCounts* TPgoProfile::Find(const TFunction& function) const {
+    auto it = Functions.find(function.SymId);
+    if (it == Functions.end() || it->second.Name != function.Name) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+void TPgoProfile::Write(std::ostream& out) const {
+    out << Header << '\n'
+        << "opt_level " << OptLevel << '\n'
+        << "bounds_checks " << (BoundsChecks ? 1 : 0) << '\n';
+    // Sorted, so that the same run always writes the same file.
+    std::vector<int> symIds;
+    symIds.reserve(Functions.size());
+    for (const auto& [symId, function] : Functions) {
+        symIds.push_back(symId);
+    }
+    std::sort(symIds.begin(), symIds.end());
+    for (int symId : symIds) {
+        const auto& function = Functions.at(symId);
+        // The name goes last: it may contain spaces.
+        out << "function " << symId << ' ' << function.EntryCount << ' ' << function.Name << '\n';
+        std::vector<int32_t> labels;
+        labels.reserve(function.Branches.size());
+        for (const auto& [label, branch] : function.Branches) {
+            labels.push_back(label);
+        }
+        std::sort(labels.begin(), labels.end());
+        for (int32_t label : labels) {
+            const auto& branch = function.Branches.at(label);
+            out << "branch " << label << ' ' << branch.Taken << ' ' << branch.NotTaken << '\n';
+        }
+    }
+}
+
+std::expected<TPgoProfile, TError> TPgoProfile::Read(std::istream& in) {
+    TPgoProfile profile;
+    std::string line;
+    if (!std::getline(in, line) || line != Header) {
+        return std::unexpected(TError("profile: not a qumir profile"));
+    }
+    TFunctionCounts* current = nullptr;
+    for (int lineNo = 2; std::getline(in, line); ++lineNo) {
+        std::istringstream fields(line);
+        std::string kind;
+        fields >> kind;
+        bool ok = true;
+        if (kind.empty()) {
+            continue;
+        } else if (kind == "opt_level") {
+            ok = static_cast<bool>(fields >> profile.OptLevel);
+        } else if (kind == "bounds_checks") {
+            int value = 0;
+            ok = static_cast<bool>(fields >> value);
+            profile.BoundsChecks = value != 0;
+        } else if (kind == "function") {
+            int symId = 0;
+            TFunctionCounts function;
+            ok = static_cast<bool>(fields >> symId >> function.EntryCount);
+            fields.get(); // the space before the name
+            std::getline(fields, function.Name);
+            current = &(profile.Functions[symId] = std::move(function));
+        } else if (kind == "branch" && current) {
+            int32_t label = 0;
+            TBranch branch;
+            ok = static_cast<bool>(fields >> label >> branch.Taken >> branch.NotTaken);
+            current->Branches[label] = branch;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            return std::unexpected(TError("profile: malformed line " + std::to_string(lineNo) + ": " + line));
+        }
+    }
+    return profile;
+}
+
+} // namespace NIR
+} // namespace NQumir
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "builder.h"
+
+#include <qumir/error.h>
+
+#include <cstdint>
+#include <expected>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace NQumir {
+namespace NIR {
+
+// Execution counts the interpreter collected for LLVM codegen (qumiri
+// --profile-out, qumirc --profile-use). Functions are keyed by SymId and
+// branches by the label of the block ending in `cmp`, both as they are after
+// the IR pipeline, so a profile applies to any compile of the same source
+// with the same pipeline options; those are recorded and checked by
+// Matches(). The name guards against a SymId that now means something else.
+struct TPgoProfile {
+    struct TBranch {
+        uint64_t Taken = 0; // to the first label of `cmp`
+        uint64_t NotTaken = 0;
+    };
+
+    struct TFunctionCounts {
+        std::string Name;
+        uint64_t EntryCount = 0;
+        std::unordered_map<int32_t, TBranch> Branches; // by block label
+    };
+
+    int OptLevel = 0;
+    bool BoundsChecks = false;
+    std::unordered_map<int, TFunctionCounts> Functions; // by SymId
+
+    bool Matches(int optLevel, bool boundsChecks) const {
+        return OptLevel == optLevel && BoundsChecks == boundsChecks;
+    }
+
+    // nullptr if the function was not profiled or its SymId now names
+    // another function.
+    const TFunctionCounts* Find(const TFunction& function) const;
+
+    // Plain text, one record per line.
+    void Write(std::ostream& out) const;
+    static std::expected<TPgoProfile, TError> Read(std::istream& in);
+};
+
+} // namespace NIR
+} // namespace NQumir
@@ -0,0 +1,200 @@
+#include "profiler.h"
+#include "vmcompiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace NQumir {
+namespace NIR {
+
+using namespace NLiterals;
+
+namespace {
+
+void WriteJsonString(std::ostream& out, const std::string& s) {
+    out << '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec << std::setfill(' ');
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+} // namespace
+
+TProfiler::TProfiler(const TModule& module)
+    : Module(module)
+{
+    Nodes.push_back(TNode{.Func = -1, .Parent = -1});
+}
+
+void TProfiler::Enter(int funcIdx) {
+    const int parent = Stack.empty() ? 0 : Stack.back().Node;
+    auto [it, inserted] = Nodes[parent].Children.emplace(funcIdx, (int)Nodes.size());
+    if (inserted) {
+        Nodes.push_back(TNode{.Func = funcIdx, .Parent = parent});
+    }
+    auto& stats = Stats[funcIdx];
+    ++stats.Calls;
+    ++stats.Active;
+    Stack.push_back(TActiveCall{.Node = it->second, .Start = TClock::now()});
+}
+
+void TProfiler::Leave() {
+    if (Stack.empty()) {
+        return;
+    }
+    const auto call = Stack.back();
+    Stack.pop_back();
+    const uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(TClock::now() - call.Start).count();
+    const uint64_t exclusive = elapsed - std::min(elapsed, call.ChildNs);
+    auto& node = Nodes[call.Node];
+    node.ExclusiveNs += exclusive;
+    auto& stats = Stats[node.Func];
+    stats.ExclusiveNs += exclusive;
+    if (--stats.Active == 0) {
+        stats.InclusiveNs += elapsed;
+    }
+    if (!Stack.empty()) {
+        Stack.back().ChildNs += elapsed;
+    }
+}
+
+void TProfiler::LeaveAll() {
+    while (!Stack.empty()) {
+        Leave();
+    }
+}
+
+void TProfiler::WriteFolded(std::ostream& out) {
+    LeaveAll();
+    std::vector<std::string> paths(Nodes.size());
+    // Children always come after their parent, so one forward pass builds every path.
+    for (size_t i = 1; i < Nodes.size(); ++i) {
+        const auto& node = Nodes[i];
+        const auto& name = Module.Functions[node.Func].Name;
+        paths[i] = node.Parent == 0 ? name : paths[node.Parent] + ";" + name;
+        if (node.ExclusiveNs > 0) {
+            out << paths[i] << " " << node.ExclusiveNs << "\n";
+        }
+    }
+}
+
+void TProfiler::WriteJson(std::ostream& out) {
+    LeaveAll();
+    std::map<std::string, uint64_t> opcodes;
+    struct THotLine {
+        int Func;
+        int Line;
+        uint64_t Count;
+    };
+    std::vector<THotLine> hotLines;
+
+    out << "{\n  \"functions\": [";
+    bool firstFunc = true;
+    for (int funcIdx = 0; funcIdx < (int)Module.Functions.size(); ++funcIdx) {
+        auto statsIt = Stats.find(funcIdx);
+        if (statsIt == Stats.end()) {
+            continue;
+        }
+        const auto& function = Module.Functions[funcIdx];
+        const auto& stats = statsIt->second;
+        out << (firstFunc ? "\n" : ",\n") << "    {\"name\": ";
+        firstFunc = false;
+        WriteJsonString(out, function.Name);
+        out << ", \"line\": " << function.Line
+            << ", \"calls\": " << stats.Calls
+            << ", \"inclusive_ns\": " << stats.InclusiveNs
+            << ", \"exclusive_ns\": " << stats.ExclusiveNs
+            << ", \"blocks\": [";
+
+        std::map<int, uint64_t> lineCounts;
+        const TExecFunc* exec = function.Exec;
+        const size_t blocks = exec ? exec->BlockCounts.size() : 0;
+        for (size_t b = 0; b < blocks; ++b) {
+            const uint64_t count = exec->BlockCounts[b];
+            out << (b ? ", " : "") << "{\"line\": " << exec->BlockLines[b] << ", \"count\": " << count << "}";
+            if (count == 0) {
+                continue;
+            }
+            lineCounts[exec->BlockLines[b]] += count;
+            // A block runs start to end, so each of its instructions ran count times.
+            const size_t end = b + 1 < blocks ? exec->BlockPCs[b + 1] : exec->VMCode.size();
+            for (size_t pc = exec->BlockPCs[b] + 1; pc < end; ++pc) {
+                std::ostringstream name;
+                name << exec->VMCode[pc].Op;
+                opcodes[name.str()] += count;
+            }
+        }
+        out << "]}";
+        for (const auto& [line, count] : lineCounts) {
+            if (line > 0) {
+                hotLines.push_back(THotLine{funcIdx, line, count});
+            }
+        }
+    }
+    out << "\n  ],\n  \"opcodes\": {";
+    bool firstOp = true;
+    for (const auto& [name, count] : opcodes) {
+        out << (firstOp ? "\n" : ",\n") << "    ";
+        firstOp = false;
+        WriteJsonString(out, name);
+        out << ": " << count;
+    }
+    out << "\n  },\n  \"hot_lines\": [";
+    std::sort(hotLines.begin(), hotLines.end(), [](const THotLine& a, const THotLine& b) {
+        return a.Count > b.Count;
+    });
+    for (size_t i = 0; i < hotLines.size(); ++i) {
+        out << (i ? ",\n" : "\n") << "    {\"function\": ";
+        WriteJsonString(out, Module.Functions[hotLines[i].Func].Name);
+        out << ", \"line\": " << hotLines[i].Line << ", \"count\": " << hotLines[i].Count << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+TPgoProfile TProfiler::PgoProfile(int optLevel, bool boundsChecks) const {
+    TPgoProfile profile{.OptLevel = optLevel, .BoundsChecks = boundsChecks};
+    for (int funcIdx = 0; funcIdx < (int)Module.Functions.size(); ++funcIdx) {
+        const auto& function = Module.Functions[funcIdx];
+        auto& counts = profile.Functions[function.SymId];
+        counts.Name = function.Name;
+        auto statsIt = Stats.find(funcIdx);
+        counts.EntryCount = statsIt == Stats.end() ? 0 : statsIt->second.Calls;
+
+        const TExecFunc* exec = function.Exec;
+        if (!exec || exec->BlockCounts.size() != function.Blocks.size()) {
+            continue;
+        }
+        // The VM compiler split critical edges (DeSSA) and kept the labels
+        // of the other blocks, so each target of a `cmp` has the branching
+        // block as its only predecessor: its count is that of the edge.
+        for (const auto& block : function.Blocks) {
+            if (block.Instrs.empty() || block.Instrs.back().Op != "cmp"_op) {
+                continue;
+            }
+            const auto& cmp = block.Instrs.back();
+            const auto taken = cmp.Operands[1].Label;
+            const auto notTaken = cmp.Operands[2].Label;
+            if (taken == notTaken) {
+                continue;
+            }
+            counts.Branches[block.Label.Idx] = TPgoProfile::TBranch{
+                .Taken = exec->BlockCounts[function.GetBlockIdx(taken)],
+                .NotTaken = exec->BlockCounts[function.GetBlockIdx(notTaken)],
+            };
+        }
+    }
+    return profile;
+}
+
+} // namespace NIR
+} // namespace NQumir
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "builder.h"
+#include "pgo_profile.h"
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+namespace NQumir {
+namespace NIR {
+
+// Counting profiler for TInterpreter (qumiri --profile). Calls and time are
+// tracked per function on a call tree; block counts come from ProfBlock
+// instructions, and opcode counts are derived from them at report time.
+class TProfiler {
+public:
+    explicit TProfiler(const TModule& module);
+
+    // funcIdx indexes TModule::Functions.
+    void Enter(int funcIdx);
+    void Leave();
+
+    // One line per call path with its exclusive time in nanoseconds, the
+    // folded-stack format read by flamegraph.pl and speedscope.
+    void WriteFolded(std::ostream& out);
+    // Per-function calls/time/blocks, per-opcode counts and the hottest
+    // source lines.
+    void WriteJson(std::ostream& out);
+    // Entry and branch counts for LLVM codegen (qumiri --profile-out); the
+    // pipeline options go in the profile so qumirc can check them.
+    TPgoProfile PgoProfile(int optLevel, bool boundsChecks) const;
+
+private:
+    using TClock = std::chrono::steady_clock;
+
+    struct TNode {
+        int Func;
+        int Parent;
+        uint64_t ExclusiveNs = 0;
+        std::unordered_map<int, int> Children; // func -> node
+    };
+
+    struct TActiveCall {
+        int Node;
+        TClock::time_point Start;
+        uint64_t ChildNs = 0;
+    };
+
+    struct TFunctionStats {
+        uint64_t Calls = 0;
+        uint64_t InclusiveNs = 0;
+        uint64_t ExclusiveNs = 0;
+        int Active = 0; // recursion depth, inclusive time counts only the outermost call
+    };
+
+    // Closes calls left open by a runtime error.
+    void LeaveAll();
+
+    const TModule& Module;
+    std::vector<TNode> Nodes; // Nodes[0] is the root
+    std::vector<TActiveCall> Stack;
+    std::unordered_map<int, TFunctionStats> Stats;
+};
+
+} // namespace NIR
+} // namespace NQumir
@@ -5,6 +5,7 @@
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <stdexcept>
 
 namespace NQumir {
 namespace NIR {
@@ -12,6 +13,7 @@ namespace NIR {
 int TTypeTable::I(EKind k) {
     auto it = PrimitiveCache.find(k);
     if (it != PrimitiveCache.end()) return it->second;
+    CheckNotFrozen();
 
     Types.push_back({
         .Kind = k,
@@ -24,6 +26,7 @@ int TTypeTable::I(EKind k) {
 int TTypeTable::Ptr(int to) {
     auto it = PtrCache.find(to);
     if (it != PtrCache.end()) return it->second;
+    CheckNotFrozen();
 
     Types.push_back({
         .Kind = EKind::Ptr,
@@ -36,6 +39,7 @@ int TTypeTable::Ptr(int to) {
 int TTypeTable::Func(std::vector<int> args, int ret) {
     auto it = FuncCache.find({args, ret});
     if (it != FuncCache.end()) return it->second;
+    CheckNotFrozen();
 
     int id = (int)FuncSigs.size();
     FuncSigs.push_back({
@@ -53,6 +57,7 @@ int TTypeTable::Func(std::vector<int> args, int ret) {
 int TTypeTable::Struct(std::vector<int> fields) {
     auto it = StructCache.find(fields);
     if (it != StructCache.end()) return it->second;
+    CheckNotFrozen();
 
     int id = (int)Structs.size();
     Structs.push_back({
@@ -66,6 +71,12 @@ int TTypeTable::Struct(std::vector<int> fields) {
     return StructCache[fields] = (int)Types.size()-1;
 }
 
+void TTypeTable::CheckNotFrozen() const {
+    if (Frozen) {
+        throw std::logic_error("new IR type requested while the type table is frozen");
+    }
+}
+
 int TTypeTable::Unify(int leftId, int rightId) {
     if (leftId == rightId) return leftId;
     auto left = Types[leftId];
@@ -450,5 +461,13 @@ const std::vector<int>& TTypeTable::GetStructFields(int typeId) const {
     return Structs[type.Aux].FieldTypes;
 }
 
+const TFuncSig& TTypeTable::GetFuncSig(int typeId) const {
+    auto& type = Types[typeId];
+    if (type.Kind != EKind::Func) {
+        throw std::runtime_error("Type is not a Func in GetFuncSig");
+    }
+    return FuncSigs[type.Aux];
+}
+
 } // namespace NIR
 } // namespace NQumir
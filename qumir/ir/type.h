@@ -69,6 +69,11 @@ public:
     EKind GetKind(int typeId) const;
     int UnderlyingType(int typeId) const; // for Ptr, Func, Struct
     const std::vector<int>& GetStructFields(int typeId) const;
+    const TFuncSig& GetFuncSig(int typeId) const;
+    // Number of type ids handed out; ids are dense in [0, Size()).
+    int Size() const {
+        return (int)Types.size();
+    }
     // Size of the type payload in bytes. Stack frames may add their own alignment.
     int SizeInBytes(int typeId) const;
     int AlignInBytes(int typeId) const;
@@ -81,8 +86,20 @@ public:
     // FieldOffset values into the IR — target width is fixed for the
     // lifetime of the module.
     void SetPointerSize(int bytes);
+    int GetPointerSize() const {
+        return PointerSize;
+    }
+
+    // While frozen, asking for a type that is not in the table yet throws
+    // instead of adding one. A frozen table is only read, so threads may
+    // share it (see NPasses::Pipeline).
+    void Freeze(bool frozen) {
+        Frozen = frozen;
+    }
 
 private:
+    void CheckNotFrozen() const;
+
     std::vector<TType> Types;
     std::vector<TFuncSig> FuncSigs;
     std::vector<TStructL> Structs;
@@ -93,6 +110,23 @@ private:
     std::map<std::vector<int>, int> StructCache;
 
     int PointerSize = 8;
+    bool Frozen = false;
+};
+
+// Keeps a type table frozen (see TTypeTable::Freeze) while it lives.
+class TTypeTableFreeze {
+public:
+    explicit TTypeTableFreeze(TTypeTable& types)
+        : Types(types)
+    {
+        Types.Freeze(true);
+    }
+    ~TTypeTableFreeze() {
+        Types.Freeze(false);
+    }
+
+private:
+    TTypeTable& Types;
 };
 
 int FromAstType(const NAst::TTypePtr& tastType, TTypeTable& tt);
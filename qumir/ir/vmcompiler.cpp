@@ -1,12 +1,17 @@
 #include "vmcompiler.h"
 #include <qumir/align.h>
+#include <qumir/parallel.h>
 #include <qumir/ir/type.h>
 #include <qumir/ir/vminstr.h>
+#include <qumir/ir/passes/analysis/liveness.h>
 #include <qumir/ir/passes/transforms/pipeline.h>
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <iomanip>
+#include <numeric>
+#include <unordered_set>
 #include <dlfcn.h>
 
 namespace NQumir {
@@ -76,6 +81,242 @@ bool Is128BitInteger(const TTypeTable& tt, int typeId) {
     return kind == EKind::I128 || kind == EKind::U128;
 }
 
+// Registers and frame storage of the tmps of one function, see AssignRegisters.
+struct TRegisterAssignment {
+    std::vector<int32_t> Reg;         // tmp -> register, -1 if the tmp is never used
+    std::vector<int> RegTypeIds;      // register -> IR typeId of (one of) its tmps
+    std::vector<int> RegFrameOffsets; // register -> frame storage of struct call results, -1 if none
+    int32_t MaxReg = -1;
+    int32_t MaxReg128 = -1;
+    int StorageEnd = 0;
+};
+
+// Graph coloring over the live ranges of the (de-SSA'd) function: tmps that
+// are never live at the same time share a register, and a `mov` does not
+// keep its source and destination apart, so most phi copies coalesce.
+// Tmps are colored greedily in index order, which roughly follows the code.
+//
+// eval reads RegTypeIds and RegFrameOffsets by register, when a call
+// returns a struct: such a register only holds tmps of that one struct type.
+// The storage a struct call result is written to lives as long as any tmp
+// that may point into it, i.e. the tmps derived from it by pointer
+// arithmetic and copies. Two results share storage (and may share a
+// register) only when those sets of tmps never interfere; a result whose
+// address is stored to memory or passed as a plain pointer keeps its own.
+TRegisterAssignment AssignRegisters(const TFunction& function, const TTypeTable& types, int storageBase) {
+    const auto live = NPasses::ComputeLiveness(function);
+    const int n = live.TmpCount;
+    auto typeOf = [&](int tmp) {
+        return tmp < (int)function.TmpTypes.size() ? function.TmpTypes[tmp] : -1;
+    };
+    auto isStruct = [&](int typeId) {
+        return typeId >= 0 && types.GetKind(typeId) == EKind::Struct;
+    };
+
+    std::vector<char> used(n, 0);
+    std::vector<char> structResult(n, 0);
+    std::vector<char> escapes(n, 0);
+    std::vector<std::vector<int>> interferes(n);
+    std::vector<int> group(n);
+    std::iota(group.begin(), group.end(), 0);
+    auto find = [&](int t) {
+        while (group[t] != t) {
+            t = group[t] = group[group[t]];
+        }
+        return t;
+    };
+
+    for (int b = 0; b < (int)function.Blocks.size(); ++b) {
+        NPasses::TTmpSet now = live.LiveOut[b];
+        const auto& instrs = function.Blocks[b].Instrs;
+        for (auto it = instrs.rbegin(); it != instrs.rend(); ++it) {
+            const auto& instr = *it;
+            const int dest = instr.Dest.Idx;
+            if (dest >= 0) {
+                used[dest] = 1;
+                int copyOf = -1;
+                if (instr.Op == "mov"_op && instr.Operands[0].Type == TOperand::EType::Tmp
+                    && typeOf(instr.Operands[0].Tmp.Idx) == typeOf(dest))
+                {
+                    copyOf = instr.Operands[0].Tmp.Idx;
+                }
+                now.ForEach([&](int t) {
+                    if (t != dest && t != copyOf) {
+                        interferes[dest].push_back(t);
+                        interferes[t].push_back(dest);
+                    }
+                });
+                now.Reset(dest);
+                const int destType = typeOf(dest);
+                structResult[dest] |= instr.Op == "call"_op && isStruct(destType);
+                if ((isStruct(destType) || types.IsPointer(destType))
+                    && instr.Op != "lde"_op && instr.Op != "load"_op)
+                {
+                    for (size_t i = 0; i < instr.OperandCount; ++i) {
+                        if (instr.Operands[i].Type == TOperand::EType::Tmp) {
+                            group[find(instr.Operands[i].Tmp.Idx)] = find(dest);
+                        }
+                    }
+                }
+            }
+            for (size_t i = 0; i < instr.OperandCount; ++i) {
+                if (instr.Operands[i].Type != TOperand::EType::Tmp) {
+                    continue;
+                }
+                const int t = instr.Operands[i].Tmp.Idx;
+                used[t] = 1;
+                now.Set(t);
+                // Struct values are copied by StructStore and at calls.
+                const bool storedStruct = instr.Op == "stre"_op
+                    && instr.Operands[0].Type == TOperand::EType::Local
+                    && instr.Operands[0].Local.Idx < (int)function.LocalTypes.size()
+                    && isStruct(function.LocalTypes[instr.Operands[0].Local.Idx]);
+                if ((instr.Op == "ste"_op && i == 1)
+                    || (instr.Op == "stre"_op && i == 1 && !storedStruct)
+                    || ((instr.Op == "arg"_op || instr.Op == "ret"_op) && !isStruct(typeOf(t))))
+                {
+                    escapes[t] = 1;
+                }
+            }
+        }
+    }
+
+    std::vector<char> pinned(n, 0);
+    for (int t = 0; t < n; ++t) {
+        pinned[find(t)] |= escapes[t];
+    }
+    std::vector<char> owner(n, 0);
+    for (int t = 0; t < n; ++t) {
+        owner[find(t)] |= structResult[t];
+    }
+    std::unordered_set<uint64_t> groupsInterfere;
+    for (int t = 0; t < n; ++t) {
+        const int g = find(t);
+        if (!owner[g]) {
+            continue;
+        }
+        for (int other : interferes[t]) {
+            const int h = find(other);
+            if (h != g && owner[h]) {
+                groupsInterfere.insert((uint64_t)std::min(g, h) << 32 | (uint32_t)std::max(g, h));
+            }
+        }
+    }
+    auto storageConflict = [&](int a, int b) {
+        const int g = find(a), h = find(b);
+        return pinned[g] || pinned[h] || g == h
+            || groupsInterfere.contains((uint64_t)std::min(g, h) << 32 | (uint32_t)std::max(g, h));
+    };
+
+    TRegisterAssignment out;
+    out.Reg.assign(n, -1);
+    std::vector<int> regClass; // struct typeId, or -1 for registers of scalars and pointers
+    std::vector<std::vector<int>> regResults;
+    std::vector<int> taken;
+    for (int t = 0; t < n; ++t) {
+        if (!used[t]) {
+            continue;
+        }
+        for (int other : interferes[t]) {
+            if (out.Reg[other] >= 0) {
+                taken[out.Reg[other]] = t;
+            }
+        }
+        const int cls = isStruct(typeOf(t)) ? typeOf(t) : -1;
+        int32_t r = 0;
+        for (; r < (int32_t)regClass.size(); ++r) {
+            if (taken[r] == t || regClass[r] != cls) {
+                continue;
+            }
+            if (structResult[t] && std::any_of(regResults[r].begin(), regResults[r].end(),
+                    [&](int u) { return storageConflict(t, u); }))
+            {
+                continue;
+            }
+            break;
+        }
+        if (r == (int32_t)regClass.size()) {
+            regClass.push_back(cls);
+            regResults.emplace_back();
+            taken.push_back(-1);
+            out.RegTypeIds.push_back(typeOf(t));
+        }
+        out.Reg[t] = r;
+        if (structResult[t]) {
+            regResults[r].push_back(t);
+        }
+        out.MaxReg = std::max(out.MaxReg, r);
+        if (Is128BitInteger(types, typeOf(t))) {
+            out.MaxReg128 = std::max(out.MaxReg128, r);
+        }
+    }
+
+    // First fit of the result storage: a block moves past every placed one
+    // it overlaps and conflicts with.
+    struct TPlaced {
+        int Reg;
+        int Begin;
+        int End;
+    };
+    std::vector<TPlaced> placed;
+    auto conflicts = [&](int r, int s) {
+        for (int a : regResults[r]) {
+            for (int b : regResults[s]) {
+                if (storageConflict(a, b)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    };
+    out.RegFrameOffsets.assign(regClass.size(), -1);
+    out.StorageEnd = storageBase;
+    for (int r = 0; r < (int)regClass.size(); ++r) {
+        if (regResults[r].empty()) {
+            continue;
+        }
+        const int size = types.SizeInBytes(regClass[r]);
+        int offset = AlignUp(storageBase, 8);
+        for (bool moved = true; moved; ) {
+            moved = false;
+            for (const auto& p : placed) {
+                if (offset < p.End && p.Begin < offset + size && conflicts(r, p.Reg)) {
+                    offset = AlignUp(p.End, 8);
+                    moved = true;
+                }
+            }
+        }
+        out.RegFrameOffsets[r] = offset;
+        placed.push_back(TPlaced{r, offset, offset + size});
+        out.StorageEnd = std::max(out.StorageEnd, offset + size);
+    }
+    return out;
+}
+
+// IR instruction with its VM opcode chosen but operands not yet encoded.
+struct TWideInstr {
+    std::array<TVMOperand, 3> Operands;
+    EVMOp Op;
+};
+
+bool IsBinaryOp(EVMOp op) {
+    return static_cast<uint8_t>(op) < static_cast<uint8_t>(EVMOp::INeg);
+}
+
+// OpRI and OpIR follow Op in the enum, see QUMIR_VM_BINARY_OPS.
+EVMOp RegImmVariant(EVMOp op) {
+    return static_cast<EVMOp>(static_cast<uint8_t>(op) + 1);
+}
+
+EVMOp ImmRegVariant(EVMOp op) {
+    return static_cast<EVMOp>(static_cast<uint8_t>(op) + 2);
+}
+
+bool IsBinary128Op(EVMOp op) {
+    return static_cast<uint8_t>(op) >= static_cast<uint8_t>(EVMOp::IAdd128)
+        && static_cast<uint8_t>(op) <= static_cast<uint8_t>(EVMOp::ICmpNE128);
+}
+
 EKind ClassifyKind(int typeId, const TTypeTable& tt, NFFI::EStructKind& structKind) {
     EKind kind = tt.GetKind(typeId);
     structKind = (kind == EKind::Struct)
@@ -87,6 +328,7 @@ EKind ClassifyKind(int typeId, const TTypeTable& tt, NFFI::EStructKind& structKi
 } // namespace
 
 NFFI::IFunction* TVMCompiler::GetOrCreateExternalThunk(int externIdx) {
+    std::lock_guard lock(ExternalThunkMutex);
     if (auto it = ExternalThunkCache.find(externIdx); it != ExternalThunkCache.end()) {
         return it->second;
     }
@@ -100,25 +342,11 @@ NFFI::IFunction* TVMCompiler::GetOrCreateExternalThunk(int externIdx) {
         if (!symbol) {
             return nullptr;
         }
-        NFFI::EStructKind retStruct = NFFI::EStructKind::None;
-        EKind retKind = ClassifyKind(ext.ReturnTypeId, Module.Types, retStruct);
-        size_t retSize = static_cast<size_t>(Module.Types.SizeInBytes(ext.ReturnTypeId));
-        std::vector<EKind> argKinds;
-        std::vector<NFFI::EStructKind> argStructs;
-        std::vector<size_t> argSizes;
-        argKinds.reserve(ext.ArgTypes.size());
-        argStructs.reserve(ext.ArgTypes.size());
-        argSizes.reserve(ext.ArgTypes.size());
-        for (int argType : ext.ArgTypes) {
-            NFFI::EStructKind argStruct = NFFI::EStructKind::None;
-            argKinds.push_back(ClassifyKind(argType, Module.Types, argStruct));
-            argStructs.push_back(argStruct);
-            argSizes.push_back(static_cast<size_t>(Module.Types.SizeInBytes(argType)));
-        }
-        thunk.reset(NFFI::BuildFFI(symbol, retKind, retStruct, retSize, argKinds, argStructs, argSizes));
-        if (!thunk) {
-            return nullptr;
+        auto* raw = BuildThunk(symbol, ext.ReturnTypeId, ext.ArgTypes);
+        if (raw) {
+            ExternalThunkCache[externIdx] = raw;
         }
+        return raw;
     }
 
     NFFI::IFunction* raw = thunk.get();
@@ -127,6 +355,51 @@ NFFI::IFunction* TVMCompiler::GetOrCreateExternalThunk(int externIdx) {
     return raw;
 }
 
+NFFI::IFunction* TVMCompiler::CreateNativeThunk(const TFunction& function, void* symbol) {
+    // The native tier emits struct and 128-bit values with LLVM's own
+    // aggregate/integer ABI, which the FFI does not model.
+    auto isPlain = [&](int typeId) {
+        return typeId < 0 || (Module.Types.GetKind(typeId) != EKind::Struct && !Is128BitInteger(Module.Types, typeId));
+    };
+    std::vector<int> argTypes;
+    argTypes.reserve(function.ArgLocals.size());
+    for (const auto& arg : function.ArgLocals) {
+        argTypes.push_back(function.LocalTypes[arg.Idx]);
+        if (!isPlain(argTypes.back())) {
+            return nullptr;
+        }
+    }
+    if (!isPlain(function.ReturnTypeId)) {
+        return nullptr;
+    }
+    return BuildThunk(symbol, function.ReturnTypeId, argTypes);
+}
+
+NFFI::IFunction* TVMCompiler::BuildThunk(void* symbol, int returnTypeId, const std::vector<int>& argTypes) {
+    NFFI::EStructKind retStruct = NFFI::EStructKind::None;
+    EKind retKind = returnTypeId < 0 ? EKind::Void : ClassifyKind(returnTypeId, Module.Types, retStruct);
+    size_t retSize = returnTypeId < 0 ? 0 : static_cast<size_t>(Module.Types.SizeInBytes(returnTypeId));
+    std::vector<EKind> argKinds;
+    std::vector<NFFI::EStructKind> argStructs;
+    std::vector<size_t> argSizes;
+    argKinds.reserve(argTypes.size());
+    argStructs.reserve(argTypes.size());
+    argSizes.reserve(argTypes.size());
+    for (int argType : argTypes) {
+        NFFI::EStructKind argStruct = NFFI::EStructKind::None;
+        argKinds.push_back(ClassifyKind(argType, Module.Types, argStruct));
+        argStructs.push_back(argStruct);
+        argSizes.push_back(static_cast<size_t>(Module.Types.SizeInBytes(argType)));
+    }
+    std::unique_ptr<NFFI::IFunction> thunk(NFFI::BuildFFI(symbol, retKind, retStruct, retSize, argKinds, argStructs, argSizes));
+    if (!thunk) {
+        return nullptr;
+    }
+    NFFI::IFunction* raw = thunk.get();
+    ExternalThunks.push_back(std::move(thunk));
+    return raw;
+}
+
 TExecFunc& TVMCompiler::Compile(TFunction& function, bool printByteCode) {
     auto it = CodeCache.find(function.SymId);
     if (it != CodeCache.end() && it->second.UniqueId == function.UniqueId) {
@@ -142,36 +415,75 @@ TExecFunc& TVMCompiler::Compile(TFunction& function, bool printByteCode) {
     CompileUltraLow(function, execFunc);
     if (printByteCode) {
         std::cerr << "Compiled function " << function.Name << " (symId=" << function.SymId << ", uniqueId=" << function.UniqueId << "):\n";
-        std::cerr << "Start address: " << (uint64_t)execFunc.VMCode.data() << ", insrt size: " << sizeof(TVMInstr) << " bytes\n";
-        char* p = reinterpret_cast<char*>(execFunc.VMCode.data());
+        std::cerr << "Instr size: " << sizeof(TVMInstr) << " bytes\n";
         for (size_t i = 0; i < execFunc.VMCode.size(); ++i) {
-            std::cerr << std::setw(4) << (uint64_t)(p + i * sizeof(TVMInstr)) << ": "<< execFunc.VMCode[i] << "\n";
+            std::cerr << std::setw(4) << i << ": " << execFunc.VMCode[i] << "\n";
+        }
+        for (size_t i = 0; i < execFunc.Consts.size(); ++i) {
+            std::cerr << "const " << i << ": " << execFunc.Consts[i] << "\n";
         }
     }
     return execFunc;
 }
 
+void TVMCompiler::CompileAll(int threads) {
+    std::vector<std::pair<TFunction*, TExecFunc*>> jobs;
+    for (auto& function : Module.Functions) {
+        if (function.Exec) {
+            continue;
+        }
+        auto it = CodeCache.find(function.SymId);
+        if (it != CodeCache.end() && it->second.UniqueId == function.UniqueId) {
+            function.Exec = &it->second;
+            continue;
+        }
+        // Entries are made here: references into the map stay valid, the
+        // map itself is not touched while the threads run.
+        auto& execFunc = CodeCache[function.SymId] = TExecFunc {
+            .UniqueId = function.UniqueId
+        };
+        jobs.push_back({&function, &execFunc});
+    }
+
+    Module.Types.Ptr(Module.Types.I(EKind::I8));
+    TTypeTableFreeze freeze(Module.Types);
+    ParallelFor(jobs.size(), threads, [&](size_t i) {
+        auto [function, execFunc] = jobs[i];
+        NPasses::BeforeCompile(*function, Module);
+        CompileUltraLow(*function, *execFunc);
+        function->Exec = execFunc;
+    });
+}
+
 void TVMCompiler::CompileUltraLow(const TFunction& function, TExecFunc& funcOut)
 {
     int lowStringTypeId = Module.Types.Ptr(Module.Types.I(EKind::I8));
-    std::unordered_map<int64_t, int64_t> labelToPC;
-    std::unordered_map<int64_t, int64_t> labelToLastPC;
+    std::unordered_map<int64_t, int32_t> labelToPC;
 
     auto& code = funcOut.VMCode;
-    funcOut.TmpTypeIds = function.TmpTypes;
+    size_t instrCount = 0;
+    // Args of a call are emitted right before it, so the widest run of args
+    // sizes the frame's outgoing arg area.
+    int32_t maxArgs = 0;
+    int32_t pendingArgs = 0;
     for (const auto& block : function.Blocks) {
-        labelToPC[block.Label.Idx] = code.size();
         for (const auto& instr : block.Instrs) {
-            funcOut.MaxTmpIdx = std::max(funcOut.MaxTmpIdx, instr.Dest.Idx);
-            code.emplace_back(); // placeholder
+            if (instr.Op == "arg"_op) {
+                maxArgs = std::max(maxArgs, ++pendingArgs);
+            } else if (instr.Op == "call"_op) {
+                pendingArgs = 0;
+            }
         }
-        labelToLastPC[block.Label.Idx] = code.size() - 1;
+        instrCount += block.Instrs.size();
     }
+    code.reserve(instrCount);
 
     // Compute byte offset for each local variable and address-backed temporary.
     // VM pointers must refer to memory owned by the current call frame; allocating
     // per instruction would make struct-heavy loops grow runtime-owned buffers.
     std::vector<int> localByteOffsets;
+    std::unordered_map<int, int> sallocOffsets;
+    TRegisterAssignment regs;
     {
         int offset = 0;
         for (int typeId : function.LocalTypes) {
@@ -180,18 +492,12 @@ void TVMCompiler::CompileUltraLow(const TFunction& function, TExecFunc& funcOut)
             offset += Module.Types.SizeInBytes(typeId);
         }
 
-        funcOut.TmpFrameOffsets.assign(function.TmpTypes.size(), -1);
-        for (int tmpIdx = 0; tmpIdx < (int)function.TmpTypes.size(); ++tmpIdx) {
-            const int typeId = function.TmpTypes[tmpIdx];
-            if (typeId >= 0 && Is128BitInteger(Module.Types, typeId)) {
-                funcOut.MaxTmp128Idx = std::max(funcOut.MaxTmp128Idx, tmpIdx);
-            }
-            if (typeId >= 0 && Module.Types.GetKind(typeId) == EKind::Struct) {
-                offset = AlignUp(offset, 8);
-                funcOut.TmpFrameOffsets[tmpIdx] = offset;
-                offset += Module.Types.SizeInBytes(typeId);
-            }
-        }
+        regs = AssignRegisters(function, Module.Types, offset);
+        offset = regs.StorageEnd;
+        funcOut.TmpTypeIds = regs.RegTypeIds;
+        funcOut.TmpFrameOffsets = regs.RegFrameOffsets;
+        funcOut.MaxTmpIdx = std::max(0, regs.MaxReg);
+        funcOut.MaxTmp128Idx = regs.MaxReg128;
 
         for (const auto& block : function.Blocks) {
             for (const auto& instr : block.Instrs) {
@@ -199,10 +505,7 @@ void TVMCompiler::CompileUltraLow(const TFunction& function, TExecFunc& funcOut)
                     continue;
                 }
                 offset = AlignUp(offset, 8);
-                if (instr.Dest.Idx >= (int)funcOut.TmpFrameOffsets.size()) {
-                    funcOut.TmpFrameOffsets.resize(instr.Dest.Idx + 1, -1);
-                }
-                funcOut.TmpFrameOffsets[instr.Dest.Idx] = offset;
+                sallocOffsets[instr.Dest.Idx] = offset;
                 offset += static_cast<int>(instr.Operands[0].Imm.Value);
             }
         }
@@ -290,7 +593,7 @@ void TVMCompiler::CompileUltraLow(const TFunction& function, TExecFunc& funcOut)
         return Is128BitInteger(Module.Types, typeId);
     };
 
-    auto ins2vm = [&](const TInstr& ins, TVMInstr& out) {
+    auto ins2vm = [&](const TInstr& ins, TWideInstr& out) {
         int offset = 0;
         if (ins.Dest.Idx >= 0) {
             out.Operands[0] = ins.Dest;
@@ -316,8 +619,7 @@ void TVMCompiler::CompileUltraLow(const TFunction& function, TExecFunc& funcOut)
                     out.Operands[i + offset] = ins.Operands[i].Imm;
                     break;
                 case TOperand::EType::Label:
-                    TVMInstr* pc = &code[labelToPC.at(ins.Operands[i].Label.Idx)];
-                    out.Operands[i + offset] = TImm{reinterpret_cast<int64_t>(pc)};
+                    out.Operands[i + offset] = ins.Operands[i].Label;
                     break;
             };
         }
@@ -327,16 +629,19 @@ void TVMCompiler::CompileUltraLow(const TFunction& function, TExecFunc& funcOut)
             case "salloc"_op: {
                 require(ins, 1, 1);
                 out.Op = EVMOp::SAlloc;
-                const int tmpIdx = ins.Dest.Idx;
-                if (tmpIdx < 0 || tmpIdx >= (int)funcOut.TmpFrameOffsets.size()
-                    || funcOut.TmpFrameOffsets[tmpIdx] < 0)
-                {
+                auto it = sallocOffsets.find(ins.Dest.Idx);
+                if (it == sallocOffsets.end()) {
                     throw std::runtime_error("salloc temporary has no frame storage");
                 }
-                out.Operands[1] = TUntypedImm{funcOut.TmpFrameOffsets[tmpIdx]};
+                out.Operands[1] = TUntypedImm{it->second};
                 out.Operands[2] = TUntypedImm{ins.Operands[0].Imm.Value};
                 break;
             }
+            case "bounds"_op: {
+                require(ins, 0, 2);
+                out.Op = EVMOp::BoundsCheck;
+                break;
+            }
             case "ste"_op: {
                 require(ins, 0, 2);
                 int storeTypeId = typeIdOp(ins.Operands[1]);
@@ -728,13 +1033,283 @@ void TVMCompiler::CompileUltraLow(const TFunction& function, TExecFunc& funcOut)
         }
     };
 
-    auto* ptr = code.data();
+    // Encoding: imm operands go to the constant pool, and an imm where the
+    // opcode has no imm form is first loaded into a scratch register past MaxTmpIdx.
+    std::unordered_map<int64_t, int32_t> constIdx;
+    struct TJumpFixup {
+        size_t PC;
+        int32_t TVMInstr::* Field;
+        int32_t Label;
+    };
+    std::vector<TJumpFixup> jumpFixups;
+    // Register layout: tmp registers, then the arg area (slot 0 is kept free for a
+    // struct-return pointer so ECall can prepend it in place), then scratch.
+    funcOut.ArgSlotBase = std::max(funcOut.MaxTmpIdx, funcOut.MaxTmp128Idx) + 1;
+    const int32_t firstScratch = funcOut.ArgSlotBase + 1 + maxArgs;
+    int32_t nextArgSlot = 0;
+    int32_t usedScratch = -1;
+    int32_t usedScratch128 = -1;
+
+    auto emit = [&](EVMOp op, int32_t a = -1, int32_t b = 0, int32_t c = 0) {
+        code.push_back(TVMInstr{.Op = op, .A = a, .B = b, .C = c});
+    };
+
+    auto konst = [&](const TVMOperand& op) -> int32_t {
+        if (op.Type != TVMOperand::EType::Imm) {
+            throw std::runtime_error("VM operand must be an immediate");
+        }
+        auto [it, inserted] = constIdx.emplace(op.Imm.Value, (int32_t)funcOut.Consts.size());
+        if (inserted) {
+            funcOut.Consts.push_back(op.Imm.Value);
+        }
+        return it->second;
+    };
+
+    auto reg = [&](const TVMOperand& op, int scratch) -> int32_t {
+        if (op.Type == TVMOperand::EType::Tmp) {
+            return op.Tmp.Idx;
+        }
+        const int32_t r = firstScratch + scratch;
+        emit(EVMOp::Cmov, r, konst(op));
+        usedScratch = std::max(usedScratch, r);
+        return r;
+    };
+
+    auto reg128 = [&](const TVMOperand& op, int scratch) -> int32_t {
+        if (op.Type == TVMOperand::EType::Tmp) {
+            return op.Tmp.Idx;
+        }
+        // 128-bit immediates carry their low half only, like ReadOperand128 did.
+        const int32_t r = firstScratch + scratch;
+        emit(EVMOp::CmovS128, r, konst(op));
+        usedScratch128 = std::max(usedScratch128, r);
+        return r;
+    };
+
+    auto frameOrSlot = [&](const TVMOperand& op, EVMOp local, EVMOp global) -> std::pair<EVMOp, int32_t> {
+        if (op.Type == TVMOperand::EType::Slot) {
+            return {global, op.Slot.Idx};
+        }
+        if (op.Type == TVMOperand::EType::Local) {
+            return {local, op.Local.Idx};
+        }
+        throw std::runtime_error("VM operand must be a local or a global slot");
+    };
+
+    auto jumpTo = [&](const TVMOperand& op, int32_t TVMInstr::* field) {
+        if (op.Type != TVMOperand::EType::Label) {
+            throw std::runtime_error("VM jump target must be a label");
+        }
+        jumpFixups.push_back(TJumpFixup{code.size() - 1, field, op.Label.Idx});
+    };
+
+    auto encode = [&](const TWideInstr& w) {
+        const auto& o = w.Operands;
+        const int32_t dst = o[0].Type == TVMOperand::EType::Tmp ? o[0].Tmp.Idx : -1;
+        if (IsBinaryOp(w.Op)) {
+            const bool lhsImm = o[1].Type == TVMOperand::EType::Imm;
+            const bool rhsImm = o[2].Type == TVMOperand::EType::Imm;
+            if (lhsImm && !rhsImm) {
+                emit(ImmRegVariant(w.Op), dst, konst(o[1]), o[2].Tmp.Idx);
+            } else if (rhsImm) {
+                emit(RegImmVariant(w.Op), dst, reg(o[1], 0), konst(o[2]));
+            } else {
+                emit(w.Op, dst, o[1].Tmp.Idx, o[2].Tmp.Idx);
+            }
+            return;
+        }
+        if (IsBinary128Op(w.Op)) {
+            const int32_t lhs = reg128(o[1], 0);
+            const int32_t rhs = reg128(o[2], 1);
+            emit(w.Op, dst, lhs, rhs);
+            return;
+        }
+        switch (w.Op) {
+            case EVMOp::Mov:
+                if (o[1].Type == TVMOperand::EType::Imm) {
+                    emit(EVMOp::Cmov, dst, konst(o[1]));
+                } else {
+                    emit(EVMOp::Mov, dst, o[1].Tmp.Idx);
+                }
+                break;
+            case EVMOp::Cmov:
+            case EVMOp::CmovS128:
+            case EVMOp::CmovU128:
+                emit(w.Op, dst, konst(o[1]));
+                break;
+            case EVMOp::SExt128:
+            case EVMOp::ZExt128:
+                if (o[1].Type == TVMOperand::EType::Imm) {
+                    emit(w.Op == EVMOp::SExt128 ? EVMOp::CmovS128 : EVMOp::CmovU128, dst, konst(o[1]));
+                } else {
+                    emit(w.Op, dst, o[1].Tmp.Idx);
+                }
+                break;
+            case EVMOp::INeg:
+            case EVMOp::INot:
+            case EVMOp::IBitNot:
+            case EVMOp::FNeg:
+            case EVMOp::Bitcast:
+            case EVMOp::I2F:
+            case EVMOp::F2I:
+            case EVMOp::F2I128: {
+                const int32_t src = reg(o[1], 0);
+                emit(w.Op, dst, src);
+                break;
+            }
+            case EVMOp::INeg128:
+            case EVMOp::INot128:
+            case EVMOp::IBitNot128:
+            case EVMOp::I2B128:
+            case EVMOp::Mov128:
+            case EVMOp::Trunc128:
+            case EVMOp::I2F128S:
+            case EVMOp::I2F128U: {
+                const int32_t src = reg128(o[1], 0);
+                emit(w.Op, dst, src);
+                break;
+            }
+            case EVMOp::Load64:
+            case EVMOp::Load128: {
+                auto [op, addr] = w.Op == EVMOp::Load64
+                    ? frameOrSlot(o[1], EVMOp::Load64, EVMOp::Load64G)
+                    : frameOrSlot(o[1], EVMOp::Load128, EVMOp::Load128G);
+                emit(op, dst, addr);
+                break;
+            }
+            case EVMOp::Store64: {
+                auto [op, addr] = frameOrSlot(o[0], EVMOp::Store64, EVMOp::Store64G);
+                const int32_t src = reg(o[1], 0);
+                emit(op, addr, src);
+                break;
+            }
+            case EVMOp::Store128: {
+                auto [op, addr] = frameOrSlot(o[0], EVMOp::Store128, EVMOp::Store128G);
+                const int32_t src = reg128(o[1], 0);
+                emit(op, addr, src);
+                break;
+            }
+            case EVMOp::Lea: {
+                auto [op, addr] = frameOrSlot(o[1], EVMOp::Lea, EVMOp::LeaG);
+                emit(op, dst, addr);
+                break;
+            }
+            case EVMOp::Lde:
+            case EVMOp::Lde128: {
+                const int32_t addr = reg(o[1], 0);
+                emit(w.Op, dst, addr, (int32_t)o[2].Imm.Value);
+                break;
+            }
+            case EVMOp::Ste:
+            case EVMOp::Copy: {
+                const int32_t addr = reg(o[0], 0);
+                const int32_t src = reg(o[1], 1);
+                emit(w.Op, addr, src, (int32_t)o[2].Imm.Value);
+                break;
+            }
+            case EVMOp::BoundsCheck: {
+                const int32_t index = reg(o[0], 0);
+                const int32_t size = reg(o[1], 1);
+                emit(w.Op, index, size);
+                break;
+            }
+            case EVMOp::Ste128: {
+                const int32_t addr = reg(o[0], 0);
+                const int32_t src = reg128(o[1], 1);
+                emit(w.Op, addr, src);
+                break;
+            }
+            case EVMOp::StructStore: {
+                const int32_t src = reg(o[1], 0);
+                emit(w.Op, o[0].Local.Idx, src, (int32_t)o[2].Imm.Value);
+                break;
+            }
+            case EVMOp::SAlloc:
+                emit(w.Op, dst, (int32_t)o[1].Imm.Value, (int32_t)o[2].Imm.Value);
+                break;
+            case EVMOp::Jmp:
+                emit(w.Op);
+                jumpTo(o[0], &TVMInstr::A);
+                break;
+            case EVMOp::Cmp: {
+                const int32_t cond = reg(o[0], 0);
+                emit(w.Op, cond);
+                jumpTo(o[1], &TVMInstr::B);
+                jumpTo(o[2], &TVMInstr::C);
+                break;
+            }
+            case EVMOp::ArgTmp:
+            case EVMOp::ArgTmp128:
+                emit(w.Op, o[0].Tmp.Idx, funcOut.ArgSlotBase + 1 + nextArgSlot++);
+                break;
+            case EVMOp::ArgConst:
+                emit(w.Op, konst(o[0]), funcOut.ArgSlotBase + 1 + nextArgSlot++);
+                break;
+            case EVMOp::Call:
+                emit(w.Op, dst, (int32_t)o[1].Imm.Value, nextArgSlot);
+                nextArgSlot = 0;
+                break;
+            case EVMOp::ECall:
+                emit(w.Op, dst, konst(o[1]), nextArgSlot);
+                nextArgSlot = 0;
+                break;
+            case EVMOp::Await: {
+                const int32_t future = reg(o[1], 0);
+                emit(w.Op, dst, future);
+                break;
+            }
+            case EVMOp::AwaitVoid: {
+                const int32_t future = reg(o[0], 0);
+                emit(w.Op, future);
+                break;
+            }
+            case EVMOp::Ret: {
+                const int32_t value = reg(o[0], 0);
+                emit(w.Op, value);
+                break;
+            }
+            case EVMOp::Ret128: {
+                const int32_t value = reg128(o[0], 0);
+                emit(w.Op, value);
+                break;
+            }
+            case EVMOp::RetVoid:
+                emit(w.Op);
+                break;
+            default:
+                throw std::runtime_error("Cannot encode VM instruction");
+        }
+    };
+
     for (const auto& block : function.Blocks) {
+        labelToPC[block.Label.Idx] = (int32_t)code.size();
+        if (Profile) {
+            funcOut.BlockPCs.push_back((int32_t)code.size());
+            funcOut.BlockLines.push_back(block.Line);
+            emit(EVMOp::ProfBlock, (int32_t)funcOut.BlockCounts.size());
+            funcOut.BlockCounts.push_back(0);
+        }
         for (const auto& ins : block.Instrs) {
-            auto& dst = *ptr++;
-            ins2vm(ins, dst);
+            TWideInstr wide{};
+            ins2vm(ins, wide);
+            // ins2vm looks up tmp types, so tmps become registers only here.
+            for (auto& op : wide.Operands) {
+                if (op.Type == TVMOperand::EType::Tmp && op.Tmp.Idx >= 0) {
+                    op.Tmp.Idx = regs.Reg[op.Tmp.Idx];
+                }
+            }
+            encode(wide);
         }
     }
+
+    // Jump targets are relative to the jump, so code can be copied or cached as is.
+    for (const auto& fixup : jumpFixups) {
+        code[fixup.PC].*fixup.Field = labelToPC.at(fixup.Label) - (int32_t)fixup.PC;
+    }
+
+    funcOut.MaxTmp128Idx = std::max(funcOut.MaxTmp128Idx, usedScratch128);
+    // Both register files share one window per frame, sized by MaxTmpIdx.
+    funcOut.MaxTmpIdx = std::max({funcOut.MaxTmpIdx, funcOut.MaxTmp128Idx, firstScratch - 1, usedScratch});
 }
 
 } // namespace NIR
@@ -5,21 +5,42 @@
 #include <qumir/ir/ffi.h>
 
 #include <memory>
+#include <mutex>
 
 namespace NQumir {
 namespace NIR {
 
+// How calls to a function run once a native tier is attached to the interpreter.
+enum class ETierState : uint8_t {
+    Interpreted, // counting hotness
+    Compiling,   // native code requested, VM keeps running it
+    Native,      // calls go through TExecFunc::Native
+    VMOnly,      // the native tier gave up on this function
+};
+
 struct TExecFunc {
     int UniqueId;
     std::vector<TInstr> Code;
     std::vector<TVMInstr> VMCode;
+    std::vector<int64_t> Consts; // pool for imm operands of VMCode
+    // Register counts; tmps with disjoint live ranges share a register.
     int32_t MaxTmpIdx{0};
     int32_t MaxTmp128Idx{-1};
+    int32_t ArgSlotBase{0};      // first register of the outgoing call arg area
     int32_t NumLocals{0};        // frame size in bytes (not variable count)
     std::vector<int> ArgByteOffsets; // byte offset of each argument local in the frame
     std::vector<int> ArgTypeIds;     // IR typeId of each argument (eval uses SizeInBytes to handle struct)
-    std::vector<int> TmpTypeIds;     // IR typeId of each tmp (eval uses it for VM-only packed ABI)
-    std::vector<int> TmpFrameOffsets; // optional frame storage for address-backed tmp values
+    std::vector<int> TmpTypeIds;     // IR typeId of each register (eval uses it for VM-only packed ABI)
+    std::vector<int> TmpFrameOffsets; // per register: frame storage for a struct call result, -1 if none
+    // Tiering: calls plus loop back-edges, only counted with a native tier.
+    uint32_t Hotness{0};
+    ETierState Tier{ETierState::Interpreted};
+    NFFI::IFunction* Native{nullptr};
+    // Profiling only (see TVMCompiler::SetProfiling): start PC, source line
+    // and execution count of each block.
+    std::vector<int32_t> BlockPCs;
+    std::vector<int> BlockLines;
+    std::vector<uint64_t> BlockCounts;
 };
 
 class TVMCompiler {
@@ -29,17 +50,31 @@ public:
     {}
 
     TExecFunc& Compile(TFunction& function, bool printByteCode = false);
+    // Compiles every function of the module that has no code yet (Exec is
+    // null) on up to `threads` threads (see ParallelFor), instead of on its
+    // first call.
+    void CompileAll(int threads);
+    // Functions compiled afterwards count block executions via ProfBlock.
+    void SetProfiling(bool profile) {
+        Profile = profile;
+    }
+    // Packed thunk for a native build of the function; nullptr if its
+    // signature is unsupported.
+    NFFI::IFunction* CreateNativeThunk(const TFunction& function, void* symbol);
 
 private:
     void CompileUltraLow(const TFunction& function, TExecFunc& out);
 
     // nullptr if the symbol is missing or the signature is unsupported.
     NFFI::IFunction* GetOrCreateExternalThunk(int externIdx);
+    NFFI::IFunction* BuildThunk(void* symbol, int returnTypeId, const std::vector<int>& argTypes);
 
     TModule& Module;
     std::unordered_map<int, TExecFunc> CodeCache;
     std::vector<std::unique_ptr<NFFI::IFunction>> ExternalThunks;
     std::unordered_map<int, NFFI::IFunction*> ExternalThunkCache;
+    std::mutex ExternalThunkMutex; // CompileAll resolves callees on several threads
+    bool Profile = false;
 };
 
 } // namespace NIR
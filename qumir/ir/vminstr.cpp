@@ -8,50 +8,24 @@ std::ostream& operator<<(std::ostream& os, EVMOp op) {
     case EVMOp::INeg: return os << "INeg";
     case EVMOp::INot: return os << "INot";
     case EVMOp::IBitNot: return os << "IBitNot";
-    case EVMOp::IAdd: return os << "IAdd";
-    case EVMOp::ISub: return os << "ISub";
-    case EVMOp::IMulS: return os << "IMulS";
-    case EVMOp::IMulU: return os << "IMulU";
-    case EVMOp::IDivS: return os << "IDivS";
-    case EVMOp::IDivU: return os << "IDivU";
-    case EVMOp::IRemS: return os << "IRemS";
-    case EVMOp::IRemU: return os << "IRemU";
-    case EVMOp::IAnd: return os << "IAnd";
-    case EVMOp::IOr: return os << "IOr";
-    case EVMOp::IXor: return os << "IXor";
-    case EVMOp::IShl: return os << "IShl";
-    case EVMOp::IShrS: return os << "IShrS";
-    case EVMOp::IShrU: return os << "IShrU";
-    case EVMOp::ICmpLTS: return os << "ICmpLTS";
-    case EVMOp::ICmpLTU: return os << "ICmpLTU";
-    case EVMOp::ICmpGTS: return os << "ICmpGTS";
-    case EVMOp::ICmpGTU: return os << "ICmpGTU";
-    case EVMOp::ICmpLES: return os << "ICmpLES";
-    case EVMOp::ICmpLEU: return os << "ICmpLEU";
-    case EVMOp::ICmpGES: return os << "ICmpGES";
-    case EVMOp::ICmpGEU: return os << "ICmpGEU";
-    case EVMOp::ICmpEQ: return os << "ICmpEQ";
-    case EVMOp::ICmpNE: return os << "ICmpNE";
+#define QUMIR_VM_PRINT_BINARY(op) \
+    case EVMOp::op: return os << #op; \
+    case EVMOp::op##RI: return os << #op "RI"; \
+    case EVMOp::op##IR: return os << #op "IR";
+    QUMIR_VM_BINARY_OPS(QUMIR_VM_PRINT_BINARY)
+#undef QUMIR_VM_PRINT_BINARY
 
     case EVMOp::FNeg: return os << "FNeg";
-    case EVMOp::FAdd: return os << "FAdd";
-    case EVMOp::FSub: return os << "FSub";
-    case EVMOp::FMul: return os << "FMul";
-    case EVMOp::FDiv: return os << "FDiv";
-    case EVMOp::FCmpLT: return os << "FCmpLT";
-    case EVMOp::FCmpGT: return os << "FCmpGT";
-    case EVMOp::FCmpLE: return os << "FCmpLE";
-    case EVMOp::FCmpGE: return os << "FCmpGE";
-    case EVMOp::FCmpEQ: return os << "FCmpEQ";
-    case EVMOp::FCmpNE: return os << "FCmpNE";
     case EVMOp::Load8: return os << "Load8";
     case EVMOp::Load16: return os << "Load16";
     case EVMOp::Load32: return os << "Load32";
     case EVMOp::Load64: return os << "Load64";
+    case EVMOp::Load64G: return os << "Load64G";
     case EVMOp::Store8: return os << "Store8";
     case EVMOp::Store16: return os << "Store16";
     case EVMOp::Store32: return os << "Store32";
     case EVMOp::Store64: return os << "Store64";
+    case EVMOp::Store64G: return os << "Store64G";
     case EVMOp::Mov: return os << "Mov";
     case EVMOp::Cmov: return os << "Cmov";
     case EVMOp::I2F: return os << "I2F";
@@ -70,9 +44,11 @@ std::ostream& operator<<(std::ostream& os, EVMOp op) {
     case EVMOp::Ste: return os << "Ste";
     case EVMOp::Lde: return os << "Lde";
     case EVMOp::Lea: return os << "Lea";
+    case EVMOp::LeaG: return os << "LeaG";
     case EVMOp::Copy: return os << "Copy";
     case EVMOp::StructStore: return os << "StructStore";
     case EVMOp::SAlloc: return os << "SAlloc";
+    case EVMOp::BoundsCheck: return os << "BoundsCheck";
 
     case EVMOp::INeg128: return os << "INeg128";
     case EVMOp::INot128: return os << "INot128";
@@ -101,7 +77,9 @@ std::ostream& operator<<(std::ostream& os, EVMOp op) {
     case EVMOp::ICmpEQ128: return os << "ICmpEQ128";
     case EVMOp::ICmpNE128: return os << "ICmpNE128";
     case EVMOp::Load128: return os << "Load128";
+    case EVMOp::Load128G: return os << "Load128G";
     case EVMOp::Store128: return os << "Store128";
+    case EVMOp::Store128G: return os << "Store128G";
     case EVMOp::Mov128: return os << "Mov128";
     case EVMOp::CmovS128: return os << "CmovS128";
     case EVMOp::CmovU128: return os << "CmovU128";
@@ -116,23 +94,14 @@ std::ostream& operator<<(std::ostream& os, EVMOp op) {
     case EVMOp::Ste128: return os << "Ste128";
     case EVMOp::ArgTmp128: return os << "ArgTmp128";
     case EVMOp::Ret128: return os << "Ret128";
+    case EVMOp::ProfBlock: return os << "ProfBlock";
     default: return os << "EVMOp(" << static_cast<int>(op) << ")";
     }
 }
 
 
 std::ostream& operator<<(std::ostream& os, const TVMInstr& instr) {
-    os << instr.Op << " ";
-    for (size_t i = 0; i < instr.Operands.size(); ++i) {
-        if (instr.Operands[i].Type == TVMOperand::EType::Tmp && instr.Operands[i].Tmp.Idx >= 0) {
-            os << "tmp(" << instr.Operands[i].Tmp.Idx << ") ";
-        } else if (instr.Operands[i].Type == TVMOperand::EType::Slot && instr.Operands[i].Slot.Idx >= 0) {
-            os << "slot(" << instr.Operands[i].Slot.Idx << ") ";
-        } else if (instr.Operands[i].Type == TVMOperand::EType::Imm) {
-            os << "imm(" << instr.Operands[i].Imm.Value << ") ";
-        }
-    }
-    return os;
+    return os << instr.Op << " " << instr.A << " " << instr.B << " " << instr.C;
 }
 
 } // namespace NIR
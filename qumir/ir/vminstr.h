@@ -6,59 +6,70 @@
 namespace NQumir {
 namespace NIR {
 
+// Binary 64-bit ALU ops. Each one has three encodings: Op takes (reg, reg),
+// OpRI takes (reg, imm) and OpIR takes (imm, reg).
+#define QUMIR_VM_BINARY_OPS(X) \
+    X(IAdd)    /* + */ \
+    X(ISub)    /* - */ \
+    X(IMulS)   /* * signed */ \
+    X(IMulU)   /* * unsigned */ \
+    X(IDivS)   /* / signed */ \
+    X(IDivU)   /* / unsigned */ \
+    X(IRemS)   /* % signed */ \
+    X(IRemU)   /* % unsigned */ \
+    X(IAnd)    /* & */ \
+    X(IOr)     /* | */ \
+    X(IXor)    /* xor */ \
+    X(IShl)    /* << */ \
+    X(IShrS)   /* >> signed */ \
+    X(IShrU)   /* >> unsigned */ \
+    X(ICmpLTS) /* < signed */ \
+    X(ICmpLTU) /* < unsigned */ \
+    X(ICmpGTS) /* > signed */ \
+    X(ICmpGTU) /* > unsigned */ \
+    X(ICmpLES) /* <= signed */ \
+    X(ICmpLEU) /* <= unsigned */ \
+    X(ICmpGES) /* >= signed */ \
+    X(ICmpGEU) /* >= unsigned */ \
+    X(ICmpEQ)  /* == */ \
+    X(ICmpNE)  /* != */ \
+    X(FAdd)    /* + */ \
+    X(FSub)    /* - */ \
+    X(FMul)    /* * */ \
+    X(FDiv)    /* / */ \
+    X(FCmpLT)  /* < */ \
+    X(FCmpGT)  /* > */ \
+    X(FCmpLE)  /* <= */ \
+    X(FCmpGE)  /* >= */ \
+    X(FCmpEQ)  /* == */ \
+    X(FCmpNE)  /* != */
+
+// Operand fields of TVMInstr are named A, B, C below. A register operand is an
+// index into the frame's register file. An imm operand indexes
+// TExecFunc::Consts. A jump target is an instruction offset relative to the
+// jump itself.
 enum class EVMOp : uint8_t {
-    // TODO: add variants imm op const for simpler decoding
-    // integer ALU ops
+#define QUMIR_VM_DECLARE_BINARY(op) op, op##RI, op##IR,
+    QUMIR_VM_BINARY_OPS(QUMIR_VM_DECLARE_BINARY)
+#undef QUMIR_VM_DECLARE_BINARY
+
+    // unary ALU ops: A = op B
     INeg, // unary -
     INot, // unary !
     IBitNot, // unary ~
-    IAdd, // +
-    ISub, // -
-    IMulS, // * signed
-    IMulU, // * unsigned
-    IDivS, // / signed
-    IDivU, // / unsigned
-    IRemS, // % signed
-    IRemU, // % unsigned
-    IAnd, // &
-    IOr,  // |
-    IXor, // xor
-    IShl, // <<
-    IShrS, // >> signed
-    IShrU, // >> unsigned
-    ICmpLTS, // < signed
-    ICmpLTU, // < unsigned
-    ICmpGTS, // > signed
-    ICmpGTU, // > unsigned
-    ICmpLES, // <= signed
-    ICmpLEU, // <= unsigned
-    ICmpGES, // >= signed
-    ICmpGEU, // >= unsigned
-    ICmpEQ, // ==
-    ICmpNE, // !=
-
-    // float ALU ops
     FNeg, // unary -
-    FAdd, // +
-    FSub, // -
-    FMul, // *
-    FDiv, // /
-    FCmpLT, // <
-    FCmpGT, // >
-    FCmpLE, // <=
-    FCmpGE, // >=
-    FCmpEQ, // ==
-    FCmpNE, // !=
-
-    // load/store
+
+    // load/store; A = register, B = frame byte offset (G: global slot index)
     Load8,
     Load16,
     Load32,
     Load64,
+    Load64G,
     Store8,
     Store16,
     Store32,
-    Store64,
+    Store64,  // B = value register
+    Store64G,
 
     // tmp assignment
     Mov,
@@ -68,24 +79,26 @@ enum class EVMOp : uint8_t {
     Bitcast,
 
     // control flow
-    Jmp,
-    Cmp,
-    ArgTmp, // temporary to argument
-    ArgConst, // constant to argument
-    Call,
-    ECall, // external call
-    Await,
-    AwaitVoid,
+    Jmp, // A = target
+    Cmp, // A = condition register, B = true target, C = false target
+    ArgTmp, // temporary to argument; A = src register, B = arg slot register
+    ArgConst, // constant to argument; A = imm, B = arg slot register
+    Call, // A = dst register or -1, B = callee index in TModule::Functions, C = arg count
+    ECall, // external call; A = dst register or -1, B = imm NFFI::IFunction*, C = arg count
+    Await, // A = dst register, B = future register
+    AwaitVoid, // A = future register
     Ret,
     RetVoid,
 
     // pointer arithmetic
-    Ste, // store by address (*a = i)
-    Lde, // load by address (a = *i)
-    Lea, // load effective address (a = &i)
-    Copy,        // copy(dst_ptr, src, size_bytes_imm); src may be a pointer or packed value
-    StructStore, // struct_store(dst_local, src_tmp, size_imm) — memcpy from Tmp into Local frame slot
-    SAlloc,      // salloc(dst_tmp, frame_offset_imm, size_imm) — zero frame storage and return its address
+    Ste, // store by address (*a = i); A = address, B = value, C = size in bytes
+    Lde, // load by address (a = *i); A = dst, B = address, C = size in bytes
+    Lea, // load effective address (a = &i); B = frame byte offset
+    LeaG, // B = global slot index
+    Copy,        // copy(dst_ptr, src, size_bytes); src may be a pointer or packed value
+    StructStore, // struct_store(dst_local, src_tmp, size) — memcpy from Tmp into Local frame slot
+    SAlloc,      // salloc(dst_tmp, frame_offset, size) — zero frame storage and return its address
+    BoundsCheck, // runtime error unless 0 <= A < B; A = index register, B = size register
 
     // 128-bit ops address the Regs128 file by the same register index as Regs.
     INeg128,
@@ -116,7 +129,9 @@ enum class EVMOp : uint8_t {
     ICmpNE128,
 
     Load128,
+    Load128G,
     Store128,
+    Store128G,
     Mov128,   // 128-bit register copy
     CmovS128, // sign-extend a 64-bit immediate into a 128-bit register
     CmovU128, // zero-extend a 64-bit immediate into a 128-bit register
@@ -129,8 +144,10 @@ enum class EVMOp : uint8_t {
     F2I128,
     Lde128,
     Ste128,
-    ArgTmp128,
+    ArgTmp128, // same operands as ArgTmp
     Ret128,
+
+    ProfBlock, // profiling only, starts each block; A = block index
 };
 
 std::ostream& operator<<(std::ostream& os, EVMOp op);
@@ -139,12 +156,14 @@ struct TUntypedImm {
     int64_t Value;
 };
 
+// Operand of the compiler's intermediate form, before it is encoded into TVMInstr.
 struct TVMOperand {
     union {
         TTmp  Tmp;
         TSlot Slot; // TODO: replace Slot/Local with Address
         TLocal Local;
         TUntypedImm  Imm;
+        TLabel Label;
     };
 
     enum class EType : uint8_t {
@@ -152,6 +171,7 @@ struct TVMOperand {
         Slot,
         Local,
         Imm,
+        Label,
     } Type;
 
     TVMOperand() : Type(EType::Tmp), Tmp({-1}) {}
@@ -160,6 +180,7 @@ struct TVMOperand {
     TVMOperand(const TLocal& l) : Type(EType::Local), Local(l) {}
     TVMOperand(const TImm& i) : Type(EType::Imm), Imm(i.Value) {}
     TVMOperand(const TUntypedImm& i) : Type(EType::Imm), Imm(i) {}
+    TVMOperand(const TLabel& l) : Type(EType::Label), Label(l) {}
 
     template<typename T>
     void Visit(T&& visitor) const {
@@ -168,18 +189,23 @@ struct TVMOperand {
         case EType::Slot: visitor(Slot); break;
         case EType::Local: visitor(Local); break;
         case EType::Imm: visitor(Imm); break;
+        case EType::Label: visitor(Label); break;
         }
     }
 };
 
+// Operands are already resolved to registers, constant pool indices and
+// relative jump targets, so the interpreter never decodes an operand kind.
 struct TVMInstr {
-    std::array<TVMOperand, 3> Operands;
     EVMOp Op;
+    int32_t A{-1};
+    int32_t B{0};
+    int32_t C{0};
 };
 
 std::ostream& operator<<(std::ostream& os, const TVMInstr& instr);
 
-static_assert(sizeof(TVMInstr) == 56, "TVMInstr must be 56 bytes");
+static_assert(sizeof(TVMInstr) == 16, "TVMInstr must be 16 bytes");
 
 } // namespace NIR
 } // namespace NQumir
@@ -545,6 +545,36 @@ SystemModule::SystemModule() {
             .ArgTypes = { stringType, stringType },
             .ReturnType = stringType,
         },
+        {
+            .Name = "str_append",
+            .MangledName = "str_append",
+            .Packed = +[](const uint64_t* args, size_t argCount) -> uint64_t {
+                NRuntime::str_append(reinterpret_cast<char**>(args[0]), reinterpret_cast<const char*>(args[1]));
+                return 0;
+            },
+            .ArgTypes = { outType<NAst::TStringType>(), stringType },
+            .ReturnType = voidType,
+        },
+        {
+            .Name = "str_init_lit",
+            .MangledName = "str_init_lit",
+            .Packed = +[](const uint64_t* args, size_t argCount) -> uint64_t {
+                auto* str = NRuntime::str_init_lit(reinterpret_cast<void*>(args[0]), reinterpret_cast<const char*>(args[1]));
+                return std::bit_cast<uint64_t>(str);
+            },
+            .ArgTypes = { voidPtrType, stringType },
+            .ReturnType = stringType,
+        },
+        {
+            .Name = "str_init_unicode",
+            .MangledName = "str_init_unicode",
+            .Packed = +[](const uint64_t* args, size_t argCount) -> uint64_t {
+                auto* str = NRuntime::str_init_unicode(reinterpret_cast<void*>(args[0]), std::bit_cast<int64_t>(args[1]));
+                return std::bit_cast<uint64_t>(str);
+            },
+            .ArgTypes = { voidPtrType, symbolType },
+            .ReturnType = stringType,
+        },
         {
             .Name = "str_compare",
             .MangledName = "str_compare",
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace NQumir {
+
+// Number of threads for a `-j <n>` style option: n itself when positive,
+// one per hardware thread for 0.
+inline int ThreadCount(int requested) {
+    if (requested > 0) {
+        return requested;
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Calls body(i) for every i in [0, count) on up to ThreadCount(threads)
+// threads, the calling one included; with one thread it is a plain loop.
+// Items are handed out one by one, so uneven work balances itself. The
+// first exception thrown by body stops handing out items and is rethrown
+// once every thread is done.
+template<typename F>
+void ParallelFor(size_t count, int threads, F&& body) {
+    const size_t workers = std::min<size_t>(ThreadCount(threads), count);
+    if (workers <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            body(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto work = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            try {
+                body(i);
+            } catch (...) {
+                std::lock_guard lock(errorMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                next = count;
+            }
+        }
+    };
+    {
+        std::vector<std::jthread> pool;
+        pool.reserve(workers - 1);
+        for (size_t t = 1; t < workers; ++t) {
+            pool.emplace_back(work);
+        }
+        work();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace NQumir
@@ -165,6 +165,26 @@ TExprPtr DeepCloneExpr(const TExprPtr& node) {
     return clone;
 }
 
+size_t CountNodes(const TExprPtr& node) {
+    if (!node) {
+        return 0;
+    }
+    size_t count = 1;
+    if (auto function = TMaybeNode<TFunDecl>(node)) {
+        for (const auto& param : function.Cast()->Params) {
+            count += CountNodes(param);
+        }
+    } else if (auto vars = TMaybeNode<TVarsBlockExpr>(node)) {
+        for (const auto& var : vars.Cast()->Vars) {
+            count += CountNodes(var);
+        }
+    }
+    for (const auto& child : node->Children()) {
+        count += CountNodes(child);
+    }
+    return count;
+}
+
 void TIdentExpr::Accept(IVisitor& visitor) { visitor.Visit(*this); }
 void TAssignExpr::Accept(IVisitor& visitor) { visitor.Visit(*this); }
 void TArrayAssignExpr::Accept(IVisitor& visitor) { visitor.Visit(*this); }
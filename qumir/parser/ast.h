@@ -24,6 +24,8 @@ using TExprPtr = std::shared_ptr<TExpr>;
 // composed into more than one independent compilation.
 TExprPtr ShallowCloneNode(const TExprPtr& node);
 TExprPtr DeepCloneExpr(const TExprPtr& node);
+// Number of nodes in the tree under `node`, `node` included (--time-report).
+size_t CountNodes(const TExprPtr& node);
 
 // Lifetime AST node forward declarations.
 struct TRetainExpr;
@@ -4,6 +4,7 @@
 #include <qumir/parser/operator.h>
 #include <qumir/parser/pragma.h>
 #include <qumir/parser/type.h>
+#include <qumir/time_report.h>
 
 #include <algorithm>
 
@@ -1069,6 +1070,7 @@ struct TParseHandleImpl : NQumir::NAst::NCore::IParseHandle {
 } // namespace
 
 std::expected<TExprPtr, TError> TParser::Parse(TTokenStream& baseStream) {
+    TPhaseTimer timer("parse");
     TWrappedTokenStream stream(baseStream, 4);
     TParserContext context{stream, MakeDefaultHandlers()};
     for (auto& [key, handler] : NodeParsers) {
@@ -97,11 +97,26 @@ void AdvanceLocation(TLocation& location, char ch) {
 ITokenStream::ITokenStream(std::istream& in)
     : In(in)
     , CurrentLocation({1, 1, 1})
+    , Report(CurrentTimeReport())
 { }
 
+ITokenStream::~ITokenStream() {
+    if (Report) {
+        Report->AddTime("parse.lex", ReadTime);
+        Report->Count("tokens", TokenCount);
+    }
+}
+
 TToken ITokenStream::Next() {
     if (Tokens.empty()) {
-        Read();
+        if (Report) {
+            const auto start = TTimeReport::TClock::now();
+            Read();
+            ReadTime += TTimeReport::TClock::now() - start;
+            TokenCount += Tokens.size();
+        } else {
+            Read();
+        }
     }
     if (Tokens.empty()) {
         return TToken {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <qumir/location.h>
+#include <qumir/time_report.h>
 
 #include <string>
 #include <optional>
@@ -88,6 +89,8 @@ struct TToken {
 class ITokenStream {
 public:
     explicit ITokenStream(std::istream& in);
+    // Reports the time spent lexing as "parse.lex" (see TTimeReport).
+    ~ITokenStream();
 
     TToken Next();
 
@@ -108,6 +111,11 @@ protected:
     std::deque<TToken> Tokens;
     bool SeenFirstToken = false;
     TLocation CurrentLocation;
+
+private:
+    TTimeReport* Report;
+    TTimeReport::TClock::duration ReadTime{};
+    int64_t TokenCount = 0;
 };
 
 class TWrappedTokenStream {
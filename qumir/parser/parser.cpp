@@ -8,6 +8,7 @@
 #include <qumir/parser/operator.h>
 #include <qumir/modules/module.h>
 #include <qumir/frontend/source_module_loader.h>
+#include <qumir/time_report.h>
 
 #include <set>
 #include <iostream>
@@ -1753,6 +1754,7 @@ TAstTask stmt(TParserContext& context) {
 std::expected<TExprPtr, TError> TParser::parse(
     TTokenStream& stream, IModuleManager* mm, NFrontend::TSourceModuleLoader* loader)
 {
+    TPhaseTimer timer("parse");
     TWrappedTokenStream wrappedStream(stream, /*windowSize = */ 10);
     TParserContext context(wrappedStream, mm, stream.GetContext(), loader);
     auto task = stmt_list(context, {});
@@ -18,8 +18,13 @@
 #include <qumir/ir/passes/transforms/pipeline.h>
 #include <qumir/frontend/source_module_loader.h>
 #include <qumir/frontend/compose.h>
+#include <qumir/codegen/llvm/llvm_native_tier.h>
+#include <qumir/ir/bytecode_cache.h>
+#include <qumir/time_report.h>
 
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <sstream>
 
 namespace NQumir {
@@ -32,10 +37,14 @@ TIRRunner::TIRRunner(
     std::istream& in,
     TIRRunnerOptions options)
     : Builder(Module)
-    , Lowerer(Module, Builder, Resolver)
+    , Lowerer(Module, Builder, Resolver, {.BoundsChecks = options.BoundsChecks})
     , Options(std::move(options))
     , Interpreter(Module, out, in)
 {
+    Interpreter.SetLimits({
+        .Fuel = Options.Fuel,
+        .MaxStackBytes = Options.MaxStackBytes,
+    });
     RegisteredModules.push_back(std::make_shared<NRegistry::SystemModule>());
     // TODO: register other modules
 
@@ -76,14 +85,14 @@ TIRRunner::TIRRunner(
     }
 }
 
-std::expected<std::optional<std::string>, TError> TIRRunner::Run(std::istream& input) {
+std::optional<TError> TIRRunner::Lower(std::istream& input, std::vector<std::filesystem::path>& sourceModules) {
     NFrontend::TSourceModuleLoader loader;
     for (const auto& dir : Options.ModuleSearchPaths) {
         loader.AddSearchPath(dir);
     }
     for (const auto& file : Options.ModuleFiles) {
         if (auto reg = loader.RegisterSourceModule(file); !reg) {
-            return std::unexpected(reg.error());
+            return reg.error();
         }
     }
 
@@ -106,18 +115,23 @@ std::expected<std::optional<std::string>, TError> TIRRunner::Run(std::istream& i
         }
     }
     if (!parsed) {
-        return std::unexpected(parsed.error());
+        return parsed.error();
     }
     auto ast = std::move(parsed.value());
 
     {
         auto composed = NFrontend::LoadAndCompose(loader, ast, mainPragmas);
         if (!composed) {
-            return std::unexpected(composed.error());
+            return composed.error();
         }
         ast = std::move(composed->Ast);
         Resolver.ApplyPragmas(composed->Pragmas);
     }
+    for (const auto* module : loader.TopologicalOrder()) {
+        if (!module->Path.empty()) {
+            sourceModules.push_back(module->Path);
+        }
+    }
 
     auto scope = Resolver.GetOrCreateRootScope();
     // scope->AllowsRedeclare = true; // TODO: move to options?
@@ -125,7 +139,7 @@ std::expected<std::optional<std::string>, TError> TIRRunner::Run(std::istream& i
 
     if (Options.CoreInput && Options.ResolveCoreInput) {
         if (auto err = Resolver.Resolve(ast)) {
-            return std::unexpected(*err);
+            return *err;
         }
     }
 
@@ -144,10 +158,11 @@ std::expected<std::optional<std::string>, TError> TIRRunner::Run(std::istream& i
     }
     auto pipelineOptions = NTransform::TPipelineOptions{
         .Extensions = std::move(extensions),
+        .RunDefiniteAssignment = Options.RunDefiniteAssignment,
     };
     auto error = NTransform::Pipeline(ast, Resolver, std::move(pipelineOptions));
     if (!error) {
-        return std::unexpected(error.error());
+        return error.error();
     }
 
     if (Options.PrintTransformedAst) {
@@ -158,10 +173,42 @@ std::expected<std::optional<std::string>, TError> TIRRunner::Run(std::istream& i
 
     auto lowerRes = Lowerer.LowerTop(ast);
     if (!lowerRes) {
-        return std::unexpected(lowerRes.error());
+        return lowerRes.error();
     }
     if (Options.OptLevel > 0) {
-        NIR::NPasses::Pipeline(Module);
+        NIR::NPasses::Pipeline(Module, Options.OptLevel, Options.Threads);
+    } else {
+        NIR::NPasses::Cleanup(Module, Options.Threads);
+    }
+    return std::nullopt;
+}
+
+std::expected<std::optional<std::string>, TError> TIRRunner::Run(std::istream& input) {
+    // Only a fresh runner can take a module from the cache: REPL chunks
+    // extend the module built by earlier ones.
+    const bool useCache = !Options.BytecodeCacheDir.empty()
+        && Module.Functions.empty()
+        && !Options.PrintAst && !Options.PrintTransformedAst;
+    if (useCache) {
+        NIR::TBytecodeCache cache(Options.BytecodeCacheDir);
+        std::string source(std::istreambuf_iterator<char>(input), {});
+        const auto key = BytecodeCacheKey(source);
+        if (auto cached = cache.Load(key, [&](const std::string& name) { return FindPacked(name); })) {
+            Module = std::move(*cached);
+        } else {
+            std::istringstream sourceInput(source);
+            std::vector<std::filesystem::path> sourceModules;
+            if (auto error = Lower(sourceInput, sourceModules)) {
+                return std::unexpected(*error);
+            }
+            // Best effort: a read-only cache dir must not fail the run.
+            (void)cache.Store(key, sourceModules, Module);
+        }
+    } else {
+        std::vector<std::filesystem::path> sourceModules;
+        if (auto error = Lower(input, sourceModules)) {
+            return std::unexpected(*error);
+        }
     }
 
     auto* mainFun = Module.GetEntryPoint();
@@ -182,14 +229,104 @@ std::expected<std::optional<std::string>, TError> TIRRunner::Run(std::istream& i
         return std::unexpected(TError(TLocation(), "no <main> function found"));
     }
 
+    // Native code is invisible to the profiler and is not metered, so
+    // profiling and fuel keep everything in the VM.
+    const bool profiling = !Options.ProfileOutput.empty() || !Options.PgoProfileOutput.empty();
+    if (Options.Tiered && !profiling && !Options.Fuel) {
+        // Copied here, before the VM compiles (and rewrites) any function.
+        NativeTiers.push_back(NCodeGen::MakeLLVMNativeTier(Module, Options.OptLevel));
+        Interpreter.SetNativeTier(NativeTiers.back().get(), Options.TierUpThreshold);
+    }
+
+    if (profiling && !Profiler) {
+        Profiler = std::make_unique<TProfiler>(Module);
+        Interpreter.SetProfiler(Profiler.get());
+    }
+
+    if (Options.Threads != 1 && !Options.PrintByteCode) {
+        TPhaseTimer timer("vm_compile");
+        Interpreter.CompileAll(Options.Threads);
+    }
+
     // Interpret
+    NRuntime::TContextScope contextScope(Options.RuntimeContext ? Options.RuntimeContext : &NRuntime::CurrentContext());
+    // Reset even when unlimited: a reused context keeps what an earlier run
+    // charged and the limit it ran with.
+    NRuntime::CurrentContext().Quota = {.HeapLimit = Options.MaxHeapBytes};
+    std::expected<std::optional<std::string>, TError> result;
     try {
-        auto res = Interpreter.Eval(*mainFun, {}, TInterpreter::TOptions{.PrintByteCode = Options.PrintByteCode});
-        return res;
+        TPhaseTimer timer("execute");
+        result = Interpreter.Eval(*mainFun, {}, TInterpreter::TOptions{.PrintByteCode = Options.PrintByteCode});
     } catch (const std::exception& e) {
         // TODO: free resources?
-        return std::unexpected(TError(std::string("runtime error: ") + e.what()));
+        result = std::unexpected(TError(std::string("runtime error: ") + e.what()));
+    }
+    // Written on runtime errors too: that is when a profile is wanted most.
+    if (Profiler) {
+        if (auto error = WriteProfile()) {
+            return std::unexpected(*error);
+        }
+    }
+    return result;
+}
+
+std::string TIRRunner::BytecodeCacheKey(const std::string& source) const {
+    std::ostringstream key;
+    key << Options.CompilerVersion << '\n'
+        << "O" << Options.OptLevel
+        << " bounds=" << Options.BoundsChecks
+        << " core=" << Options.CoreInput << Options.ResolveCoreInput
+        << " definite_assignment=" << Options.RunDefiniteAssignment << '\n';
+    for (const auto& name : Options.Prelude) {
+        key << "prelude " << name << '\n';
+    }
+    for (const auto& dir : Options.ModuleSearchPaths) {
+        key << "path " << dir << '\n';
+    }
+    for (const auto& file : Options.ModuleFiles) {
+        key << "module " << file << '\n';
+    }
+    key << '\n' << source;
+    return key.str();
+}
+
+NIR::TExternalFunction::TPacked TIRRunner::FindPacked(const std::string& mangledName) const {
+    for (const auto* modules : {&RegisteredModules, &AvailableModules}) {
+        for (const auto& mod : *modules) {
+            for (const auto& fn : mod->ExternalFunctions()) {
+                if (fn.Packed && fn.MangledName == mangledName) {
+                    return fn.Packed;
+                }
+            }
+        }
+    }
+    return nullptr;
+}
+
+std::optional<TError> TIRRunner::WriteProfile() {
+    if (!Options.PgoProfileOutput.empty()) {
+        std::ofstream out(Options.PgoProfileOutput);
+        if (!out) {
+            return TError("cannot write profile to " + Options.PgoProfileOutput);
+        }
+        Profiler->PgoProfile(Options.OptLevel, Options.BoundsChecks).Write(out);
+    }
+    if (Options.ProfileOutput.empty()) {
+        return std::nullopt;
+    }
+    const std::string foldedPath = Options.ProfileOutput + ".folded";
+    const std::string jsonPath = Options.ProfileOutput + ".json";
+    std::ofstream folded(foldedPath);
+    if (!folded) {
+        return TError("cannot write profile to " + foldedPath);
+    }
+    Profiler->WriteFolded(folded);
+    std::ofstream json(jsonPath);
+    if (!json) {
+        return TError("cannot write profile to " + jsonPath);
     }
+    Profiler->WriteJson(json);
+    return std::nullopt;
 }
 
 } // namespace NQumir
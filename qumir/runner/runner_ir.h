@@ -8,9 +8,12 @@
 #include <qumir/ir/builder.h>
 #include <qumir/ir/lowering/lower_ast.h>
 #include <qumir/ir/eval.h>
+#include <qumir/runtime/context.h>
 
 #include <expected>
+#include <filesystem>
 #include <istream>
+#include <memory>
 #include <optional>
 
 #include <unordered_set>
@@ -26,7 +29,40 @@ struct TIRRunnerOptions {
     bool PrintByteCode = false;
     bool CoreInput = false;
     bool ResolveCoreInput = true;
+    bool RunDefiniteAssignment = true;
     int OptLevel = 0;
+    // Check array indices at run time (see NIR::TLowerOptions::BoundsChecks).
+    bool BoundsChecks = false;
+    // Threads for the per-function IR passes (0: one per hardware thread).
+    // Other than 1, every function is also compiled to bytecode before the
+    // run, on as many threads, rather than on its first call.
+    int Threads = 1;
+    // Tiered execution: functions start in the VM and the hot ones move to the
+    // LLVM JIT (see INativeTier), after TierUpThreshold calls plus loop iterations.
+    bool Tiered = false;
+    uint32_t TierUpThreshold = 1000;
+    // When set, the run is profiled and written to <ProfileOutput>.folded
+    // (folded stacks) and <ProfileOutput>.json (summary).
+    std::string ProfileOutput;
+    // When set, entry and branch counts are written to this file for LLVM
+    // codegen to use (see NIR::TPgoProfile, qumirc --profile-use).
+    std::string PgoProfileOutput;
+    // When set, lowered modules are cached in this directory (see
+    // NIR::TBytecodeCache) and repeated runs of the same program skip the
+    // frontend. CompilerVersion is part of the cache key and must change
+    // with every build, since the cache holds the output of its passes.
+    std::string BytecodeCacheDir;
+    std::string CompilerVersion;
+    // Runtime state (streams, open files, robot, turtle, ...) the program
+    // runs against; nullptr means the calling thread's current context.
+    // Hosts running several programs at once give each its own.
+    NRuntime::TRuntimeContext* RuntimeContext = nullptr;
+    // Limits for untrusted programs (see TInterpreter::TLimits); exceeding
+    // one fails the run with a runtime error. Fuel turns tiering off, since
+    // native code is not metered. MaxHeapBytes sets the context's quota.
+    uint64_t Fuel = 0;
+    size_t MaxStackBytes = NIR::TInterpreter::DefaultMaxStackBytes;
+    size_t MaxHeapBytes = 0;
     // Core frontend host prelude: modules imported on behalf of the host.
     // Empty means pure core-lang imports nothing. Ignored for the Kumir
     // frontend, which imports its own prelude.
@@ -49,10 +85,19 @@ public:
     std::expected<std::optional<std::string>, TError> Run(std::istream& input);
 
 private:
+    // Frontend up to optimized IR in Module; appends the `.oz` files it read.
+    std::optional<TError> Lower(std::istream& input, std::vector<std::filesystem::path>& sourceModules);
+    std::string BytecodeCacheKey(const std::string& source) const;
+    NIR::TExternalFunction::TPacked FindPacked(const std::string& mangledName) const;
+    std::optional<TError> WriteProfile();
+
     NIR::TModule Module;
     NIR::TRuntime Runtime;
     NIR::TBuilder Builder;
     NIR::TAstLowerer Lowerer;
+    // One per Run(); earlier ones keep their native code alive. Outlive Interpreter.
+    std::vector<std::unique_ptr<NIR::INativeTier>> NativeTiers;
+    std::unique_ptr<NIR::TProfiler> Profiler; // outlives Interpreter
     NIR::TInterpreter Interpreter;
     TIRRunnerOptions Options;
     std::unordered_set<int> PrintedChunks;
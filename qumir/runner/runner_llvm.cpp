@@ -39,10 +39,12 @@ bool IsKnown32BitTarget(const std::string& targetTriple) {
 TLLVMRunner::TLLVMRunner(TLLVMRunnerOptions options)
     : Options(std::move(options))
     , Builder(Module)
-    , Lowerer(Module, Builder, Resolver)
-    , LlvmRunner_({
+    , Lowerer(Module, Builder, Resolver, {.BoundsChecks = Options.BoundsChecks})
+    , LlvmRunner_(Options.Jit ? Options.Jit : std::make_shared<NCodeGen::TLlvmRunner>(NCodeGen::TLlvmRunnerOptions{
         .EnablePerfJitEventListener = Options.EnablePerfJitEventListener,
-    })
+        .CompileThreads = Options.Threads,
+        .LazyCompile = Options.LazyJit,
+    }))
 {
     if (IsKnown32BitTarget(Options.TargetTriple)) {
         Module.Types.SetPointerSize(4);
@@ -192,7 +194,9 @@ std::expected<std::optional<std::string>, TError> TLLVMRunner::Run(std::istream&
     }
 
     if (Options.OptLevel > 0) {
-        NIR::NPasses::Pipeline(Module);
+        NIR::NPasses::Pipeline(Module, Options.OptLevel, Options.Threads);
+    } else {
+        NIR::NPasses::Cleanup(Module, Options.Threads);
     }
 
     if (Options.PrintIr) {
@@ -210,6 +214,7 @@ std::expected<std::optional<std::string>, TError> TLLVMRunner::Run(std::istream&
     NCodeGen::TLLVMCodeGen cg({
         .NativeCode = Options.NativeCode,
         .TargetTriple = Options.TargetTriple,
+        .DeferOptimization = Options.LazyJit,
     });
     std::string err;
     std::unique_ptr<NCodeGen::ILLVMModuleArtifacts> artifacts;
@@ -240,10 +245,7 @@ std::expected<std::optional<std::string>, TError> TLLVMRunner::Run(std::istream&
         return std::unexpected(TError({}, std::string("entry point not found")));
     }
 
-    // Run via LLVM JIT
-    NCodeGen::TLlvmRunner runner({
-        .EnablePerfJitEventListener = Options.EnablePerfJitEventListener,
-    });
+    // Run via LLVM JIT, on the shared session and compile threads
     try {
         std::string runErr;
         auto coroutineResultFormatter = [&]() -> std::function<std::optional<std::string>(const void*)> {
@@ -263,7 +265,8 @@ std::expected<std::optional<std::string>, TError> TLLVMRunner::Run(std::istream&
                 return out.str();
             };
         }();
-        auto res = runner.Run(
+        NRuntime::TContextScope contextScope(Options.RuntimeContext ? Options.RuntimeContext : &NRuntime::CurrentContext());
+        auto res = LlvmRunner_->Run(
             std::move(artifacts),
             mainFun->Name,
             &runErr,
@@ -487,7 +490,7 @@ std::unordered_map<std::string, void*> TLLVMRunner::CompileKernelAst(
     }
 
     std::string runErr;
-    auto entries = LlvmRunner_.LookupMany(std::move(artifacts), entryNames, &runErr);
+    auto entries = LlvmRunner_->LookupMany(std::move(artifacts), entryNames, &runErr);
     if (entries.empty()) {
         if (error) {
             *error = runErr.empty() ? "function lookup failed" : runErr;
@@ -514,7 +517,7 @@ std::unordered_map<std::string, void*> TLLVMRunner::CompileKernelAst(
     }
 
     std::string runErr;
-    auto entries = LlvmRunner_.LookupMany(std::move(artifacts), entryNames, &runErr);
+    auto entries = LlvmRunner_->LookupMany(std::move(artifacts), entryNames, &runErr);
     if (entries.empty()) {
         if (error) {
             *error = runErr.empty() ? "function lookup failed" : runErr;
@@ -659,7 +662,7 @@ NCodeGen::TLlvmRunner::TLinkedModule TLLVMRunner::CompileFusedKernelsCached(
     }
     auto tPrepared = std::chrono::steady_clock::now();
 
-    auto linked = LlvmRunner_.LinkAndLookup(
+    auto linked = LlvmRunner_->LinkAndLookup(
         prepared->ObjectFiles,
         prepared->ObjectBlobs,
         std::move(prepared->KernelModule),
@@ -679,6 +682,29 @@ NCodeGen::TLlvmRunner::TLinkedModule TLLVMRunner::CompileFusedKernelsCached(
     return linked;
 }
 
+std::future<NCodeGen::TLlvmRunner::TLinkedModule> TLLVMRunner::SubmitFusedKernelsCached(
+    NAst::TExprPtr ast,
+    const std::vector<std::string>& entryNames,
+    const std::string& cacheDir,
+    const std::string& cacheSchema,
+    const std::string& kernelLibVersion)
+{
+    std::string error;
+    auto prepared = PrepareFusedKernelsCached(
+        std::move(ast), entryNames, cacheDir, cacheSchema, kernelLibVersion, &error);
+    if (!prepared) {
+        std::promise<NCodeGen::TLlvmRunner::TLinkedModule> failed;
+        failed.set_value({.Error = std::move(error)});
+        return failed.get_future();
+    }
+    return LlvmRunner_->SubmitLinkAndLookup(
+        prepared->ObjectFiles,
+        prepared->ObjectBlobs,
+        std::move(prepared->KernelModule),
+        Options.NativeCode,
+        entryNames);
+}
+
 std::optional<TLLVMRunner::TCachedObjectModule>
 TLLVMRunner::CompileFusedKernelsToObjectsCached(
     NAst::TExprPtr ast,
@@ -828,7 +854,7 @@ void* TLLVMRunner::CompileKernel(const std::string& source, std::string* error)
     }
 
     std::string runErr;
-    void* fnPtr = LlvmRunner_.Lookup(std::move(artifacts), funcName, &runErr);
+    void* fnPtr = LlvmRunner_->Lookup(std::move(artifacts), funcName, &runErr);
     if (!fnPtr) {
         if (error) {
             *error = runErr.empty() ? "function not found: " + funcName : runErr;
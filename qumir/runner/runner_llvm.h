@@ -12,8 +12,12 @@
 #include <qumir/codegen/llvm/llvm_codegen.h>
 #include <qumir/codegen/llvm/llvm_runner.h>
 
+#include <qumir/runtime/context.h>
+
 #include <expected>
+#include <future>
 #include <istream>
+#include <memory>
 #include <optional>
 #include <unordered_set>
 #include <unordered_map>
@@ -33,6 +37,15 @@ struct TLLVMRunnerOptions {
     bool EnablePerfJitEventListener = false;
     bool RunDefiniteAssignment = true;
     int OptLevel = 0; // 0-3
+    // Check array indices at run time (see NIR::TLowerOptions::BoundsChecks).
+    bool BoundsChecks = false;
+    // Threads for the per-function IR passes (0: one per hardware thread).
+    int Threads = 1;
+    // JIT each function on its first call (see TLlvmRunnerOptions::
+    // LazyCompile) instead of the whole module up front. Run() also leaves
+    // the LLVM pipeline of OptLevel to that first call; kernels and objects
+    // are optimized as before, since the object cache stores them.
+    bool LazyJit = false;
     // Core frontend host prelude: modules imported on behalf of the host.
     // Empty means pure core-lang imports nothing. Ignored for the Kumir
     // frontend, which imports its own prelude.
@@ -43,11 +56,19 @@ struct TLLVMRunnerOptions {
     std::vector<std::string> ModuleFiles;
     // Target triple override (e.g. "wasm32-unknown-unknown"). Empty means the host default.
     std::string TargetTriple;
+    // Runtime state the JIT-compiled program of Run() uses; nullptr means
+    // the calling thread's current context (see TIRRunnerOptions).
+    NRuntime::TRuntimeContext* RuntimeContext = nullptr;
+    // JIT to link kernels into. Runners on different threads may share one
+    // (its session and compile threads); nullptr means a private JIT that
+    // compiles on Threads threads.
+    std::shared_ptr<NCodeGen::TLlvmRunner> Jit;
 };
 
 // A single compilation session: holds persistent frontend state (Module,
 // Resolver, Builder) that accumulates across calls, so it is not thread-safe.
-// Use a fresh runner per independent compilation (e.g. one per query).
+// Use a fresh runner per independent compilation (e.g. one per query); the
+// runners can share one thread-safe JIT through TLLVMRunnerOptions::Jit.
 class TLLVMRunner {
 public:
     struct TCachedObjectModule {
@@ -110,6 +131,16 @@ public:
         const std::string& kernelLibVersion,
         std::string* error);
 
+    // CompileFusedKernelsCached that returns once the frontend work and the
+    // missing dependency objects are done; the JIT compiles and links the
+    // kernel in the background. Failures are reported in the module's Error.
+    std::future<NCodeGen::TLlvmRunner::TLinkedModule> SubmitFusedKernelsCached(
+        NAst::TExprPtr ast,
+        const std::vector<std::string>& entryNames,
+        const std::string& cacheDir,
+        const std::string& cacheSchema,
+        const std::string& kernelLibVersion);
+
     // Object-emitting counterpart of CompileFusedKernelsCached. Cache hits are
     // returned as paths, freshly compiled dependencies as object blobs, and the
     // query-specific kernel as a separate object. The caller owns final linking.
@@ -178,7 +209,8 @@ private:
     std::vector<std::shared_ptr<NRegistry::IModule>> RegisteredModules;
     std::vector<std::shared_ptr<NRegistry::IModule>> AvailableModules;
 
-    NCodeGen::TLlvmRunner LlvmRunner_; // persistent; keeps compiled kernels alive
+    // Persistent; keeps compiled kernels alive. Options.Jit when set.
+    std::shared_ptr<NCodeGen::TLlvmRunner> LlvmRunner_;
 };
 
 } // namespace NQumir
@@ -4,11 +4,13 @@
 #include <iostream>
 #include <cstring>
 
+#include "context.h"
 #include "string.h"
 
 namespace NQumir::NRuntime {
 
 void* array_create(size_t sizeInBytes) {
+    ChargeHeap(sizeInBytes);
     auto ptr = operator new(sizeInBytes, std::align_val_t(8));
     memset(ptr, 0, sizeInBytes);
     return ptr;
@@ -0,0 +1,48 @@
+#include "context.h"
+#include "runtime.h"
+
+namespace NQumir {
+namespace NRuntime {
+
+namespace {
+
+thread_local TRuntimeContext* Current = nullptr;
+
+TRuntimeContext& DefaultContext() {
+    thread_local TRuntimeContext context;
+    return context;
+}
+
+} // namespace
+
+TRuntimeContext& CurrentContext() {
+    if (Current) [[likely]] {
+        return *Current;
+    }
+    return DefaultContext();
+}
+
+void SetCurrentContext(TRuntimeContext* context) {
+    Current = context;
+}
+
+void ChargeHeap(size_t bytes) {
+    auto& quota = CurrentContext().Quota;
+    quota.HeapAllocated += bytes;
+    if (quota.HeapLimit && quota.HeapAllocated > quota.HeapLimit) [[unlikely]] {
+        __raise_runtime_error("memory quota exceeded");
+    }
+}
+
+TContextScope::TContextScope(TRuntimeContext* context)
+    : Previous(Current)
+{
+    Current = context;
+}
+
+TContextScope::~TContextScope() {
+    Current = Previous;
+}
+
+} // namespace NRuntime
+} // namespace NQumir
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "colors.h"
+
+#include <qumir/future.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <forward_list>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace NQumir {
+namespace NRuntime {
+
+// Work queued by an async runtime call: the *_process_events of its module
+// runs Callback, then resumes the program waiting on Future.
+struct TPendingEvent {
+    std::function<void()> Callback;
+    TFuture<void> Future;
+};
+
+struct TIoState {
+    // The program's standard streams, and the ones output_set_file /
+    // input_set_file redirect to.
+    std::istream* StdIn = &std::cin;
+    std::ostream* StdOut = &std::cout;
+    std::istream* In = &std::cin;
+    std::ostream* Out = &std::cout;
+
+    std::unordered_map<int32_t, std::ifstream> ReadFiles;
+    std::unordered_map<int32_t, std::ofstream> WriteFiles;
+    std::forward_list<int32_t> FreeFileHandles;
+    int32_t NextFileHandle = 1;
+
+    std::vector<std::function<void()>> PendingCalls;
+    std::vector<TFuture<void>> PendingFutures;
+};
+
+struct TRobotState {
+    int X = 0;
+    int Y = 0;
+    bool CellPainted = false;
+    std::vector<TPendingEvent> PendingEvents;
+};
+
+struct TTurtleState {
+    struct TSaved {
+        double X;
+        double Y;
+        double Angle;
+        bool Pen;
+    };
+
+    double X = 0.0;
+    double Y = 0.0;
+    double AngleDeg = 0.0; // 0 degrees is to the right
+    bool PenDown = true;
+    std::vector<TSaved> Saved;
+    std::vector<TPendingEvent> PendingEvents;
+};
+
+struct TDrawerState {
+    double X = 0.0;
+    double Y = 0.0;
+    bool PenDown = true;
+    int64_t Color = 0; // черный по умолчанию
+    std::vector<TPendingEvent> PendingEvents;
+};
+
+struct TPainterState {
+    int64_t SheetWidth  = 800;
+    int64_t SheetHeight = 600;
+    int64_t PenWidth    = 1;
+    int64_t PenColor    = PackRGB(0, 0, 0);
+    int64_t BrushColor  = PackRGB(255, 255, 255);
+    bool    HasBrush    = true;
+    int64_t Density     = 100;
+    std::string FontFamily = "Arial";
+    int64_t FontSize    = 12;
+    bool    FontBold    = false;
+    bool    FontItalic  = false;
+    int64_t CurX        = 0;
+    int64_t CurY        = 0;
+    std::vector<uint32_t> Pixels; // SheetWidth * SheetHeight, ARGB packed
+
+    std::vector<std::function<void()>> PendingCalls;
+    std::vector<TFuture<void>> PendingFutures;
+};
+
+struct TQuotaState {
+    // Bytes the program may allocate through array_create and the string
+    // functions; 0 means unlimited. Frees are not credited back, so this
+    // bounds allocation work the way fuel bounds VM instructions.
+    size_t HeapLimit = 0;
+    size_t HeapAllocated = 0;
+};
+
+// All mutable state of the runtime library for one running program. Runtime
+// functions reach it through CurrentContext(), whether they are called by the
+// VM or by JIT code, so threads running different programs share nothing.
+struct TRuntimeContext {
+    TIoState Io;
+    TRobotState Robot;
+    TTurtleState Turtle;
+    TDrawerState Drawer;
+    TPainterState Painter;
+    TQuotaState Quota;
+};
+
+// Context of the calling thread. Each thread starts with a default context of
+// its own, so hosts that run one program per process need not create one.
+TRuntimeContext& CurrentContext();
+// nullptr goes back to the thread's default context.
+void SetCurrentContext(TRuntimeContext* context);
+
+// Charges an allocation to the current context's quota; raises a runtime
+// error (see __ensure) when it goes over HeapLimit.
+void ChargeHeap(size_t bytes);
+
+// Makes a context current for a scope, restoring the previous one on exit.
+class TContextScope {
+public:
+    explicit TContextScope(TRuntimeContext* context);
+    ~TContextScope();
+
+    TContextScope(const TContextScope&) = delete;
+    TContextScope& operator=(const TContextScope&) = delete;
+
+private:
+    TRuntimeContext* Previous;
+};
+
+} // namespace NRuntime
+} // namespace NQumir
@@ -1,32 +1,25 @@
 #include "drawer.h"
-#include <qumir/future.h>
+#include "context.h"
 
 #include <functional>
 #include <iostream>
 #include <string>
 #include <utility>
-#include <vector>
 
 namespace NQumir {
 namespace NRuntime {
 
 namespace {
-    double current_x = 0.0;
-    double current_y = 0.0;
-    bool pen_down = true;
-    int64_t current_color = 0; // черный по умолчанию
-
-    struct TPendingEvent {
-        std::function<void()> Callback;
-        TFuture<void> Future;
-    };
-
-    std::vector<TPendingEvent> pendingEvents;
+    TDrawerState& Drawer() {
+        return CurrentContext().Drawer;
+    }
 
-    ITypeErasedFuture* EnqueueDrawerCall(std::function<void()> call) {
+    // The call runs against the context that queued it.
+    ITypeErasedFuture* EnqueueDrawerCall(std::function<void(TDrawerState&)> call) {
+        auto& drawer = Drawer();
         auto promise = std::make_shared<TPromise<void>>();
-        pendingEvents.emplace_back(TPendingEvent{
-            .Callback = std::move(call),
+        drawer.PendingEvents.emplace_back(TPendingEvent{
+            .Callback = [&drawer, call = std::move(call)]() { call(drawer); },
             .Future = MakeExternalFuture<void>(promise)
         });
         return new TWrappedFuture<void>(MakeExternalFuture<void>(promise));
@@ -37,56 +30,56 @@ extern "C" {
 
 void drawer_pen_up() {
     std::cerr << "Drawer pen up\n";
-    pen_down = false;
+    Drawer().PenDown = false;
 }
 
 void drawer_pen_down() {
     std::cerr << "Drawer pen down\n";
-    pen_down = true;
+    Drawer().PenDown = true;
 }
 
 void drawer_set_color(int64_t color) {
     std::cerr << "Drawer set color to " << color << "\n";
-    current_color = color;
+    Drawer().Color = color;
 }
 
 ITypeErasedFuture* drawer_move_to(double x, double y) {
-    return EnqueueDrawerCall([x, y]() {
+    return EnqueueDrawerCall([x, y](TDrawerState& drawer) {
         std::cerr << "Drawer move to (" << x << ", " << y << ")\n";
-        if (pen_down) {
-            std::cerr << "Drawing from (" << current_x << ", " << current_y << ") to (" << x << ", " << y << ") with color " << current_color << "\n";
+        if (drawer.PenDown) {
+            std::cerr << "Drawing from (" << drawer.X << ", " << drawer.Y << ") to (" << x << ", " << y << ") with color " << drawer.Color << "\n";
         } else {
-            std::cerr << "Moving from (" << current_x << ", " << current_y << ") to (" << x << ", " << y << ")\n";
+            std::cerr << "Moving from (" << drawer.X << ", " << drawer.Y << ") to (" << x << ", " << y << ")\n";
         }
-        current_x = x;
-        current_y = y;
+        drawer.X = x;
+        drawer.Y = y;
     });
 }
 
 ITypeErasedFuture* drawer_move_by(double dx, double dy) {
-    return EnqueueDrawerCall([dx, dy]() {
-        double new_x = current_x + dx;
-        double new_y = current_y + dy;
+    return EnqueueDrawerCall([dx, dy](TDrawerState& drawer) {
+        double new_x = drawer.X + dx;
+        double new_y = drawer.Y + dy;
         std::cerr << "Drawer move by (" << dx << ", " << dy << ")\n";
-        if (pen_down) {
-            std::cerr << "Drawing from (" << current_x << ", " << current_y << ") to (" << new_x << ", " << new_y << ") with color " << current_color << "\n";
+        if (drawer.PenDown) {
+            std::cerr << "Drawing from (" << drawer.X << ", " << drawer.Y << ") to (" << new_x << ", " << new_y << ") with color " << drawer.Color << "\n";
         } else {
-            std::cerr << "Moving from (" << current_x << ", " << current_y << ") to (" << new_x << ", " << new_y << ")\n";
+            std::cerr << "Moving from (" << drawer.X << ", " << drawer.Y << ") to (" << new_x << ", " << new_y << ")\n";
         }
-        current_x = new_x;
-        current_y = new_y;
+        drawer.X = new_x;
+        drawer.Y = new_y;
     });
 }
 
 ITypeErasedFuture* drawer_write_text(double width, const char* text) {
     std::string textCopy = text ? text : "";
-    return EnqueueDrawerCall([width, textCopy = std::move(textCopy)]() {
-        std::cerr << "Drawer write text '" << textCopy << "' with width " << width << " at (" << current_x << ", " << current_y << ")\n";
+    return EnqueueDrawerCall([width, textCopy = std::move(textCopy)](TDrawerState& drawer) {
+        std::cerr << "Drawer write text '" << textCopy << "' with width " << width << " at (" << drawer.X << ", " << drawer.Y << ")\n";
     });
 }
 
 size_t drawer_process_events() {
-    auto events = std::move(pendingEvents);
+    auto events = std::move(Drawer().PendingEvents);
     for (auto& event : events) {
         if (event.Callback) {
             event.Callback();
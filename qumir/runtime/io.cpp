@@ -1,122 +1,121 @@
 #include "io.h"
+#include "context.h"
 
-#include <unordered_map>
-#include <forward_list>
-#include <fstream>
-#include <vector>
-#include <functional>
 #include <chrono>
 #include <thread>
 #include <ctime>
 
-#include <qumir/future.h>
-
 namespace NQumir {
 namespace NRuntime {
 
 namespace {
 
-std::istream *In = &std::cin;
-std::ostream *Out = &std::cout;
+TIoState& Io() {
+    return CurrentContext().Io;
+}
 
-std::vector<std::function<void()>> g_pendingCalls;
-std::vector<TFuture<void>> g_pendingFutures;
+int32_t AllocFileHandle(TIoState& io) {
+    if (!io.FreeFileHandles.empty()) {
+        int32_t handle = io.FreeFileHandles.front();
+        io.FreeFileHandles.pop_front();
+        return handle;
+    }
+    return io.NextFileHandle++;
+}
 
-};
+} // namespace
 
 void SetOutputStream(std::ostream* os) {
-    Out = os ? os : &std::cout;
+    auto& io = Io();
+    io.StdOut = io.Out = os ? os : &std::cout;
 }
 
 void SetInputStream(std::istream* is) {
-    In = is ? is : &std::cin;
+    auto& io = Io();
+    io.StdIn = io.In = is ? is : &std::cin;
 }
 
 std::istream* GetInputStream() {
-    return In;
+    return Io().In;
 }
 
 std::ostream* GetOutputStream() {
-    return Out;
+    return Io().Out;
 }
 
 extern "C" {
 
 double input_double() {
     double x;
-    (*In) >> x;
+    (*Io().In) >> x;
     return x;
 }
 
 int64_t input_int64() {
     int64_t x;
-    (*In) >> x;
+    (*Io().In) >> x;
     return x;
 }
 
 void output_double(double x, int64_t width, int64_t precision) {
+    auto& out = *Io().Out;
     if (width > 0) {
-        (*Out).width(static_cast<std::streamsize>(width));
+        out.width(static_cast<std::streamsize>(width));
     }
     if (precision >= 0) {
-        (*Out).precision(static_cast<std::streamsize>(precision));
-        (*Out).setf(std::ios::fixed);
+        out.precision(static_cast<std::streamsize>(precision));
+        out.setf(std::ios::fixed);
     }
-    (*Out) << x;
+    out << x;
     if (width > 0) {
-        (*Out).width(0);
+        out.width(0);
     }
     if (precision >= 0) {
-        (*Out).unsetf(std::ios::fixed);
-        (*Out).precision(6); // reset to default
+        out.unsetf(std::ios::fixed);
+        out.precision(6); // reset to default
     }
 }
 
 void output_int64(int64_t x, int64_t width) {
+    auto& out = *Io().Out;
     if (width > 0) {
-        (*Out).width(static_cast<std::streamsize>(width));
+        out.width(static_cast<std::streamsize>(width));
     }
-    (*Out) << x;
+    out << x;
     if (width > 0) {
-        (*Out).width(0);
+        out.width(0);
     }
 }
 
 void output_string(const char* s) {
     if (!s) {return;}
-    (*Out) << s;
+    *Io().Out << s;
 }
 
 void output_bool(int64_t b) {
-    (*Out) << (b ? "да" : "нет");
+    *Io().Out << (b ? "да" : "нет");
 }
 
 void output_symbol(int32_t s) {
+    auto& out = *Io().Out;
     // convert unicode to utf-8
     if (s < 0x80) {
-        (*Out) << static_cast<char>(s);
+        out << static_cast<char>(s);
     } else if (s < 0x800) {
-        (*Out) << static_cast<char>(0b11000000 | ((s >> 6) & 0b00011111));
-        (*Out) << static_cast<char>(0b10000000 | (s & 0b00111111));
+        out << static_cast<char>(0b11000000 | ((s >> 6) & 0b00011111));
+        out << static_cast<char>(0b10000000 | (s & 0b00111111));
     } else if (s < 0x10000) {
-        (*Out) << static_cast<char>(0b11100000 | ((s >> 12) & 0b00001111));
-        (*Out) << static_cast<char>(0b10000000 | ((s >> 6) & 0b00111111));
-        (*Out) << static_cast<char>(0b10000000 | (s & 0b00111111));
+        out << static_cast<char>(0b11100000 | ((s >> 12) & 0b00001111));
+        out << static_cast<char>(0b10000000 | ((s >> 6) & 0b00111111));
+        out << static_cast<char>(0b10000000 | (s & 0b00111111));
     } else if (s <= 0x10FFFF) {
-        (*Out) << static_cast<char>(0b11110000 | ((s >> 18) & 0b00000111));
-        (*Out) << static_cast<char>(0b10000000 | ((s >> 12) & 0b00111111));
-        (*Out) << static_cast<char>(0b10000000 | ((s >> 6) & 0b00111111));
-        (*Out) << static_cast<char>(0b10000000 | (s & 0b00111111));
+        out << static_cast<char>(0b11110000 | ((s >> 18) & 0b00000111));
+        out << static_cast<char>(0b10000000 | ((s >> 12) & 0b00111111));
+        out << static_cast<char>(0b10000000 | ((s >> 6) & 0b00111111));
+        out << static_cast<char>(0b10000000 | (s & 0b00111111));
     }
 }
 
-namespace {
-    std::unordered_map<int32_t, std::ifstream> ReadFiles;
-    std::unordered_map<int32_t, std::ofstream> WriteFiles;
-    std::forward_list<int32_t> FreeFileHandles;
-    int32_t NextFileHandle = 1;
-};
-
 int32_t file_open_for_read(const char* filename) {
     if (!filename) {
         return -1;
@@ -125,14 +124,9 @@ int32_t file_open_for_read(const char* filename) {
     if (!fileStream.is_open()) {
         return -1;
     }
-    int32_t handle;
-    if (!FreeFileHandles.empty()) {
-        handle = FreeFileHandles.front();
-        FreeFileHandles.pop_front();
-    } else {
-        handle = NextFileHandle++;
-    }
-    ReadFiles.emplace(handle, std::move(fileStream));
+    auto& io = Io();
+    int32_t handle = AllocFileHandle(io);
+    io.ReadFiles.emplace(handle, std::move(fileStream));
     return handle;
 }
 
@@ -144,14 +138,9 @@ int32_t file_open_for_write(const char* filename) {
     if (!fileStream.is_open()) {
         return -1;
     }
-    int32_t handle;
-    if (!FreeFileHandles.empty()) {
-        handle = FreeFileHandles.front();
-        FreeFileHandles.pop_front();
-    } else {
-        handle = NextFileHandle++;
-    }
-    WriteFiles.emplace(handle, std::move(fileStream));
+    auto& io = Io();
+    int32_t handle = AllocFileHandle(io);
+    io.WriteFiles.emplace(handle, std::move(fileStream));
     return handle;
 }
 
@@ -163,35 +152,32 @@ int32_t file_open_for_append(const char* filename) {
     if (!fileStream.is_open()) {
         return -1;
     }
-    int32_t handle;
-    if (!FreeFileHandles.empty()) {
-        handle = FreeFileHandles.front();
-        FreeFileHandles.pop_front();
-    } else {
-        handle = NextFileHandle++;
-    }
-    WriteFiles.emplace(handle, std::move(fileStream));
+    auto& io = Io();
+    int32_t handle = AllocFileHandle(io);
+    io.WriteFiles.emplace(handle, std::move(fileStream));
     return handle;
 }
 
 void file_close(int32_t fileHandle) {
-    auto itr = ReadFiles.find(fileHandle);
-    if (itr != ReadFiles.end()) {
+    auto& io = Io();
+    auto itr = io.ReadFiles.find(fileHandle);
+    if (itr != io.ReadFiles.end()) {
         itr->second.close();
-        ReadFiles.erase(itr);
-        FreeFileHandles.push_front(fileHandle);
+        io.ReadFiles.erase(itr);
+        io.FreeFileHandles.push_front(fileHandle);
     }
-    auto itw = WriteFiles.find(fileHandle);
-    if (itw != WriteFiles.end()) {
+    auto itw = io.WriteFiles.find(fileHandle);
+    if (itw != io.WriteFiles.end()) {
         itw->second.close();
-        WriteFiles.erase(itw);
-        FreeFileHandles.push_front(fileHandle);
+        io.WriteFiles.erase(itw);
+        io.FreeFileHandles.push_front(fileHandle);
     }
 }
 
 bool file_has_more_data(int32_t fileHandle) {
-    auto it = ReadFiles.find(fileHandle);
-    if (it == ReadFiles.end()) {
+    auto& io = Io();
+    auto it = io.ReadFiles.find(fileHandle);
+    if (it == io.ReadFiles.end()) {
         return false;
     }
     return !it->second.eof();
@@ -202,25 +188,30 @@ bool file_eof(int32_t fileHandle) {
 }
 
 void input_set_file(int32_t fileHandle) {
-    auto it = ReadFiles.find(fileHandle);
-    if (it != ReadFiles.end()) {
-        SetInputStream(&it->second);
+    auto& io = Io();
+    auto it = io.ReadFiles.find(fileHandle);
+    if (it != io.ReadFiles.end()) {
+        io.In = &it->second;
     }
 }
 
 void output_set_file(int32_t fileHandle) {
-    auto it = WriteFiles.find(fileHandle);
-    if (it != WriteFiles.end()) {
-        SetOutputStream(&it->second);
+    auto& io = Io();
+    auto it = io.WriteFiles.find(fileHandle);
+    if (it != io.WriteFiles.end()) {
+        io.Out = &it->second;
     }
 }
 
+// Back to the program's own streams, which need not be the process ones.
 void input_reset_file() {
-    SetInputStream(&std::cin);
+    auto& io = Io();
+    io.In = io.StdIn;
 }
 
 void output_reset_file() {
-    SetOutputStream(&std::cout);
+    auto& io = Io();
+    io.Out = io.StdOut;
 }
 
 // time from day start in milliseconds in local timezone
@@ -247,20 +238,22 @@ int64_t time_from_daystart_millis() {
 ITypeErasedFuture* qumir_sleep(int64_t milliseconds) {
     auto promise = std::make_shared<TPromise<void>>();
     auto future = MakeExternalFuture<void>(promise);
-    g_pendingCalls.emplace_back([promise, milliseconds]() {
+    auto& io = Io();
+    io.PendingCalls.emplace_back([promise, milliseconds]() {
         std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
     });
-    g_pendingFutures.emplace_back(std::move(future));
+    io.PendingFutures.emplace_back(std::move(future));
     return new TWrappedFuture<void>(MakeExternalFuture<void>(promise));
 }
 
 size_t io_process_events() {
-    auto calls = std::move(g_pendingCalls);
+    auto& io = Io();
+    auto calls = std::move(io.PendingCalls);
     for (auto& call : calls) {
         call();
     }
 
-    auto futures = std::move(g_pendingFutures);
+    auto futures = std::move(io.PendingFutures);
     for (auto& future : futures) {
         if (!future.done()) {
             future.resume();
@@ -1,6 +1,6 @@
 #include "painter.h"
 #include "colors.h"
-#include <qumir/future.h>
+#include "context.h"
 
 #include <algorithm>
 #include <cmath>
@@ -16,50 +16,34 @@ namespace NRuntime {
 
 namespace {
 
-struct PainterState {
-    int64_t sheetWidth  = 800;
-    int64_t sheetHeight = 600;
-    int64_t penWidth    = 1;
-    int64_t penColor    = PackRGB(0, 0, 0);
-    int64_t brushColor  = PackRGB(255, 255, 255);
-    bool    hasBrush    = true;
-    int64_t density     = 100;
-    std::string fontFamily = "Arial";
-    int64_t fontSize    = 12;
-    bool    fontBold    = false;
-    bool    fontItalic  = false;
-    int64_t curX        = 0;
-    int64_t curY        = 0;
-    std::vector<uint32_t> pixels; // sheetWidth * sheetHeight, ARGB packed
-};
-
-PainterState g_state;
-
-std::vector<std::function<void()>> g_pendingCalls;
-std::vector<TFuture<void>> g_pendingFutures;
-
-void EnqueuePainterCall(std::function<void()> call) {
-    g_pendingCalls.push_back(std::move(call));
-}
-
-void DoPainterNewSheet(int64_t w, int64_t h, int64_t color) {
+TPainterState& Painter() {
+    return CurrentContext().Painter;
+}
+
+// The call runs against the context that queued it.
+void EnqueuePainterCall(std::function<void(TPainterState&)> call) {
+    auto& painter = Painter();
+    painter.PendingCalls.push_back([&painter, call = std::move(call)]() { call(painter); });
+}
+
+void DoPainterNewSheet(TPainterState& painter, int64_t w, int64_t h, int64_t color) {
     std::cerr << "painter_new_sheet " << w << "x" << h << " color=" << std::hex << color << std::dec << "\n";
     if (w <= 0 || h <= 0 || w > 32767 || h > 32767) {
         throw std::runtime_error("Invalid sheet dimensions");
     }
-    g_state.sheetWidth  = w;
-    g_state.sheetHeight = h;
-    g_state.pixels.assign(static_cast<size_t>(w * h), static_cast<uint32_t>(color));
+    painter.SheetWidth  = w;
+    painter.SheetHeight = h;
+    painter.Pixels.assign(static_cast<size_t>(w * h), static_cast<uint32_t>(color));
 }
 
 } // namespace
 
 extern "C" {
 
-int64_t painter_sheet_height() { return g_state.sheetHeight; }
-int64_t painter_sheet_width()  { return g_state.sheetWidth; }
-int64_t painter_center_x()     { return g_state.sheetWidth  / 2; }
-int64_t painter_center_y()     { return g_state.sheetHeight / 2; }
+int64_t painter_sheet_height() { return Painter().SheetHeight; }
+int64_t painter_sheet_width()  { return Painter().SheetWidth; }
+int64_t painter_center_x()     { return Painter().SheetWidth  / 2; }
+int64_t painter_center_y()     { return Painter().SheetHeight / 2; }
 
 int64_t painter_text_width(const char* text) {
     // stub: approximate 7 pixels per character
@@ -67,75 +51,76 @@ int64_t painter_text_width(const char* text) {
 }
 
 int64_t painter_get_pixel(int64_t x, int64_t y) {
-    if (x < 0 || y < 0 || x >= g_state.sheetWidth || y >= g_state.sheetHeight) {
+    const auto& painter = Painter();
+    if (x < 0 || y < 0 || x >= painter.SheetWidth || y >= painter.SheetHeight) {
         return 0;
     }
-    if (g_state.pixels.empty()) return 0;
-    return static_cast<int64_t>(g_state.pixels[y * g_state.sheetWidth + x]);
+    if (painter.Pixels.empty()) return 0;
+    return static_cast<int64_t>(painter.Pixels[y * painter.SheetWidth + x]);
 }
 
 void painter_pen(int64_t width, int64_t color) {
-    EnqueuePainterCall([width, color]() {
+    EnqueuePainterCall([width, color](TPainterState& painter) {
         std::cerr << "painter_pen width=" << width << " color=" << std::hex << color << std::dec << "\n";
-        g_state.penWidth = width;
-        g_state.penColor = color;
+        painter.PenWidth = width;
+        painter.PenColor = color;
     });
 }
 
 void painter_brush(int64_t color) {
-    EnqueuePainterCall([color]() {
+    EnqueuePainterCall([color](TPainterState& painter) {
         std::cerr << "painter_brush color=" << std::hex << color << std::dec << "\n";
-        g_state.brushColor = color;
-        g_state.hasBrush   = true;
+        painter.BrushColor = color;
+        painter.HasBrush   = true;
     });
 }
 
 void painter_no_brush() {
-    EnqueuePainterCall([]() {
+    EnqueuePainterCall([](TPainterState& painter) {
         std::cerr << "painter_no_brush\n";
-        g_state.hasBrush = false;
+        painter.HasBrush = false;
     });
 }
 
 void painter_density(int64_t d) {
-    EnqueuePainterCall([d]() {
+    EnqueuePainterCall([d](TPainterState& painter) {
         std::cerr << "painter_density " << d << "\n";
-        g_state.density = d;
+        painter.Density = d;
     });
 }
 
 void painter_font(const char* family, int64_t size, bool bold, bool italic) {
     std::string familyCopy = family ? family : "";
-    EnqueuePainterCall([familyCopy = std::move(familyCopy), size, bold, italic]() {
+    EnqueuePainterCall([familyCopy = std::move(familyCopy), size, bold, italic](TPainterState& painter) {
         std::cerr << "painter_font family=" << familyCopy << " size=" << size
                   << " bold=" << bold << " italic=" << italic << "\n";
-        g_state.fontFamily = familyCopy;
-        g_state.fontSize   = size;
-        g_state.fontBold   = bold;
-        g_state.fontItalic = italic;
+        painter.FontFamily = familyCopy;
+        painter.FontSize   = size;
+        painter.FontBold   = bold;
+        painter.FontItalic = italic;
     });
 }
 
 void painter_move_to(int64_t x, int64_t y) {
-    EnqueuePainterCall([x, y]() {
+    EnqueuePainterCall([x, y](TPainterState& painter) {
         std::cerr << "painter_move_to (" << x << "," << y << ")\n";
-        g_state.curX = x;
-        g_state.curY = y;
+        painter.CurX = x;
+        painter.CurY = y;
     });
 }
 
 void painter_line(int64_t x1, int64_t y1, int64_t x2, int64_t y2) {
-    EnqueuePainterCall([x1, y1, x2, y2]() {
+    EnqueuePainterCall([x1, y1, x2, y2](TPainterState&) {
         std::cerr << "painter_line (" << x1 << "," << y1 << ") -> (" << x2 << "," << y2 << ")\n";
     });
 }
 
 void painter_line_to(int64_t x, int64_t y) {
-    EnqueuePainterCall([x, y]() {
-        std::cerr << "painter_line_to (" << g_state.curX << "," << g_state.curY
+    EnqueuePainterCall([x, y](TPainterState& painter) {
+        std::cerr << "painter_line_to (" << painter.CurX << "," << painter.CurY
                   << ") -> (" << x << "," << y << ")\n";
-        g_state.curX = x;
-        g_state.curY = y;
+        painter.CurX = x;
+        painter.CurY = y;
     });
 }
 
@@ -146,7 +131,7 @@ void painter_polygon(int64_t n, int64_t* xs, int64_t* ys) {
         xsCopy.assign(xs, xs + n);
         ysCopy.assign(ys, ys + n);
     }
-    EnqueuePainterCall([n, xsCopy = std::move(xsCopy), ysCopy = std::move(ysCopy)]() {
+    EnqueuePainterCall([n, xsCopy = std::move(xsCopy), ysCopy = std::move(ysCopy)](TPainterState&) {
         (void)xsCopy;
         (void)ysCopy;
         std::cerr << "painter_polygon n=" << n << "\n";
@@ -154,41 +139,41 @@ void painter_polygon(int64_t n, int64_t* xs, int64_t* ys) {
 }
 
 void painter_pixel(int64_t x, int64_t y, int64_t color) {
-    EnqueuePainterCall([x, y, color]() {
+    EnqueuePainterCall([x, y, color](TPainterState& painter) {
         std::cerr << "painter_pixel (" << x << "," << y << ") color=" << std::hex << color << std::dec << "\n";
-        if (x >= 0 && y >= 0 && x < g_state.sheetWidth && y < g_state.sheetHeight && !g_state.pixels.empty()) {
-            g_state.pixels[y * g_state.sheetWidth + x] = static_cast<uint32_t>(color);
+        if (x >= 0 && y >= 0 && x < painter.SheetWidth && y < painter.SheetHeight && !painter.Pixels.empty()) {
+            painter.Pixels[y * painter.SheetWidth + x] = static_cast<uint32_t>(color);
         }
     });
 }
 
 void painter_rect(int64_t x1, int64_t y1, int64_t x2, int64_t y2) {
-    EnqueuePainterCall([x1, y1, x2, y2]() {
+    EnqueuePainterCall([x1, y1, x2, y2](TPainterState&) {
         std::cerr << "painter_rect (" << x1 << "," << y1 << ")-(" << x2 << "," << y2 << ")\n";
     });
 }
 
 void painter_ellipse(int64_t x1, int64_t y1, int64_t x2, int64_t y2) {
-    EnqueuePainterCall([x1, y1, x2, y2]() {
+    EnqueuePainterCall([x1, y1, x2, y2](TPainterState&) {
         std::cerr << "painter_ellipse (" << x1 << "," << y1 << ")-(" << x2 << "," << y2 << ")\n";
     });
 }
 
 void painter_circle(int64_t x, int64_t y, int64_t r) {
-    EnqueuePainterCall([x, y, r]() {
+    EnqueuePainterCall([x, y, r](TPainterState&) {
         std::cerr << "painter_circle center=(" << x << "," << y << ") r=" << r << "\n";
     });
 }
 
 void painter_text(int64_t x, int64_t y, const char* text) {
     std::string textCopy = text ? text : "";
-    EnqueuePainterCall([x, y, textCopy = std::move(textCopy)]() {
+    EnqueuePainterCall([x, y, textCopy = std::move(textCopy)](TPainterState&) {
         std::cerr << "painter_text (" << x << "," << y << ") \"" << textCopy << "\"\n";
     });
 }
 
 void painter_fill(int64_t x, int64_t y) {
-    EnqueuePainterCall([x, y]() {
+    EnqueuePainterCall([x, y](TPainterState&) {
         std::cerr << "painter_fill (" << x << "," << y << ")\n";
     });
 }
@@ -196,20 +181,21 @@ void painter_fill(int64_t x, int64_t y) {
 ITypeErasedFuture* painter_new_sheet(int64_t w, int64_t h, int64_t color) {
     auto promise = std::make_shared<TPromise<void>>();
     auto future = MakeExternalFuture<void>(promise);
-    EnqueuePainterCall([w, h, color]() {
-        DoPainterNewSheet(w, h, color);
+    EnqueuePainterCall([w, h, color](TPainterState& painter) {
+        DoPainterNewSheet(painter, w, h, color);
     });
-    g_pendingFutures.emplace_back(std::move(future));
+    Painter().PendingFutures.emplace_back(std::move(future));
     return new TWrappedFuture<void>(MakeExternalFuture<void>(promise));
 }
 
 size_t painter_process_events() {
-    auto calls = std::move(g_pendingCalls);
+    auto& painter = Painter();
+    auto calls = std::move(painter.PendingCalls);
     for (auto& call : calls) {
         call();
     }
 
-    auto futures = std::move(g_pendingFutures);
+    auto futures = std::move(painter.PendingFutures);
     for (auto& future : futures) {
         if (!future.done()) {
             future.resume();
@@ -220,14 +206,14 @@ size_t painter_process_events() {
 
 void painter_load_sheet(const char* filename) {
     std::string filenameCopy = filename ? filename : "";
-    EnqueuePainterCall([filenameCopy = std::move(filenameCopy)]() {
+    EnqueuePainterCall([filenameCopy = std::move(filenameCopy)](TPainterState&) {
         std::cerr << "painter_load_sheet \"" << filenameCopy << "\"\n";
     });
 }
 
 void painter_save_sheet(const char* filename) {
     std::string filenameCopy = filename ? filename : "";
-    EnqueuePainterCall([filenameCopy = std::move(filenameCopy)]() {
+    EnqueuePainterCall([filenameCopy = std::move(filenameCopy)](TPainterState&) {
         std::cerr << "painter_save_sheet \"" << filenameCopy << "\"\n";
     });
 }
@@ -1,30 +1,20 @@
 #include "robot.h"
-#include <qumir/future.h>
+#include "context.h"
 
 #include <functional>
 #include <iostream>
 #include <utility>
-#include <vector>
 
 namespace NQumir {
 namespace NRuntime {
 
 namespace {
-    int robotX = 0;
-    int robotY = 0;
-    bool cellPainted = false;
-
-    struct TPendingEvent {
-        std::function<void()> Callback;
-        TFuture<void> Future;
-    };
-
-    std::vector<TPendingEvent> pendingEvents;
-
-    ITypeErasedFuture* EnqueueRobotCall(std::function<void()> call) {
+    // The call runs against the context that queued it.
+    ITypeErasedFuture* EnqueueRobotCall(std::function<void(TRobotState&)> call) {
+        auto& robot = CurrentContext().Robot;
         auto promise = std::make_shared<TPromise<void>>();
-        pendingEvents.emplace_back(TPendingEvent{
-            .Callback = std::move(call),
+        robot.PendingEvents.emplace_back(TPendingEvent{
+            .Callback = [&robot, call = std::move(call)]() { call(robot); },
             .Future = MakeExternalFuture<void>(promise)
         });
         return new TWrappedFuture<void>(MakeExternalFuture<void>(promise));
@@ -34,42 +24,42 @@ namespace {
 extern "C" {
 
 ITypeErasedFuture* robot_left() {
-    return EnqueueRobotCall([]() {
-        robotX--;
+    return EnqueueRobotCall([](TRobotState& robot) {
+        robot.X--;
         std::cerr << "robot_left\n";
     });
 }
 
 ITypeErasedFuture* robot_right() {
-    return EnqueueRobotCall([]() {
-        robotX++;
+    return EnqueueRobotCall([](TRobotState& robot) {
+        robot.X++;
         std::cerr << "robot_right\n";
     });
 }
 
 ITypeErasedFuture* robot_up() {
-    return EnqueueRobotCall([]() {
-        robotY--;
+    return EnqueueRobotCall([](TRobotState& robot) {
+        robot.Y--;
         std::cerr << "robot_up\n";
     });
 }
 
 ITypeErasedFuture* robot_down() {
-    return EnqueueRobotCall([]() {
-        robotY++;
+    return EnqueueRobotCall([](TRobotState& robot) {
+        robot.Y++;
         std::cerr << "robot_down\n";
     });
 }
 
 ITypeErasedFuture* robot_paint() {
-    return EnqueueRobotCall([]() {
-        cellPainted = true;
+    return EnqueueRobotCall([](TRobotState& robot) {
+        robot.CellPainted = true;
         std::cerr << "robot_paint\n";
     });
 }
 
 size_t robot_process_events() {
-    auto events = std::move(pendingEvents);
+    auto events = std::move(CurrentContext().Robot.PendingEvents);
     for (auto& event : events) {
         if (event.Callback) {
             event.Callback();
@@ -114,7 +104,7 @@ bool robot_bottom_wall() {
 }
 
 bool robot_cell_painted() {
-    return cellPainted;
+    return CurrentContext().Robot.CellPainted;
 }
 
 bool robot_cell_clean() {
@@ -11,6 +11,14 @@ void __set_jmp_target(jmp_buf* buf) { tls_jmp_buf = buf; }
 void __clear_jmp_target(void) { tls_jmp_buf = nullptr; }
 const char* __get_runtime_error(void) { return tls_error_buf; }
 
+void __raise_runtime_error(const char* message) {
+    if (tls_jmp_buf) {
+        snprintf(tls_error_buf, sizeof(tls_error_buf), "%s", message);
+        longjmp(*tls_jmp_buf, 1);
+    }
+    throw std::runtime_error(message);
+}
+
 void __ensure(bool condition, const char* message) {
     if (!condition) {
         if (tls_jmp_buf) {
@@ -10,6 +10,8 @@
 
 extern "C" {
     void __ensure(bool condition, const char* message);
+    // Unconditional form of __ensure, without its "assertion failed" prefix.
+    [[noreturn]] void __raise_runtime_error(const char* message);
     // JIT error escape: set a longjmp target so __ensure can jump back to host code
     // instead of throwing through JIT frames (which lack unwind info on macOS).
     void __set_jmp_target(jmp_buf* buf);
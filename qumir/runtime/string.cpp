@@ -8,6 +8,7 @@
 #include <sstream>
 #include <iomanip>
 
+#include "context.h"
 #include "io.h"
 
 namespace NQumir {
@@ -30,16 +31,33 @@ std::string dbg_str(const char* s) {
     }
     return out.str();
 }
+
+// Every string buffer comes from here, so it is charged to the quota.
+TString* AllocString(int length) {
+    ChargeHeap(sizeof(TString) + length + 1);
+    auto* str = (TString*)calloc(1, sizeof(TString) + length + 1);
+    str->Capacity = length;
+    return str;
+}
+
 } // namespace {
 
 char* str_from_lit_(const char* s, int len) {
-    TString* str = (TString*)calloc(1, sizeof(TString) + len + 1);
+    TString* str = AllocString(len);
     str->Rc = 1;
     str->Length = len;
     std::memcpy(str->Data, s, len);
     return str->Data;
 }
 
+char* str_init_lit_(void* buf, const char* s, int len) {
+    TString* str = (TString*)buf;
+    str->Rc = 1;
+    str->Length = str->Capacity = len;
+    std::memcpy(str->Data, s, len);
+    return str->Data;
+}
+
 char* str_from_lit(const char* s) {
     //std::cerr << "from_lit '" << s << "'\n";
     if (!s) {
@@ -123,7 +141,7 @@ char* str_concat(const char* a, const char* b) {
     if (!b) { b = ""; }
     int lenA = strlen(a);
     int lenB = strlen(b);
-    TString* strC = (TString*)calloc(1, sizeof(TString) + lenA + lenB + 1);
+    TString* strC = AllocString(lenA + lenB);
     strC->Rc = 1;
     strC->Length = lenA + lenB;
     std::memcpy(strC->Data, a, lenA);
@@ -180,8 +198,10 @@ int64_t str_unicode(const char* s) {
     return -1; // invalid UTF-8
 }
 
-char* str_from_unicode(int64_t codepoint) {
-    char buffer[5] = {0};
+namespace {
+
+// UTF-8 for codepoint into buffer, false for an invalid one.
+bool encode_unicode(int64_t codepoint, char (&buffer)[5]) {
     if (codepoint < 0x80) {
         buffer[0] = static_cast<char>(codepoint);
     } else if (codepoint < 0x800) {
@@ -197,11 +217,36 @@ char* str_from_unicode(int64_t codepoint) {
         buffer[2] = static_cast<char>(0b10000000 | ((codepoint >> 6) & 0b00111111));
         buffer[3] = static_cast<char>(0b10000000 | (codepoint & 0b00111111));
     } else {
-        return nullptr; // invalid codepoint
+        return false; // invalid codepoint
+    }
+    return true;
+}
+
+} // namespace
+
+char* str_from_unicode(int64_t codepoint) {
+    char buffer[5] = {0};
+    if (!encode_unicode(codepoint, buffer)) {
+        return nullptr;
     }
     return str_from_lit_(buffer, std::strlen(buffer));
 }
 
+char* str_init_lit(void* buf, const char* s) {
+    if (!s) {
+        return nullptr;
+    }
+    return str_init_lit_(buf, s, std::strlen(s));
+}
+
+char* str_init_unicode(void* buf, int64_t codepoint) {
+    char buffer[5] = {0};
+    if (!encode_unicode(codepoint, buffer)) {
+        return nullptr;
+    }
+    return str_init_lit_(buf, buffer, std::strlen(buffer));
+}
+
 int64_t str_str(const char* needle, const char* haystack) {
     if (!haystack || !needle) return 0; // strings are 1-indexed
     auto* pos = std::strstr(haystack, needle);
@@ -272,7 +317,7 @@ void str_delete_symbols(char** s, int64_t startSymbol, int64_t count)
     int bytesToDelete = endByte - startByte;
     int newLength = str->Length - bytesToDelete;
 
-    TString* newStr = (TString*)calloc(1, sizeof(TString) + newLength + 1);
+    TString* newStr = AllocString(newLength);
     newStr->Rc = 1;
     newStr->Length = newLength;
     // copy data before deleted segment
@@ -307,7 +352,7 @@ void str_insert_symbols(const char* insertStr, char** s, int64_t insertSymbolPos
     int insertLen = strlen(insertStr);
     int newLength = str->Length + insertLen;
 
-    TString* newStr = (TString*)calloc(1, sizeof(TString) + newLength + 1);
+    TString* newStr = AllocString(newLength);
     newStr->Rc = 1;
     newStr->Length = newLength;
     std::memcpy(newStr->Data, str->Data, insertBytePos);
@@ -401,7 +446,7 @@ char* str_replace_sym(char* str, int32_t newSym, int64_t symIdx)
     } else {
         // need to reallocate
         int newLength = tstr->Length - oldSymLen + newSymLen;
-        TString* newTStr = (TString*)calloc(1, sizeof(TString) + newLength + 1);
+        TString* newTStr = AllocString(newLength);
         newTStr->Rc = 1;
         int outPos = 0;
         if (symIdx > 1) {
@@ -422,6 +467,40 @@ char* str_replace_sym(char* str, int32_t newSym, int64_t symIdx)
     }
 }
 
+void str_append(char** s, const char* b) {
+    char* a = *s;
+    if (!a || ((TString*)(a - offsetof(TString, Data)))->Rc != 1) {
+        char* c = str_concat(a, b);
+        str_release(a);
+        *s = c;
+        return;
+    }
+    if (!b) {
+        return;
+    }
+    TString* str = (TString*)(a - offsetof(TString, Data));
+    int64_t lenB = std::strlen(b);
+    int64_t length = str->Length + lenB;
+    if (length > str->Capacity) {
+        int64_t capacity = std::max(length, 2 * str->Capacity);
+        // s := s + s appends the string to itself
+        bool self = b == a;
+        ChargeHeap(capacity - str->Capacity);
+        str = (TString*)realloc(str, sizeof(TString) + capacity + 1);
+        str->Capacity = capacity;
+        if (self) {
+            b = str->Data;
+        }
+    }
+    std::memmove(str->Data + str->Length, b, lenB);
+    str->Length = length;
+    str->Data[length] = 0;
+    free(str->Utf8Indices);
+    str->Utf8Indices = nullptr;
+    str->Symbols = 0;
+    *s = str->Data;
+}
+
 char* assign_from_lit(char* dest, const char* src) {
     if (!src) {
         str_release(dest);
@@ -441,7 +520,7 @@ char* assign_from_lit(char* dest, const char* src) {
         // need to reallocate inplace
         int newSize = sizeof(TString) + srcLen + 1;
         TString* newStr = (TString*)realloc(destStr, newSize);
-        newStr->Length = srcLen;
+        newStr->Length = newStr->Capacity = srcLen;
         std::memcpy(newStr->Data, src, newStr->Length + 1);
         return newStr->Data;
     }
@@ -10,6 +10,7 @@ struct TString {
     int64_t Symbols;
     int64_t Rc;
     int64_t Length;
+    int64_t Capacity; // bytes Data can hold, not counting the terminating zero
     char Data[0];
 };
 
@@ -37,6 +38,15 @@ char* str_input();
 
 char* str_replace_sym(char* str, int32_t newSym, int64_t symIdx);
 
+// *s = *s + b. A string nobody else holds grows in place, with spare room
+// for the next append, so building a string in a loop does not go through
+// the allocator on every iteration.
+void str_append(char** s, const char* b);
+// Build a string in caller-provided zeroed storage of at least
+// sizeof(TString) + length + 1 bytes. Such a string is never released.
+char* str_init_lit(void* buf, const char* s);
+char* str_init_unicode(void* buf, int64_t codepoint);
+
 char* assign_from_lit(char* dest, const char* src);
 char* assign_from_str(char* dest, char* src, int borrowed);
 
@@ -1,40 +1,21 @@
 #include "turtle.h"
-#include <qumir/future.h>
+#include "context.h"
 
 #include <functional>
 #include <iostream>
 #include <cmath>
 #include <utility>
-#include <vector>
 
 namespace NQumir {
 namespace NRuntime {
 
 namespace {
-    struct State {
-        double x;
-        double y;
-        double angle;
-        bool pen;
-    };
-
-    double current_x = 0.0;
-    double current_y = 0.0;
-    double angle_deg = 0.0; // 0 degrees is to the right
-    bool pen_down = true;
-
-    std::vector<State> states;
-
-    struct TPendingEvent {
-        std::function<void()> Callback;
-        TFuture<void> Future;
-    };
-    std::vector<TPendingEvent> pendingEvents;
-
-    ITypeErasedFuture* EnqueueTurtleCall(std::function<void()> call) {
+    // The call runs against the context that queued it.
+    ITypeErasedFuture* EnqueueTurtleCall(std::function<void(TTurtleState&)> call) {
+        auto& turtle = CurrentContext().Turtle;
         auto promise = std::make_shared<TPromise<void>>();
-        pendingEvents.emplace_back(TPendingEvent{
-            .Callback = std::move(call),
+        turtle.PendingEvents.emplace_back(TPendingEvent{
+            .Callback = [&turtle, call = std::move(call)]() { call(turtle); },
             .Future = MakeExternalFuture<void>(promise)
         });
         return new TWrappedFuture<void>(MakeExternalFuture<void>(promise));
@@ -44,82 +25,82 @@ namespace {
 extern "C" {
 // placeholders for turtle functions
 ITypeErasedFuture* turtle_pen_up() {
-    return EnqueueTurtleCall([]() {
+    return EnqueueTurtleCall([](TTurtleState& turtle) {
         std::cerr << "Turtle pen up\n";
-        pen_down = false;
+        turtle.PenDown = false;
     });
 }
 
 ITypeErasedFuture* turtle_pen_down() {
-    return EnqueueTurtleCall([]() {
+    return EnqueueTurtleCall([](TTurtleState& turtle) {
         std::cerr << "Turtle pen down\n";
-        pen_down = true;
+        turtle.PenDown = true;
     });
 }
 
 ITypeErasedFuture* turtle_forward(double distance) {
-    return EnqueueTurtleCall([distance]() {
+    return EnqueueTurtleCall([distance](TTurtleState& turtle) {
         std::cerr << "Turtle forward " << distance << "\n";
-        auto next_x = current_x + distance * cos(angle_deg * M_PI / 180.0);
-        auto next_y = current_y + distance * sin(angle_deg * M_PI / 180.0);
-        if (pen_down) {
-            std::cerr << "Drawing from (" << current_x << "," << current_y << ") to (" << next_x << "," << next_y << ")\n";
+        auto next_x = turtle.X + distance * cos(turtle.AngleDeg * M_PI / 180.0);
+        auto next_y = turtle.Y + distance * sin(turtle.AngleDeg * M_PI / 180.0);
+        if (turtle.PenDown) {
+            std::cerr << "Drawing from (" << turtle.X << "," << turtle.Y << ") to (" << next_x << "," << next_y << ")\n";
         } else {
-            std::cerr << "Moving  from (" << current_x << "," << current_y << ") to (" << next_x << "," << next_y << ")\n";
+            std::cerr << "Moving  from (" << turtle.X << "," << turtle.Y << ") to (" << next_x << "," << next_y << ")\n";
         }
-        current_x = next_x;
-        current_y = next_y;
+        turtle.X = next_x;
+        turtle.Y = next_y;
     });
 }
 
 ITypeErasedFuture* turtle_backward(double distance) {
-    return EnqueueTurtleCall([distance]() {
+    return EnqueueTurtleCall([distance](TTurtleState& turtle) {
         std::cerr << "Turtle backward " << distance << "\n";
-        auto next_x = current_x - distance * cos(angle_deg * M_PI / 180.0);
-        auto next_y = current_y - distance * sin(angle_deg * M_PI / 180.0);
-        if (pen_down) {
-            std::cerr << "Drawing from (" << current_x << "," << current_y << ") to (" << next_x << "," << next_y << ")\n";
+        auto next_x = turtle.X - distance * cos(turtle.AngleDeg * M_PI / 180.0);
+        auto next_y = turtle.Y - distance * sin(turtle.AngleDeg * M_PI / 180.0);
+        if (turtle.PenDown) {
+            std::cerr << "Drawing from (" << turtle.X << "," << turtle.Y << ") to (" << next_x << "," << next_y << ")\n";
         } else {
-            std::cerr << "Moving  from (" << current_x << "," << current_y << ") to (" << next_x << "," << next_y << ")\n";
+            std::cerr << "Moving  from (" << turtle.X << "," << turtle.Y << ") to (" << next_x << "," << next_y << ")\n";
         }
-        current_x = next_x;
-        current_y = next_y;
+        turtle.X = next_x;
+        turtle.Y = next_y;
     });
 }
 
 ITypeErasedFuture* turtle_turn_left(double angle) {
-    return EnqueueTurtleCall([angle]() {
+    return EnqueueTurtleCall([angle](TTurtleState& turtle) {
         std::cerr << "Turtle turn left " << angle << "\n";
-        angle_deg -= angle;
-        std::cerr << "New angle: " << angle_deg << "\n";
+        turtle.AngleDeg -= angle;
+        std::cerr << "New angle: " << turtle.AngleDeg << "\n";
     });
 }
 
 ITypeErasedFuture* turtle_turn_right(double angle) {
-    return EnqueueTurtleCall([angle]() {
+    return EnqueueTurtleCall([angle](TTurtleState& turtle) {
         std::cerr << "Turtle turn right " << angle << "\n";
-        angle_deg += angle;
-        std::cerr << "New angle: " << angle_deg << "\n";
+        turtle.AngleDeg += angle;
+        std::cerr << "New angle: " << turtle.AngleDeg << "\n";
     });
 }
 
 ITypeErasedFuture* turtle_save_state() {
-    return EnqueueTurtleCall([]() {
+    return EnqueueTurtleCall([](TTurtleState& turtle) {
         std::cerr << "Turtle save state\n";
-        states.push_back(State{current_x, current_y, angle_deg, pen_down});
+        turtle.Saved.push_back({turtle.X, turtle.Y, turtle.AngleDeg, turtle.PenDown});
     });
 }
 
 ITypeErasedFuture* turtle_restore_state() {
-    return EnqueueTurtleCall([]() {
+    return EnqueueTurtleCall([](TTurtleState& turtle) {
         std::cerr << "Turtle restore state\n";
-        if (!states.empty()) {
-            State s = states.back();
-            states.pop_back();
-            current_x = s.x;
-            current_y = s.y;
-            angle_deg = s.angle;
-            pen_down = s.pen;
+        if (!turtle.Saved.empty()) {
+            auto s = turtle.Saved.back();
+            turtle.Saved.pop_back();
+            turtle.X = s.X;
+            turtle.Y = s.Y;
+            turtle.AngleDeg = s.Angle;
+            turtle.PenDown = s.Pen;
         } else {
             std::cerr << "No saved state to restore\n";
         }
@@ -127,7 +108,7 @@ ITypeErasedFuture* turtle_restore_state() {
 }
 
 size_t turtle_process_events() {
-    auto events = std::move(pendingEvents);
+    auto events = std::move(CurrentContext().Turtle.PendingEvents);
     for (auto& event : events) {
         if (event.Callback) {
             event.Callback();
@@ -2,6 +2,7 @@
 #include "qumir/error.h"
 #include "qumir/parser/ast.h"
 #include "qumir/parser/core/printer.h"
+#include "qumir/time_report.h"
 
 #include <qumir/semantics/type_annotation/type_annotation.h>
 #include <qumir/semantics/definite_assignment/definite_assignment.h>
@@ -864,6 +865,7 @@ std::expected<std::monostate, TError> RunSourceTransformFixpoint(
     TPipelineOptions options)
 {
     static constexpr int MaxIterations = 10;
+    TPhaseTimer timer("semantics.fixpoint");
 
     auto initialNameResolution = RunSourceNameResolution(
         expr,
@@ -875,6 +877,9 @@ std::expected<std::monostate, TError> RunSourceTransformFixpoint(
 
     NTypeAnnotation::TTypeAnnotator annotator(context);
     for (int iteration = 0; iteration < MaxIterations; ++iteration) {
+        if (auto* report = CurrentTimeReport()) {
+            report->Count("semantics.fixpoint_iterations", 1);
+        }
         auto annotationResult = annotator.Annotate(expr);
         if (!annotationResult) {
             return std::unexpected(annotationResult.error());
@@ -938,17 +943,24 @@ std::expected<std::monostate, TError> RunFinalSemanticPipeline(
     NAst::TExprPtr& expr,
     NSemantics::TNameResolver& context)
 {
-    auto returnResult = NSemantics::ReturnNormalizationPass(expr, context);
-    if (!returnResult) {
-        return std::unexpected(returnResult.error());
+    {
+        TPhaseTimer timer("semantics.return_normalization");
+        auto returnResult = NSemantics::ReturnNormalizationPass(expr, context);
+        if (!returnResult) {
+            return std::unexpected(returnResult.error());
+        }
     }
 
-    NSemantics::TSyntheticNameGenerator syntheticNames(context, expr);
-    auto lifetimeResult = NSemantics::LifetimePass(expr, context, syntheticNames);
-    if (!lifetimeResult) {
-        return std::unexpected(lifetimeResult.error());
+    {
+        TPhaseTimer timer("semantics.lifetime");
+        NSemantics::TSyntheticNameGenerator syntheticNames(context, expr);
+        auto lifetimeResult = NSemantics::LifetimePass(expr, context, syntheticNames);
+        if (!lifetimeResult) {
+            return std::unexpected(lifetimeResult.error());
+        }
     }
 
+    TPhaseTimer timer("semantics.final");
     if (auto result = FinalNameResolution(expr, context); !result) {
         return result;
     }
@@ -968,18 +980,29 @@ std::expected<std::monostate, TError> Pipeline(
     NSemantics::TNameResolver& context,
     TPipelineOptions options)
 {
+    TPhaseTimer total("semantics");
+    auto* report = CurrentTimeReport();
+    if (report) {
+        report->Count("ast.nodes.parsed", NAst::CountNodes(expr));
+    }
+
     if (auto result = RunSourceTransformFixpoint(expr, context, options); !result) {
         return result;
     }
 
     if (options.RunDefiniteAssignment) {
+        TPhaseTimer timer("semantics.definite_assignment");
         NSemantics::TDefiniteAssignmentChecker definiteAssignmentChecker(context);
         if (auto result = definiteAssignmentChecker.Check(expr); !result) {
             return std::unexpected(result.error());
         }
     }
 
-    return RunFinalSemanticPipeline(expr, context);
+    auto result = RunFinalSemanticPipeline(expr, context);
+    if (result && report) {
+        report->Count("ast.nodes.transformed", NAst::CountNodes(expr));
+    }
+    return result;
 }
 
 } // namespace NTransform
@@ -0,0 +1,177 @@
+#include "time_report.h"
+
+#include <algorithm>
+#include <iomanip>
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+namespace NQumir {
+
+namespace {
+
+thread_local TTimeReport* Current = nullptr;
+
+double Milliseconds(TTimeReport::TClock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+} // namespace
+
+TTimeReport::TTimeReport()
+    : Created(TClock::now())
+{ }
+
+TTimeReport::TPhase& TTimeReport::Find(std::string_view phase) {
+    auto it = std::find_if(Phases.begin(), Phases.end(), [&](const TPhase& p) {
+        return p.Name == phase;
+    });
+    if (it == Phases.end()) {
+        it = Phases.insert(Phases.end(), TPhase{.Name = std::string(phase)});
+    }
+    return *it;
+}
+
+void TTimeReport::Start(std::string_view phase) {
+    std::lock_guard lock(Mutex);
+    Find(phase);
+}
+
+void TTimeReport::AddTime(std::string_view phase, TClock::duration elapsed) {
+    const int64_t rss = PeakRssKb();
+    std::lock_guard lock(Mutex);
+    auto& p = Find(phase);
+    ++p.Calls;
+    p.Elapsed += elapsed;
+    p.PeakRssKb = std::max(p.PeakRssKb, rss);
+}
+
+void TTimeReport::Count(std::string_view counter, int64_t value) {
+    std::lock_guard lock(Mutex);
+    auto it = std::find_if(Counters.begin(), Counters.end(), [&](const auto& c) {
+        return c.first == counter;
+    });
+    if (it == Counters.end()) {
+        Counters.emplace_back(std::string(counter), value);
+    } else {
+        it->second += value;
+    }
+}
+
+void TTimeReport::Print(std::ostream& out) const {
+    std::lock_guard lock(Mutex);
+    const auto total = TClock::now() - Created;
+    size_t width = 5;
+    for (const auto& phase : Phases) {
+        width = std::max(width, phase.Name.size());
+    }
+    for (const auto& [name, value] : Counters) {
+        width = std::max(width, name.size());
+    }
+
+    const auto flags = out.flags();
+    out << "===== Time report =====\n"
+        << std::left << std::setw(width) << "phase" << std::right
+        << std::setw(8) << "calls"
+        << std::setw(12) << "wall ms"
+        << std::setw(8) << "%"
+        << std::setw(14) << "peak RSS KiB" << '\n';
+    out << std::fixed;
+    for (const auto& phase : Phases) {
+        out << std::left << std::setw(width) << phase.Name << std::right
+            << std::setw(8) << phase.Calls
+            << std::setw(12) << std::setprecision(3) << Milliseconds(phase.Elapsed)
+            << std::setw(8) << std::setprecision(1) << 100.0 * phase.Elapsed / total
+            << std::setw(14) << phase.PeakRssKb << '\n';
+    }
+    out << std::left << std::setw(width) << "total" << std::right
+        << std::setw(8) << ""
+        << std::setw(12) << std::setprecision(3) << Milliseconds(total)
+        << std::setw(8) << std::setprecision(1) << 100.0
+        << std::setw(14) << PeakRssKb() << '\n';
+    if (!Counters.empty()) {
+        out << '\n' << std::left << std::setw(width) << "counter" << std::right
+            << std::setw(12) << "value" << '\n';
+        for (const auto& [name, value] : Counters) {
+            out << std::left << std::setw(width) << name << std::right
+                << std::setw(12) << value << '\n';
+        }
+    }
+    out.flags(flags);
+}
+
+void TTimeReport::PrintJson(std::ostream& out) const {
+    std::lock_guard lock(Mutex);
+    const auto total = TClock::now() - Created;
+    const auto flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"total_ms\": " << Milliseconds(total)
+        << ",\n  \"peak_rss_kb\": " << PeakRssKb()
+        << ",\n  \"phases\": [";
+    bool first = true;
+    for (const auto& phase : Phases) {
+        out << (first ? "\n" : ",\n")
+            << "    {\"name\": \"" << phase.Name << "\""
+            << ", \"calls\": " << phase.Calls
+            << ", \"ms\": " << Milliseconds(phase.Elapsed)
+            << ", \"peak_rss_kb\": " << phase.PeakRssKb << "}";
+        first = false;
+    }
+    out << (Phases.empty() ? "]" : "\n  ]") << ",\n  \"counters\": {";
+    first = true;
+    for (const auto& [name, value] : Counters) {
+        out << (first ? "\n" : ",\n") << "    \"" << name << "\": " << value;
+        first = false;
+    }
+    out << (Counters.empty() ? "}" : "\n  }") << "\n}\n";
+    out.flags(flags);
+}
+
+int64_t TTimeReport::PeakRssKb() {
+#if defined(_WIN32)
+    return 0;
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+TTimeReport* CurrentTimeReport() {
+    return Current;
+}
+
+TTimeReportScope::TTimeReportScope(TTimeReport* report)
+    : Previous(Current)
+{
+    Current = report;
+}
+
+TTimeReportScope::~TTimeReportScope() {
+    Current = Previous;
+}
+
+TPhaseTimer::TPhaseTimer(std::string_view phase)
+    : Report(Current)
+    , Phase(phase)
+{
+    if (Report) {
+        Report->Start(Phase);
+        Start = TTimeReport::TClock::now();
+    }
+}
+
+TPhaseTimer::~TPhaseTimer() {
+    if (Report) {
+        Report->AddTime(Phase, TTimeReport::TClock::now() - Start);
+    }
+}
+
+} // namespace NQumir
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace NQumir {
+
+// Compile time statistics (qumirc/qumiri --time-report). The phases of the
+// pipeline time themselves with TPhaseTimer and publish sizes with
+// TTimeReport::Count; both go to the report the calling thread installed
+// with TTimeReportScope, and cost one thread-local load when there is none.
+//
+// Phase names are dotted paths ("semantics.lifetime" is part of
+// "semantics"), so the nesting is the same whichever thread a phase ran on.
+// Phases run on several threads at once (the per-function IR passes with
+// -j) add up their times across threads.
+class TTimeReport {
+public:
+    using TClock = std::chrono::steady_clock;
+
+    TTimeReport();
+
+    // Adds a row for the phase if there is none yet, so that the rows go in
+    // the order the phases started and a phase comes before its parts.
+    void Start(std::string_view phase);
+    void AddTime(std::string_view phase, TClock::duration elapsed);
+    // Counters add up: a REPL session reports its chunks together.
+    void Count(std::string_view counter, int64_t value);
+
+    // Aligned table: calls, wall time, share of the total and the peak RSS
+    // seen when the phase ended.
+    void Print(std::ostream& out) const;
+    void PrintJson(std::ostream& out) const;
+
+    // Peak resident set size of the process in KiB, 0 where unknown.
+    static int64_t PeakRssKb();
+
+private:
+    struct TPhase {
+        std::string Name;
+        uint64_t Calls = 0;
+        TClock::duration Elapsed{};
+        int64_t PeakRssKb = 0;
+    };
+
+    TPhase& Find(std::string_view phase);
+
+    const TClock::time_point Created;
+    mutable std::mutex Mutex;
+    std::vector<TPhase> Phases;
+    // In the order they were first set.
+    std::vector<std::pair<std::string, int64_t>> Counters;
+};
+
+// The report of the calling thread, nullptr when nobody asked for one.
+TTimeReport* CurrentTimeReport();
+
+// Installs a report for the calling thread until the end of the scope.
+// Workers that run a part of a timed phase install the report of the
+// thread that started them.
+class TTimeReportScope {
+public:
+    explicit TTimeReportScope(TTimeReport* report);
+    ~TTimeReportScope();
+
+    TTimeReportScope(const TTimeReportScope&) = delete;
+    TTimeReportScope& operator=(const TTimeReportScope&) = delete;
+
+private:
+    TTimeReport* Previous;
+};
+
+// Adds the time from construction to destruction to a phase of the current
+// report. `phase` must outlive the timer.
+class TPhaseTimer {
+public:
+    explicit TPhaseTimer(std::string_view phase);
+    ~TPhaseTimer();
+
+    TPhaseTimer(const TPhaseTimer&) = delete;
+    TPhaseTimer& operator=(const TPhaseTimer&) = delete;
+
+private:
+    TTimeReport* Report;
+    std::string_view Phase;
+    TTimeReport::TClock::time_point Start;
+};
+
+} // namespace NQumir
@@ -341,6 +341,12 @@ export function __ensure(condition, msgPtr) {
   throw new Error(line);
 }
 
+export function __raise_runtime_error(msgPtr) {
+  const line = readString(msgPtr) || 'runtime error';
+  appendStdout(line + '\n');
+  throw new Error(line);
+}
+
 function asHandle(value) {
   return Number(value) | 0;
 }
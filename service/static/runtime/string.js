@@ -248,6 +248,35 @@ export function str_concat(a, b) {
     const sb = loadString(b);
     return allocHandle(sa + sb);
 }
+// *strPtrPtr = *strPtrPtr + b; a string only this variable holds grows in place
+export function str_append(strPtrPtr, b) {
+    if (!MEMORY) return;
+    const u32 = new Uint32Array(MEMORY.buffer);
+    const ptrAddr = Number(strPtrPtr) >>> 0;
+    const handle = u32[ptrAddr >>> 2] | 0;
+    const sb = loadString(b);
+    const entry = isJsHandle(handle) ? STRING_POOL.get(handle) : null;
+    if (entry && entry.refs === 1) {
+        entry.value += sb;
+        entry.positions = null;
+        entry.len = null;
+        return;
+    }
+    const joined = allocHandle(loadString(handle) + sb);
+    str_release(handle);
+    u32[ptrAddr >>> 2] = joined;
+}
+// Strings built in a stack buffer: plain C-strings, which carry no refcount
+export function str_init_lit(buf, ptr) {
+    return ptr;
+}
+export function str_init_unicode(buf, codepoint) {
+    const cp = Number(codepoint);
+    if (!MEMORY || !encoder || !Number.isFinite(cp) || cp < 0 || cp > 0x10FFFF) return buf;
+    const bytes = encoder.encode(String.fromCodePoint(cp));
+    new Uint8Array(MEMORY.buffer).set(bytes, Number(buf) >>> 0);
+    return buf;
+}
 export function str_slice(strPtr, startSymbol, endSymbol) {
     // 1-indexed, endSymbol is inclusive
     const s = loadString(strPtr);
@@ -0,0 +1,204 @@
+#include <gtest/gtest.h>
+
+#include <qumir/ir/bytecode_cache.h>
+#include <qumir/ir/lowering/lower_ast.h>
+#include <qumir/modules/system/system.h>
+#include <qumir/parser/parser.h>
+#include <qumir/runner/runner_ir.h>
+#include <qumir/runtime/io.h>
+#include <qumir/semantics/transform/transform.h>
+
+#include <unistd.h>
+
+#include <chrono>
+#include <expected>
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace NQumir;
+namespace fs = std::filesystem;
+
+namespace {
+
+// Strings, a global, a user call and a packed builtin (sqrt).
+const char* Program = R"(цел сумма
+сумма := 0
+
+алг цел главный
+нач
+    цел i
+    нц для i от 1 до 4
+        сумма := сумма + квадрат(i)
+    кц
+    вывод "сумма = ", сумма, " корень = ", sqrt(сумма)
+    знач := сумма
+кон
+
+алг цел квадрат(цел х)
+нач
+    знач := х * х
+кон
+)";
+
+struct TCacheDir {
+    fs::path Dir = fs::temp_directory_path() / fs::path("qbccache-" + std::to_string(::getpid()) + "-" + std::to_string(rand()));
+    ~TCacheDir() { std::error_code ec; fs::remove_all(Dir, ec); }
+
+    std::vector<fs::path> Entries() const {
+        std::vector<fs::path> entries;
+        std::error_code ec;
+        for (const auto& e : fs::directory_iterator(Dir, ec)) {
+            entries.push_back(e.path());
+        }
+        return entries;
+    }
+};
+
+struct TRunResult {
+    std::string Output;
+    std::string Value;
+};
+
+std::expected<TRunResult, TError> TryRunCached(const std::string& program, const fs::path& cacheDir, TIRRunnerOptions options) {
+    std::ostringstream out;
+    NRuntime::SetOutputStream(&out);
+    NRuntime::SetInputStream(nullptr);
+    std::istringstream in;
+    std::istringstream src(program);
+    options.BytecodeCacheDir = cacheDir.string();
+    options.CompilerVersion = "test";
+    TIRRunner runner(out, in, std::move(options));
+    auto res = runner.Run(src);
+    if (!res) {
+        return std::unexpected(res.error());
+    }
+    return TRunResult{out.str(), *res ? **res : std::string{}};
+}
+
+TRunResult RunCached(const std::string& program, const fs::path& cacheDir, int optLevel = 0) {
+    auto res = TryRunCached(program, cacheDir, {.OptLevel = optLevel});
+    EXPECT_TRUE(res.has_value()) << (res ? "" : res.error().ToString());
+    return res.value_or(TRunResult{});
+}
+
+} // namespace
+
+TEST(BytecodeCache, SecondRunUsesTheStoredModule) {
+    TCacheDir dir;
+    auto first = RunCached(Program, dir.Dir);
+    EXPECT_EQ(first.Value, "30");
+    EXPECT_NE(first.Output.find("сумма = 30"), std::string::npos) << first.Output;
+
+    auto entries = dir.Entries();
+    ASSERT_EQ(entries.size(), 1u);
+    // A hit does not rewrite the entry.
+    const auto old = fs::file_time_type::clock::now() - std::chrono::hours(1);
+    fs::last_write_time(entries[0], old);
+
+    auto second = RunCached(Program, dir.Dir);
+    EXPECT_EQ(second.Value, first.Value);
+    EXPECT_EQ(second.Output, first.Output);
+    EXPECT_EQ(fs::last_write_time(entries[0]), old);
+}
+
+TEST(BytecodeCache, OptimizedModuleRoundTrips) {
+    TCacheDir dir;
+    auto first = RunCached(Program, dir.Dir, 1);
+    auto second = RunCached(Program, dir.Dir, 1);
+    EXPECT_EQ(first.Value, "30");
+    EXPECT_EQ(second.Output, first.Output);
+    // -O1 is a different key from -O0.
+    RunCached(Program, dir.Dir, 0);
+    EXPECT_EQ(dir.Entries().size(), 2u);
+}
+
+TEST(BytecodeCache, EditedSourceIsAMiss) {
+    TCacheDir dir;
+    RunCached(Program, dir.Dir);
+    std::string edited = Program;
+    const std::string bound = "до 4";
+    edited.replace(edited.find(bound), bound.size(), "до 5");
+    auto res = RunCached(edited, dir.Dir);
+    EXPECT_EQ(res.Value, "55");
+    EXPECT_EQ(dir.Entries().size(), 2u);
+}
+
+// The check only decides whether a program is accepted; an entry stored
+// without it must not let the same program through with it.
+TEST(BytecodeCache, DefiniteAssignmentIsPartOfTheKey) {
+    const char* unassigned = R"(алг цел главный
+нач
+    цел х
+    знач := х
+кон
+)";
+    TCacheDir dir;
+    EXPECT_TRUE(TryRunCached(unassigned, dir.Dir, {.RunDefiniteAssignment = false}).has_value());
+    EXPECT_FALSE(TryRunCached(unassigned, dir.Dir, {}).has_value());
+    EXPECT_EQ(dir.Entries().size(), 1u);
+}
+
+TEST(BytecodeCache, CorruptEntryIsRecompiled) {
+    TCacheDir dir;
+    RunCached(Program, dir.Dir);
+    auto entries = dir.Entries();
+    ASSERT_EQ(entries.size(), 1u);
+    fs::resize_file(entries[0], fs::file_size(entries[0]) / 2);
+
+    auto res = RunCached(Program, dir.Dir);
+    EXPECT_EQ(res.Value, "30");
+    // Rewritten in full by the miss.
+    EXPECT_EQ(RunCached(Program, dir.Dir).Value, "30");
+}
+
+TEST(BytecodeCache, SaveLoadPreservesModule) {
+    NSemantics::TNameResolver resolver;
+    NRegistry::SystemModule sys;
+    resolver.RegisterModule(&sys);
+    resolver.ImportModule(sys.Name());
+
+    std::istringstream in(Program);
+    NAst::TTokenStream ts(in);
+    NAst::TParser p;
+    auto parsed = p.parse(ts, &resolver);
+    ASSERT_TRUE(parsed);
+    auto expr = parsed.value();
+    ASSERT_TRUE(NTransform::Pipeline(expr, resolver));
+
+    NIR::TModule module;
+    NIR::TBuilder builder(module);
+    NIR::TAstLowerer lowerer(module, builder, resolver);
+    ASSERT_TRUE(lowerer.LowerTop(expr));
+
+    std::stringstream image;
+    NIR::SaveModule(image, module);
+
+    auto findPacked = [&](const std::string& name) -> NIR::TExternalFunction::TPacked {
+        for (const auto& fn : sys.ExternalFunctions()) {
+            if (fn.MangledName == name) {
+                return fn.Packed;
+            }
+        }
+        return nullptr;
+    };
+    auto loaded = NIR::LoadModule(image, findPacked);
+    ASSERT_TRUE(loaded) << loaded.error().ToString();
+
+    std::ostringstream before, after;
+    module.Print(before);
+    loaded->Print(after);
+    EXPECT_EQ(after.str(), before.str());
+    EXPECT_EQ(loaded->StringLiterals, module.StringLiterals);
+    EXPECT_EQ(loaded->StringLiteralsSet, module.StringLiteralsSet);
+    EXPECT_EQ(loaded->Types.Size(), module.Types.Size());
+
+    // Without the packed thunks of the builtins the image is unusable.
+    image.clear();
+    image.seekg(0);
+    auto unresolved = NIR::LoadModule(image, [](const std::string&) { return nullptr; });
+    ASSERT_FALSE(unresolved);
+    EXPECT_NE(unresolved.error().ToString().find("unknown builtin"), std::string::npos) << unresolved.error().ToString();
+}
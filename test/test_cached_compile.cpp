@@ -7,8 +7,12 @@
 
 #include <cstdint>
 #include <filesystem>
+#include <future>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace NQumir;
 namespace fs = std::filesystem;
@@ -144,6 +148,49 @@ TEST(CachedCompile, OverloadedCacheableReused) {
     EXPECT_EQ(CountObjects(cache.Dir), after); // both overloads were cache hits
 }
 
+// Runners on several threads share one JIT: each submits its kernel and the
+// JIT compiles them on its pool while the dependency object is linked once.
+TEST(CachedCompile, ConcurrentSubmissionsShareOneJit) {
+    TCacheDir cache;
+    std::string err;
+    auto warm = Compile(cache.Str(), Source, "kernel", &err);
+    ASSERT_FALSE(warm.Entries.empty()) << err;
+
+    auto jit = std::make_shared<NCodeGen::TLlvmRunner>(NCodeGen::TLlvmRunnerOptions{
+        .CompileThreads = 2,
+    });
+    constexpr int queries = 4;
+    std::vector<NCodeGen::TLlvmRunner::TLinkedModule> linked(queries);
+    {
+        std::vector<std::jthread> threads;
+        for (int i = 0; i < queries; ++i) {
+            threads.emplace_back([&, i] {
+                std::istringstream in(Source);
+                NAst::NCore::TTokenStream tokens(in);
+                auto parsed = NAst::NCore::TParser().Parse(tokens);
+                if (!parsed) {
+                    return;
+                }
+                TLLVMRunner runner({
+                    .NativeCode = true,
+                    .CoreInput = true,
+                    .ResolveCoreInput = true,
+                    .AllowOverloads = true,
+                    .OptLevel = 0,
+                    .Jit = jit,
+                });
+                linked[i] = runner.SubmitFusedKernelsCached(
+                    *parsed, {"kernel"}, cache.Str(), "v1", "k1").get();
+            });
+        }
+    }
+    for (auto& module : linked) {
+        ASSERT_FALSE(module.Entries.empty()) << module.Error;
+        EXPECT_EQ(reinterpret_cast<int64_t (*)()>(module.Entries["kernel"])(), 42);
+    }
+    EXPECT_EQ(CountObjects(cache.Dir), 1);
+}
+
 int main(int argc, char** argv) {
     NQumir::NCodeGen::TLLVMInitializer llvmInit;
     testing::InitGoogleTest(&argc, argv);
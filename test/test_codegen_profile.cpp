@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+
+#include <qumir/codegen/llvm/llvm_codegen.h>
+#include <qumir/codegen/llvm/llvm_initializer.h>
+#include <qumir/ir/lowering/lower_ast.h>
+#include <qumir/ir/passes/transforms/pipeline.h>
+#include <qumir/ir/pgo_profile.h>
+#include <qumir/modules/system/system.h>
+#include <qumir/parser/parser.h>
+#include <qumir/semantics/transform/transform.h>
+
+#include <regex>
+#include <sstream>
+#include <string>
+
+using namespace NQumir;
+using namespace NQumir::NIR::NLiterals;
+
+namespace {
+
+const char* Program = R"(алг цел цикл
+нач
+    цел ф, i
+    ф := 0
+    нц для i от 1 до 3
+        ф := ф + факториал(4)
+    кц
+    знач := ф
+кон
+
+алг цел факториал(цел число)
+нач
+    если число = 1
+    то
+        знач := 1
+    иначе
+        знач := число * факториал(число - 1)
+    все
+кон
+)";
+
+std::string BuildIR(const std::string& source, NIR::TModule& module) {
+    NSemantics::TNameResolver resolver;
+    NRegistry::SystemModule sys;
+    resolver.RegisterModule(&sys);
+    resolver.ImportModule(sys.Name());
+
+    std::istringstream ss(source);
+    NAst::TTokenStream ts(ss);
+    NAst::TParser p;
+    auto parsed = p.parse(ts, &resolver);
+    if (!parsed) {
+        return "Error: " + parsed.error().ToString();
+    }
+    auto expr = parsed.value();
+    auto error = NTransform::Pipeline(expr, resolver);
+    if (!error) {
+        return "Error: " + error.error().ToString();
+    }
+
+    NIR::TBuilder builder(module);
+    NIR::TAstLowerer lowerer(module, builder, resolver);
+    auto lowerRes = lowerer.LowerTop(expr);
+    if (!lowerRes) {
+        return "Error: " + lowerRes.error().ToString();
+    }
+    NIR::NPasses::Pipeline(module, 0, 1);
+    return {};
+}
+
+// The metadata node `!id` of the printed module.
+std::string Node(const std::string& ir, const std::string& id) {
+    std::smatch m;
+    if (!std::regex_search(ir, m, std::regex("\n!" + id + " = (![^\n]*)"))) {
+        return {};
+    }
+    return m[1];
+}
+
+} // namespace
+
+// Counts of a qumiri --profile-out run reach the LLVM IR: the entry count on
+// the function and the branch weights on the `cmp`, taken side first.
+TEST(CodegenProfile, EmitsEntryCountAndBranchWeights) {
+    NIR::TModule module;
+    ASSERT_EQ(BuildIR(Program, module), "");
+    auto* factorial = module.GetFunctionByName("факториал");
+    ASSERT_NE(factorial, nullptr);
+
+    const NIR::TBlock* branching = nullptr;
+    for (const auto& block : factorial->Blocks) {
+        if (!block.Instrs.empty() && block.Instrs.back().Op == "cmp"_op) {
+            branching = &block;
+        }
+    }
+    ASSERT_NE(branching, nullptr);
+    const auto& cmp = branching->Instrs.back();
+
+    NIR::TPgoProfile profile;
+    auto& counts = profile.Functions[factorial->SymId];
+    counts.Name = factorial->Name;
+    counts.EntryCount = 12;
+    counts.Branches[branching->Label.Idx] = {.Taken = 3, .NotTaken = 9};
+
+    NCodeGen::TLLVMCodeGenOptions opts;
+    opts.Profile = &profile;
+    NCodeGen::TLLVMCodeGen cg(opts);
+    auto artifacts = cg.Emit(module, 0);
+    std::ostringstream out;
+    artifacts->PrintModule(out);
+    const auto ir = out.str();
+
+    std::smatch m;
+    const auto br = "br i1 %[^,]+, label %bb" + std::to_string(cmp.Operands[1].Label.Idx)
+        + ", label %bb" + std::to_string(cmp.Operands[2].Label.Idx) + ", !prof !([0-9]+)";
+    ASSERT_TRUE(std::regex_search(ir, m, std::regex(br))) << ir;
+    EXPECT_EQ(Node(ir, m[1]), "!{!\"branch_weights\", i32 3, i32 9}") << ir;
+
+    // Only факториал is in the profile.
+    ASSERT_TRUE(std::regex_search(ir, m, std::regex("define [^\n]*!prof !([0-9]+) \\{"))) << ir;
+    EXPECT_EQ(Node(ir, m[1]), "!{!\"function_entry_count\", i64 12}") << ir;
+    EXPECT_NE(ir.find("ProfileSummary"), std::string::npos) << ir;
+}
+
+int main(int argc, char** argv) {
+    NQumir::NCodeGen::TLLVMInitializer llvmInit;
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
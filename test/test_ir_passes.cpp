@@ -0,0 +1,1048 @@
+#include <gtest/gtest.h>
+
+#include <qumir/parser/parser.h>
+#include <qumir/semantics/transform/transform.h>
+#include <qumir/modules/system/system.h>
+#include <qumir/ir/lowering/lower_ast.h>
+#include <qumir/ir/passes/analysis/cfg.h>
+#include <qumir/ir/passes/analysis/dominators.h>
+#include <qumir/ir/passes/analysis/loops.h>
+#include <qumir/ir/passes/transforms/bounds_checks.h>
+#include <qumir/ir/passes/transforms/dce.h>
+#include <qumir/ir/passes/transforms/gvn.h>
+#include <qumir/ir/passes/transforms/inline.h>
+#include <qumir/ir/passes/transforms/licm.h>
+#include <qumir/ir/passes/transforms/locals2ssa.h>
+#include <qumir/ir/passes/transforms/ownership.h>
+#include <qumir/ir/passes/transforms/pipeline.h>
+#include <qumir/ir/passes/transforms/sccp.h>
+#include <qumir/ir/passes/transforms/strength_reduce.h>
+#include <qumir/ir/eval.h>
+#include <qumir/ir/vmcompiler.h>
+#include <qumir/runner/runner_ir.h>
+#include <qumir/runtime/context.h>
+
+#include <set>
+#include <sstream>
+
+using namespace NQumir;
+using namespace NQumir::NIR;
+using namespace NQumir::NIR::NPasses;
+using namespace NQumir::NIR::NLiterals;
+
+namespace {
+
+// TODO: move to utils
+std::string BuildIR(const std::string& source, NIR::TModule& module, NIR::TLowerOptions options = {}) {
+    NSemantics::TNameResolver resolver;
+    NRegistry::SystemModule sys;
+    resolver.RegisterModule(&sys);
+    resolver.ImportModule(sys.Name());
+
+    std::istringstream ss(source);
+    NAst::TTokenStream ts(ss);
+    NAst::TParser p;
+    auto parsed = p.parse(ts, &resolver);
+    if (!parsed) {
+        return "Error: " + parsed.error().ToString() + "\n";
+    }
+
+    auto expr = parsed.value();
+    auto error = NTransform::Pipeline(expr, resolver);
+    if (!error) {
+        return "Error: " + error.error().ToString() + "\n";
+    }
+
+    NIR::TBuilder builder(module);
+    NIR::TAstLowerer lowerer(module, builder, resolver, options);
+    auto lowerRes = lowerer.LowerTop(expr);
+    if (!lowerRes) {
+        return "Error: " + lowerRes.error().ToString() + "\n";
+    }
+
+    std::ostringstream out;
+    module.Print(out);
+    return out.str();
+}
+
+int CountOps(const TFunction& function, TOp op) {
+    int count = 0;
+    for (const auto& block : function.Blocks) {
+        for (const auto& phi : block.Phis) {
+            count += phi.Op == op;
+        }
+        for (const auto& instr : block.Instrs) {
+            count += instr.Op == op;
+        }
+    }
+    return count;
+}
+
+int CountOpsInLoops(TFunction& function, TOp op) {
+    auto tree = BuildDominatorTree(function);
+    auto nest = FindLoops(function, tree);
+    int count = 0;
+    for (int i = 0; i < (int)function.Blocks.size(); ++i) {
+        if (nest.BlockLoop[i] < 0) {
+            continue;
+        }
+        for (const auto& instr : function.Blocks[i].Instrs) {
+            count += instr.Op == op;
+        }
+    }
+    return count;
+}
+
+int CountCalls(const TFunction& function, const TModule& module, const std::string& callee) {
+    const auto* target = const_cast<TModule&>(module).GetFunctionByName(callee);
+    int count = 0;
+    for (const auto& block : function.Blocks) {
+        for (const auto& instr : block.Instrs) {
+            count += instr.Op == "call"_op && target && instr.Operands[0].Imm.Value == target->SymId;
+        }
+    }
+    return count;
+}
+
+int CountExternalCalls(const TFunction& function, const TModule& module, const std::string& mangledName) {
+    int count = 0;
+    for (const auto& block : function.Blocks) {
+        for (const auto& instr : block.Instrs) {
+            if (instr.Op != "call"_op) {
+                continue;
+            }
+            auto it = module.SymIdToExtFuncIdx.find(instr.Operands[0].Imm.Value);
+            count += it != module.SymIdToExtFuncIdx.end()
+                && module.ExternalFunctions[it->second].MangledName == mangledName;
+        }
+    }
+    return count;
+}
+
+std::string RunAt(const std::string& source, int optLevel, bool boundsChecks = false, int threads = 1) {
+    NRuntime::TRuntimeContext context;
+    std::ostringstream out;
+    context.Io.StdOut = context.Io.Out = &out;
+    std::istringstream in;
+    std::istringstream src(source);
+    TIRRunner runner(out, in, TIRRunnerOptions{.OptLevel = optLevel, .BoundsChecks = boundsChecks, .Threads = threads, .RuntimeContext = &context});
+    auto res = runner.Run(src);
+    if (!res) {
+        return "Error: " + res.error().ToString();
+    }
+    return out.str() + res->value_or("");
+}
+
+TFunction& FunctionByName(TModule& module, const std::string& name) {
+    auto* function = module.GetFunctionByName(name);
+    EXPECT_NE(function, nullptr) << name;
+    return *function;
+}
+
+} // namespace
+
+TEST(IrPassesTest, DominatorTree) {
+    const std::string s = R"(
+алг
+нач
+    цел ф
+    ф := 0
+    нц пока ф < 10
+        ф := ф + 1
+    кц
+кон
+    )";
+
+    NIR::TModule module;
+    BuildIR(s, module);
+    ASSERT_EQ(module.Functions.size(), 1);
+    auto& function = module.Functions[0];
+    auto tree = BuildDominatorTree(function);
+
+    // entry -> header <-> body, header -> exit (see CfgTest.Basic)
+    EXPECT_EQ(tree.RPO.size(), function.Blocks.size());
+    EXPECT_EQ(tree.IDom[0], -1);
+    EXPECT_EQ(tree.IDom[1], 0);
+    EXPECT_EQ(tree.IDom[2], 1);
+    EXPECT_EQ(tree.IDom[3], 1);
+    EXPECT_TRUE(tree.Dominates(0, 3));
+    EXPECT_TRUE(tree.Dominates(1, 2));
+    EXPECT_TRUE(tree.Dominates(2, 2));
+    EXPECT_FALSE(tree.Dominates(2, 3));
+    EXPECT_FALSE(tree.Dominates(2, 1));
+}
+
+TEST(IrPassesTest, GvnRemovesRepeatedExpression) {
+    const std::string s = R"(
+алг цел ф(цел а, цел б)
+нач
+    знач := (а * б + 1) * (а * б + 1)
+кон
+    )";
+
+    NIR::TModule module;
+    BuildIR(s, module);
+    auto& function = FunctionByName(module, "ф");
+    PromoteLocalsToSSA(function, module);
+    EXPECT_EQ(CountOps(function, "*"_op), 3);
+    EXPECT_EQ(CountOps(function, "load"_op), 4);
+
+    GlobalValueNumbering(function, module);
+    function.Print(std::cout, module);
+    // Both loads of each argument and then a * b + 1 are shared.
+    EXPECT_EQ(CountOps(function, "load"_op), 2);
+    EXPECT_EQ(CountOps(function, "*"_op), 2);
+    EXPECT_EQ(CountOps(function, "+"_op), 1);
+}
+
+TEST(IrPassesTest, GvnKeepsLoadsAcrossWrites) {
+    const std::string s = R"(
+цел г
+г := 1
+
+алг цел ф
+нач
+    цел x, y
+    x := г + г
+    изменить
+    y := г
+    знач := x + y
+кон
+
+алг изменить
+нач
+    г := г + 1
+кон
+    )";
+
+    NIR::TModule module;
+    BuildIR(s, module);
+    auto& function = FunctionByName(module, "ф");
+    PromoteLocalsToSSA(function, module);
+    EXPECT_EQ(CountOps(function, "load"_op), 3);
+
+    GlobalValueNumbering(function, module);
+    function.Print(std::cout, module);
+    // The second read of г before the call is shared, the one after it is not.
+    EXPECT_EQ(CountOps(function, "load"_op), 2);
+}
+
+TEST(IrPassesTest, GvnIsDominatorScoped) {
+    const std::string s = R"(
+алг цел ф(цел а, цел б)
+нач
+    цел x
+    x := а * б
+    если а > 0 то
+        x := x + а * б
+    иначе
+        x := x - а * б
+    все
+    знач := x
+кон
+    )";
+
+    NIR::TModule module;
+    BuildIR(s, module);
+    auto& function = FunctionByName(module, "ф");
+    PromoteLocalsToSSA(function, module);
+    EXPECT_EQ(CountOps(function, "*"_op), 3);
+
+    GlobalValueNumbering(function, module);
+    function.Print(std::cout, module);
+    // Arguments are never written, so the branches reuse their loads and
+    // the product from the entry block.
+    EXPECT_EQ(CountOps(function, "load"_op), 2);
+    EXPECT_EQ(CountOps(function, "*"_op), 1);
+}
+
+TEST(IrPassesTest, DceRemovesUnusedValuesAndPhis) {
+    const std::string s = R"(
+алг цел ф(цел а)
+нач
+    цел i, мусор, y
+    мусор := 0
+    y := а * 7
+    нц для i от 1 до а
+        мусор := мусор + i * 3
+    кц
+    знач := а
+кон
+    )";
+
+    NIR::TModule module;
+    BuildIR(s, module);
+    auto& function = FunctionByName(module, "ф");
+    PromoteLocalsToSSA(function, module);
+    const int phisBefore = CountOps(function, "phi"_op);
+    ASSERT_GE(phisBefore, 2);
+    const int mulsBefore = CountOps(function, "*"_op);
+
+    EliminateDeadCode(function, module);
+    function.Print(std::cout, module);
+    // а * 7 and i * 3 are gone, the loop exit test keeps its own product.
+    EXPECT_EQ(CountOps(function, "*"_op), mulsBefore - 2);
+    // Only the loop counter's phi is left: it feeds the exit test.
+    EXPECT_EQ(CountOps(function, "phi"_op), 1);
+    EXPECT_EQ(CountOps(function, "ret"_op), 1);
+}
+
+TEST(IrPassesTest, LoopNest) {
+    const std::string s = R"(
+алг цел ф(цел n)
+нач
+    цел i, j, s
+    s := 0
+    нц для i от 1 до n
+        нц для j от 1 до n
+            s := s + i * j
+        кц
+    кц
+    нц пока s > 100
+        s := s - 100
+    кц
+    знач := s
+кон
+    )";
+
+    NIR::TModule module;
+    BuildIR(s, module);
+    auto& function = FunctionByName(module, "ф");
+    auto tree = BuildDominatorTree(function);
+    auto nest = FindLoops(function, tree);
+    ASSERT_EQ(nest.Loops.size(), 3);
+
+    int outer = -1, inner = -1, second = -1;
+    for (int i = 0; i < (int)nest.Loops.size(); ++i) {
+        const auto& loop = nest.Loops[i];
+        EXPECT_GE(loop.Preheader, 0);
+        EXPECT_FALSE(loop.Contains(loop.Preheader));
+        EXPECT_EQ(loop.Latches.size(), 1);
+        if (loop.Depth == 2) {
+            inner = i;
+        } else if (outer < 0 || nest.Loops[outer].Blocks.size() < loop.Blocks.size()) {
+            second = outer;
+            outer = i;
+        } else {
+            second = i;
+        }
+    }
+    ASSERT_GE(outer, 0);
+    ASSERT_GE(inner, 0);
+    ASSERT_GE(second, 0);
+    EXPECT_EQ(nest.Loops[inner].Parent, outer);
+    EXPECT_EQ(nest.Loops[second].Parent, -1);
+    EXPECT_LT(outer, inner);
+    EXPECT_EQ(nest.BlockLoop[nest.Loops[inner].Header], inner);
+    EXPECT_EQ(nest.BlockLoop[nest.Loops[outer].Header], outer);
+    EXPECT_EQ(nest.BlockLoop[0], -1);
+    for (int block : nest.Loops[inner].Blocks) {
+        EXPECT_TRUE(nest.Loops[outer].Contains(block));
+        EXPECT_FALSE(nest.Loops[second].Contains(block));
+    }
+}
+
+TEST(IrPassesTest, LicmHoistsArrayLayoutLoads) {
+    const std::string s = R"(
+цел таб а[1:10, 1:10]
+
+алг цел ф
+нач
+    цел i, j, s
+    s := 0
+    нц для i от 1 до 10
+        нц для j от 1 до 10
+            s := s + а[i, j]
+            вывод s
+        кц
+    кц
+    знач := s
+кон
+    )";
+
+    NIR::TModule module;
+    BuildIR(s, module);
+    auto& function = FunctionByName(module, "ф");
+    PromoteLocalsToSSA(function, module);
+    ASSERT_GT(CountOpsInLoops(function, "load"_op), 0);
+
+    HoistLoopInvariants(function, module);
+    function.Print(std::cout, module);
+    // Bounds, strides and the array pointer live in globals nothing in the
+    // loop can write: the runtime calls of вывод do not see them.
+    EXPECT_EQ(CountOpsInLoops(function, "load"_op), 0);
+}
+
+TEST(IrPassesTest, LicmKeepsLoadsClobberedInLoop) {
+    const std::string s = R"(
+цел г
+г := 1
+
+алг цел ф
+нач
+    цел i, s
+    s := 0
+    нц для i от 1 до 10
+        s := s + г * 2
+        изменить
+    кц
+    знач := s
+кон
+
+алг изменить
+нач
+    г := г + 1
+кон
+    )";
+
+    NIR::TModule module;
+    BuildIR(s, module);
+    auto& function = FunctionByName(module, "ф");
+    PromoteLocalsToSSA(function, module);
+    const int loads = CountOpsInLoops(function, "load"_op);
+    const int muls = CountOpsInLoops(function, "*"_op);
+    ASSERT_GT(loads, 0);
+
+    HoistLoopInvariants(function, module);
+    function.Print(std::cout, module);
+    EXPECT_EQ(CountOpsInLoops(function, "load"_op), loads);
+    EXPECT_EQ(CountOpsInLoops(function, "*"_op), muls);
+}
+
+const char* InlineProgram = R"(
+алг цел главный
+нач
+    цел i, s
+    s := 0
+    нц для i от -3 до 3
+        s := s + квадрат(i) + модуль(i)
+    кц
+    вывод факториал(5), нс
+    знач := s
+кон
+
+алг цел квадрат(цел x)
+нач
+    знач := x * x
+кон
+
+алг цел модуль(цел x)
+нач
+    если x < 0 то
+        знач := -x
+        выход
+    все
+    знач := x
+кон
+
+алг цел факториал(цел n)
+нач
+    если n <= 1 то
+        знач := 1
+    иначе
+        знач := n * факториал(n - 1)
+    все
+кон
+)";
+
+TEST(IrPassesTest, InlinerReplacesSmallCalls) {
+    NIR::TModule module;
+    BuildIR(InlineProgram, module);
+    auto& main = FunctionByName(module, "главный");
+    ASSERT_EQ(CountCalls(main, module, "квадрат"), 1);
+    ASSERT_EQ(CountCalls(main, module, "модуль"), 1);
+
+    InlineFunctions(module, InlineOptionsForLevel(1));
+    main.Print(std::cout, module);
+    EXPECT_EQ(CountCalls(main, module, "квадрат"), 0);
+    // Early exit: two rets in the callee.
+    EXPECT_EQ(CountCalls(main, module, "модуль"), 0);
+    // One level of the recursion is copied, the call inside it stays.
+    EXPECT_EQ(CountCalls(main, module, "факториал"), 1);
+    auto& factorial = FunctionByName(module, "факториал");
+    EXPECT_EQ(CountCalls(factorial, module, "факториал"), 1);
+
+    // Nothing is inlined at -O0.
+    NIR::TModule module0;
+    BuildIR(InlineProgram, module0);
+    InlineFunctions(module0, InlineOptionsForLevel(0));
+    EXPECT_EQ(CountCalls(FunctionByName(module0, "главный"), module0, "квадрат"), 1);
+}
+
+TEST(IrPassesTest, InlinedProgramComputesTheSame) {
+    const auto expected = RunAt(InlineProgram, 0);
+    EXPECT_EQ(expected, "120\n40");
+    EXPECT_EQ(RunAt(InlineProgram, 1), expected);
+    EXPECT_EQ(RunAt(InlineProgram, 3), expected);
+}
+
+TEST(IrPassesTest, SccpRemovesConstantBranches) {
+    const std::string s = R"(
+алг цел ф(цел а)
+нач
+    цел режим, x
+    режим := 2
+    выбор
+        при режим = 1:
+            x := а * 10
+        при режим = 2:
+            x := а + 5
+        иначе x := -1
+    все
+    если режим > 1 то
+        x := x + 1
+    все
+    знач := x
+кон
+    )";
+
+    NIR::TModule module;
+    BuildIR(s, module);
+    auto& function = FunctionByName(module, "ф");
+    PromoteLocalsToSSA(function, module);
+    const auto blocksBefore = function.Blocks.size();
+    const auto cmpsBefore = CountOps(function, "cmp"_op);
+
+    PropagateConstants(function, module);
+    function.Print(std::cout, module);
+    // Every test is on режим: no branches and no other arms of выбор left.
+    EXPECT_GT(cmpsBefore, 0);
+    EXPECT_EQ(CountOps(function, "cmp"_op), 0);
+    EXPECT_LT(function.Blocks.size(), blocksBefore);
+    EXPECT_EQ(CountOps(function, "*"_op), 0);
+    EXPECT_EQ(CountOps(function, "neg"_op), 0);
+}
+
+TEST(IrPassesTest, SccpMeetsOnlyExecutableEdges) {
+    const std::string s = R"(
+алг цел ф
+нач
+    цел i, x
+    x := 7
+    нц для i от 1 до 10
+        если x <> 7 то
+            x := i
+        все
+    кц
+    знач := x * 2
+кон
+    )";
+
+    NIR::TModule module;
+    BuildIR(s, module);
+    auto& function = FunctionByName(module, "ф");
+    PromoteLocalsToSSA(function, module);
+
+    PropagateConstants(function, module);
+    function.Print(std::cout, module);
+    // x only merges with itself around the loop, so x * 2 is 14.
+    EXPECT_EQ(CountOps(function, "*"_op), 0);
+    bool returnsConstant = false;
+    for (const auto& block : function.Blocks) {
+        for (const auto& instr : block.Instrs) {
+            if (instr.Op == "ret"_op && instr.Operands[0].Type == TOperand::EType::Imm) {
+                returnsConstant |= instr.Operands[0].Imm.Value == 14;
+            }
+        }
+    }
+    EXPECT_TRUE(returnsConstant);
+}
+
+TEST(IrPassesTest, SccpFoldsConstantGlobals) {
+    const std::string s = R"(
+цел размер, счет
+размер := 8
+счет := 0
+
+алг цел ф
+нач
+    счет := счет + 1
+    знач := размер * размер + счет
+кон
+    )";
+
+    NIR::TModule module;
+    BuildIR(s, module);
+    auto& function = FunctionByName(module, "ф");
+    PromoteLocalsToSSA(function, module);
+    EXPECT_EQ(CountOps(function, "load"_op), 4);
+
+    PropagateConstants(function, module);
+    function.Print(std::cout, module);
+    // размер is set once before anything runs; счет is written again.
+    EXPECT_EQ(CountOps(function, "load"_op), 2);
+    EXPECT_EQ(CountOps(function, "*"_op), 0);
+}
+
+TEST(IrPassesTest, SccpFoldsOnlyGlobalsSetBeforeTheirReaders) {
+    const std::string s = R"(
+цел g, h
+
+алг главный
+нач
+    h := 7
+    вывод читать, нс
+    задать
+    вывод читать, нс
+кон
+
+алг задать
+нач
+    g := 5
+кон
+
+алг цел читать
+нач
+    знач := g + h
+кон
+    )";
+
+    NIR::TModule module;
+    BuildIR(s, module);
+    auto& reader = FunctionByName(module, "читать");
+    PromoteLocalsToSSA(reader, module);
+    PropagateConstants(reader, module);
+    reader.Print(std::cout, module);
+    // h is set at the top of the entry point; the first read of g comes
+    // before задать runs.
+    EXPECT_EQ(CountOps(reader, "load"_op), 1);
+
+    for (int optLevel : {0, 1, 3}) {
+        EXPECT_EQ(RunAt(s, optLevel), "7\n12\n");
+    }
+}
+
+const char* SccpProgram = R"(
+цел коэф
+коэф := 3
+
+алг главный
+нач
+    цел i, s, режим
+    режим := 1
+    s := 0
+    нц для i от 1 до 10
+        если режим = 1 то
+            s := s + i * коэф
+        иначе
+            s := s - i
+        все
+    кц
+    вывод s, нс
+    вывод div(7, 2), " ", mod(7, 3), " ", 1.5 / 2, нс
+кон
+)";
+
+TEST(IrPassesTest, SccpProgramComputesTheSame) {
+    const auto expected = RunAt(SccpProgram, 0);
+    EXPECT_EQ(expected, "165\n3 1 0.75\n");
+    EXPECT_EQ(RunAt(SccpProgram, 1), expected);
+    EXPECT_EQ(RunAt(SccpProgram, 3), expected);
+}
+
+TEST(IrPassesTest, BoundsChecksFollowLoopCounters) {
+    const std::string s = R"(
+алг цел ф
+нач
+    цел таб а[1:100]
+    цел i, s
+    s := 0
+    нц для i от 1 до 100
+        а[i] := i
+    кц
+    нц для i от 100 до 1 шаг -1
+        s := s + а[i]
+    кц
+    знач := s
+кон
+
+алг цел г(цел n)
+нач
+    цел таб а[1:n]
+    цел i
+    если n >= 1 то
+        если n <= 1000 то
+            нц для i от 1 до n
+                а[i] := 0
+                а[i + 1] := i
+            кц
+        все
+    все
+    знач := а[1]
+кон
+
+алг цел х(цел n)
+нач
+    цел таб а[1:n]
+    цел i
+    нц для i от 1 до n
+        а[i] := i
+    кц
+    знач := 0
+кон
+    )";
+
+    NIR::TModule module;
+    BuildIR(s, module, {.BoundsChecks = true});
+    auto& f = FunctionByName(module, "ф");
+    auto& g = FunctionByName(module, "г");
+    auto& h = FunctionByName(module, "х");
+    EXPECT_EQ(CountOps(f, "bounds"_op), 2);
+    EXPECT_EQ(CountOps(g, "bounds"_op), 3);
+    EXPECT_EQ(CountOps(h, "bounds"_op), 1);
+
+    for (auto* function : {&f, &g, &h}) {
+        PromoteLocalsToSSA(*function, module);
+        PropagateConstants(*function, module);
+        GlobalValueNumbering(*function, module);
+        EliminateBoundsChecks(*function, module);
+    }
+    g.Print(std::cout, module);
+    EXPECT_EQ(CountOps(f, "bounds"_op), 0);
+    // а[i + 1] runs past the end on the last iteration, and а[1] after the
+    // ifs does not know the array is not empty.
+    EXPECT_EQ(CountOps(g, "bounds"_op), 2);
+    // With n near the i64 minimum `n - i` wraps and the loop runs.
+    EXPECT_EQ(CountOps(h, "bounds"_op), 1);
+}
+
+TEST(IrPassesTest, BoundsChecksKeepIndexThatMayWrap) {
+    const std::string s = R"(
+алг
+нач
+    вывод к(10, 6), нс
+    вывод п(10, 9223372036854775805), нс
+кон
+
+алг цел п(цел n, цел i)
+нач
+    цел таб а[0:n-1]
+    знач := 0
+    если i >= 0 то
+        если i + 3 < n то
+            знач := а[i + 3]
+        все
+    все
+кон
+
+алг цел к(цел n, цел i)
+нач
+    цел таб а[0:n-1]
+    знач := 0
+    если i >= 0 то
+        если i <= 1000 то
+            если i + 3 < n то
+                знач := а[i + 3]
+            все
+        все
+    все
+кон
+    )";
+
+    NIR::TModule module;
+    BuildIR(s, module, {.BoundsChecks = true});
+    auto& p = FunctionByName(module, "п");
+    auto& k = FunctionByName(module, "к");
+    for (auto* function : {&p, &k}) {
+        PromoteLocalsToSSA(*function, module);
+        PropagateConstants(*function, module);
+        GlobalValueNumbering(*function, module);
+        EliminateBoundsChecks(*function, module);
+    }
+    // i + 3 wraps to a negative index for i close to the i64 maximum.
+    EXPECT_EQ(CountOps(p, "bounds"_op), 1);
+    EXPECT_EQ(CountOps(k, "bounds"_op), 0);
+
+    for (int optLevel : {0, 1}) {
+        EXPECT_NE(RunAt(s, optLevel, true).find("array index out of bounds"), std::string::npos);
+    }
+}
+
+TEST(IrPassesTest, BoundsChecksReportBadIndex) {
+    const std::string good = R"(
+алг
+нач
+    цел таб а[0:4]
+    цел i
+    нц для i от 0 до 4
+        а[i] := i * i
+    кц
+    вывод а[4], нс
+кон
+    )";
+    const std::string bad = R"(
+алг
+нач
+    цел таб а[0:4]
+    цел i
+    нц для i от 0 до 5
+        а[i] := i
+    кц
+    вывод а[0], нс
+кон
+    )";
+
+    for (int optLevel : {0, 1}) {
+        EXPECT_EQ(RunAt(good, optLevel, true), "16\n");
+        EXPECT_NE(RunAt(bad, optLevel, true).find("array index out of bounds"), std::string::npos);
+    }
+}
+
+const char* StrengthReductionProgram = R"(
+алг цел ф(цел n)
+нач
+    цел таб а[1:n, 1:n], б[1:n, 1:n]
+    цел i, k, s
+    нц для i от 1 до n
+        нц для k от 1 до n
+            а[i, k] := i + k
+            б[k, i] := i - k
+        кц
+    кц
+    s := 0
+    нц для i от 1 до n
+        нц для k от 2 до n
+            s := s + а[i, k] * б[k, i] - а[i, k - 1]
+        кц
+    кц
+    знач := s
+кон
+
+алг главный
+нач
+    вывод ф(5), " ", ф(9), нс
+кон
+)";
+
+TEST(IrPassesTest, StrengthReductionRemovesIndexArithmetic) {
+    NIR::TModule module;
+    BuildIR(StrengthReductionProgram, module);
+    auto& function = FunctionByName(module, "ф");
+    PromoteLocalsToSSA(function, module);
+    PropagateConstants(function, module);
+    GlobalValueNumbering(function, module);
+    HoistLoopInvariants(function, module);
+
+    // Integer multiplications left in the innermost loops.
+    auto innerMuls = [&]() {
+        auto tree = BuildDominatorTree(function);
+        auto nest = FindLoops(function, tree);
+        int count = 0;
+        for (int i = 0; i < (int)function.Blocks.size(); ++i) {
+            const int loop = nest.BlockLoop[i];
+            if (loop < 0 || nest.Loops[loop].Depth < 2) {
+                continue;
+            }
+            for (const auto& instr : function.Blocks[i].Instrs) {
+                count += instr.Op == '*'_op
+                    && module.Types.GetKind(function.GetType(instr.Dest)) == EKind::I64;
+            }
+        }
+        return count;
+    };
+    // а[i, k], б[k, i] twice: the row length of б is only known at run time.
+    ASSERT_GE(innerMuls(), 4);
+
+    ReduceStrength(function, module);
+    EliminateDeadCode(function, module);
+    function.Print(std::cout, module);
+    // What remains is the product of the elements.
+    EXPECT_EQ(innerMuls(), 1);
+}
+
+TEST(IrPassesTest, StrengthReducedProgramComputesTheSame) {
+    const auto expected = RunAt(StrengthReductionProgram, 0);
+    EXPECT_EQ(expected, "-160 -960\n");
+    EXPECT_EQ(RunAt(StrengthReductionProgram, 1), expected);
+    EXPECT_EQ(RunAt(StrengthReductionProgram, 3), expected);
+}
+
+const char* OwnershipProgram = R"(
+алг лит повтор(лит а, цел n)
+нач
+    цел i
+    знач := ""
+    нц для i от 1 до n
+        знач := знач + а
+    кц
+кон
+
+алг главный
+нач
+    лит s, t
+    цел i
+    s := ""
+    нц для i от 1 до 3
+        s := s + "ab"
+        s := s + "!"
+        s := s + s
+    кц
+    t := s
+    t[1] := "z"
+    s := s + "."
+    вывод длин(s), " ", s, " ", t, нс
+    вывод повтор("xy", 3), " ", s = "ab!", нс
+кон
+)";
+
+TEST(IrPassesTest, OwnershipPassAppendsInPlace) {
+    NIR::TModule module;
+    BuildIR(OwnershipProgram, module);
+    auto& function = FunctionByName(module, "главный");
+    PromoteLocalsToSSA(function, module);
+    ASSERT_EQ(CountExternalCalls(function, module, "str_concat"), 4);
+    const int releases = CountExternalCalls(function, module, "str_release");
+
+    OptimizeOwnership(function, module);
+    function.Print(std::cout, module);
+    // Every `s := s + x` appends, the "!" and "." temporaries live in the
+    // frame, and so does the literal compared with s.
+    EXPECT_EQ(CountExternalCalls(function, module, "str_concat"), 0);
+    EXPECT_EQ(CountExternalCalls(function, module, "str_append"), 4);
+    EXPECT_EQ(CountExternalCalls(function, module, "str_from_unicode"), 0);
+    EXPECT_EQ(CountExternalCalls(function, module, "str_init_unicode"), 2);
+    EXPECT_EQ(CountExternalCalls(function, module, "str_init_lit"), 1);
+    EXPECT_EQ(CountOps(function, "salloc"_op), 3);
+    // The old values of s, the temporaries, str_release(nullptr) for the
+    // first assignment.
+    EXPECT_EQ(CountExternalCalls(function, module, "str_release"), releases - 8);
+    // t := s keeps its retain: t[1] := "z" must see two holders.
+    EXPECT_EQ(CountExternalCalls(function, module, "str_retain"), 1);
+}
+
+TEST(IrPassesTest, OwnershipPassPairsRetainAndRelease) {
+    NIR::TModule module;
+    BuildIR(OwnershipProgram, module);
+    auto& function = FunctionByName(module, "повтор");
+    PromoteLocalsToSSA(function, module);
+    // знач is retained for the caller and then released with the locals.
+    ASSERT_EQ(CountExternalCalls(function, module, "str_retain"), 1);
+
+    OptimizeOwnership(function, module);
+    function.Print(std::cout, module);
+    EXPECT_EQ(CountExternalCalls(function, module, "str_retain"), 0);
+}
+
+TEST(IrPassesTest, OwnershipOptimizedProgramComputesTheSame) {
+    const auto expected = RunAt(OwnershipProgram, 0);
+    EXPECT_EQ(expected,
+        "43 ab!ab!ab!ab!ab!ab!ab!ab!ab!ab!ab!ab!ab!ab!. zb!ab!ab!ab!ab!ab!ab!ab!ab!ab!ab!ab!ab!ab!\n"
+        "xyxyxy нет\n");
+    EXPECT_EQ(RunAt(OwnershipProgram, 1), expected);
+    EXPECT_EQ(RunAt(OwnershipProgram, 2), expected);
+}
+
+TEST(IrPassesTest, ParallelPipelineGivesTheSameCode) {
+    for (const char* program : {InlineProgram, SccpProgram, StrengthReductionProgram, OwnershipProgram}) {
+        for (int optLevel : {0, 2}) {
+            std::string printed[2];
+            for (int threads : {1, 4}) {
+                NIR::TModule module;
+                BuildIR(program, module);
+                if (optLevel > 0) {
+                    Pipeline(module, optLevel, threads);
+                } else {
+                    Cleanup(module, threads);
+                }
+                std::ostringstream out;
+                module.Print(out);
+                printed[threads > 1] = out.str();
+            }
+            EXPECT_EQ(printed[0], printed[1]) << "-O" << optLevel << "\n" << program;
+
+            // With threads, every function is compiled to bytecode before the run.
+            EXPECT_EQ(RunAt(program, optLevel, false, 4), RunAt(program, optLevel));
+        }
+    }
+}
+
+TEST(IrPassesTest, VmRegistersAreShared) {
+    const std::string s = R"(
+алг цел ф(цел x)
+нач
+    цел s
+    s := x
+    s := s * x + 1
+    s := s * x + 2
+    s := s * x + 3
+    s := s * x + 4
+    s := s * x + 5
+    s := s * x + 6
+    s := s * x + 7
+    s := s * x + 8
+    знач := s
+кон
+    )";
+
+    NIR::TModule module;
+    BuildIR(s, module);
+    auto& function = FunctionByName(module, "ф");
+    TVMCompiler compiler(module);
+    const auto& exec = compiler.Compile(function);
+    // Each statement loads, multiplies, adds and stores through its own
+    // tmps, but none of them outlives the statement.
+    EXPECT_GT(function.NextTmpIdx, 30);
+    EXPECT_LE(exec.MaxTmpIdx, 4);
+}
+
+TEST(IrPassesTest, VmStructResultsKeepTheirStorage) {
+    NIR::TModule module;
+    NIR::TBuilder b(module);
+    const int i64 = module.Types.I(EKind::I64);
+    const int pairType = module.Types.Struct({i64, i64});
+    const int i64Ptr = module.Types.Ptr(i64);
+    const int pairFunc = module.Types.Func({i64}, pairType);
+    auto emit = [&](TOp op, std::initializer_list<TOperand> operands, int typeId) {
+        auto tmp = b.Emit1(op, operands);
+        b.SetType(tmp, typeId);
+        return tmp;
+    };
+
+    // pair(x) = {x, 10 * x}
+    b.NewFunction("pair", {TLocal{0}}, 1);
+    b.SetType(TLocal{0}, i64);
+    b.SetReturnType(pairType);
+    auto result = b.AllocLocal(pairType);
+    auto x = emit("load"_op, {TLocal{0}}, i64);
+    auto first = emit("lea"_op, {result}, i64Ptr);
+    b.Emit0("ste"_op, {first, x});
+    auto second = emit('+'_op, {first, TImm{8, i64}}, i64Ptr);
+    b.Emit0("ste"_op, {second, emit('*'_op, {x, TImm{10, i64}}, i64)});
+    b.Emit0("ret"_op, {emit("load"_op, {result}, pairType)});
+
+    // pair(1).first + pair(2).second + pair(3).first: the first result is
+    // read before the next call, the other two are alive at the same time.
+    b.NewFunction("main", {}, 2);
+    b.SetReturnType(i64);
+    auto call = [&](int64_t arg) {
+        b.Emit0("arg"_op, {TImm{arg, i64}});
+        return emit("call"_op, {TImm{1, pairFunc}}, pairType);
+    };
+    auto a = emit("lde"_op, {call(1)}, i64);
+    auto p2 = call(2);
+    auto p3 = call(3);
+    auto c = emit("lde"_op, {emit('+'_op, {p2, TImm{8, i64}}, i64Ptr)}, i64);
+    auto d = emit("lde"_op, {p3}, i64);
+    b.Emit0("ret"_op, {emit('+'_op, {emit('+'_op, {a, c}, i64), d}, i64)});
+
+    std::ostringstream out;
+    std::istringstream in;
+    TInterpreter interpreter(module, out, in);
+    auto& main = FunctionByName(module, "main");
+    auto res = interpreter.EvalRaw(main, {}, {});
+    ASSERT_TRUE(res.has_value());
+    EXPECT_EQ(*res, 1 + 20 + 3);
+
+    std::set<int> storage;
+    for (int offset : main.Exec->TmpFrameOffsets) {
+        if (offset >= 0) {
+            storage.insert(offset);
+        }
+    }
+    EXPECT_EQ(storage.size(), 2);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
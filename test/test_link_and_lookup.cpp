@@ -37,6 +37,38 @@ TEST(LinkAndLookup, LoadsPrebuiltObjectAndRuns) {
     EXPECT_EQ(f(), 42);
 }
 
+TEST(LinkAndLookup, ModulesShareOneSession) {
+    std::istringstream in("(block (fun f () -> i64 (block (return (: 42 i64)))))");
+    NAst::NCore::TTokenStream tokens(in);
+    NAst::NCore::TParser parser;
+    auto parsed = parser.Parse(tokens);
+    ASSERT_TRUE(parsed) << parsed.error().ToString();
+
+    TLLVMRunner compiler({
+        .NativeCode = true,
+        .CoreInput = true,
+        .ResolveCoreInput = true,
+        .AllowOverloads = true,
+        .OptLevel = 0,
+    });
+    std::string err;
+    auto obj = compiler.CompileKernelAstToObject(*parsed, {"f"}, &err);
+    ASSERT_TRUE(obj.has_value()) << err;
+
+    NCodeGen::TLlvmRunner jit;
+    // The same dependency object twice: it is linked once and shared.
+    auto first = jit.LinkAndLookup({}, {*obj}, nullptr, /*nativeCode=*/true, {"f"}, &err);
+    ASSERT_EQ(first.Entries.size(), 1u) << err;
+    auto second = jit.LinkAndLookup({}, {*obj}, nullptr, /*nativeCode=*/true, {"f"}, &err);
+    ASSERT_EQ(second.Entries.size(), 1u) << err;
+    EXPECT_EQ(first.Entries["f"], second.Entries["f"]);
+
+    // Dropping one module leaves the others (and the shared objects) usable.
+    first = {};
+    auto* f = reinterpret_cast<int64_t (*)()>(second.Entries["f"]);
+    EXPECT_EQ(f(), 42);
+}
+
 int main(int argc, char** argv) {
     NQumir::NCodeGen::TLLVMInitializer llvmInit;
     testing::InitGoogleTest(&argc, argv);
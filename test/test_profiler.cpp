@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+
+#include <qumir/ir/pgo_profile.h>
+#include <qumir/runner/runner_ir.h>
+#include <qumir/runtime/io.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace NQumir;
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* Program = R"(алг цел цикл
+нач
+    цел ф, i
+    ф := 0
+    нц для i от 1 до 3
+        ф := ф + факториал(4)
+    кц
+    знач := ф
+кон
+
+алг цел факториал(цел число)
+нач
+    если число = 1
+    то
+        знач := 1
+    иначе
+        знач := число * факториал(число - 1)
+    все
+кон
+)";
+
+class ProfilerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Prefix = (fs::temp_directory_path() / "qumir_profile_test").string();
+    }
+    void TearDown() override {
+        std::error_code ec;
+        fs::remove(Prefix + ".folded", ec);
+        fs::remove(Prefix + ".json", ec);
+        fs::remove(Prefix + ".profdata", ec);
+    }
+
+    std::string Run(TIRRunnerOptions options = {}) {
+        std::ostringstream out;
+        NRuntime::SetOutputStream(&out);
+        NRuntime::SetInputStream(nullptr);
+        std::istringstream in;
+        std::istringstream src(Program);
+        if (options.PgoProfileOutput.empty()) {
+            options.ProfileOutput = Prefix;
+        }
+        TIRRunner runner(out, in, options);
+        auto res = runner.Run(src);
+        EXPECT_TRUE(res.has_value());
+        return res && *res ? **res : std::string{};
+    }
+
+    static std::string ReadAll(const std::string& path) {
+        std::ifstream in(path);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    }
+
+    std::string Prefix;
+};
+
+} // namespace
+
+TEST_F(ProfilerTest, CountsCallsBlocksAndLines) {
+    EXPECT_EQ(Run(), "72");
+    const auto json = ReadAll(Prefix + ".json");
+    // 3 outer calls, each recursing down to 1; a function's line is its 'кон'.
+    EXPECT_NE(json.find(R"("name": "факториал", "line": 19, "calls": 12,)"), std::string::npos) << json;
+    EXPECT_NE(json.find(R"("name": "цикл", "line": 9, "calls": 1,)"), std::string::npos) << json;
+    // The recursive branch of 'если' runs 9 times.
+    EXPECT_NE(json.find(R"({"line": 13, "count": 9})"), std::string::npos) << json;
+    EXPECT_NE(json.find(R"({"function": "факториал", "line": 19, "count": 24})"), std::string::npos) << json;
+    EXPECT_NE(json.find(R"("Call": )"), std::string::npos) << json;
+}
+
+TEST_F(ProfilerTest, WritesFoldedStacks) {
+    Run();
+    const auto folded = ReadAll(Prefix + ".folded");
+    EXPECT_NE(folded.find("цикл;факториал;факториал;факториал;факториал "), std::string::npos) << folded;
+    EXPECT_EQ(folded.find("факториал;факториал;факториал;факториал;факториал"), std::string::npos) << folded;
+}
+
+TEST_F(ProfilerTest, WritesBranchProfileForCodegen) {
+    const auto path = Prefix + ".profdata";
+    EXPECT_EQ(Run({.PgoProfileOutput = path}), "72");
+    std::ifstream in(path);
+    auto profile = NIR::TPgoProfile::Read(in);
+    ASSERT_TRUE(profile.has_value()) << profile.error().ToString();
+    EXPECT_TRUE(profile->Matches(0, false));
+    EXPECT_FALSE(profile->Matches(0, true));
+
+    const NIR::TPgoProfile::TFunctionCounts* factorial = nullptr;
+    for (const auto& [symId, function] : profile->Functions) {
+        if (function.Name == "факториал") {
+            factorial = &function;
+        }
+    }
+    ASSERT_NE(factorial, nullptr);
+    EXPECT_EQ(factorial->EntryCount, 12u);
+    // 'если число = 1' holds on 3 of the 12 calls. Its `cmp` goes to the
+    // `то` arm first, so that is the taken count.
+    ASSERT_EQ(factorial->Branches.size(), 1u) << ReadAll(path);
+    const auto& branch = factorial->Branches.begin()->second;
+    EXPECT_EQ(branch.Taken, 3u) << ReadAll(path);
+    EXPECT_EQ(branch.NotTaken, 9u) << ReadAll(path);
+
+    // Written sorted, so a round trip gives the same text.
+    std::ostringstream written;
+    profile->Write(written);
+    EXPECT_EQ(written.str(), ReadAll(path));
+}
+
+TEST_F(ProfilerTest, RejectsMalformedBranchProfile) {
+    std::istringstream notProfile("hello\n");
+    EXPECT_FALSE(NIR::TPgoProfile::Read(notProfile).has_value());
+    std::istringstream badLine("qumir-profile 1\nopt_level 2\nfunction x 1 f\n");
+    EXPECT_FALSE(NIR::TPgoProfile::Read(badLine).has_value());
+}
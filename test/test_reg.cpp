@@ -437,6 +437,8 @@ void CheckExecGoldens(
 enum class EExecBackend {
     IR,
     LLVM,
+    LLVMLazy,
+    Tiered,
 };
 
 bool IsExecDisabled(const std::string& code) {
@@ -477,11 +479,14 @@ std::pair<std::string, std::string> RunExec(
     }
 
     std::expected<std::optional<std::string>, TError> res;
-    if (backend == EExecBackend::IR) {
+    if (backend == EExecBackend::IR || backend == EExecBackend::Tiered) {
+        // Tiered with threshold 1 moves every eligible callee to native code.
         TIRRunner runner(std::cout, std::cin, {
             .CoreInput = coreInput,
             .ResolveCoreInput = coreInput,
             .OptLevel = optLevel,
+            .Tiered = backend == EExecBackend::Tiered,
+            .TierUpThreshold = 1,
             .Prelude = corePrelude,
             .ModuleSearchPaths = modulePaths,
         });
@@ -491,6 +496,7 @@ std::pair<std::string, std::string> RunExec(
             .CoreInput = coreInput,
             .ResolveCoreInput = coreInput,
             .OptLevel = optLevel,
+            .LazyJit = backend == EExecBackend::LLVMLazy,
             .Prelude = corePrelude,
             .ModuleSearchPaths = modulePaths,
         });
@@ -595,6 +601,16 @@ TEST_P(RegExec, ExecLLVMOPT) {
     CheckExecCase(src, GetParam().base, false, EExecBackend::LLVM, 3, "LLVM OPT RUN");
 }
 
+TEST_P(RegExec, ExecLLVMLazy) {
+    const fs::path src = fs::path(CasesDir / GetParam().base).replace_extension(".kum");
+    CheckExecCase(src, GetParam().base, false, EExecBackend::LLVMLazy, 2, "LLVM LAZY RUN");
+}
+
+TEST_P(RegExec, ExecTiered) {
+    const fs::path src = fs::path(CasesDir / GetParam().base).replace_extension(".kum");
+    CheckExecCase(src, GetParam().base, false, EExecBackend::Tiered, 0, "TIERED RUN");
+}
+
 TEST_P(RegExec, CoreExec) {
     const fs::path src = fs::path(CasesDir / GetParam().base).replace_extension(".kum");
     const fs::path stdin = fs::path(CasesDir / GetParam().base).replace_extension(".stdin");
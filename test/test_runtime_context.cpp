@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include <qumir/runner/runner_ir.h>
+#include <qumir/runtime/context.h>
+#include <qumir/runtime/io.h>
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace NQumir;
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string Program(int id) {
+    return "алг главный\n"
+           "нач\n"
+           "    цел i\n"
+           "    нц для i от 1 до 2000\n"
+           "        вывод \"" + std::to_string(id) + ":\", i, нс\n"
+           "    кц\n"
+           "кон\n";
+}
+
+std::string Expected(int id) {
+    std::string out;
+    for (int i = 1; i <= 2000; ++i) {
+        out += std::to_string(id) + ":" + std::to_string(i) + "\n";
+    }
+    return out;
+}
+
+} // namespace
+
+TEST(RuntimeContext, ConcurrentRunsKeepTheirOutput) {
+    constexpr int threadCount = 4;
+    std::vector<NRuntime::TRuntimeContext> contexts(threadCount);
+    std::vector<std::ostringstream> outputs(threadCount);
+    std::vector<bool> ok(threadCount);
+    std::vector<std::thread> threads;
+    for (int id = 0; id < threadCount; ++id) {
+        contexts[id].Io.StdOut = contexts[id].Io.Out = &outputs[id];
+        threads.emplace_back([&, id]() {
+            std::istringstream in;
+            std::istringstream src(Program(id));
+            TIRRunner runner(outputs[id], in, TIRRunnerOptions{
+                .RuntimeContext = &contexts[id],
+            });
+            ok[id] = runner.Run(src).has_value();
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    for (int id = 0; id < threadCount; ++id) {
+        EXPECT_TRUE(ok[id]) << id;
+        EXPECT_EQ(outputs[id].str(), Expected(id)) << id;
+    }
+}
+
+TEST(RuntimeContext, OutputResetReturnsToContextStream) {
+    const auto path = fs::temp_directory_path() / ("qumir_context_test_" + std::to_string(::getpid()) + ".txt");
+    NRuntime::TRuntimeContext context;
+    std::ostringstream out;
+    context.Io.StdOut = context.Io.Out = &out;
+    {
+        NRuntime::TContextScope scope(&context);
+        auto handle = NRuntime::file_open_for_write(path.c_str());
+        NRuntime::output_set_file(handle);
+        NRuntime::output_string("to file");
+        NRuntime::output_reset_file();
+        NRuntime::output_string("to stream");
+        NRuntime::file_close(handle);
+    }
+    EXPECT_EQ(out.str(), "to stream");
+
+    std::ifstream file(path);
+    std::string content((std::istreambuf_iterator<char>(file)), {});
+    EXPECT_EQ(content, "to file");
+    std::error_code ec;
+    fs::remove(path, ec);
+}
+
+TEST(RuntimeContext, ScopesNest) {
+    NRuntime::TRuntimeContext outer, inner;
+    auto* initial = &NRuntime::CurrentContext();
+    {
+        NRuntime::TContextScope outerScope(&outer);
+        EXPECT_EQ(&NRuntime::CurrentContext(), &outer);
+        {
+            NRuntime::TContextScope innerScope(&inner);
+            EXPECT_EQ(&NRuntime::CurrentContext(), &inner);
+        }
+        EXPECT_EQ(&NRuntime::CurrentContext(), &outer);
+    }
+    EXPECT_EQ(&NRuntime::CurrentContext(), initial);
+}
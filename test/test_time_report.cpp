@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+
+#include <qumir/parser/json/lexer.h>
+#include <qumir/parser/json/parser.h>
+#include <qumir/runner/runner_ir.h>
+#include <qumir/runtime/io.h>
+#include <qumir/time_report.h>
+
+#include <sstream>
+#include <string>
+
+using namespace NQumir;
+
+namespace {
+
+const char* Program = R"(алг цел сумма
+нач
+    цел с, i
+    с := 0
+    нц для i от 1 до 10
+        с := с + квадрат(i)
+    кц
+    знач := с
+кон
+
+алг цел квадрат(цел x)
+нач
+    знач := x * x
+кон
+)";
+
+std::string RunProgram(int optLevel, int threads, TTimeReport* report) {
+    std::ostringstream out;
+    NRuntime::SetOutputStream(&out);
+    NRuntime::SetInputStream(nullptr);
+    std::istringstream in;
+    std::istringstream src(Program);
+    TIRRunner runner(out, in, TIRRunnerOptions{
+        .OptLevel = optLevel,
+        .Threads = threads,
+    });
+    TTimeReportScope scope(report);
+    auto res = runner.Run(src);
+    EXPECT_TRUE(res.has_value());
+    return res && *res ? **res : std::string{};
+}
+
+NAst::NJson::TJson ParseJson(const TTimeReport& report) {
+    std::stringstream json;
+    report.PrintJson(json);
+    NAst::NJson::TTokenStream stream(json);
+    auto parsed = NAst::NJson::TParser().Parse(stream);
+    EXPECT_TRUE(parsed.has_value()) << json.str();
+    return parsed ? std::move(*parsed) : NAst::NJson::TJson{};
+}
+
+int64_t Counter(const NAst::NJson::TJson& json, const std::string& name) {
+    auto* counters = json.Root()->As<NAst::NJson::TObject>()->Get("counters");
+    auto* value = counters ? counters->As<NAst::NJson::TObject>()->Get(name) : nullptr;
+    return value ? value->As<NAst::NJson::TInteger>()->Value : -1;
+}
+
+bool HasPhase(const NAst::NJson::TJson& json, const std::string& name) {
+    auto* phases = json.Root()->As<NAst::NJson::TObject>()->Get("phases");
+    for (auto* phase : phases->As<NAst::NJson::TArray>()->Elements) {
+        auto* phaseName = phase->As<NAst::NJson::TObject>()->Get("name");
+        if (phaseName->As<NAst::NJson::TString>()->Value == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+TEST(TimeReportTest, CoversEveryPhase) {
+    TTimeReport report;
+    EXPECT_EQ(RunProgram(/*optLevel=*/1, /*threads=*/1, &report), "385");
+
+    auto json = ParseJson(report);
+    ASSERT_NE(json.Root(), nullptr);
+    for (const char* phase : {
+        "parse", "parse.lex", "semantics", "semantics.fixpoint",
+        "semantics.definite_assignment", "semantics.lifetime", "lower",
+        "ir_passes", "ir_passes.inline", "ir_passes.gvn", "execute"})
+    {
+        EXPECT_TRUE(HasPhase(json, phase)) << phase;
+    }
+    EXPECT_GT(Counter(json, "tokens"), 0);
+    EXPECT_GT(Counter(json, "ast.nodes.parsed"), 0);
+    EXPECT_GT(Counter(json, "ast.nodes.transformed"), 0);
+    EXPECT_GE(Counter(json, "semantics.fixpoint_iterations"), 1);
+    EXPECT_GT(Counter(json, "ir.instructions.lowered"), 0);
+    EXPECT_GT(Counter(json, "ir.instructions.optimized"), 0);
+    EXPECT_GT(TTimeReport::PeakRssKb(), 0);
+
+    std::ostringstream table;
+    report.Print(table);
+    EXPECT_NE(table.str().find("semantics.lifetime"), std::string::npos) << table.str();
+    EXPECT_NE(table.str().find("total"), std::string::npos) << table.str();
+}
+
+TEST(TimeReportTest, PassesOnWorkerThreadsAreReported) {
+    TTimeReport report;
+    EXPECT_EQ(RunProgram(/*optLevel=*/1, /*threads=*/2, &report), "385");
+
+    auto json = ParseJson(report);
+    ASSERT_NE(json.Root(), nullptr);
+    EXPECT_TRUE(HasPhase(json, "ir_passes.sccp"));
+    EXPECT_TRUE(HasPhase(json, "vm_compile"));
+}
+
+TEST(TimeReportTest, NothingIsRecordedWithoutAScope) {
+    TTimeReport report;
+    {
+        TTimeReportScope scope(&report);
+        EXPECT_EQ(CurrentTimeReport(), &report);
+    }
+    EXPECT_EQ(CurrentTimeReport(), nullptr);
+    EXPECT_EQ(RunProgram(/*optLevel=*/0, /*threads=*/1, nullptr), "385");
+
+    auto json = ParseJson(report);
+    ASSERT_NE(json.Root(), nullptr);
+    EXPECT_FALSE(HasPhase(json, "parse"));
+    EXPECT_EQ(Counter(json, "tokens"), -1);
+}
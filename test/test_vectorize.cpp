@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+
+#include <qumir/codegen/llvm/llvm_codegen.h>
+#include <qumir/codegen/llvm/llvm_initializer.h>
+#include <qumir/ir/lowering/lower_ast.h>
+#include <qumir/ir/passes/transforms/pipeline.h>
+#include <qumir/modules/system/system.h>
+#include <qumir/parser/parser.h>
+#include <qumir/semantics/transform/transform.h>
+
+#include <regex>
+#include <sstream>
+#include <string>
+
+using namespace NQumir;
+
+// Regression benchmark for alias info on array code: the hot loops of
+// examples/math (heat3d, matvec) must come out of -O3 vectorized. A kernel
+// that falls back to scalar code here usually means LLVM lost track of
+// which memory an array store may touch.
+
+namespace {
+
+// Returns the optimized LLVM IR of `function`, or an error message.
+std::string EmitO3(const std::string& source, const std::string& function) {
+    NSemantics::TNameResolver resolver;
+    NRegistry::SystemModule sys;
+    resolver.RegisterModule(&sys);
+    resolver.ImportModule(sys.Name());
+
+    std::istringstream ss(source);
+    NAst::TTokenStream ts(ss);
+    NAst::TParser p;
+    auto parsed = p.parse(ts, &resolver);
+    if (!parsed) {
+        return "Error: " + parsed.error().ToString();
+    }
+    auto expr = parsed.value();
+    auto error = NTransform::Pipeline(expr, resolver);
+    if (!error) {
+        return "Error: " + error.error().ToString();
+    }
+
+    NIR::TModule module;
+    NIR::TBuilder builder(module);
+    NIR::TAstLowerer lowerer(module, builder, resolver);
+    auto lowerRes = lowerer.LowerTop(expr);
+    if (!lowerRes) {
+        return "Error: " + lowerRes.error().ToString();
+    }
+    NIR::NPasses::Pipeline(module, 3, 1);
+
+    NCodeGen::TLLVMCodeGen cg;
+    cg.Emit(module, 3);
+    for (const auto& f : module.Functions) {
+        if (f.Name == function) {
+            std::ostringstream out;
+            cg.PrintFunction(f.SymId, out);
+            return out.str();
+        }
+    }
+    return "Error: no function " + function;
+}
+
+bool IsVectorized(const std::string& ir, const std::string& element) {
+    return std::regex_search(ir, std::regex("<[0-9]+ x " + element + ">"));
+}
+
+} // namespace
+
+// The time step of examples/math/heat3d.kum on array parameters.
+TEST(Vectorize, Heat3dStencil) {
+    const auto ir = EmitO3(R"(
+алг main
+нач
+кон
+
+алг heat_step(цел N, вещ alpha, вещ таб u[0:N-1, 0:N-1, 0:N-1], рез вещ таб un[0:N-1, 0:N-1, 0:N-1])
+нач
+  цел i, j, k
+  нц для i от 1 до N-2
+    нц для j от 1 до N-2
+      нц для k от 1 до N-2
+        un[i,j,k] := u[i,j,k] + alpha * ((u[i+1,j,k] + u[i-1,j,k] + u[i,j+1,k] + u[i,j-1,k] + u[i,j,k+1] + u[i,j,k-1]) - 6.0 * u[i,j,k])
+      кц
+    кц
+  кц
+кон
+)", "heat_step");
+    EXPECT_TRUE(IsVectorized(ir, "double")) << ir;
+}
+
+// The same stencil on arrays the function creates itself: only array_create
+// tells LLVM that u and un are different allocations.
+TEST(Vectorize, Heat3dLocalArrays) {
+    const auto ir = EmitO3(R"(
+алг heat3d
+нач
+  цел N, i, j, k
+  N := 64
+  вещ таб u[0:N-1, 0:N-1, 0:N-1]
+  вещ таб un[0:N-1, 0:N-1, 0:N-1]
+  нц для i от 1 до N-2
+    нц для j от 1 до N-2
+      нц для k от 1 до N-2
+        un[i,j,k] := u[i,j,k] + 0.1 * ((u[i+1,j,k] + u[i-1,j,k] + u[i,j+1,k] + u[i,j-1,k] + u[i,j,k+1] + u[i,j,k-1]) - 6.0 * u[i,j,k])
+      кц
+    кц
+  кц
+  вывод un[N/2, N/2, N/2], нс
+кон
+)", "heat3d");
+    EXPECT_TRUE(IsVectorized(ir, "double")) << ir;
+}
+
+// Matrix-vector product in axpy order, the inner loop running along a row.
+// The dot-product order of examples/math/matvec.kum is a вещ reduction and
+// stays scalar: vectorizing it would reorder the additions.
+TEST(Vectorize, MatvecRows) {
+    const auto ir = EmitO3(R"(
+алг main
+нач
+кон
+
+алг matvec(цел n, вещ таб At[0:n-1, 0:n-1], вещ таб x[0:n-1], арг рез вещ таб y[0:n-1])
+нач
+  цел i, j
+  нц для i от 0 до n-1
+    y[i] := 0.0
+  кц
+  нц для j от 0 до n-1
+    нц для i от 0 до n-1
+      y[i] := y[i] + At[j,i] * x[j]
+    кц
+  кц
+кон
+)", "matvec");
+    EXPECT_TRUE(IsVectorized(ir, "double")) << ir;
+}
+
+// Global arrays keep their base pointers and bounds in hidden i64 slots,
+// which element stores of a цел array must not be taken to overwrite.
+TEST(Vectorize, GlobalArrays) {
+    const auto ir = EmitO3(R"(
+цел N = 1024
+вещ таб u[0:N+1]
+вещ таб v[0:N+1]
+цел таб a[1:N]
+цел таб b[1:N]
+
+алг step
+нач
+  цел i
+  нц для i от 1 до N
+    v[i] := u[i] + 0.25 * (u[i-1] - 2.0 * u[i] + u[i+1])
+  кц
+  нц для i от 1 до N
+    a[i] := a[i] + b[i]
+  кц
+кон
+)", "step");
+    EXPECT_TRUE(IsVectorized(ir, "double")) << ir;
+    EXPECT_TRUE(IsVectorized(ir, "i64")) << ir;
+}
+
+int main(int argc, char** argv) {
+    NQumir::NCodeGen::TLLVMInitializer llvmInit;
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
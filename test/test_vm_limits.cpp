@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+
+#include <qumir/runner/runner_ir.h>
+#include <qumir/runtime/context.h>
+
+#include <sstream>
+#include <string>
+
+using namespace NQumir;
+
+namespace {
+
+const char* LongLoop = R"(алг цел главный
+нач
+    цел i, s
+    s := 0
+    нц для i от 1 до 1000000000
+        s := s + i
+    кц
+    знач := s
+кон
+)";
+
+const char* DeepRecursion = R"(алг цел главный
+нач
+    знач := глубина(100000)
+кон
+
+алг цел глубина(цел n)
+нач
+    вещ таб буфер[1:4]
+    если n = 0
+    то
+        знач := 0
+    иначе
+        знач := глубина(n - 1) + 1
+    все
+кон
+)";
+
+const char* StringGrowth = R"(алг цел главный
+нач
+    цел i
+    лит s
+    s := ""
+    нц для i от 1 до 10000
+        s := s + "абв"
+    кц
+    знач := длин(s)
+кон
+)";
+
+const char* BigArray = R"(алг цел главный
+нач
+    цел таб а[1:1000000]
+    а[1] := 7
+    знач := а[1]
+кон
+)";
+
+struct TRunResult {
+    std::optional<std::string> Value;
+    std::string Error;
+};
+
+TRunResult RunOn(NRuntime::TRuntimeContext& context, const char* program, TIRRunnerOptions options) {
+    std::ostringstream out;
+    context.Io.StdOut = context.Io.Out = &out;
+    options.RuntimeContext = &context;
+    std::istringstream in;
+    std::istringstream src(program);
+    TIRRunner runner(out, in, std::move(options));
+    auto res = runner.Run(src);
+    if (!res) {
+        return {std::nullopt, res.error().ToString()};
+    }
+    return {*res, {}};
+}
+
+TRunResult RunLimited(const char* program, TIRRunnerOptions options) {
+    NRuntime::TRuntimeContext context;
+    return RunOn(context, program, std::move(options));
+}
+
+} // namespace
+
+TEST(VMLimits, FuelStopsLongLoop) {
+    auto res = RunLimited(LongLoop, {.Fuel = 10000});
+    EXPECT_FALSE(res.Value);
+    EXPECT_NE(res.Error.find("instruction budget exhausted"), std::string::npos) << res.Error;
+}
+
+TEST(VMLimits, FuelStopsRecursion) {
+    auto res = RunLimited(DeepRecursion, {.Fuel = 1000});
+    EXPECT_NE(res.Error.find("instruction budget exhausted"), std::string::npos) << res.Error;
+}
+
+TEST(VMLimits, StackCap) {
+    auto res = RunLimited(DeepRecursion, {.MaxStackBytes = 64 * 1024});
+    EXPECT_NE(res.Error.find("Stack overflow"), std::string::npos) << res.Error;
+
+    res = RunLimited(DeepRecursion, {});
+    EXPECT_EQ(res.Value, "100000") << res.Error;
+}
+
+TEST(VMLimits, HeapQuota) {
+    auto res = RunLimited(StringGrowth, {.MaxHeapBytes = 100000});
+    EXPECT_NE(res.Error.find("memory quota exceeded"), std::string::npos) << res.Error;
+
+    res = RunLimited(BigArray, {.MaxHeapBytes = 1024 * 1024});
+    EXPECT_NE(res.Error.find("memory quota exceeded"), std::string::npos) << res.Error;
+
+    res = RunLimited(BigArray, {.MaxHeapBytes = 16 * 1024 * 1024});
+    EXPECT_EQ(res.Value, "7") << res.Error;
+}
+
+TEST(VMLimits, HeapQuotaEndsWithTheRun) {
+    NRuntime::TRuntimeContext context;
+    auto res = RunOn(context, BigArray, {.MaxHeapBytes = 1024 * 1024});
+    EXPECT_NE(res.Error.find("memory quota exceeded"), std::string::npos) << res.Error;
+
+    res = RunOn(context, BigArray, {});
+    EXPECT_EQ(res.Value, "7") << res.Error;
+    res = RunOn(context, BigArray, {.MaxHeapBytes = 16 * 1024 * 1024});
+    EXPECT_EQ(res.Value, "7") << res.Error;
+}
+
+TEST(VMLimits, ProgramWithinLimits) {
+    auto res = RunLimited(StringGrowth, {
+        .Fuel = 100000,
+        .MaxStackBytes = 64 * 1024,
+        .MaxHeapBytes = 1024 * 1024 * 1024,
+    });
+    EXPECT_EQ(res.Value, "30000") << res.Error;
+}